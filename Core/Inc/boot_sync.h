@@ -0,0 +1,87 @@
+/**
+  ******************************************************************************
+  * @file    boot_sync.h
+  * @brief   This file contains all the function prototypes for
+  *          the boot_sync.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __BOOT_SYNC_H__
+#define __BOOT_SYNC_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "main.h"
+
+/* Semaphores: the CM7 frees CLOCKS once clocks and shared memories are
+   set up (HSEM_ID_0, as the CubeMX boot sequence), each core frees its
+   READY semaphore at the end of its own boot */
+#define BOOT_SYNC_HSEM_CLOCKS       0U
+#define BOOT_SYNC_HSEM_CM7_READY    1U
+#define BOOT_SYNC_HSEM_CM4_READY    2U
+
+/* Boot times of both cores, in SRAM4 which both can reach and neither
+   linker script uses; 32-byte aligned, one cache line per core */
+#ifndef BOOT_SYNC_RECORD_ADDR
+#define BOOT_SYNC_RECORD_ADDR       0x3800FF00U
+#endif
+
+/* CM4 wait for the CM7 before it takes the clocks over itself */
+#ifndef BOOT_SYNC_TIMEOUT_MS
+#define BOOT_SYNC_TIMEOUT_MS        100U
+#endif
+
+enum{
+    BOOT_SYNC_CM7 = 0,
+    BOOT_SYNC_CM4,
+    BOOT_SYNC_CORES
+};
+
+enum{
+    BOOT_SYNC_LOCAL = 0,    /* work that needs nothing from the other core done */
+    BOOT_SYNC_CLOCKS,       /* shared clocks and memories usable */
+    BOOT_SYNC_READY,        /* boot finished */
+    BOOT_SYNC_MARKS
+};
+
+typedef struct{
+    uint32_t us[BOOT_SYNC_MARKS];   /* since Boot_Sync_Begin, 0 until reached */
+    uint32_t waited_us;             /* spent waiting for the other core */
+    uint32_t reserved[4];
+}Boot_Sync_Core_t;
+
+typedef struct{
+    Boot_Sync_Core_t core[BOOT_SYNC_CORES];
+}Boot_Sync_Record_t;
+
+/* First thing after reset on each core; times are from here */
+void Boot_Sync_Begin(void);
+void Boot_Sync_Mark(uint32_t Mark);
+#if defined(CORE_CM7)
+/* After SystemClock_Config and the external memory setup */
+void Boot_Sync_ReleaseClocks(void);
+#else
+/* 0 once the CM7 has released the clocks, with SystemCoreClock and the
+   tick updated; 1 after Timeout ms without a CM7 */
+uint32_t Boot_Sync_WaitClocks(uint32_t Timeout);
+#endif
+void Boot_Sync_Ready(void);
+/* Copies the times of both cores once both are ready; 1 before that */
+uint32_t Boot_Sync_Report(Boot_Sync_Record_t *report);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __BOOT_SYNC_H__ */
@@ -0,0 +1,110 @@
+/**
+  ******************************************************************************
+  * @file    flash_ab.h
+  * @brief   This file contains all the function prototypes for
+  *          the flash_ab.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_AB_H__
+#define __FLASH_AB_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "main.h"
+#include "flash_geometry.h"
+#include "flash_stream.h"
+#include "flash_delta.h"
+#include "flash_sha.h"
+#include "flash_dump.h"
+
+/* The spare slot is the whole other bank and SWAP_BANK swaps the banks
+   for both cores: with a CM7 image in bank1 (BOOT_SYNC_DUAL_CORE) an update
+   would overwrite it and the swap would move the CM7's boot bank too. A/B
+   updates are for builds where this core owns the flash alone. */
+#ifdef BOOT_SYNC_DUAL_CORE
+#error "flash_ab: A/B updates overwrite and swap the CM7 bank, not usable with BOOT_SYNC_DUAL_CORE"
+#endif
+
+/* Address this core boots from; SWAP_BANK decides which physical bank
+   answers there. The other bank base is the update slot. */
+#ifndef FLASH_AB_RUN_BASE
+#define FLASH_AB_RUN_BASE       FLASH_BANK2_BASE
+#endif
+#define FLASH_AB_SPARE_BASE     ((FLASH_AB_RUN_BASE == FLASH_BANK1_BASE) ? FLASH_BANK2_BASE : FLASH_BANK1_BASE)
+
+/* Three flashwords at the end of each slot: image record, trial mark,
+   confirm mark. Each is programmed once from erased, so state moves
+   forward without an erase and survives power loss. */
+#define FLASH_AB_STATE_SIZE     (3U * FLASH_GEO_FLASHWORD_SIZE)
+/* Images stop at the crash dump sector's offset: whichever slot holds it,
+   neither an update nor the image may reach it */
+#define FLASH_AB_IMAGE_MAX      (FLASH_GEO_OFFSET(FLASH_DUMP_BASE) & (FLASH_GEO_BANK_SIZE - 1U))
+
+enum{
+    FLASH_AB_EMPTY = 0,     /* no image */
+    FLASH_AB_LEGACY,        /* image without a record, e.g. programmed by the debugger */
+    FLASH_AB_PENDING,       /* verified, never booted */
+    FLASH_AB_TRIAL,         /* booted, not confirmed yet */
+    FLASH_AB_CONFIRMED
+};
+
+typedef struct{
+    uint32_t magic;
+    uint32_t size;          /* image bytes from the slot base */
+    uint32_t crc;           /* Flash_Stream_Crc of the image, 0 if a manifest follows it */
+    uint32_t reserved[5];
+}Flash_AB_Record_t;
+
+uint32_t Flash_AB_SlotState(uint32_t SlotAddress, Flash_AB_Record_t *record);
+
+/* Early in main: marks a first boot as trial, rolls back a trial that
+   never confirmed. Returns the state of the running slot. */
+uint32_t Flash_AB_Boot(void);
+uint32_t Flash_AB_Confirm(void);
+uint32_t Flash_AB_Rollback(void);
+
+/* Update: stream into the spare slot, verify, then swap with one reset */
+uint32_t Flash_AB_Begin(Flash_Stream_t *stream, uint32_t Resume);
+uint32_t Flash_AB_Finish(Flash_Stream_t *stream, uint32_t Size, uint32_t Crc);
+/* Same, with a patch against the running image instead of the full image */
+uint32_t Flash_AB_BeginDelta(Flash_Delta_t *delta);
+uint32_t Flash_AB_FinishDelta(Flash_Delta_t *delta);
+/* Same, hashing each block as it is programmed: FinishSigned checks the
+   digest against the manifest without reading the image back and keeps
+   the manifest after the image for Flash_AB_Verify */
+uint32_t Flash_AB_BeginSigned(Flash_Stream_t *stream, Flash_Sha_Image_t *image, uint32_t Resume);
+uint32_t Flash_AB_FinishSigned(Flash_Stream_t *stream, Flash_Sha_Image_t *image, const Flash_Sha_Manifest_t *manifest,
+                               const uint8_t *key, uint32_t KeyLength);
+/* Swaps the banks and resets; returns only if the option change could
+   not be started or did not complete */
+uint32_t Flash_AB_Activate(void);
+/* Running image against its manifest. With a NULL cache every sector is
+   hashed and this authenticates the image. With a cache, sectors whose
+   controller CRC is unchanged keep their cached digest: that only tells
+   the image has not changed since those sectors were last hashed, it is
+   not a signed-image check on its own. */
+uint32_t Flash_AB_Verify(Flash_Sha_Cache_t *cache, const uint8_t *key, uint32_t KeyLength);
+
+#ifdef FLASH_AB_SIGNED
+/* Manifest key, provisioned per product outside this tree */
+extern const uint8_t Flash_AB_Key[];
+extern const uint32_t Flash_AB_KeySize;
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_AB_H__ */
@@ -0,0 +1,258 @@
+/**
+  ******************************************************************************
+  * @file    flash_bank.h
+  * @brief   Bank-generic flash controller access shared by flash_if.c and
+  *          flash_shin.c. Every routine takes the bank (FLASH_BANK_1 or
+  *          FLASH_BANK_2) as a constant, so the register block resolves at
+  *          compile time and the inlined code is plain register access.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_BANK_H__
+#define __FLASH_BANK_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+#include "main.h"
+#include "flash_if.h"
+#include "flash_geometry.h"
+#include "flash_timing.h"
+
+/* Per-bank view of the controller: the bank2 registers sit exactly 0x100
+   above their bank1 counterparts */
+typedef struct{
+    uint32_t RESERVED0;         /* 0x00 ACR, bank1 block only */
+    __IO uint32_t KEYR;         /* 0x04 */
+    uint32_t RESERVED1;         /* 0x08 OPTKEYR, bank1 block only */
+    __IO uint32_t CR;           /* 0x0C */
+    __IO uint32_t SR;           /* 0x10 */
+    __IO uint32_t CCR;          /* 0x14 */
+    uint32_t RESERVED2[4];      /* 0x18 option byte registers */
+    __IO uint32_t PRAR_CUR;     /* 0x28 */
+    __IO uint32_t PRAR_PRG;     /* 0x2C */
+    __IO uint32_t SCAR_CUR;     /* 0x30 */
+    __IO uint32_t SCAR_PRG;     /* 0x34 */
+    __IO uint32_t WPSN_CUR;     /* 0x38 */
+    __IO uint32_t WPSN_PRG;     /* 0x3C */
+    uint32_t RESERVED3[4];      /* 0x40 boot address, reserved */
+    __IO uint32_t CRCCR;        /* 0x50 */
+    __IO uint32_t CRCSADD;      /* 0x54 */
+    __IO uint32_t CRCEADD;      /* 0x58 */
+    __IO uint32_t CRCDATA;      /* 0x5C, bank1 block only, shared by both banks */
+    __IO uint32_t ECC_FA;       /* 0x60 */
+}Flash_Bank_TypeDef;
+
+#define FLASH_BANK_REGS(bank)   ((Flash_Bank_TypeDef *)((uint8_t *)FLASH + (((bank) - FLASH_BANK_1) << 8)))
+
+_Static_assert(offsetof(FLASH_TypeDef, KEYR2) == (offsetof(FLASH_TypeDef, KEYR1) + 0x100U), "bank2 register offset");
+_Static_assert(offsetof(FLASH_TypeDef, CR2) == (offsetof(FLASH_TypeDef, CR1) + 0x100U), "bank2 register offset");
+_Static_assert(offsetof(FLASH_TypeDef, SR2) == (offsetof(FLASH_TypeDef, SR1) + 0x100U), "bank2 register offset");
+_Static_assert(offsetof(FLASH_TypeDef, CCR2) == (offsetof(FLASH_TypeDef, CCR1) + 0x100U), "bank2 register offset");
+_Static_assert(offsetof(FLASH_TypeDef, CR1) == offsetof(Flash_Bank_TypeDef, CR), "bank register layout");
+_Static_assert(offsetof(FLASH_TypeDef, CRCCR1) == offsetof(Flash_Bank_TypeDef, CRCCR), "bank register layout");
+_Static_assert(offsetof(FLASH_TypeDef, ECC_FA1) == offsetof(Flash_Bank_TypeDef, ECC_FA), "bank register layout");
+
+/* SR/CCR bit positions are identical on both banks; the HAL _BANK2 flags
+   only add a 0x80000000 selector that is not part of the register */
+#define FLASH_BANK_SR_ERRORS    (FLASH_FLAG_ALL_ERRORS_BANK1 & 0x7FFFFFFFU)
+
+#ifndef FLASH_BANK_TIMEOUT
+#define FLASH_BANK_TIMEOUT      0x0FFFFFFFU     /* polling loops, > max sector erase time */
+#endif
+
+/* Indexed by bank - FLASH_BANK_1; the SR bits are latched here before
+   they are cleared, the failing address is filled in by the operation */
+extern Flash_Error_t Flash_Bank_LastError[2];
+
+#define FLASH_BANK_ERROR(bank)  (&Flash_Bank_LastError[(bank) - FLASH_BANK_1])
+
+__STATIC_FORCEINLINE uint32_t Flash_Bank_Unlock(uint32_t bank)
+{
+    Flash_Bank_TypeDef *regs = FLASH_BANK_REGS(bank);
+
+    if(READ_BIT(regs->CR, FLASH_CR_LOCK) != 0U){
+        WRITE_REG(regs->KEYR, FLASH_KEY1);
+        WRITE_REG(regs->KEYR, FLASH_KEY2);
+
+        if(READ_BIT(regs->CR, FLASH_CR_LOCK) != 0U){
+            return FLASH_ERROR;
+        }
+    }
+    return FLASH_OK;
+}
+
+__STATIC_FORCEINLINE uint32_t Flash_Bank_Lock(uint32_t bank)
+{
+    Flash_Bank_TypeDef *regs = FLASH_BANK_REGS(bank);
+
+    SET_BIT(regs->CR, FLASH_CR_LOCK);
+
+    if(READ_BIT(regs->CR, FLASH_CR_LOCK) == 0U){
+        return FLASH_ERROR;
+    }
+    return FLASH_OK;
+}
+
+__STATIC_FORCEINLINE uint32_t Flash_Bank_WaitForLastOperation(uint32_t bank)
+{
+    Flash_Bank_TypeDef *regs = FLASH_BANK_REGS(bank);
+    uint32_t count = 0;
+    uint32_t errorflag;
+
+    /* Even if the operation fails QW drops and an error flag is set */
+    while(READ_BIT(regs->SR, FLASH_SR_QW) != 0U){
+        if(count++ > FLASH_BANK_TIMEOUT){
+            FLASH_BANK_ERROR(bank)->status = FLASH_TIMEOUT;
+            FLASH_BANK_ERROR(bank)->flags = 0U;
+            return FLASH_TIMEOUT;
+        }
+    }
+
+    errorflag = regs->SR & FLASH_BANK_SR_ERRORS;
+    if(errorflag != 0U){
+        FLASH_BANK_ERROR(bank)->status = FLASH_ERROR;
+        FLASH_BANK_ERROR(bank)->flags = errorflag;
+        WRITE_REG(regs->CCR, errorflag);
+        return FLASH_ERROR;
+    }
+
+    if(READ_BIT(regs->SR, FLASH_SR_EOP) != 0U){
+        WRITE_REG(regs->CCR, FLASH_SR_EOP);
+    }
+    return FLASH_OK;
+}
+
+/* Erases sectors of an unlocked bank; IRQs must already be masked */
+__STATIC_FORCEINLINE uint32_t Flash_Bank_EraseSectors(uint32_t bank, uint32_t FirstSector, uint32_t NbOfSectors)
+{
+    Flash_Bank_TypeDef *regs = FLASH_BANK_REGS(bank);
+    uint32_t sector_index;
+    uint32_t status;
+
+    status = Flash_Bank_WaitForLastOperation(bank);
+    if(status != FLASH_OK){
+        FLASH_BANK_ERROR(bank)->address = FLASH_GEO_SECTOR_BASE(bank, FirstSector);
+    }
+
+    for(sector_index = FirstSector; (status == FLASH_OK) && (sector_index < (FirstSector + NbOfSectors)); sector_index++){
+        MODIFY_REG(regs->CR, (FLASH_CR_PSIZE | FLASH_CR_SNB),
+                   (FLASH_CR_SER | Flash_Timing_GetPsize() | (sector_index << FLASH_CR_SNB_Pos) | FLASH_CR_START));
+
+        status = Flash_Bank_WaitForLastOperation(bank);
+
+        CLEAR_BIT(regs->CR, (FLASH_CR_SER | FLASH_CR_SNB));
+
+        if(status != FLASH_OK){
+            FLASH_BANK_ERROR(bank)->address = FLASH_GEO_SECTOR_BASE(bank, sector_index);
+        }
+    }
+    return status;
+}
+
+/* Programs one 256-bit flashword of an unlocked bank; IRQs must already be masked */
+__STATIC_FORCEINLINE uint32_t Flash_Bank_ProgramFlashWord(uint32_t bank, uint32_t FlashAddress, const uint32_t *src)
+{
+    Flash_Bank_TypeDef *regs = FLASH_BANK_REGS(bank);
+    __IO uint32_t *dest = (__IO uint32_t *)FlashAddress;
+    uint32_t row_index = FLASH_NB_32BITWORD_IN_FLASHWORD;
+    uint32_t status;
+
+    status = Flash_Bank_WaitForLastOperation(bank);
+    if(status != FLASH_OK){
+        FLASH_BANK_ERROR(bank)->address = FlashAddress;
+        return status;
+    }
+
+    SET_BIT(regs->CR, FLASH_CR_PG);
+    __ISB();
+    __DSB();
+
+    do{
+        *dest++ = *src++;
+    }while(--row_index != 0U);
+
+    __ISB();
+    __DSB();
+
+    status = Flash_Bank_WaitForLastOperation(bank);
+    CLEAR_BIT(regs->CR, FLASH_CR_PG);
+
+    if(status != FLASH_OK){
+        FLASH_BANK_ERROR(bank)->address = FlashAddress;
+    }
+    return status;
+}
+
+/* Full erase session: unlock, mask IRQs, erase, restore, lock */
+__STATIC_FORCEINLINE uint32_t Flash_Bank_Erase(uint32_t bank, uint32_t FirstSector, uint32_t NbOfSectors)
+{
+    uint32_t primask;
+    uint32_t status;
+
+    FLASH_BANK_ERROR(bank)->status = FLASH_OK;
+    if(Flash_Bank_Unlock(bank) != FLASH_OK){
+        FLASH_BANK_ERROR(bank)->status = FLASH_ERROR;
+        FLASH_BANK_ERROR(bank)->flags = 0U;
+        FLASH_BANK_ERROR(bank)->address = FLASH_GEO_SECTOR_BASE(bank, FirstSector);
+        return FLASH_ERROR;
+    }
+    /* To avoid interrupt while flash erase operation */
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    status = Flash_Bank_EraseSectors(bank, FirstSector, NbOfSectors);
+
+    __set_PRIMASK(primask);
+    if((Flash_Bank_Lock(bank) != FLASH_OK) && (status == FLASH_OK)){
+        status = FLASH_ERROR;
+    }
+    return status;
+}
+
+/* Full program session over consecutive flashwords of one bank */
+__STATIC_FORCEINLINE uint32_t Flash_Bank_Program(uint32_t bank, uint32_t FlashAddress, const uint32_t *src, uint32_t NbOfFlashWords)
+{
+    uint32_t primask;
+    uint32_t status = FLASH_OK;
+
+    FLASH_BANK_ERROR(bank)->status = FLASH_OK;
+    if(Flash_Bank_Unlock(bank) != FLASH_OK){
+        FLASH_BANK_ERROR(bank)->status = FLASH_ERROR;
+        FLASH_BANK_ERROR(bank)->flags = 0U;
+        FLASH_BANK_ERROR(bank)->address = FlashAddress;
+        return FLASH_ERROR;
+    }
+    primask = __get_PRIMASK();
+    __disable_irq();
+
+    while((NbOfFlashWords != 0U) && (status == FLASH_OK)){
+        status = Flash_Bank_ProgramFlashWord(bank, FlashAddress, src);
+        FlashAddress += (FLASH_NB_32BITWORD_IN_FLASHWORD * 4U);
+        src += FLASH_NB_32BITWORD_IN_FLASHWORD;
+        NbOfFlashWords--;
+    }
+
+    __set_PRIMASK(primask);
+    if((Flash_Bank_Lock(bank) != FLASH_OK) && (status == FLASH_OK)){
+        status = FLASH_ERROR;
+    }
+    return status;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_BANK_H__ */
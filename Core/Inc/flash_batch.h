@@ -0,0 +1,61 @@
+/**
+  ******************************************************************************
+  * @file    flash_batch.h
+  * @brief   This file contains all the function prototypes for
+  *          the flash_batch.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_BATCH_H__
+#define __FLASH_BATCH_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HOST_BUILD
+#include <stdint.h>
+#else
+#include "main.h"
+#endif
+
+typedef struct{
+    uint32_t address;       /* destination in flash, any alignment */
+    const uint8_t *data;
+    uint32_t length;        /* bytes, must stay inside one bank */
+}Flash_Batch_Op_t;
+
+typedef struct{
+    uint32_t ops;               /* non-empty operations in the batch */
+    uint32_t flashwords;        /* flashword programs issued */
+    uint32_t lock_cycles;       /* unlock/lock sessions opened */
+    uint32_t flashwords_saved;  /* versus one padded FLASH_Program call per op */
+    uint32_t lock_cycles_saved;
+}Flash_Batch_Stats_t;
+
+/* Sorts ops in place by address. Empty ops are skipped; FLASH_ERROR,
+   before anything is written, if any other op leaves flash or straddles
+   a bank. Bytes of a flashword not covered by any op are programmed as
+   0xFF; overlapping ops resolve in favour of the one sorted last (the
+   later one in the caller's order for equal addresses). */
+uint32_t Flash_Batch_Program(Flash_Batch_Op_t *ops, uint32_t NbOfOps, Flash_Batch_Stats_t *stats);
+
+#ifdef HOST_BUILD
+/* Provided by the host check: programs one flashword */
+uint32_t Flash_Batch_HostProgram(uint32_t FlashAddress, const uint32_t *src);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_BATCH_H__ */
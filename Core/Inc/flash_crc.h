@@ -0,0 +1,99 @@
+/**
+  ******************************************************************************
+  * @file    flash_crc.h
+  * @brief   This file contains all the function prototypes for
+  *          the flash_crc.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_CRC_H__
+#define __FLASH_CRC_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HOST_BUILD
+#include <stdint.h>
+#else
+#include "main.h"
+#endif
+#include "flash_if.h"
+#include "flash_geometry.h"
+
+/* The controller CRC: CRC-32 polynomial 0x04C11DB7, initial value
+   0xFFFFFFFF, one 32-bit word at a time MSB first, no final XOR */
+#define FLASH_CRC_INIT          0xFFFFFFFFU
+
+/* Address ranges are computed in bursts of 4 flashwords */
+#define FLASH_CRC_BURST         (4U * FLASH_GEO_FLASHWORD_SIZE)
+
+/* Program/verify pipeline step; a multiple of FLASH_CRC_BURST */
+#ifndef FLASH_CRC_CHUNK
+#define FLASH_CRC_CHUNK         4096U
+#endif
+
+typedef struct{
+    uint32_t (*program)(uint32_t FlashAddress, const uint32_t *src, uint32_t NbOfFlashWords);
+    uint32_t (*read)(void *dest, uint32_t FlashAddress, uint32_t Length, uint32_t *FailAddress);
+    /* FLASH_BUSY while an earlier computation still runs */
+    uint32_t (*crc_start)(uint32_t FlashAddress, uint32_t Length);
+    /* FLASH_BUSY until the computation started on that bank has finished */
+    uint32_t (*crc_result)(uint32_t FlashAddress, uint32_t *crc);
+}Flash_Crc_Backend_t;
+
+typedef struct{
+    uint32_t ranges;            /* hardware CRCs compared */
+    uint32_t crc_bytes;         /* bytes checked by the controller */
+    uint32_t read_bytes;        /* bytes read back by the CPU, unaligned tails */
+    uint32_t overlapped;        /* CRCs still running when the next program began */
+    uint32_t mismatches;
+    uint32_t first_bad;         /* start of the first failing range, 0xFFFFFFFF if none */
+}Flash_Crc_Stats_t;
+
+uint32_t Flash_Crc_Soft(uint32_t crc, const void *data, uint32_t Length);
+
+/* Blocking hardware CRC of [FlashAddress, FlashAddress + Length), whole
+   bursts inside one bank; whole sectors use the sector mode */
+uint32_t Flash_Crc_Compute(const Flash_Crc_Backend_t *backend, uint32_t FlashAddress, uint32_t Length, uint32_t *crc);
+/* FLASH_OK if the range CRC equals Expected, FLASH_ERROR if it differs */
+uint32_t Flash_Crc_Verify(const Flash_Crc_Backend_t *backend, uint32_t FlashAddress, uint32_t Length, uint32_t Expected);
+uint32_t Flash_Crc_VerifySectors(const Flash_Crc_Backend_t *backend, uint32_t Bank, uint32_t FirstSector,
+                                 uint32_t NbOfSectors, uint32_t Expected);
+
+/* Programs in FLASH_CRC_CHUNK steps; the controller checks each chunk
+   while the next one programs and the CPU derives the expected CRC from
+   the source. FLASH_ERROR on a mismatch, stats->first_bad tells where. */
+uint32_t Flash_Crc_ProgramVerify(const Flash_Crc_Backend_t *backend, uint32_t FlashAddress, const uint32_t *src,
+                                 uint32_t NbOfFlashWords, Flash_Crc_Stats_t *stats);
+
+#ifndef HOST_BUILD
+extern const Flash_Crc_Backend_t Flash_Crc_TargetBackend;
+#endif
+
+#ifdef FLASH_CRC_BENCHMARK
+typedef struct{
+    uint32_t hw_cycles;         /* controller CRC of the sector, CPU polling */
+    uint32_t soft_cycles;       /* CPU read-back through Flash_Crc_Soft */
+    uint32_t read_cycles;       /* CPU read-back compare against a RAM copy */
+}Flash_Crc_Bench_t;
+
+/* DWT cycles to verify one whole sector each way; bytes/cycle is
+   FLASH_GEO_SECTOR_SIZE / cycles */
+uint32_t Flash_Crc_Benchmark(uint32_t Bank, uint32_t Sector, const void *copy, Flash_Crc_Bench_t *results);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_CRC_H__ */
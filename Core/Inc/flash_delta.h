@@ -0,0 +1,90 @@
+/**
+  ******************************************************************************
+  * @file    flash_delta.h
+  * @brief   This file contains all the function prototypes for
+  *          the flash_delta.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_DELTA_H__
+#define __FLASH_DELTA_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HOST_BUILD
+#include <stdint.h>
+#else
+#include "main.h"
+#endif
+#include "flash_geometry.h"
+#include "flash_stream.h"
+
+#define FLASH_DELTA_MAGIC       0x31504446U     /* "FDP1" */
+
+/* Patch stream: this header, then records until new_size bytes are out.
+   Record: diff length, diff runs (zero count, non-zero count, bytes added
+   to the old image) up to the diff length, extra length, extra bytes,
+   signed seek of the old position. Counts are LEB128, the seek zigzag. */
+typedef struct{
+    uint32_t magic;
+    uint32_t old_size;
+    uint32_t old_crc;       /* Flash_Stream_Crc: the patch only applies to this image */
+    uint32_t new_size;
+    uint32_t new_crc;
+}Flash_Delta_Header_t;
+
+typedef struct{
+    uint32_t patch_bytes;
+    uint32_t programmed;        /* flashwords written */
+    uint32_t blank;             /* flashwords left erased, nothing to program */
+    uint32_t erased;            /* sectors erased */
+    uint32_t clean;             /* sectors already blank, erase skipped */
+}Flash_Delta_Stats_t;
+
+typedef struct{
+    const Flash_Stream_Backend_t *backend;
+    uint32_t src;               /* old image base */
+    uint32_t dst;               /* new image base, sector aligned */
+    uint32_t capacity;
+    uint32_t status;
+    uint32_t state;
+    uint32_t value;             /* varint being assembled */
+    uint32_t shift;
+    uint32_t remaining;         /* diff bytes left in the record */
+    uint32_t count;             /* bytes left in the current run */
+    uint32_t old_pos;
+    uint32_t produced;
+    uint32_t prepared;          /* destination offset up to which sectors are ready */
+    uint32_t cache_addr;
+    uint32_t stage_fill;
+    Flash_Delta_Header_t header;
+    Flash_Delta_Stats_t stats;
+    uint32_t cache[FLASH_NB_32BITWORD_IN_FLASHWORD];
+    uint32_t stage[FLASH_NB_32BITWORD_IN_FLASHWORD];
+}Flash_Delta_t;
+
+/* Capacity: bytes the new image may take from DestAddress, whole
+   flashwords; sectors are erased whole as output reaches them */
+uint32_t Flash_Delta_Init(Flash_Delta_t *delta, const Flash_Stream_Backend_t *backend,
+                          uint32_t SourceAddress, uint32_t DestAddress, uint32_t Capacity);
+/* Accepts the patch in pieces of any size as it arrives */
+uint32_t Flash_Delta_Feed(Flash_Delta_t *delta, const void *data, uint32_t Length);
+/* Flushes the last flashword and checks the new image against new_crc */
+uint32_t Flash_Delta_Finish(Flash_Delta_t *delta);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_DELTA_H__ */
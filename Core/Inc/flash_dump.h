@@ -0,0 +1,131 @@
+/**
+  ******************************************************************************
+  * @file    flash_dump.h
+  * @brief   This file contains all the function prototypes for
+  *          the flash_dump.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_DUMP_H__
+#define __FLASH_DUMP_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HOST_BUILD
+#include <stdint.h>
+#else
+#include "main.h"
+#endif
+#include "flash_geometry.h"
+#include "flash_safe.h"
+
+/* Reserved sector holding the dump records; nothing else may use it.
+   A/B images end below its offset in the bank (FLASH_AB_IMAGE_MAX), so an
+   update never erases it; the state sector after it stays with flash_ab.c */
+#ifndef FLASH_DUMP_BASE
+#define FLASH_DUMP_BASE         FLASH_GEO_SECTOR_BASE(FLASH_BANK_1, FLASH_GEO_SECTORS_PER_BANK - 2U)
+#endif
+
+#define FLASH_DUMP_MAGIC        0x504D5544U     /* "DUMP" */
+#define FLASH_DUMP_SIZE         1024U           /* one record, 32 flashwords */
+#define FLASH_DUMP_SLOTS        (FLASH_GEO_SECTOR_SIZE / FLASH_DUMP_SIZE)
+#define FLASH_DUMP_STACK_WORDS  ((FLASH_DUMP_SIZE - (6U * FLASH_GEO_FLASHWORD_SIZE) - \
+                                  (FLASH_SAFE_EVENT_DEPTH * sizeof(Flash_Safe_Event_t))) / 4U)
+
+/* Plain literals: the fault entry stubs paste them into assembly */
+#define FLASH_DUMP_NMI          1
+#define FLASH_DUMP_HARDFAULT    2
+#define FLASH_DUMP_MEMMANAGE    3
+#define FLASH_DUMP_BUSFAULT     4
+#define FLASH_DUMP_USAGEFAULT   5
+#define FLASH_DUMP_ERROR        6   /* Error_Handler, no exception frame */
+
+typedef struct{
+    /* Header flashword, programmed last: a record without it is incomplete */
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t reason;            /* FLASH_DUMP_NMI .. FLASH_DUMP_ERROR */
+    uint32_t tick;              /* HAL_GetTick() at the crash */
+    uint32_t crc;               /* Flash_Stream_Crc of everything after the header */
+    uint32_t stack_words;       /* valid entries of stack[] */
+    uint32_t reserved[2];
+
+    uint32_t frame[8];          /* r0, r1, r2, r3, r12, lr, pc, xPSR as stacked */
+    uint32_t callee[8];         /* r4 - r11 at exception entry */
+    uint32_t msp;
+    uint32_t psp;
+    uint32_t exc_return;
+    uint32_t control;
+    uint32_t primask;
+    uint32_t basepri;
+    uint32_t faultmask;
+    uint32_t sp;                /* faulting context stack pointer, stack[0] address */
+    uint32_t cfsr;
+    uint32_t hfsr;
+    uint32_t dfsr;
+    uint32_t mmfar;
+    uint32_t bfar;
+    uint32_t afsr;
+    uint32_t shcsr;
+    uint32_t icsr;
+    uint32_t flash_sr[2];       /* per bank */
+    uint32_t flash_ecc_fa[2];
+    uint32_t ecc_single;
+    uint32_t ecc_double;
+    uint32_t ecc_recovered;
+    uint32_t ecc_count;
+    Flash_Safe_Event_t ecc[FLASH_SAFE_EVENT_DEPTH];
+    uint32_t stack[FLASH_DUMP_STACK_WORDS];
+}Flash_Dump_t;
+
+/* Boot side: scan the slot, report, then arm */
+void Flash_Dump_Init(void);
+uint32_t Flash_Dump_Count(void);
+/* Index 0 is the newest dump */
+uint32_t Flash_Dump_Read(uint32_t Index, Flash_Dump_t *dump);
+/* Guarantees a pre-erased record for the next crash, erasing the slot
+   once it is full: call after the stored dumps have been read */
+uint32_t Flash_Dump_Arm(void);
+
+/* Crash side; neither returns. With a debugger attached the core halts
+   in a loop, otherwise it resets once the record is programmed. */
+void Flash_Dump_Fault(uint32_t *frame, uint32_t exc_return, uint32_t *callee, uint32_t reason) __attribute__((noreturn));
+void Flash_Dump_Error(uint32_t reason) __attribute__((noreturn));
+/* Weak, called before the record is written: a board signal such as an
+   LED, which must not fault or wait on interrupts */
+void Flash_Dump_Notify(uint32_t reason);
+
+#define FLASH_DUMP_STR_(x)      #x
+#define FLASH_DUMP_STR(x)       FLASH_DUMP_STR_(x)
+
+/* Body of a naked fault handler: r4-r11 are pushed before any C code can
+   touch them, and the stacked frame is taken from the active stack */
+#define FLASH_DUMP_ENTRY(reason) \
+    __asm volatile(                                         \
+        "tst   lr, #4                   \n"                 \
+        "ite   eq                       \n"                 \
+        "mrseq r0, msp                  \n"                 \
+        "mrsne r0, psp                  \n"                 \
+        "mov   r1, lr                   \n"                 \
+        "push  {r4-r11}                 \n"                 \
+        "mov   r2, sp                   \n"                 \
+        "movs  r3, #" FLASH_DUMP_STR(reason) "\n"           \
+        "ldr   r12, =Flash_Dump_Fault   \n"                 \
+        "bx    r12                      \n")
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_DUMP_H__ */
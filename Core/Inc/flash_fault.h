@@ -0,0 +1,86 @@
+/**
+  ******************************************************************************
+  * @file    flash_fault.h
+  * @brief   This file contains all the function prototypes for
+  *          the flash_fault.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_FAULT_H__
+#define __FLASH_FAULT_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HOST_BUILD
+#include <stdint.h>
+#else
+#include "main.h"
+#endif
+
+enum{
+    FLASH_FAULT_NONE   = 0,
+    FLASH_FAULT_SINGLE = 1,     /* one flipped bit, corrected by ECC */
+    FLASH_FAULT_DOUBLE = 2      /* two flipped bits, uncorrectable */
+};
+
+/* How long to wait for a corrected-error report after the read, backend ticks */
+#ifndef FLASH_FAULT_DETECT_WINDOW
+#define FLASH_FAULT_DETECT_WINDOW   10000U
+#endif
+
+typedef struct{
+    uint32_t (*inject)(uint32_t FlashAddress, uint32_t Kind, uint32_t Seed);
+    uint32_t (*erase_sector)(uint32_t FlashAddress);
+    uint32_t (*read)(void *dest, uint32_t FlashAddress, uint32_t Length, uint32_t *FailAddress);
+    uint32_t (*ticks)(void);            /* free running time base */
+    uint32_t (*corrected)(void);        /* corrected-error events seen so far */
+    uint32_t (*handler_ticks)(void);    /* time spent in the last error handler */
+}Flash_Fault_Backend_t;
+
+typedef struct{
+    uint32_t kind;          /* FLASH_FAULT_SINGLE or FLASH_FAULT_DOUBLE */
+    uint32_t address;       /* first flashword */
+    uint32_t count;         /* consecutive flashwords to hit */
+}Flash_Fault_Step_t;
+
+typedef struct{
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint32_t samples;
+}Flash_Fault_Range_t;
+
+typedef struct{
+    uint32_t injections;
+    uint32_t inject_failures;   /* backend could not create the fault */
+    uint32_t detected[3];       /* indexed by observed FLASH_FAULT_x */
+    uint32_t misclassified;     /* observed kind differs from injected kind */
+    uint32_t recovered;         /* uncorrectable reads that returned the right address */
+    Flash_Fault_Range_t latency;        /* read to detection, backend ticks */
+    Flash_Fault_Range_t handler;
+}Flash_Fault_Stats_t;
+
+uint32_t Flash_Fault_RunCampaign(const Flash_Fault_Backend_t *backend, const Flash_Fault_Step_t *script,
+                                 uint32_t NbOfSteps, Flash_Fault_Stats_t *stats);
+void Flash_Fault_Pattern(uint32_t Seed, uint32_t Kind, uint32_t *first, uint32_t *second);
+
+#ifndef HOST_BUILD
+extern const Flash_Fault_Backend_t Flash_Fault_TargetBackend;
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_FAULT_H__ */
@@ -0,0 +1,137 @@
+/**
+  ******************************************************************************
+  * @file    flash_fs.h
+  * @brief   This file contains all the function prototypes for
+  *          the flash_fs.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_FS_H__
+#define __FLASH_FS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HOST_BUILD
+#include <stdint.h>
+#else
+#include "main.h"
+#endif
+#include "flash_geometry.h"
+#include "flash_stream.h"
+
+/* Block 0 of a sector holds one tag flashword per block of the sector:
+   with 2 Kbyte blocks that table is itself exactly one block */
+#define FLASH_FS_BLOCK_SIZE         2048U
+#define FLASH_FS_BLOCKS_PER_SECTOR  (FLASH_GEO_SECTOR_SIZE / FLASH_FS_BLOCK_SIZE)
+#define FLASH_FS_DATA_PER_SECTOR    (FLASH_FS_BLOCKS_PER_SECTOR - 1U)
+
+#ifndef FLASH_FS_MAX_SECTORS
+#define FLASH_FS_MAX_SECTORS        FLASH_GEO_SECTORS_PER_BANK
+#endif
+#ifndef FLASH_FS_MAX_FILES
+#define FLASH_FS_MAX_FILES          32U
+#endif
+#ifndef FLASH_FS_CACHE_BLOCKS
+#define FLASH_FS_CACHE_BLOCKS       4U      /* RAM block cache, 2 Kbytes each */
+#endif
+#ifndef FLASH_FS_WEAR_DELTA
+#define FLASH_FS_WEAR_DELTA         16U     /* erase count spread that moves cold data */
+#endif
+
+#define FLASH_FS_NAME_MAX           24U     /* terminating NUL included */
+#define FLASH_FS_INODE_BLOCKS       ((FLASH_FS_BLOCK_SIZE - 16U) / sizeof(uint16_t))
+#define FLASH_FS_FILE_MAX           (FLASH_FS_INODE_BLOCKS * FLASH_FS_BLOCK_SIZE)
+
+/* Blocks are numbered sector * FLASH_FS_BLOCKS_PER_SECTOR + slot, slot >= 1 */
+typedef struct{
+    char name[FLASH_FS_NAME_MAX];
+    uint32_t size;
+    uint16_t inode;
+    uint16_t id;
+}Flash_FS_Entry_t;
+
+/* Rewritten to a fresh block on every change; the newest valid one wins */
+typedef struct{
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t count;
+    uint32_t next_id;
+    uint32_t reserved[4];
+    Flash_FS_Entry_t entry[FLASH_FS_MAX_FILES];
+}Flash_FS_Dir_t;
+
+typedef struct{
+    uint32_t magic;
+    uint32_t id;
+    uint32_t size;
+    uint32_t nb_blocks;
+    uint16_t block[FLASH_FS_INODE_BLOCKS];
+}Flash_FS_Inode_t;
+
+typedef struct{
+    uint32_t blocks;            /* blocks programmed, relocations included */
+    uint32_t flashwords;        /* flashwords programmed, tags included */
+    uint32_t erases;
+    uint32_t collections;
+    uint32_t moved;             /* live blocks relocated by collections */
+    uint32_t cache_hits;
+    uint32_t cache_misses;
+}Flash_FS_Stats_t;
+
+typedef struct{
+    uint16_t block;             /* 0: empty */
+    uint32_t stamp;             /* LRU clock at the last use */
+    uint32_t data[FLASH_FS_BLOCK_SIZE / 4U];
+}Flash_FS_Cache_t;
+
+typedef struct{
+    const Flash_Stream_Backend_t *backend;
+    uint32_t base;
+    uint32_t nb_sectors;
+    uint32_t status;            /* first error, sticky until the next mount */
+    uint32_t sequence;          /* of the newest tag */
+    uint32_t head;              /* sector taking new blocks, FLASH_FS_NO_SECTOR if none */
+    uint32_t collecting;        /* the reserve sector may be used */
+    uint32_t clock;
+    uint16_t dir_block;
+    uint8_t used[FLASH_FS_MAX_SECTORS];         /* programmed tag slots, header included */
+    uint32_t erase_count[FLASH_FS_MAX_SECTORS];
+    uint64_t live[FLASH_FS_MAX_SECTORS];        /* blocks reachable from the directory */
+    Flash_FS_Stats_t stats;
+    Flash_FS_Dir_t dir;
+    Flash_FS_Inode_t inode;
+    uint32_t scratch[FLASH_FS_BLOCK_SIZE / 4U];
+    Flash_FS_Cache_t cache[FLASH_FS_CACHE_BLOCKS];
+}Flash_FS_t;
+
+#define FLASH_FS_NO_SECTOR          0xFFFFFFFFU
+
+/* Mounts the file system in [FlashAddress, FlashAddress + NbOfSectors
+   sectors); sectors without a valid header are erased, Format erases all */
+uint32_t Flash_FS_Mount(Flash_FS_t *fs, const Flash_Stream_Backend_t *backend,
+                        uint32_t FlashAddress, uint32_t NbOfSectors, uint32_t Format);
+/* Replaces the whole file; the old contents stay readable until the new
+   directory is programmed, so a reset leaves one version or the other */
+uint32_t Flash_FS_Write(Flash_FS_t *fs, const char *name, const void *data, uint32_t Size);
+uint32_t Flash_FS_Read(Flash_FS_t *fs, const char *name, uint32_t Offset, void *dest, uint32_t Length, uint32_t *Read);
+uint32_t Flash_FS_Delete(Flash_FS_t *fs, const char *name);
+uint32_t Flash_FS_Size(Flash_FS_t *fs, const char *name, uint32_t *Size);
+/* Blocks that can still be written, the reserve for collections excluded */
+uint32_t Flash_FS_Free(Flash_FS_t *fs);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_FS_H__ */
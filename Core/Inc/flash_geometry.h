@@ -0,0 +1,112 @@
+/**
+  ******************************************************************************
+  * @file    flash_geometry.h
+  * @brief   Flash geometry of the STM32H745: 2 banks of 8 x 128 Kbytes
+  *          sectors, programmed by 256-bit flashwords. All sizes are powers
+  *          of two, so address decoding is shifts and masks, and every macro
+  *          is a constant expression when its argument is.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_GEOMETRY_H__
+#define __FLASH_GEOMETRY_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HOST_BUILD
+/* Host tools share the geometry without the device header */
+#include <stdint.h>
+#define FLASH_BANK_1                    0x01U
+#define FLASH_BANK_2                    0x02U
+#define FLASH_BANK1_BASE                0x08000000UL
+#define FLASH_BANK2_BASE                0x08100000UL
+#define FLASH_END                       0x081FFFFFUL
+#define FLASH_SECTOR_SIZE               0x00020000UL
+#define FLASH_SECTOR_TOTAL              8U
+#define FLASH_NB_32BITWORD_IN_FLASHWORD 8U
+#define FLASH_PAGE_SIZE                 (128 * 1024)
+#ifndef __STATIC_INLINE
+#define __STATIC_INLINE                 static inline
+#endif
+#else
+#include "main.h"
+#endif
+
+#define FLASH_GEO_BASE              FLASH_BANK1_BASE
+#define FLASH_GEO_NB_BANKS          2U
+#define FLASH_GEO_BANK_SHIFT        20U     /* 1 Mbyte per bank */
+#define FLASH_GEO_SECTOR_SHIFT      17U     /* 128 Kbytes per sector */
+#define FLASH_GEO_FLASHWORD_SHIFT   5U      /* 32 bytes per flashword */
+
+#define FLASH_GEO_BANK_SIZE         (1UL << FLASH_GEO_BANK_SHIFT)
+#define FLASH_GEO_SECTOR_SIZE       (1UL << FLASH_GEO_SECTOR_SHIFT)
+#define FLASH_GEO_FLASHWORD_SIZE    (1UL << FLASH_GEO_FLASHWORD_SHIFT)
+#define FLASH_GEO_SECTORS_PER_BANK  (1UL << (FLASH_GEO_BANK_SHIFT - FLASH_GEO_SECTOR_SHIFT))
+#define FLASH_GEO_WORDS_PER_SECTOR  (1UL << (FLASH_GEO_SECTOR_SHIFT - FLASH_GEO_FLASHWORD_SHIFT))
+#define FLASH_GEO_TOTAL_SIZE        (FLASH_GEO_NB_BANKS << FLASH_GEO_BANK_SHIFT)
+
+/* Offset from the start of flash; wraps to a huge value below FLASH_GEO_BASE */
+#define FLASH_GEO_OFFSET(addr)      ((uint32_t)(addr) - FLASH_GEO_BASE)
+
+#define FLASH_GEO_IS_VALID(addr)    (FLASH_GEO_OFFSET(addr) < FLASH_GEO_TOTAL_SIZE)
+#define FLASH_GEO_BANK(addr)        ((FLASH_GEO_OFFSET(addr) >> FLASH_GEO_BANK_SHIFT) + FLASH_BANK_1)
+#define FLASH_GEO_SECTOR(addr)      ((FLASH_GEO_OFFSET(addr) >> FLASH_GEO_SECTOR_SHIFT) & (FLASH_GEO_SECTORS_PER_BANK - 1U))
+#define FLASH_GEO_FLASHWORD(addr)   ((FLASH_GEO_OFFSET(addr) >> FLASH_GEO_FLASHWORD_SHIFT) & (FLASH_GEO_WORDS_PER_SECTOR - 1U))
+#define FLASH_GEO_IS_ALIGNED(addr)  ((FLASH_GEO_OFFSET(addr) & (FLASH_GEO_FLASHWORD_SIZE - 1U)) == 0U)
+
+#define FLASH_GEO_BANK_BASE(bank)           (FLASH_GEO_BASE + (((uint32_t)(bank) - FLASH_BANK_1) << FLASH_GEO_BANK_SHIFT))
+#define FLASH_GEO_SECTOR_BASE(bank, sector) (FLASH_GEO_BANK_BASE(bank) + ((uint32_t)(sector) << FLASH_GEO_SECTOR_SHIFT))
+
+/* [addr, addr + len) is non-empty, inside flash and inside one bank/sector */
+#define FLASH_GEO_SAME_BANK(addr, len)      (((len) != 0U) && FLASH_GEO_IS_VALID(addr) && FLASH_GEO_IS_VALID((addr) + (len) - 1U) && \
+                                             (((FLASH_GEO_OFFSET(addr) ^ FLASH_GEO_OFFSET((addr) + (len) - 1U)) >> FLASH_GEO_BANK_SHIFT) == 0U))
+#define FLASH_GEO_SAME_SECTOR(addr, len)    (FLASH_GEO_SAME_BANK(addr, len) && \
+                                             (((FLASH_GEO_OFFSET(addr) ^ FLASH_GEO_OFFSET((addr) + (len) - 1U)) >> FLASH_GEO_SECTOR_SHIFT) == 0U))
+
+/* Build-time rejection of constant ranges */
+#define FLASH_GEO_STATIC_ASSERT_BANK(addr, len) \
+    _Static_assert(FLASH_GEO_SAME_BANK(addr, len), "flash range straddles a bank or leaves flash")
+#define FLASH_GEO_STATIC_ASSERT_SECTOR(addr, len) \
+    _Static_assert(FLASH_GEO_SAME_SECTOR(addr, len), "flash range straddles a sector or leaves flash")
+
+/* The description must agree with the device header */
+_Static_assert((FLASH_BANK2_BASE - FLASH_BANK1_BASE) == FLASH_GEO_BANK_SIZE, "bank size");
+_Static_assert(FLASH_SECTOR_SIZE == FLASH_GEO_SECTOR_SIZE, "sector size");
+_Static_assert(FLASH_SECTOR_TOTAL == FLASH_GEO_SECTORS_PER_BANK, "sectors per bank");
+_Static_assert((FLASH_NB_32BITWORD_IN_FLASHWORD * 4U) == FLASH_GEO_FLASHWORD_SIZE, "flashword size");
+_Static_assert((FLASH_END - FLASH_GEO_BASE + 1U) == FLASH_GEO_TOTAL_SIZE, "flash size");
+_Static_assert(FLASH_PAGE_SIZE == FLASH_GEO_SECTOR_SIZE, "FLASH_PAGE_SIZE is one sector");
+
+typedef struct{
+    uint32_t bank;          /* FLASH_BANK_1 or FLASH_BANK_2 */
+    uint32_t sector;        /* sector within the bank */
+    uint32_t flashword;     /* flashword within the sector */
+}Flash_Geo_Location_t;
+
+__STATIC_INLINE uint32_t Flash_Geo_Decode(uint32_t addr, Flash_Geo_Location_t *loc)
+{
+    if(!FLASH_GEO_IS_VALID(addr)){
+        return 0U;
+    }
+    loc->bank = FLASH_GEO_BANK(addr);
+    loc->sector = FLASH_GEO_SECTOR(addr);
+    loc->flashword = FLASH_GEO_FLASHWORD(addr);
+    return 1U;
+}
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_GEOMETRY_H__ */
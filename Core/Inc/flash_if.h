@@ -20,20 +20,36 @@
 #define __FLASH_IF_H__
 
 #ifdef __cplusplus
-extern "c" {
+extern "C" {
 #endif
 
+#ifdef HOST_BUILD
+#include <stdint.h>
+#else
 #include "main.h"
+#endif
 
     enum{
         FLASH_OK      = 0x00,
         FLASH_ERROR   = 0x01,
         FLASH_BUSY    = 0x02,
-        FLASH_TIMEOUT = 0x03
+        FLASH_TIMEOUT = 0x03,
+        FLASH_ECC_ERROR = 0x04
     };    
 
+/* Detail behind a failed status: which SR error bits the operation left
+   and the flashword (program) or sector base (erase) it stopped at */
+typedef struct{
+    uint32_t status;        /* FLASH_ERROR or FLASH_TIMEOUT */
+    uint32_t flags;         /* FLASH_SR error bits, already cleared in SR */
+    uint32_t address;
+}Flash_Error_t;
+
 uint32_t Flash_Sector_Erase(uint32_t Banks, uint32_t FirstSector, uint32_t NbOfSectors);
 uint32_t Flash_Program(uint32_t FlashAddress, uint32_t DataAddress, uint32_t NbOfFlashWords);
+/* Failure of the last erase or program session on the bank; status is
+   FLASH_OK if it succeeded */
+void Flash_GetLastError(uint32_t Bank, Flash_Error_t *error);
     
 #ifdef __cplusplus
 }
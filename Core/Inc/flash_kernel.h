@@ -0,0 +1,58 @@
+/**
+  ******************************************************************************
+  * @file    flash_kernel.h
+  * @brief   This file contains all the function prototypes for
+  *          the flash_kernel.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_KERNEL_H__
+#define __FLASH_KERNEL_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HOST_BUILD
+#include <stdint.h>
+#else
+#include "main.h"
+#endif
+
+/* All kernels return the offset of the first byte that does not match,
+   or Length when the whole range matches. They are plain loads: a
+   double-bit ECC error in memory-mapped flash still raises a bus fault. */
+uint32_t Flash_Kernel_Compare(const void *flash, const void *data, uint32_t Length);
+/* Pattern repeats every 32-bit word, anchored at word-aligned addresses */
+uint32_t Flash_Kernel_Check(const void *flash, uint32_t Length, uint32_t Pattern);
+
+#define Flash_Kernel_IsBlank(flash, Length) \
+    (Flash_Kernel_Check((flash), (Length), 0xFFFFFFFFU) == (uint32_t)(Length))
+
+#ifdef FLASH_KERNEL_BENCHMARK
+typedef struct{
+    uint32_t naive_cycles;      /* byte loop, as the scans in main.c */
+    uint32_t word_cycles;       /* 32-bit word loop */
+    uint32_t kernel_cycles;
+}Flash_Kernel_Bench_t;
+
+/* DWT cycles over Length bytes at flash: results[0] pattern check,
+   results[1] compare against data; bytes/cycle is Length / cycles */
+void Flash_Kernel_Benchmark(const void *flash, const void *data, uint32_t Length, uint32_t Pattern,
+                            Flash_Kernel_Bench_t results[2]);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_KERNEL_H__ */
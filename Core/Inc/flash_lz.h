@@ -0,0 +1,112 @@
+/**
+  ******************************************************************************
+  * @file    flash_lz.h
+  * @brief   This file contains all the function prototypes for
+  *          the flash_lz.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_LZ_H__
+#define __FLASH_LZ_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HOST_BUILD
+#include <stdint.h>
+#else
+#include "main.h"
+#endif
+#include "flash_geometry.h"
+#include "flash_stream.h"
+
+/* History window shared by compressor and decompressor; the 12-bit match
+   offset of the token format caps it at 4 Kbytes */
+#ifndef FLASH_LZ_WINDOW_BITS
+#define FLASH_LZ_WINDOW_BITS    12U
+#endif
+#define FLASH_LZ_WINDOW         (1UL << FLASH_LZ_WINDOW_BITS)
+
+#ifndef FLASH_LZ_HASH_BITS
+#define FLASH_LZ_HASH_BITS      10U
+#endif
+
+#define FLASH_LZ_MIN_MATCH      3U
+#define FLASH_LZ_MAX_MATCH      18U
+
+/* First flashword of an object, programmed last: an object without it is
+   incomplete and reads as absent */
+typedef struct{
+    uint32_t magic;
+    uint32_t raw_size;
+    uint32_t packed_size;   /* token bytes after the header */
+    uint32_t crc;           /* Flash_Stream_Crc of the raw data */
+    uint32_t window_bits;
+    uint32_t reserved[3];
+}Flash_Lz_Header_t;
+
+typedef struct{
+    const Flash_Stream_Backend_t *backend;
+    uint32_t base;
+    uint32_t next;              /* next flashword to program */
+    uint32_t end;
+    uint32_t status;
+    uint32_t pos;               /* bytes taken in */
+    uint32_t cur;               /* bytes encoded */
+    uint32_t crc;
+    uint32_t packed;
+    uint32_t flashwords;
+    uint32_t group_fill;        /* bytes in group[], group[0] holds the flags */
+    uint32_t group_items;
+    uint32_t stage_fill;
+    uint8_t group[1U + (8U * 2U)];
+    uint32_t stage[FLASH_NB_32BITWORD_IN_FLASHWORD];
+    uint16_t head[1UL << FLASH_LZ_HASH_BITS];
+    uint8_t window[FLASH_LZ_WINDOW];
+}Flash_Lz_Writer_t;
+
+typedef struct{
+    const Flash_Stream_Backend_t *backend;
+    Flash_Lz_Header_t header;
+    uint32_t next;              /* next flashword to fetch */
+    uint32_t status;
+    uint32_t total;             /* bytes produced */
+    uint32_t crc;
+    uint32_t flags;
+    uint32_t items;             /* tokens left in the current group */
+    uint32_t match_left;
+    uint32_t match_dist;
+    uint32_t in_pos;
+    uint32_t flashwords;
+    uint8_t in[FLASH_NB_32BITWORD_IN_FLASHWORD * 4U];
+    uint8_t window[FLASH_LZ_WINDOW];
+}Flash_Lz_Reader_t;
+
+/* The region [FlashAddress, FlashAddress + Capacity) must be erased */
+uint32_t Flash_Lz_WriterInit(Flash_Lz_Writer_t *writer, const Flash_Stream_Backend_t *backend,
+                             uint32_t FlashAddress, uint32_t Capacity);
+uint32_t Flash_Lz_Write(Flash_Lz_Writer_t *writer, const void *data, uint32_t Length);
+uint32_t Flash_Lz_Finish(Flash_Lz_Writer_t *writer, Flash_Lz_Header_t *header);
+
+uint32_t Flash_Lz_ReaderInit(Flash_Lz_Reader_t *reader, const Flash_Stream_Backend_t *backend, uint32_t FlashAddress);
+uint32_t Flash_Lz_Read(Flash_Lz_Reader_t *reader, void *dest, uint32_t Length);
+
+/* Flash bytes an object occupies, header included */
+#define FLASH_LZ_FOOTPRINT(header) \
+    (FLASH_GEO_FLASHWORD_SIZE + (((header)->packed_size + FLASH_GEO_FLASHWORD_SIZE - 1U) & ~(FLASH_GEO_FLASHWORD_SIZE - 1U)))
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_LZ_H__ */
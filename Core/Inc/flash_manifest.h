@@ -0,0 +1,97 @@
+/**
+  ******************************************************************************
+  * @file    flash_manifest.h
+  * @brief   This file contains all the function prototypes for
+  *          the flash_manifest.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_MANIFEST_H__
+#define __FLASH_MANIFEST_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HOST_BUILD
+#include <stdint.h>
+#else
+#include "main.h"
+#endif
+#include "flash_geometry.h"
+#include "flash_stream.h"
+
+#define FLASH_MANIFEST_MAGIC        0x31464D46U     /* "FMF1" */
+#define FLASH_MANIFEST_MAX_SECTORS  (FLASH_GEO_NB_BANKS * FLASH_GEO_SECTORS_PER_BANK)
+#define FLASH_MANIFEST_MAP_WORDS    (FLASH_GEO_WORDS_PER_SECTOR / 32U)
+
+/* Manifest: this header, one hash per sector, then one hash per flashword,
+   all Flash_Manifest_Hash values. The image is padded with 0xFF to whole
+   sectors, so whatever follows the image in its last sector ends up erased.
+   The target only needs the sector hashes up front, and the flashword
+   hashes of the sectors that differ. */
+typedef struct{
+    uint32_t magic;
+    uint32_t base;          /* sector aligned flash address of the image */
+    uint32_t sectors;       /* padded image length in sectors */
+    uint32_t size;          /* image bytes before padding */
+    uint32_t crc;           /* Flash_Stream_Crc of the padded image */
+}Flash_Manifest_Header_t;
+
+/* One sector being brought up to date */
+typedef struct{
+    uint32_t address;       /* sector base */
+    uint32_t blank;         /* hash of an erased flashword */
+    uint32_t erase;         /* a changed flashword is programmed in flash: erase first */
+    uint32_t requested;     /* flashwords still expected from the host */
+    uint32_t request[FLASH_MANIFEST_MAP_WORDS];     /* changed and not blank in the new image */
+    uint32_t kept[FLASH_MANIFEST_MAP_WORDS];        /* unchanged and not blank: lost on erase */
+}Flash_Manifest_Sector_t;
+
+/* Murmur3-style 32-bit hash of one flashword */
+uint32_t Flash_Manifest_Hash(const uint32_t *flashword);
+/* Hash of a sector from the hashes of its FLASH_GEO_WORDS_PER_SECTOR flashwords */
+uint32_t Flash_Manifest_SectorHash(const uint32_t *FlashwordHashes);
+
+uint32_t Flash_Manifest_Check(const Flash_Manifest_Header_t *header);
+/* Hash of a sector as it is in flash, same value as the host computes */
+uint32_t Flash_Manifest_ScanSector(const Flash_Stream_Backend_t *backend, uint32_t SectorAddress, uint32_t *hash);
+/* Bit n of *dirty set when sector n of the image differs from flash or
+   does not read back */
+uint32_t Flash_Manifest_Changed(const Flash_Stream_Backend_t *backend, const Flash_Manifest_Header_t *header,
+                                const uint32_t *SectorHashes, uint32_t *dirty);
+
+/* Per dirty sector: Begin, Compare its flashword hashes (in pieces of any
+   size, in order or not), Prepare, then Write every flashword Next yields.
+   A flashword that does not read back (torn by an interrupted update) is
+   taken as changed and programmed: the sector is erased and it is requested. */
+void Flash_Manifest_Begin(Flash_Manifest_Sector_t *sector, uint32_t SectorAddress);
+uint32_t Flash_Manifest_Compare(const Flash_Stream_Backend_t *backend, Flash_Manifest_Sector_t *sector,
+                                uint32_t First, const uint32_t *FlashwordHashes, uint32_t NbOfFlashWords);
+/* Erases the sector if needed. With save (FLASH_GEO_SECTOR_SIZE bytes of
+   RAM) the kept flashwords are copied out and programmed back; without it
+   they are requested from the host like the changed ones. A reset before
+   they are back only makes the sector dirty again for the next update. */
+uint32_t Flash_Manifest_Prepare(const Flash_Stream_Backend_t *backend, Flash_Manifest_Sector_t *sector, uint32_t *save);
+/* Index of the next requested flashword from Index on, or FLASH_GEO_WORDS_PER_SECTOR */
+uint32_t Flash_Manifest_Next(const Flash_Manifest_Sector_t *sector, uint32_t Index);
+uint32_t Flash_Manifest_Write(const Flash_Stream_Backend_t *backend, Flash_Manifest_Sector_t *sector,
+                              uint32_t Index, const uint32_t *flashword);
+
+/* CRC of the whole padded image in flash against the manifest */
+uint32_t Flash_Manifest_Finish(const Flash_Stream_Backend_t *backend, const Flash_Manifest_Header_t *header);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_MANIFEST_H__ */
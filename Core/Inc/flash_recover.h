@@ -0,0 +1,108 @@
+/**
+  ******************************************************************************
+  * @file    flash_recover.h
+  * @brief   This file contains all the function prototypes for
+  *          the flash_recover.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_RECOVER_H__
+#define __FLASH_RECOVER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HOST_BUILD
+#include <stdint.h>
+#else
+#include "main.h"
+#endif
+#include "flash_if.h"
+#include "flash_geometry.h"
+
+/* FLASH_SR error bits, identical on both banks; spelled out so the policy
+   also builds on the host, checked against the device header on target */
+#define FLASH_ERR_WRPERR        0x00020000U
+#define FLASH_ERR_PGSERR        0x00040000U
+#define FLASH_ERR_STRBERR       0x00080000U
+#define FLASH_ERR_INCERR        0x00200000U
+#define FLASH_ERR_OPERR         0x00400000U
+#define FLASH_ERR_RDPERR        0x00800000U
+#define FLASH_ERR_RDSERR        0x01000000U
+#define FLASH_ERR_SNECCERR      0x02000000U
+#define FLASH_ERR_DBECCERR      0x04000000U
+
+enum{
+    FLASH_ERR_NONE = 0,
+    FLASH_ERR_SEQUENCE,         /* PGSERR, STRBERR, INCERR: command rejected */
+    FLASH_ERR_TIMEOUT,          /* QW never dropped */
+    FLASH_ERR_PROTECTED,        /* WRPERR, RDPERR, RDSERR: sector is protected */
+    FLASH_ERR_OPERATION,        /* OPERR: the array operation itself failed */
+    FLASH_ERR_ECC,              /* SNECCERR, DBECCERR raised during the operation */
+    FLASH_ERR_CLASSES
+};
+
+/* Recovery cost model of the baseline policy, erase and reprogram */
+#ifndef FLASH_RECOVER_ERASE_US
+#define FLASH_RECOVER_ERASE_US      1000000U
+#endif
+#ifndef FLASH_RECOVER_PROGRAM_US
+#define FLASH_RECOVER_PROGRAM_US    16U
+#endif
+#ifndef FLASH_RECOVER_RETRIES
+#define FLASH_RECOVER_RETRIES       3U      /* re-issues of one flashword, and erases of one call */
+#endif
+
+/* Policy flags */
+#define FLASH_RECOVER_ERASE         0x01U   /* caller owns the sectors: corruption may erase one
+                                               and replay this call's data into it */
+
+typedef struct{
+    uint32_t (*erase_sector)(uint32_t FlashAddress);
+    uint32_t (*program)(uint32_t FlashAddress, const uint32_t *src, uint32_t NbOfFlashWords);
+    uint32_t (*read)(void *dest, uint32_t FlashAddress, uint32_t Length, uint32_t *FailAddress);
+    void (*last_error)(uint32_t FlashAddress, Flash_Error_t *error);  /* detail of the failed call */
+}Flash_Recover_Backend_t;
+
+/* Accumulates across calls; clear it to start a new measurement */
+typedef struct{
+    uint32_t errors;                    /* failures reported by the backend */
+    uint32_t classes[FLASH_ERR_CLASSES];
+    uint32_t retries;                   /* flashwords re-issued in place */
+    uint32_t verified;                  /* failed flashwords that read back correct */
+    uint32_t skipped;                   /* flashwords left in protected sectors */
+    uint32_t escalations;               /* sector erases for corrupted data */
+    uint64_t saved_us;                  /* lower bound against erasing and starting again on every error */
+    Flash_Error_t last;
+}Flash_Recover_Report_t;
+
+uint32_t Flash_Err_Classify(const Flash_Error_t *error);
+
+/* Programs NbOfFlashWords and recovers from failures as cheaply as the
+   error allows: a rejected or timed-out command is re-issued once the
+   flashword reads back blank, a protected sector is skipped, and only a
+   flashword holding wrong data escalates to an erase. Returns FLASH_OK
+   when every flashword holds its data, FLASH_ERROR otherwise; report->last
+   then names the first flashword that was not written. */
+uint32_t Flash_Recover_Program(const Flash_Recover_Backend_t *backend, uint32_t FlashAddress, const uint32_t *src,
+                               uint32_t NbOfFlashWords, uint32_t Policy, Flash_Recover_Report_t *report);
+
+#ifndef HOST_BUILD
+extern const Flash_Recover_Backend_t Flash_Recover_TargetBackend;
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_RECOVER_H__ */
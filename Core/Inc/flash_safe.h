@@ -0,0 +1,65 @@
+/**
+  ******************************************************************************
+  * @file    flash_safe.h
+  * @brief   This file contains all the function prototypes for
+  *          the flash_safe.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_SAFE_H__
+#define __FLASH_SAFE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HOST_BUILD
+#include <stdint.h>
+#else
+#include "main.h"
+#endif
+
+#ifndef FLASH_SAFE_EVENT_DEPTH
+#define FLASH_SAFE_EVENT_DEPTH  8U      /* recent ECC events kept, power of two */
+#endif
+
+/* FailAddress of a failed Flash_Safe_Read when the error could not be
+   placed: no bus fault address and no matching event in the log */
+#define FLASH_SAFE_NO_ADDRESS   0xFFFFFFFFU
+
+typedef struct{
+    uint32_t address;       /* failing flashword address */
+    uint32_t flags;         /* FLASH_SR_SNECCERR and/or FLASH_SR_DBECCERR */
+    uint32_t tick;          /* HAL_GetTick() at detection */
+}Flash_Safe_Event_t;
+
+typedef struct{
+    uint32_t single_errors;     /* corrected, data was valid */
+    uint32_t double_errors;     /* uncorrectable */
+    uint32_t recovered_faults;  /* bus faults unwound by Flash_Safe_Read */
+    uint32_t event_count;       /* total events, index of the next slot */
+    uint32_t handler_cycles;    /* DWT cycles spent in the last FLASH_IRQHandler */
+    Flash_Safe_Event_t events[FLASH_SAFE_EVENT_DEPTH];
+}Flash_Safe_Log_t;
+
+extern Flash_Safe_Log_t Flash_Safe_EccLog;
+
+void Flash_Safe_Init(void);
+uint32_t Flash_Safe_Read(void *dest, uint32_t FlashAddress, uint32_t Length, uint32_t *FailAddress);
+void Flash_Safe_EccIrq(void);
+void Flash_Safe_BusFault(uint32_t *frame, uint32_t exc_return, uint32_t *callee);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_SAFE_H__ */
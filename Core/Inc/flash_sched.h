@@ -0,0 +1,146 @@
+/**
+  ******************************************************************************
+  * @file    flash_sched.h
+  * @brief   This file contains all the function prototypes for
+  *          the flash_sched.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_SCHED_H__
+#define __FLASH_SCHED_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HOST_BUILD
+#include <stdint.h>
+#else
+#include "main.h"
+#endif
+#include "flash_if.h"
+#include "flash_geometry.h"
+
+enum{
+    FLASH_SCHED_URGENT = 0,     /* config commits, small and late */
+    FLASH_SCHED_NORMAL,
+    FLASH_SCHED_BULK,           /* log flushes, image writes */
+    FLASH_SCHED_CLASSES
+};
+
+enum{
+    FLASH_SCHED_PROGRAM = 0,    /* count flashwords from data */
+    FLASH_SCHED_ERASE           /* count sectors */
+};
+
+/* Starting estimates; the erase estimate grows to the longest erase seen */
+#ifndef FLASH_SCHED_ERASE_US
+#define FLASH_SCHED_ERASE_US        1000000U
+#endif
+#ifndef FLASH_SCHED_PROGRAM_US
+#define FLASH_SCHED_PROGRAM_US      16U
+#endif
+/* A request whose slack drops below this is served as urgent */
+#ifndef FLASH_SCHED_SLACK_US
+#define FLASH_SCHED_SLACK_US        1000U
+#endif
+/* Flashwords one bank programs per Flash_Sched_Poll */
+#ifndef FLASH_SCHED_QUANTUM
+#define FLASH_SCHED_QUANTUM         8U
+#endif
+
+typedef struct{
+    uint32_t (*erase_start)(uint32_t FlashAddress);         /* starts one sector erase, returns at once */
+    uint32_t (*erase_poll)(uint32_t Bank);                  /* FLASH_BUSY while it runs, then its result */
+    uint32_t (*program)(uint32_t FlashAddress, const uint32_t *src);   /* one flashword */
+    uint32_t (*now_us)(void);                               /* free running */
+}Flash_Sched_Backend_t;
+
+/* Owned by the caller from Flash_Sched_Submit until status leaves FLASH_BUSY */
+typedef struct Flash_Sched_Request{
+    struct Flash_Sched_Request *next;
+    uint32_t op;
+    uint32_t priority;
+    uint32_t address;           /* flashword aligned, or a sector base for erases */
+    const uint32_t *data;
+    uint32_t count;
+    uint32_t deadline;          /* now_us based, valid with has_deadline */
+    uint32_t has_deadline;
+    uint32_t submitted;
+    uint32_t done;              /* flashwords or sectors finished */
+    uint32_t started;           /* first unit issued */
+    volatile uint32_t status;   /* FLASH_BUSY, then FLASH_OK or the failure */
+}Flash_Sched_Request_t;
+
+typedef struct{
+    uint32_t completed;
+    uint32_t failed;
+    uint32_t deadlines;         /* completed requests that had one */
+    uint32_t misses;
+    uint64_t wait_us;           /* submit to first unit issued */
+    uint32_t wait_max_us;
+    uint64_t latency_us;        /* submit to completion */
+    uint32_t latency_max_us;
+}Flash_Sched_Class_Stats_t;
+
+typedef struct{
+    Flash_Sched_Class_Stats_t cls[FLASH_SCHED_CLASSES];    /* by submitted priority */
+    uint32_t preemptions;       /* a request went ahead of one half done */
+    uint32_t promotions;        /* picks made urgent by a close deadline */
+    uint32_t erases_deferred;   /* polls an erase waited for a gap */
+    uint32_t erase_max_us;
+}Flash_Sched_Stats_t;
+
+typedef struct{
+    const Flash_Sched_Backend_t *backend;
+    Flash_Sched_Request_t *queue[FLASH_GEO_NB_BANKS];
+    Flash_Sched_Request_t *last[FLASH_GEO_NB_BANKS];    /* last one served */
+    Flash_Sched_Request_t *erasing[FLASH_GEO_NB_BANKS];
+    uint32_t erase_start[FLASH_GEO_NB_BANKS];
+    uint32_t erase_us;
+    Flash_Sched_Stats_t stats;
+}Flash_Sched_t;
+
+void Flash_Sched_Init(Flash_Sched_t *sched, const Flash_Sched_Backend_t *backend);
+
+/* Queues an erase or program that stays inside one bank. BudgetUs is the
+   time from now it should be done in, 0 for none. FLASH_ERROR for a bad
+   request, which is then not queued. */
+uint32_t Flash_Sched_Submit(Flash_Sched_t *sched, Flash_Sched_Request_t *req, uint32_t Op, uint32_t Priority,
+                            uint32_t Address, const uint32_t *data, uint32_t Count, uint32_t BudgetUs);
+
+/* Does a bounded amount of work on each bank and returns: FLASH_BUSY while
+   anything is queued or erasing, FLASH_OK once idle. On each bank the
+   next flashword goes to the best request: urgent (or close to its
+   deadline) first, then earliest deadline, then oldest, so urgent writes
+   get in between two flashwords of bulk work. Whatever the classes, no
+   request passes an earlier one on a sector both touch when either of
+   them is an erase. An erase cannot be broken off: below urgent it only
+   starts in a gap, when it is the best request on the bank and every
+   queued deadline survives it. Urgent
+   writes that cannot wait out an erase belong on the other bank; erasing
+   the bank code runs from stalls the CPU for the whole erase either way.
+   Submit and Poll must not preempt each other. */
+uint32_t Flash_Sched_Poll(Flash_Sched_t *sched);
+
+/* Polls until req completes, for callers that want the old blocking call */
+uint32_t Flash_Sched_Wait(Flash_Sched_t *sched, Flash_Sched_Request_t *req);
+
+#ifndef HOST_BUILD
+extern const Flash_Sched_Backend_t Flash_Sched_TargetBackend;
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_SCHED_H__ */
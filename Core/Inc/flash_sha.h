@@ -0,0 +1,107 @@
+/**
+  ******************************************************************************
+  * @file    flash_sha.h
+  * @brief   This file contains all the function prototypes for
+  *          the flash_sha.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_SHA_H__
+#define __FLASH_SHA_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HOST_BUILD
+#include <stdint.h>
+#else
+#include "main.h"
+#endif
+#include "flash_geometry.h"
+#include "flash_crc.h"
+
+#define FLASH_SHA_DIGEST_SIZE       32U
+#define FLASH_SHA_BLOCK_SIZE        64U
+
+#define FLASH_SHA_MANIFEST_MAGIC    0x32414853U     /* "SHA2" */
+
+typedef struct{
+    uint32_t state[8];
+    uint32_t count;             /* bytes hashed, images stay far below 512 Mbytes */
+    uint32_t fill;              /* bytes waiting in block */
+    uint32_t block[FLASH_SHA_BLOCK_SIZE / 4U];
+}Flash_Sha_t;
+
+/* Image digest: SHA-256 over the SHA-256 of each sector's part of the
+   image, so a sector can be checked, or taken from a cache, on its own */
+typedef struct{
+    Flash_Sha_t sector;
+    uint32_t size;              /* image bytes hashed so far */
+    uint8_t digest[FLASH_GEO_SECTORS_PER_BANK][FLASH_SHA_DIGEST_SIZE];
+}Flash_Sha_Image_t;
+
+/* Sent with an update and programmed after the image, three flashwords */
+typedef struct{
+    uint32_t magic;
+    uint32_t size;              /* image bytes */
+    uint32_t version;
+    uint32_t reserved[5];
+    uint8_t digest[FLASH_SHA_DIGEST_SIZE];      /* image digest */
+    uint8_t mac[FLASH_SHA_DIGEST_SIZE];         /* HMAC-SHA-256 of everything above */
+}Flash_Sha_Manifest_t;
+
+/* Per-sector digests kept between boots (e.g. in FLASH_WARM memory). The
+   controller CRC of a sector costs no CPU time and tells whether it still
+   holds what its digest was taken from; only sectors whose CRC moved are
+   hashed again. The CRC only detects change, and a CRC-32 is easy to
+   forge: a sector taken from the cache is not authenticated. The cache
+   must sit where nothing but this firmware writes. */
+typedef struct{
+    uint32_t valid;             /* bit per sector */
+    uint32_t crc[FLASH_GEO_SECTORS_PER_BANK];
+    uint8_t digest[FLASH_GEO_SECTORS_PER_BANK][FLASH_SHA_DIGEST_SIZE];
+    uint32_t reused;            /* sectors taken from the cache by the last check */
+    uint32_t hashed;            /* sectors hashed by the last check */
+}Flash_Sha_Cache_t;
+
+void Flash_Sha_Init(Flash_Sha_t *sha);
+void Flash_Sha_Update(Flash_Sha_t *sha, const void *data, uint32_t Length);
+void Flash_Sha_Final(Flash_Sha_t *sha, uint8_t *digest);
+void Flash_Sha_Hmac(const uint8_t *key, uint32_t KeyLength, const void *data, uint32_t Length, uint8_t *mac);
+
+/* Incremental image digest; Update takes the image in order, in pieces
+   of any size */
+void Flash_Sha_ImageInit(Flash_Sha_Image_t *image);
+void Flash_Sha_ImageUpdate(Flash_Sha_Image_t *image, const void *data, uint32_t Length);
+void Flash_Sha_ImageFinal(Flash_Sha_Image_t *image, uint8_t *digest);
+/* Flash_Stream_t hook: feeds each block once it is verified in flash */
+void Flash_Sha_StreamHook(void *context, uint32_t Offset, const void *data, uint32_t Length);
+
+/* FLASH_OK when the MAC is right for the key, and the digest matches if
+   one is given; FLASH_ERROR otherwise */
+uint32_t Flash_Sha_ManifestCheck(const Flash_Sha_Manifest_t *manifest, const uint8_t *key, uint32_t KeyLength,
+                                 const uint8_t *digest);
+void Flash_Sha_ManifestSign(Flash_Sha_Manifest_t *manifest, const uint8_t *key, uint32_t KeyLength);
+
+/* Digest of the image at FlashAddress (sector aligned) as flash holds it.
+   With a cache, sectors whose CRC is unchanged are not read and their
+   cached digest is trusted; only NULL hashes everything, which is what an
+   authenticating check needs. */
+uint32_t Flash_Sha_ImageCompute(const Flash_Crc_Backend_t *backend, uint32_t FlashAddress, uint32_t Size,
+                                Flash_Sha_Cache_t *cache, uint8_t *digest);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_SHA_H__ */
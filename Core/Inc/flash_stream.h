@@ -0,0 +1,107 @@
+/**
+  ******************************************************************************
+  * @file    flash_stream.h
+  * @brief   This file contains all the function prototypes for
+  *          the flash_stream.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_STREAM_H__
+#define __FLASH_STREAM_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HOST_BUILD
+#include <stdint.h>
+#else
+#include "main.h"
+#endif
+
+/* Payload bytes per block: a multiple of the flashword that divides a sector.
+   Programming a block hides behind the transfer of the next one, but a
+   sector erase holds the bank for its full duration: the link only keeps
+   streaming through it if two blocks take longer to arrive than one erase. */
+#ifndef FLASH_STREAM_BLOCK_SIZE
+#define FLASH_STREAM_BLOCK_SIZE     4096U
+#endif
+
+/* Wire header in front of every block; offset is relative to the image base */
+typedef struct{
+    uint32_t offset;
+    uint32_t length;        /* 1..FLASH_STREAM_BLOCK_SIZE, short only for the last block */
+    uint32_t crc;           /* CRC-32 (IEEE 802.3) of the payload */
+}Flash_Stream_Header_t;
+
+typedef struct{
+    uint32_t (*erase_sector)(uint32_t FlashAddress);
+    uint32_t (*program)(uint32_t FlashAddress, const uint32_t *src, uint32_t NbOfFlashWords);
+    uint32_t (*read)(void *dest, uint32_t FlashAddress, uint32_t Length, uint32_t *FailAddress);
+}Flash_Stream_Backend_t;
+
+enum{
+    FLASH_STREAM_FREE = 0,      /* owned by the transport side, empty */
+    FLASH_STREAM_FILLING,       /* handed out by Flash_Stream_Acquire */
+    FLASH_STREAM_FULL           /* checked, waiting for Flash_Stream_Process */
+};
+
+typedef struct{
+    const Flash_Stream_Backend_t *backend;
+    uint32_t base;              /* sector aligned image start */
+    uint32_t size;              /* image region, whole flashwords; erased by sector */
+    volatile uint32_t state[2];
+    Flash_Stream_Header_t header[2];
+    uint32_t fill;              /* next buffer for the transport */
+    uint32_t drain;             /* next buffer for programming */
+    uint32_t expected;          /* offset the next committed block must carry */
+    uint32_t written;           /* bytes programmed and verified; the resume offset */
+    uint32_t erased;            /* region offset up to which sectors are erased */
+    uint32_t status;            /* first programming error, sticky */
+    uint32_t blocks;
+    uint32_t rejected;          /* CRC or offset mismatches */
+    uint32_t skipped;           /* flashwords already holding the right data */
+    uint32_t stalls;            /* Flash_Stream_Acquire calls refused for back-pressure */
+    /* Optional, set after Flash_Stream_Init: sees every block once it is
+       verified in flash, in offset order (e.g. Flash_Sha_StreamHook) */
+    void (*hook)(void *context, uint32_t Offset, const void *data, uint32_t Length);
+    void *hook_context;
+    uint32_t buffer[2][FLASH_STREAM_BLOCK_SIZE / 4U];
+}Flash_Stream_t;
+
+/* Resume keeps what a previous interrupted transfer already wrote;
+   otherwise the region is erased sector by sector as blocks arrive. */
+uint32_t Flash_Stream_Init(Flash_Stream_t *stream, const Flash_Stream_Backend_t *backend,
+                           uint32_t FlashAddress, uint32_t Size, uint32_t Resume);
+
+/* Transport side, callable from the DMA or UART interrupt */
+uint8_t *Flash_Stream_Acquire(Flash_Stream_t *stream);
+uint32_t Flash_Stream_Commit(Flash_Stream_t *stream, const Flash_Stream_Header_t *header);
+uint32_t Flash_Stream_NextOffset(const Flash_Stream_t *stream);
+
+/* Programming side, called from the main loop */
+uint32_t Flash_Stream_Process(Flash_Stream_t *stream);
+uint32_t Flash_Stream_Idle(const Flash_Stream_t *stream);
+
+uint32_t Flash_Stream_Crc(uint32_t crc, const void *data, uint32_t Length);
+
+#ifndef HOST_BUILD
+/* Erases with interrupts enabled and masks them per flashword only while
+   programming, so the transport interrupt runs throughout */
+extern const Flash_Stream_Backend_t Flash_Stream_TargetBackend;
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_STREAM_H__ */
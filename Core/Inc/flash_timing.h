@@ -0,0 +1,63 @@
+/**
+  ******************************************************************************
+  * @file    flash_timing.h
+  * @brief   This file contains all the function prototypes for
+  *          the flash_timing.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_TIMING_H__
+#define __FLASH_TIMING_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "main.h"
+
+/* Supply voltage used when the application does not measure VDD */
+#ifndef FLASH_TIMING_VDD_MV
+#define FLASH_TIMING_VDD_MV     3300U
+#endif
+
+typedef struct{
+    uint32_t hclk_hz;       /* AXI/flash interface clock the profile is valid for */
+    uint32_t vos;           /* PWR_REGULATOR_VOLTAGE_SCALEx */
+    uint32_t latency;       /* FLASH_ACR LATENCY, wait states */
+    uint32_t wrhighfreq;    /* FLASH_ACR WRHIGHFREQ field value (0..3) */
+    uint32_t psize;         /* FLASH_CR PSIZE bits, already shifted */
+}Flash_Timing_t;
+
+typedef struct{
+    uint32_t latency;
+    uint32_t read_cycles;   /* DWT cycles to read the benchmark window */
+    uint32_t psize;
+    uint32_t erase_cycles;  /* DWT cycles for one sector erase */
+}Flash_Timing_Bench_t;
+
+uint32_t Flash_Timing_Derive(uint32_t hclk_hz, uint32_t vos, uint32_t vdd_mv, Flash_Timing_t *profile);
+uint32_t Flash_Timing_Current(uint32_t vdd_mv, Flash_Timing_t *profile);
+uint32_t Flash_Timing_Apply(const Flash_Timing_t *profile);
+uint32_t Flash_Timing_PrepareClockChange(uint32_t new_hclk_hz, uint32_t new_vos, uint32_t vdd_mv);
+uint32_t Flash_Timing_CommitClockChange(void);
+uint32_t Flash_Timing_GetPsize(void);
+
+#ifdef FLASH_TIMING_BENCHMARK
+uint32_t Flash_Timing_Benchmark(uint32_t ReadAddress, uint32_t ReadLength, uint32_t EraseSector,
+                                Flash_Timing_Bench_t *results, uint32_t NbOfResults);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_TIMING_H__ */
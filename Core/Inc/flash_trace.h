@@ -0,0 +1,111 @@
+/**
+  ******************************************************************************
+  * @file    flash_trace.h
+  * @brief   This file contains the flash operation trace record format and
+  *          the recording hooks used by flash_if.c and flash_shin.c
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_TRACE_H__
+#define __FLASH_TRACE_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HOST_BUILD
+#include <stdint.h>
+#else
+#include "main.h"
+#endif
+
+#define FLASH_TRACE_MAGIC       0x46545243U     /* "CRTF" in memory */
+#define FLASH_TRACE_VERSION     1U
+
+#ifndef FLASH_TRACE_DEPTH
+#define FLASH_TRACE_DEPTH       256U            /* records, power of two */
+#endif
+
+enum{
+    FLASH_TRACE_OP_PROGRAM = 0,     /* Flash_Program: flashwords */
+    FLASH_TRACE_OP_SECTOR_ERASE,    /* Flash_Sector_Erase: whole sectors */
+    FLASH_TRACE_OP_PROGRAM_BYTES,   /* FLASH_Program: byte length, padded */
+    FLASH_TRACE_OP_ERASE_RANGE,     /* FLASH_Erase: [start, end] */
+    FLASH_TRACE_OP_COUNT
+};
+
+/* 16 bytes per call */
+typedef struct{
+    uint32_t start;         /* DWT cycle count at entry */
+    uint32_t cycles;        /* duration */
+    uint32_t address;       /* first byte touched */
+    uint32_t info;          /* length[21:0] | op[25:22] | result[31:26] */
+}Flash_Trace_Record_t;
+
+#define FLASH_TRACE_LEN_MASK        0x003FFFFFU
+#define FLASH_TRACE_OP_POS          22U
+#define FLASH_TRACE_RESULT_POS      26U
+#define FLASH_TRACE_INFO(op, len, result) \
+    (((uint32_t)(len) & FLASH_TRACE_LEN_MASK) | ((uint32_t)(op) << FLASH_TRACE_OP_POS) | ((uint32_t)(result) << FLASH_TRACE_RESULT_POS))
+
+/* The RAM image is the dump format: read it out with the debugger, e.g.
+   dump binary memory trace.bin &Flash_Trace (char *)&Flash_Trace + sizeof(Flash_Trace) */
+typedef struct{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t record_size;
+    uint32_t depth;
+    uint32_t head;          /* records written since Flash_Trace_Init, free running */
+    uint32_t clock_hz;      /* cycle counter frequency */
+    Flash_Trace_Record_t records[FLASH_TRACE_DEPTH];
+}Flash_Trace_t;
+
+#ifdef FLASH_TRACE_ENABLE
+
+extern Flash_Trace_t Flash_Trace;
+
+void Flash_Trace_Init(void);
+
+#define FLASH_TRACE_BEGIN()     (DWT->CYCCNT)
+
+__STATIC_FORCEINLINE void Flash_Trace_End(uint32_t start, uint32_t address, uint32_t info)
+{
+    uint32_t now = DWT->CYCCNT;
+    uint32_t primask = __get_PRIMASK();
+    Flash_Trace_Record_t *rec;
+
+    __disable_irq();
+    rec = &Flash_Trace.records[Flash_Trace.head++ & (FLASH_TRACE_DEPTH - 1U)];
+    __set_PRIMASK(primask);
+
+    rec->start = start;
+    rec->cycles = now - start;
+    rec->address = address;
+    rec->info = info;
+}
+
+#define FLASH_TRACE_END(start, op, address, len, result) \
+    Flash_Trace_End((start), (address), FLASH_TRACE_INFO((op), (len), (result)))
+
+#else
+
+#define Flash_Trace_Init()                                  do{ }while(0)
+#define FLASH_TRACE_BEGIN()                                 (0U)
+#define FLASH_TRACE_END(start, op, address, len, result)    do{ (void)(start); }while(0)
+
+#endif /* FLASH_TRACE_ENABLE */
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_TRACE_H__ */
@@ -0,0 +1,94 @@
+/**
+  ******************************************************************************
+  * @file    flash_ts.h
+  * @brief   This file contains all the function prototypes for
+  *          the flash_ts.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_TS_H__
+#define __FLASH_TS_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HOST_BUILD
+#include <stdint.h>
+#else
+#include "main.h"
+#endif
+#include "flash_geometry.h"
+#include "flash_stream.h"
+
+#ifndef FLASH_TS_MAX_SECTORS
+#define FLASH_TS_MAX_SECTORS    FLASH_GEO_SECTORS_PER_BANK
+#endif
+
+typedef struct{
+    uint32_t time;          /* non-decreasing; 0xFFFFFFFF marks an unused slot */
+    int32_t value;
+}Flash_TS_Sample_t;
+
+#define FLASH_TS_PER_FLASHWORD  (FLASH_GEO_FLASHWORD_SIZE / sizeof(Flash_TS_Sample_t))
+/* Flashword 0 of a sector is its header, the last one its summary */
+#define FLASH_TS_DATA_WORDS     (FLASH_GEO_WORDS_PER_SECTOR - 2U)
+#define FLASH_TS_PER_SECTOR     (FLASH_TS_DATA_WORDS * FLASH_TS_PER_FLASHWORD)
+
+/* Programmed when a sector seals; the open sector keeps its copy in RAM */
+typedef struct{
+    uint32_t magic;
+    uint32_t first;         /* time of the first sample */
+    uint32_t last;          /* time of the last sample */
+    uint32_t count;
+    int32_t min;
+    int32_t max;
+    int64_t sum;
+}Flash_TS_Summary_t;
+
+typedef struct{
+    uint32_t count;
+    int32_t min;
+    int32_t max;
+    int64_t sum;
+    uint32_t flashwords;    /* data flashwords read to answer */
+    uint32_t summaries;     /* sectors answered from their summary alone */
+}Flash_TS_Result_t;
+
+typedef struct{
+    const Flash_Stream_Backend_t *backend;
+    uint32_t base;
+    uint32_t nb_sectors;
+    uint32_t status;
+    uint32_t oldest;        /* ring index of the oldest sector holding data */
+    uint32_t used;          /* sectors holding data, the open one included */
+    uint32_t sequence;      /* of the open sector */
+    uint32_t fill;          /* data flashwords programmed in the open sector */
+    uint32_t pending;       /* samples in batch[] */
+    Flash_TS_Summary_t summary[FLASH_TS_MAX_SECTORS];
+    Flash_TS_Sample_t batch[FLASH_TS_PER_FLASHWORD];
+}Flash_TS_t;
+
+/* Mounts the ring in [FlashAddress, FlashAddress + NbOfSectors sectors),
+   sealing a sector that lost power between its last sample and its summary */
+uint32_t Flash_TS_Init(Flash_TS_t *ts, const Flash_Stream_Backend_t *backend, uint32_t FlashAddress, uint32_t NbOfSectors);
+uint32_t Flash_TS_Append(Flash_TS_t *ts, uint32_t Time, int32_t Value);
+/* Programs a partial batch now; its unused slots are skipped by readers */
+uint32_t Flash_TS_Flush(Flash_TS_t *ts);
+/* Aggregates every sample with First <= time <= Last */
+uint32_t Flash_TS_Query(Flash_TS_t *ts, uint32_t First, uint32_t Last, Flash_TS_Result_t *result);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_TS_H__ */
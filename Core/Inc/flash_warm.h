@@ -0,0 +1,90 @@
+/**
+  ******************************************************************************
+  * @file    flash_warm.h
+  * @brief   This file contains all the function prototypes for
+  *          the flash_warm.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_WARM_H__
+#define __FLASH_WARM_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HOST_BUILD
+#include <stdint.h>
+#define FLASH_WARM
+#else
+#include "main.h"
+/* RAM the startup code leaves alone (.noinit in the linker scripts) */
+#define FLASH_WARM              __attribute__((section(".noinit")))
+#endif
+
+#ifndef FLASH_WARM_MAX_REGIONS
+#define FLASH_WARM_MAX_REGIONS  8U
+#endif
+
+/* Changes whenever a rebuild may lay the regions out differently; the
+   default hashes the time flash_warm.c was compiled, so a build that
+   changes the regions must rebuild it too. Release builds can define it
+   to the image CRC instead. Evaluated once in Flash_Warm_Begin. */
+#ifndef FLASH_WARM_BUILD_ID
+#define FLASH_WARM_BUILD_ID     Flash_Warm_Check(__DATE__ " " __TIME__, sizeof(__DATE__ " " __TIME__))
+#endif
+
+typedef struct{
+    uint32_t address;
+    uint32_t size;
+    uint32_t check;
+}Flash_Warm_Region_t;
+
+/* Written by Flash_Warm_Save just before a planned reset, cleared by
+   Flash_Warm_Begin on every boot: only a reset that went through
+   Flash_Warm_Save finds it valid */
+typedef struct{
+    uint32_t magic;
+    uint32_t generation;    /* warm restarts since the last cold boot */
+    uint32_t build;
+    uint32_t count;
+    Flash_Warm_Region_t region[FLASH_WARM_MAX_REGIONS];
+    uint32_t commit;        /* equals generation once the save is complete */
+}Flash_Warm_Record_t;
+
+/* Early in main, before any Flash_Warm_Attach */
+void Flash_Warm_Begin(void);
+/* Registers state kept in FLASH_WARM memory, in the same order on every
+   boot. Returns 1 when it comes through a warm restart intact and can be
+   used as is, 0 when it has to be rebuilt from flash. */
+uint32_t Flash_Warm_Attach(void *state, uint32_t Size);
+/* Seals the attached regions; the next boot trusts them only if nothing
+   changes them, or the flash behind them, before the reset */
+void Flash_Warm_Save(void);
+uint32_t Flash_Warm_Generation(void);
+
+#ifndef HOST_BUILD
+/* Flash_Warm_Save then NVIC system reset; thread context only, with no
+   index update under way */
+void Flash_Warm_Restart(void) __attribute__((noreturn));
+/* Asks for a warm restart; safe from interrupts, which may have cut an
+   index update in half and so must not save themselves */
+void Flash_Warm_Request(void);
+/* Restarts if one was requested; call it where the indexes are consistent */
+void Flash_Warm_Poll(void);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_WARM_H__ */
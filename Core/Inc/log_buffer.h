@@ -0,0 +1,82 @@
+/**
+  ******************************************************************************
+  * @file    log_buffer.h
+  * @brief   This file contains all the function prototypes for
+  *          the log_buffer.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __LOG_BUFFER_H__
+#define __LOG_BUFFER_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HOST_BUILD
+#include <stdint.h>
+#else
+#include "main.h"
+#endif
+
+/* Drain backends */
+#define LOG_BACKEND_ITM         0   /* ITM stimulus port, drained from Log_Buffer_Drain() */
+#define LOG_BACKEND_UART_DMA    1   /* Log_Transport_Start() + Log_Buffer_DrainComplete() */
+#define LOG_BACKEND_HOST        2   /* stdout, for host builds */
+
+/* Overflow policies */
+#define LOG_OVERFLOW_DROP       0   /* discard what does not fit and count it */
+#define LOG_OVERFLOW_BLOCK      1   /* drain until everything fits (thread mode only);
+                                       drops when no transport takes data */
+
+#ifndef LOG_BACKEND
+#ifdef HOST_BUILD
+#define LOG_BACKEND             LOG_BACKEND_HOST
+#else
+#define LOG_BACKEND             LOG_BACKEND_ITM
+#endif
+#endif
+
+#ifndef LOG_BUFFER_SIZE
+#define LOG_BUFFER_SIZE         1024U   /* must be a power of two */
+#endif
+
+#ifndef LOG_OVERFLOW_POLICY
+#define LOG_OVERFLOW_POLICY     LOG_OVERFLOW_DROP
+#endif
+
+#ifndef LOG_ITM_PORT
+#define LOG_ITM_PORT            0U
+#endif
+
+typedef struct{
+    uint32_t written;       /* bytes accepted into the ring */
+    uint32_t dropped;       /* bytes discarded by the overflow policy */
+    uint32_t drained;       /* bytes handed to the backend */
+    uint32_t high_water;    /* maximum ring fill level seen */
+}Log_Stats_t;
+
+void Log_Buffer_Init(void);
+uint32_t Log_Buffer_Write(const char *ptr, uint32_t len);
+void Log_Buffer_Drain(void);
+void Log_Buffer_DrainComplete(uint32_t len);
+void Log_Buffer_GetStats(Log_Stats_t *stats);
+
+/* Provided by the board layer when LOG_BACKEND == LOG_BACKEND_UART_DMA,
+   e.g. with HAL_UART_Transmit_DMA(). Return 0 when the transfer started. */
+int32_t Log_Transport_Start(const uint8_t *buf, uint32_t len);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __LOG_BUFFER_H__ */
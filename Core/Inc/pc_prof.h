@@ -0,0 +1,114 @@
+/**
+  ******************************************************************************
+  * @file    pc_prof.h
+  * @brief   This file contains all the function prototypes for
+  *          the pc_prof.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __PC_PROF_H__
+#define __PC_PROF_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifdef HOST_BUILD
+#include <stdint.h>
+#else
+#include "main.h"
+#endif
+
+#define PC_PROF_MAGIC           0x464F5250U     /* "PROF" in memory */
+#define PC_PROF_VERSION         2U
+
+/* Code covered by the histogram; samples elsewhere (RAM code, system
+   memory) are only counted */
+#ifndef PC_PROF_BASE
+#define PC_PROF_BASE            0x08100000U     /* this image, bank2 */
+#endif
+#ifndef PC_PROF_SIZE
+#define PC_PROF_SIZE            0x00020000U
+#endif
+#ifndef PC_PROF_SHIFT
+#define PC_PROF_SHIFT           5U              /* 32-byte buckets: one ART line */
+#endif
+#define PC_PROF_BUCKETS         (PC_PROF_SIZE >> PC_PROF_SHIFT)
+
+/* Rate main.c samples at, rounded down to a multiple of the HAL tick.
+   Work that runs in step with the tick is over- or under-sampled. Code
+   running with interrupts masked cannot be sampled at all: that includes
+   every flash program and erase wait (flash_bank.h), so a 1 s erase is
+   one late sample. Ticks held off like this are counted in masked, from
+   the cycle counter, but not attributed to any code. */
+#ifndef PC_PROF_RATE_HZ
+#define PC_PROF_RATE_HZ         10000U
+#endif
+
+#ifdef PC_PROF_LR
+#define PC_PROF_HISTOGRAMS      2U
+#else
+#define PC_PROF_HISTOGRAMS      1U
+#endif
+
+/* The RAM image is the dump format: read it out with the debugger, e.g.
+   dump binary memory prof.bin &Pc_Prof (char *)&Pc_Prof + sizeof(Pc_Prof) */
+typedef struct{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t histograms;    /* 1: pc[], 2: pc[] then lr[] */
+    uint32_t base;
+    uint32_t shift;         /* bucket size is 1 << shift bytes */
+    uint32_t buckets;       /* per histogram */
+    uint32_t rate_hz;       /* samples per second, 0 while stopped */
+    uint32_t samples;
+    uint32_t outside;       /* PC not in [base, base + (buckets << shift)) */
+    uint32_t masked;        /* ticks lost while SysTick was held off, not in samples */
+    uint32_t pc[PC_PROF_BUCKETS];
+#ifdef PC_PROF_LR
+    uint32_t lr[PC_PROF_BUCKETS];   /* stacked LR: where a leaf returns to */
+#endif
+}Pc_Prof_t;
+
+#ifdef PC_PROF_ENABLE
+
+extern Pc_Prof_t Pc_Prof;
+
+/* SysTick runs at RateHz, rounded down to a multiple of the HAL tick
+   rate; the HAL tick keeps its rate. Start clears the histogram. */
+void Pc_Prof_Start(uint32_t RateHz);
+void Pc_Prof_Stop(void);
+/* Called by PC_PROF_ENTRY with the stacked exception frame */
+void Pc_Prof_Tick(const uint32_t *frame);
+
+/* Body of a naked SysTick_Handler: the frame is taken from the stack that
+   was active, and Pc_Prof_Tick returns straight from the exception */
+#define PC_PROF_ENTRY() \
+    __asm volatile(                                         \
+        "tst   lr, #4                   \n"                 \
+        "ite   eq                       \n"                 \
+        "mrseq r0, msp                  \n"                 \
+        "mrsne r0, psp                  \n"                 \
+        "b     Pc_Prof_Tick             \n")
+
+#else
+
+#define Pc_Prof_Start(RateHz)   do{ (void)(RateHz); }while(0)
+#define Pc_Prof_Stop()          do{ }while(0)
+
+#endif /* PC_PROF_ENABLE */
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __PC_PROF_H__ */
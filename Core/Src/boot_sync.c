@@ -0,0 +1,162 @@
+/**
+  ******************************************************************************
+  * @file    boot_sync.c
+  * @brief   This file provides the dual-core boot handshake. Instead of
+             parking the CM4 in D2 STOP mode until the CM7 has finished,
+             both cores start at once: the CM4 brings up everything that
+             only needs its own core (flash ECC reporting, RAM indexes
+             scanned from flash) while the CM7 sets up clocks and memories,
+             and waits on the CLOCKS semaphore only before the first step
+             that needs them. Each core keeps its times in cycles of its own
+             DWT counter, converted with the clock of the phase they were
+             spent in.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <string.h>
+#include "boot_sync.h"
+
+#if defined(CORE_CM7)
+#define BOOT_SYNC_SELF              BOOT_SYNC_CM7
+#define BOOT_SYNC_HSEM_SELF_READY   BOOT_SYNC_HSEM_CM7_READY
+#define BOOT_SYNC_HSEM_PEER_READY   BOOT_SYNC_HSEM_CM4_READY
+#define BOOT_SYNC_WAITED            __HAL_HSEM_SEMID_TO_MASK(BOOT_SYNC_HSEM_PEER_READY)
+#else
+#define BOOT_SYNC_SELF              BOOT_SYNC_CM4
+#define BOOT_SYNC_HSEM_SELF_READY   BOOT_SYNC_HSEM_CM4_READY
+#define BOOT_SYNC_HSEM_PEER_READY   BOOT_SYNC_HSEM_CM7_READY
+#define BOOT_SYNC_WAITED            (__HAL_HSEM_SEMID_TO_MASK(BOOT_SYNC_HSEM_PEER_READY) | \
+                                     __HAL_HSEM_SEMID_TO_MASK(BOOT_SYNC_HSEM_CLOCKS))
+#endif
+
+#define BOOT_SYNC_RECORD            ((Boot_Sync_Record_t *)BOOT_SYNC_RECORD_ADDR)
+#define BOOT_SYNC_PEER              (BOOT_SYNC_CORES - 1U - BOOT_SYNC_SELF)
+
+/* The CM7 cleans and invalidates only its own and only the peer's line */
+_Static_assert(sizeof(Boot_Sync_Core_t) == 32U, "one cache line per core");
+_Static_assert((BOOT_SYNC_RECORD_ADDR & 31U) == 0U, "record must be cache line aligned");
+
+static uint32_t boot_cycles;        /* DWT count up to boot_us */
+static uint32_t boot_us;
+static uint32_t boot_hz;            /* core clock of the phase since boot_cycles */
+static uint32_t boot_peer_ready;
+
+static uint32_t Boot_Sync_Now(void);
+static void Boot_Sync_Publish(uint32_t Semaphore);
+
+void Boot_Sync_Begin(void)
+{
+    SET_BIT(CoreDebug->DEMCR, CoreDebug_DEMCR_TRCENA_Msk);
+    SET_BIT(DWT->CTRL, DWT_CTRL_CYCCNTENA_Msk);
+    boot_cycles = DWT->CYCCNT;
+    boot_us = 0;
+    boot_hz = SystemCoreClock;
+    boot_peer_ready = 0;
+
+    /* SRAM4 keeps the previous boot's times across a reset */
+    memset(&BOOT_SYNC_RECORD->core[BOOT_SYNC_SELF], 0, sizeof(Boot_Sync_Core_t));
+
+    /* Only the notification flags are used, the HSEM interrupt stays off
+       in the NVIC. The flags latch, so a release that happens before this
+       core looks is not missed; the CM7 needs far longer for its clock
+       setup than this takes. */
+    __HAL_RCC_HSEM_CLK_ENABLE();
+    __HAL_HSEM_CLEAR_FLAG(BOOT_SYNC_WAITED);
+    HAL_HSEM_ActivateNotification(BOOT_SYNC_WAITED);
+}
+
+void Boot_Sync_Mark(uint32_t Mark)
+{
+    BOOT_SYNC_RECORD->core[BOOT_SYNC_SELF].us[Mark] = Boot_Sync_Now();
+}
+
+#if defined(CORE_CM7)
+void Boot_Sync_ReleaseClocks(void)
+{
+    Boot_Sync_Mark(BOOT_SYNC_CLOCKS);
+    Boot_Sync_Publish(BOOT_SYNC_HSEM_CLOCKS);
+}
+#else
+uint32_t Boot_Sync_WaitClocks(uint32_t Timeout)
+{
+    uint32_t start = Boot_Sync_Now();
+    uint32_t now = start;
+
+    /* The CM7 switches this core's clock during the wait: sample it on
+       every pass so the time stays right across the switch */
+    while(__HAL_HSEM_GET_FLAG(__HAL_HSEM_SEMID_TO_MASK(BOOT_SYNC_HSEM_CLOCKS)) == 0U){
+        SystemCoreClockUpdate();
+        now = Boot_Sync_Now();
+        if((now - start) >= (Timeout * 1000U)){
+            BOOT_SYNC_RECORD->core[BOOT_SYNC_SELF].waited_us = now - start;
+            return 1U;
+        }
+    }
+    __HAL_HSEM_CLEAR_FLAG(__HAL_HSEM_SEMID_TO_MASK(BOOT_SYNC_HSEM_CLOCKS));
+    SystemCoreClockUpdate();
+    BOOT_SYNC_RECORD->core[BOOT_SYNC_SELF].waited_us = Boot_Sync_Now() - start;
+    Boot_Sync_Mark(BOOT_SYNC_CLOCKS);
+
+    /* HAL_Init started the tick from the reset clock */
+    if(HAL_InitTick(uwTickPrio) != HAL_OK){
+        return 1U;
+    }
+    return 0U;
+}
+#endif
+
+void Boot_Sync_Ready(void)
+{
+    Boot_Sync_Mark(BOOT_SYNC_READY);
+    Boot_Sync_Publish(BOOT_SYNC_HSEM_SELF_READY);
+}
+
+uint32_t Boot_Sync_Report(Boot_Sync_Record_t *report)
+{
+    if(boot_peer_ready == 0U){
+        if(__HAL_HSEM_GET_FLAG(__HAL_HSEM_SEMID_TO_MASK(BOOT_SYNC_HSEM_PEER_READY)) == 0U){
+            return 1U;
+        }
+        __HAL_HSEM_CLEAR_FLAG(__HAL_HSEM_SEMID_TO_MASK(BOOT_SYNC_HSEM_PEER_READY));
+        boot_peer_ready = 1;
+    }
+#if defined(CORE_CM7)
+    SCB_InvalidateDCache_by_Addr((uint32_t *)&BOOT_SYNC_RECORD->core[BOOT_SYNC_PEER], sizeof(Boot_Sync_Core_t));
+#endif
+    memcpy(report, BOOT_SYNC_RECORD, sizeof(*report));
+    return 0U;
+}
+
+/* Microseconds since Boot_Sync_Begin */
+static uint32_t Boot_Sync_Now(void)
+{
+    uint32_t per_us = boot_hz / 1000000U;
+    uint32_t elapsed = (DWT->CYCCNT - boot_cycles) / per_us;
+
+    boot_cycles += elapsed * per_us;
+    boot_us += elapsed;
+    boot_hz = SystemCoreClock;
+    return boot_us;
+}
+
+/* Record visible to the other core before the semaphore frees */
+static void Boot_Sync_Publish(uint32_t Semaphore)
+{
+#if defined(CORE_CM7)
+    SCB_CleanDCache_by_Addr((uint32_t *)&BOOT_SYNC_RECORD->core[BOOT_SYNC_SELF], sizeof(Boot_Sync_Core_t));
+#endif
+    __DSB();
+    if(HAL_HSEM_FastTake(Semaphore) == HAL_OK){
+        HAL_HSEM_Release(Semaphore, 0);
+    }
+}
@@ -0,0 +1,377 @@
+/**
+  ******************************************************************************
+  * @file    flash_ab.c
+  * @brief   This file provides a dual-bank A/B firmware update. The new
+             image streams into the bank this core does not run from, is
+             verified against its CRC, and the SWAP_BANK option bit then maps
+             it at the boot address: no copy, one reset of downtime. A new
+             image runs on trial until it calls Flash_AB_Confirm; if it
+             resets before that (watchdog, crash), the next boot swaps back.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+/* Dual-core builds share the flash with the CM7 image (see flash_ab.h) */
+#ifndef BOOT_SYNC_DUAL_CORE
+
+#include <string.h>
+#include "flash_ab.h"
+#include "flash_if.h"
+#include "flash_bank.h"
+#include "flash_safe.h"
+
+#define FLASH_AB_RECORD_MAGIC   0x41424657U     /* "WFBA" */
+#define FLASH_AB_TRIAL_MAGIC    0x54524941U
+#define FLASH_AB_CONFIRM_MAGIC  0x434F4E46U
+
+#define FLASH_AB_RECORD(slot)   ((slot) + FLASH_GEO_BANK_SIZE - FLASH_AB_STATE_SIZE)
+#define FLASH_AB_TRIAL(slot)    (FLASH_AB_RECORD(slot) + FLASH_GEO_FLASHWORD_SIZE)
+#define FLASH_AB_CONFIRM(slot)  (FLASH_AB_TRIAL(slot) + FLASH_GEO_FLASHWORD_SIZE)
+/* Signed images: the manifest starts at the flashword after the image */
+#define FLASH_AB_MANIFEST(slot, size) \
+    ((slot) + (((size) + FLASH_GEO_FLASHWORD_SIZE - 1U) & ~(FLASH_GEO_FLASHWORD_SIZE - 1U)))
+#define FLASH_AB_SIGNED_MAX     (FLASH_AB_IMAGE_MAX - sizeof(Flash_Sha_Manifest_t))
+
+#define FLASH_AB_CHUNK          256U
+
+_Static_assert(sizeof(Flash_AB_Record_t) == FLASH_GEO_FLASHWORD_SIZE, "record is one flashword");
+_Static_assert((FLASH_AB_IMAGE_MAX != 0U) && (FLASH_AB_IMAGE_MAX <= (FLASH_GEO_BANK_SIZE - (2U * FLASH_GEO_SECTOR_SIZE))),
+               "dump sector leaves room for an image and stays out of the state sector");
+_Static_assert((sizeof(Flash_Sha_Manifest_t) % FLASH_GEO_FLASHWORD_SIZE) == 0U, "manifest is whole flashwords");
+
+static uint32_t Flash_AB_Prepare(uint32_t Resume);
+static uint32_t Flash_AB_Seal(uint32_t Size, uint32_t Crc);
+static uint32_t Flash_AB_Record(uint32_t Size, uint32_t Crc);
+static uint32_t Flash_AB_Mark(uint32_t FlashAddress, uint32_t Magic);
+static uint32_t Flash_AB_IsMark(uint32_t FlashAddress, uint32_t Magic);
+static uint32_t Flash_AB_ImageCrc(uint32_t SlotAddress, uint32_t Size, uint32_t *Crc);
+static uint32_t Flash_AB_ImageHash(uint32_t SlotAddress, uint32_t Size, Flash_Sha_Image_t *image);
+
+uint32_t Flash_AB_SlotState(uint32_t SlotAddress, Flash_AB_Record_t *record)
+{
+    uint32_t vector;
+    uint32_t fail;
+
+    if((Flash_Safe_Read(record, FLASH_AB_RECORD(SlotAddress), sizeof(*record), &fail) != FLASH_OK) ||
+       (record->magic != FLASH_AB_RECORD_MAGIC)){
+        /* No record: an initial stack pointer is as much as can be checked */
+        if((Flash_Safe_Read(&vector, SlotAddress, sizeof(vector), &fail) == FLASH_OK) && (vector != 0xFFFFFFFFU)){
+            return FLASH_AB_LEGACY;
+        }
+        return FLASH_AB_EMPTY;
+    }
+    if(Flash_AB_IsMark(FLASH_AB_CONFIRM(SlotAddress), FLASH_AB_CONFIRM_MAGIC)){
+        return FLASH_AB_CONFIRMED;
+    }
+    if(Flash_AB_IsMark(FLASH_AB_TRIAL(SlotAddress), FLASH_AB_TRIAL_MAGIC)){
+        return FLASH_AB_TRIAL;
+    }
+    return FLASH_AB_PENDING;
+}
+
+uint32_t Flash_AB_Boot(void)
+{
+    Flash_AB_Record_t record;
+    uint32_t state = Flash_AB_SlotState(FLASH_AB_RUN_BASE, &record);
+
+    if(state == FLASH_AB_PENDING){
+        /* First boot of a new image: from here a reset without
+           Flash_AB_Confirm counts as a failed health check */
+        if(Flash_AB_Mark(FLASH_AB_TRIAL(FLASH_AB_RUN_BASE), FLASH_AB_TRIAL_MAGIC) != FLASH_OK){
+            return state;
+        }
+        return FLASH_AB_TRIAL;
+    }
+    if(state == FLASH_AB_TRIAL){
+        /* Does not return if the previous image is still there */
+        Flash_AB_Rollback();
+    }
+    return state;
+}
+
+uint32_t Flash_AB_Confirm(void)
+{
+    Flash_AB_Record_t record;
+
+    if(Flash_AB_SlotState(FLASH_AB_RUN_BASE, &record) != FLASH_AB_TRIAL){
+        return FLASH_OK;
+    }
+    return Flash_AB_Mark(FLASH_AB_CONFIRM(FLASH_AB_RUN_BASE), FLASH_AB_CONFIRM_MAGIC);
+}
+
+uint32_t Flash_AB_Rollback(void)
+{
+    Flash_AB_Record_t record;
+    uint32_t state = Flash_AB_SlotState(FLASH_AB_SPARE_BASE, &record);
+
+    /* A spare without a record is only trusted as the image a trial just
+       replaced: outside a trial it may be an interrupted update */
+    if((state != FLASH_AB_CONFIRMED) &&
+       ((state != FLASH_AB_LEGACY) || (Flash_AB_SlotState(FLASH_AB_RUN_BASE, &record) != FLASH_AB_TRIAL))){
+        return FLASH_ERROR;
+    }
+    /* Does not return once the swap is programmed */
+    return Flash_AB_Activate();
+}
+
+uint32_t Flash_AB_Begin(Flash_Stream_t *stream, uint32_t Resume)
+{
+    if(Flash_AB_Prepare(Resume) != FLASH_OK){
+        return FLASH_ERROR;
+    }
+    /* The slot state flashwords after the image are not the stream's */
+    return Flash_Stream_Init(stream, &Flash_Stream_TargetBackend, FLASH_AB_SPARE_BASE, FLASH_AB_IMAGE_MAX, Resume);
+}
+
+uint32_t Flash_AB_Finish(Flash_Stream_t *stream, uint32_t Size, uint32_t Crc)
+{
+    if((stream->status != FLASH_OK) || !Flash_Stream_Idle(stream) || (stream->written != Size)){
+        return FLASH_ERROR;
+    }
+    return Flash_AB_Seal(Size, Crc);
+}
+
+uint32_t Flash_AB_BeginDelta(Flash_Delta_t *delta)
+{
+    if(Flash_AB_Prepare(0) != FLASH_OK){
+        return FLASH_ERROR;
+    }
+    return Flash_Delta_Init(delta, &Flash_Stream_TargetBackend, FLASH_AB_RUN_BASE, FLASH_AB_SPARE_BASE, FLASH_AB_IMAGE_MAX);
+}
+
+uint32_t Flash_AB_FinishDelta(Flash_Delta_t *delta)
+{
+    if(Flash_Delta_Finish(delta) != FLASH_OK){
+        return FLASH_ERROR;
+    }
+    return Flash_AB_Seal(delta->header.new_size, delta->header.new_crc);
+}
+
+uint32_t Flash_AB_BeginSigned(Flash_Stream_t *stream, Flash_Sha_Image_t *image, uint32_t Resume)
+{
+    if(Flash_AB_Begin(stream, Resume) != FLASH_OK){
+        return FLASH_ERROR;
+    }
+    /* A resumed transfer hashes what the previous one already wrote; only
+       that part is read back */
+    Flash_Sha_ImageInit(image);
+    if(Flash_AB_ImageHash(FLASH_AB_SPARE_BASE, stream->written, image) != FLASH_OK){
+        return FLASH_ERROR;
+    }
+    stream->hook = Flash_Sha_StreamHook;
+    stream->hook_context = image;
+    return FLASH_OK;
+}
+
+uint32_t Flash_AB_FinishSigned(Flash_Stream_t *stream, Flash_Sha_Image_t *image, const Flash_Sha_Manifest_t *manifest,
+                               const uint8_t *key, uint32_t KeyLength)
+{
+    uint8_t digest[FLASH_SHA_DIGEST_SIZE];
+    uint32_t address = FLASH_AB_MANIFEST(FLASH_AB_SPARE_BASE, manifest->size);
+    uint32_t last;
+
+    if((stream->status != FLASH_OK) || !Flash_Stream_Idle(stream) || (stream->written != manifest->size) ||
+       (image->size != manifest->size) || (manifest->size == 0U) || (manifest->size > FLASH_AB_SIGNED_MAX)){
+        return FLASH_ERROR;
+    }
+    Flash_Sha_ImageFinal(image, digest);
+    if(Flash_Sha_ManifestCheck(manifest, key, KeyLength, digest) != FLASH_OK){
+        return FLASH_ERROR;
+    }
+
+    /* An image ending at or just before a sector boundary leaves (part of)
+       the manifest in a sector the stream never erased */
+    last = address + sizeof(*manifest) - 1U;
+    if((last - FLASH_AB_SPARE_BASE) >= stream->erased){
+        if(Flash_Sector_Erase(FLASH_GEO_BANK(last), FLASH_GEO_SECTOR(last), 1) != FLASH_OK){
+            return FLASH_ERROR;
+        }
+    }
+    if(Flash_Program(address, (uint32_t)manifest, sizeof(*manifest) / FLASH_GEO_FLASHWORD_SIZE) != FLASH_OK){
+        return FLASH_ERROR;
+    }
+    return Flash_AB_Record(manifest->size, 0);
+}
+
+uint32_t Flash_AB_Verify(Flash_Sha_Cache_t *cache, const uint8_t *key, uint32_t KeyLength)
+{
+    Flash_Sha_Manifest_t manifest;
+    Flash_AB_Record_t record;
+    uint8_t digest[FLASH_SHA_DIGEST_SIZE];
+    uint32_t state = Flash_AB_SlotState(FLASH_AB_RUN_BASE, &record);
+    uint32_t fail;
+
+    if((state == FLASH_AB_EMPTY) || (state == FLASH_AB_LEGACY) || (record.size == 0U) ||
+       (record.size > FLASH_AB_SIGNED_MAX) ||
+       (Flash_Safe_Read(&manifest, FLASH_AB_MANIFEST(FLASH_AB_RUN_BASE, record.size), sizeof(manifest), &fail) != FLASH_OK) ||
+       (manifest.size != record.size)){
+        return FLASH_ERROR;
+    }
+    if(Flash_Sha_ImageCompute(&Flash_Crc_TargetBackend, FLASH_AB_RUN_BASE, record.size, cache, digest) != FLASH_OK){
+        return FLASH_ERROR;
+    }
+    return Flash_Sha_ManifestCheck(&manifest, key, KeyLength, digest);
+}
+
+uint32_t Flash_AB_Activate(void)
+{
+    uint32_t primask = __get_PRIMASK();
+    uint32_t count = 0;
+
+    __disable_irq();
+
+    /* Option bytes must not change under a program or erase on either bank */
+    while((READ_BIT(FLASH_BANK_REGS(FLASH_BANK_1)->SR, (FLASH_SR_QW | FLASH_SR_BSY)) != 0U) ||
+          (READ_BIT(FLASH_BANK_REGS(FLASH_BANK_2)->SR, (FLASH_SR_QW | FLASH_SR_BSY)) != 0U)){
+        if(count++ > FLASH_BANK_TIMEOUT){
+            __set_PRIMASK(primask);
+            return FLASH_TIMEOUT;
+        }
+    }
+
+    WRITE_REG(FLASH->OPTKEYR, FLASH_OPT_KEY1);
+    WRITE_REG(FLASH->OPTKEYR, FLASH_OPT_KEY2);
+
+    /* A failed earlier change would make this one look failed as well */
+    if(READ_BIT(FLASH->OPTSR_CUR, FLASH_OPTSR_OPTCHANGEERR) != 0U){
+        WRITE_REG(FLASH->OPTCCR, FLASH_OPTCCR_CLR_OPTCHANGEERR);
+    }
+
+    /* SWAP_BANK takes effect at the next reset: both slots trade addresses */
+    FLASH->OPTSR_PRG ^= FLASH_OPTSR_SWAP_BANK_OPT;
+    SET_BIT(FLASH->OPTCR, FLASH_OPTCR_OPTSTART);
+    count = 0;
+    while(READ_BIT(FLASH->OPTSR_CUR, FLASH_OPTSR_OPT_BUSY) != 0U){
+        if(count++ > FLASH_BANK_TIMEOUT){
+            break;
+        }
+    }
+    if((READ_BIT(FLASH->OPTSR_CUR, (FLASH_OPTSR_OPT_BUSY | FLASH_OPTSR_OPTCHANGEERR)) != 0U) ||
+       (((FLASH->OPTSR_CUR ^ FLASH->OPTSR_PRG) & FLASH_OPTSR_SWAP_BANK_OPT) != 0U)){
+        /* The running image stays current: resetting now would boot the
+           same slot, or one the option bytes only half describe */
+        SET_BIT(FLASH->OPTCR, FLASH_OPTCR_OPTLOCK);
+        __set_PRIMASK(primask);
+        return FLASH_ERROR;
+    }
+    SET_BIT(FLASH->OPTCR, FLASH_OPTCR_OPTLOCK);
+
+    NVIC_SystemReset();
+    return FLASH_OK;
+}
+
+static uint32_t Flash_AB_Prepare(uint32_t Resume)
+{
+    Flash_AB_Record_t record;
+    uint32_t state;
+
+    /* The spare slot is the rollback image until the running one is confirmed */
+    state = Flash_AB_SlotState(FLASH_AB_RUN_BASE, &record);
+    if((state == FLASH_AB_PENDING) || (state == FLASH_AB_TRIAL)){
+        return FLASH_ERROR;
+    }
+
+    state = Flash_AB_SlotState(FLASH_AB_SPARE_BASE, &record);
+    if((state == FLASH_AB_PENDING) || (state == FLASH_AB_TRIAL) || (state == FLASH_AB_CONFIRMED)){
+        if(Resume != 0U){
+            return FLASH_ERROR;     /* the spare slot holds a finished image, not a partial one */
+        }
+        /* Invalidate the old image before its first byte is overwritten */
+        if(Flash_Sector_Erase(FLASH_GEO_BANK(FLASH_AB_SPARE_BASE), FLASH_GEO_SECTORS_PER_BANK - 1U, 1) != FLASH_OK){
+            return FLASH_ERROR;
+        }
+    }
+    return FLASH_OK;
+}
+
+static uint32_t Flash_AB_Seal(uint32_t Size, uint32_t Crc)
+{
+    uint32_t crc;
+
+    if((Size == 0U) || (Size > FLASH_AB_IMAGE_MAX)){
+        return FLASH_ERROR;
+    }
+
+    /* Transfer checks cover the link; this covers the image as flash holds it */
+    if((Flash_AB_ImageCrc(FLASH_AB_SPARE_BASE, Size, &crc) != FLASH_OK) || (crc != Crc)){
+        return FLASH_ERROR;
+    }
+    return Flash_AB_Record(Size, Crc);
+}
+
+static uint32_t Flash_AB_Record(uint32_t Size, uint32_t Crc)
+{
+    Flash_AB_Record_t record;
+
+    memset(&record, 0xFF, sizeof(record));
+    record.magic = FLASH_AB_RECORD_MAGIC;
+    record.size = Size;
+    record.crc = Crc;
+    return Flash_Program(FLASH_AB_RECORD(FLASH_AB_SPARE_BASE), (uint32_t)&record, 1);
+}
+
+static uint32_t Flash_AB_Mark(uint32_t FlashAddress, uint32_t Magic)
+{
+    uint32_t mark[FLASH_NB_32BITWORD_IN_FLASHWORD];
+    uint32_t index;
+
+    for(index = 0; index < FLASH_NB_32BITWORD_IN_FLASHWORD; index++){
+        mark[index] = Magic;
+    }
+    return Flash_Program(FlashAddress, (uint32_t)mark, 1);
+}
+
+static uint32_t Flash_AB_IsMark(uint32_t FlashAddress, uint32_t Magic)
+{
+    uint32_t mark;
+    uint32_t fail;
+
+    return (Flash_Safe_Read(&mark, FlashAddress, sizeof(mark), &fail) == FLASH_OK) && (mark == Magic);
+}
+
+static uint32_t Flash_AB_ImageCrc(uint32_t SlotAddress, uint32_t Size, uint32_t *Crc)
+{
+    uint8_t chunk[FLASH_AB_CHUNK];
+    uint32_t offset;
+    uint32_t length;
+    uint32_t fail;
+    uint32_t crc = 0;
+
+    for(offset = 0; offset < Size; offset += length){
+        length = ((Size - offset) < FLASH_AB_CHUNK) ? (Size - offset) : FLASH_AB_CHUNK;
+        if(Flash_Safe_Read(chunk, SlotAddress + offset, length, &fail) != FLASH_OK){
+            return FLASH_ERROR;
+        }
+        crc = Flash_Stream_Crc(crc, chunk, length);
+    }
+    *Crc = crc;
+    return FLASH_OK;
+}
+
+static uint32_t Flash_AB_ImageHash(uint32_t SlotAddress, uint32_t Size, Flash_Sha_Image_t *image)
+{
+    uint8_t chunk[FLASH_AB_CHUNK];
+    uint32_t offset;
+    uint32_t length;
+    uint32_t fail;
+
+    for(offset = 0; offset < Size; offset += length){
+        length = ((Size - offset) < FLASH_AB_CHUNK) ? (Size - offset) : FLASH_AB_CHUNK;
+        if(Flash_Safe_Read(chunk, SlotAddress + offset, length, &fail) != FLASH_OK){
+            return FLASH_ERROR;
+        }
+        Flash_Sha_ImageUpdate(image, chunk, length);
+    }
+    return FLASH_OK;
+}
+
+#endif /* BOOT_SYNC_DUAL_CORE */
@@ -0,0 +1,176 @@
+/**
+  ******************************************************************************
+  * @file    flash_batch.c
+  * @brief   This file provides scatter-gather flash programming: many small
+             (address, buffer, length) updates are sorted, merged into whole
+             flashwords and issued in one unlock/lock session per bank
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <string.h>
+#include "flash_batch.h"
+#include "flash_if.h"
+#include "flash_geometry.h"
+#ifndef HOST_BUILD
+#include "flash_bank.h"
+#endif
+
+#define FLASH_BATCH_FW_MASK     (~(FLASH_GEO_FLASHWORD_SIZE - 1U))
+#define FLASH_BATCH_END(op)     ((op)->address + (op)->length)
+#define FLASH_BATCH_KEY(op)     (((op)->length != 0U) ? (op)->address : 0U)
+
+static void Flash_Batch_Sort(Flash_Batch_Op_t *ops, uint32_t NbOfOps);
+static uint32_t Flash_Batch_Session(uint32_t bank, uint32_t open);
+static uint32_t Flash_Batch_Word(uint32_t bank, uint32_t FlashAddress, const uint32_t *src);
+
+uint32_t Flash_Batch_Program(Flash_Batch_Op_t *ops, uint32_t NbOfOps, Flash_Batch_Stats_t *stats)
+{
+    uint32_t stage[FLASH_NB_32BITWORD_IN_FLASHWORD];
+    uint32_t status = FLASH_OK;
+    uint32_t index;
+    uint32_t first = 0;
+    uint32_t bank;
+    uint32_t fw;
+    uint32_t next;
+    uint32_t naive_words = 0;
+
+    memset(stats, 0, sizeof(*stats));
+
+    for(index = 0; index < NbOfOps; index++){
+        if(ops[index].length == 0U){
+            continue;
+        }
+        /* The length bound keeps address + length from wrapping back into
+           the bank, which would stall the merge below */
+        if((ops[index].length > FLASH_GEO_BANK_SIZE) || !FLASH_GEO_SAME_BANK(ops[index].address, ops[index].length)){
+            return FLASH_ERROR;
+        }
+        stats->ops++;
+        naive_words += ((FLASH_BATCH_END(&ops[index]) - 1U) >> FLASH_GEO_FLASHWORD_SHIFT) -
+                       (ops[index].address >> FLASH_GEO_FLASHWORD_SHIFT) + 1U;
+    }
+
+    Flash_Batch_Sort(ops, NbOfOps);
+
+    /* Empty ops sort first and carry no data */
+    while((first < NbOfOps) && (ops[first].length == 0U)){
+        first++;
+    }
+
+    while((first < NbOfOps) && (status == FLASH_OK)){
+        bank = FLASH_GEO_BANK(ops[first].address);
+        fw = ops[first].address & FLASH_BATCH_FW_MASK;
+
+        status = Flash_Batch_Session(bank, 1);
+        stats->lock_cycles++;
+
+        while((status == FLASH_OK) && (first < NbOfOps) && (FLASH_GEO_BANK(fw) == bank)){
+            /* Gather every fragment that lands in this flashword */
+            memset(stage, 0xFF, sizeof(stage));
+            for(index = first; (index < NbOfOps) && (ops[index].address < (fw + FLASH_GEO_FLASHWORD_SIZE)); index++){
+                uint32_t from = (ops[index].address > fw) ? ops[index].address : fw;
+                uint32_t to = FLASH_BATCH_END(&ops[index]);
+
+                if(to > (fw + FLASH_GEO_FLASHWORD_SIZE)){
+                    to = fw + FLASH_GEO_FLASHWORD_SIZE;
+                }
+                if(to > from){
+                    memcpy((uint8_t *)stage + (from - fw), ops[index].data + (from - ops[index].address), to - from);
+                }
+            }
+
+            status = Flash_Batch_Word(bank, fw, stage);
+            stats->flashwords++;
+
+            /* Retire consumed ops and skip untouched flashwords */
+            next = fw + FLASH_GEO_FLASHWORD_SIZE;
+            while((first < NbOfOps) && (FLASH_BATCH_END(&ops[first]) <= next)){
+                first++;
+            }
+            if((first < NbOfOps) && (ops[first].address > next)){
+                next = ops[first].address & FLASH_BATCH_FW_MASK;
+            }
+            fw = next;
+        }
+
+        if((Flash_Batch_Session(bank, 0) != FLASH_OK) && (status == FLASH_OK)){
+            status = FLASH_ERROR;
+        }
+    }
+
+    stats->flashwords_saved = naive_words - stats->flashwords;
+    stats->lock_cycles_saved = stats->ops - stats->lock_cycles;
+    return status;
+}
+
+/* Stable insertion sort: batches are dozens of entries, and equal
+   addresses must keep the caller's order. Empty ops go in front whatever
+   their address, so none is left between two that carry data. */
+static void Flash_Batch_Sort(Flash_Batch_Op_t *ops, uint32_t NbOfOps)
+{
+    uint32_t index;
+    uint32_t pos;
+    Flash_Batch_Op_t key;
+
+    for(index = 1; index < NbOfOps; index++){
+        key = ops[index];
+        pos = index;
+        while((pos > 0U) && (FLASH_BATCH_KEY(&ops[pos - 1U]) > FLASH_BATCH_KEY(&key))){
+            ops[pos] = ops[pos - 1U];
+            pos--;
+        }
+        ops[pos] = key;
+    }
+}
+
+#ifdef HOST_BUILD
+/* Host checks run on the emulated array and need no sessions */
+static uint32_t Flash_Batch_Session(uint32_t bank, uint32_t open)
+{
+    (void)bank;
+    (void)open;
+    return FLASH_OK;
+}
+
+static uint32_t Flash_Batch_Word(uint32_t bank, uint32_t FlashAddress, const uint32_t *src)
+{
+    (void)bank;
+    return Flash_Batch_HostProgram(FlashAddress, src);
+}
+#else
+static uint32_t Flash_Batch_Session(uint32_t bank, uint32_t open)
+{
+    if(bank == FLASH_BANK_1){
+        return (open != 0U) ? Flash_Bank_Unlock(FLASH_BANK_1) : Flash_Bank_Lock(FLASH_BANK_1);
+    }
+    return (open != 0U) ? Flash_Bank_Unlock(FLASH_BANK_2) : Flash_Bank_Lock(FLASH_BANK_2);
+}
+
+/* IRQs are masked per flashword only, so a long batch keeps interrupt
+   latency bounded by one flashword program */
+static uint32_t Flash_Batch_Word(uint32_t bank, uint32_t FlashAddress, const uint32_t *src)
+{
+    uint32_t primask = __get_PRIMASK();
+    uint32_t status;
+
+    __disable_irq();
+    if(bank == FLASH_BANK_1){
+        status = Flash_Bank_ProgramFlashWord(FLASH_BANK_1, FlashAddress, src);
+    }else{
+        status = Flash_Bank_ProgramFlashWord(FLASH_BANK_2, FlashAddress, src);
+    }
+    __set_PRIMASK(primask);
+
+    return status;
+}
+#endif
@@ -0,0 +1,342 @@
+/**
+  ******************************************************************************
+  * @file    flash_crc.c
+  * @brief   This file provides verify-after-write on the flash controller's
+             own CRC unit (CRCCR/CRCSADD/CRCEADD per bank, CRCDATA shared).
+             The unit reads the array itself, so the CPU neither fetches the
+             programmed data back nor waits for it: the program/verify
+             pipeline starts the CRC of one chunk, computes the expected
+             value from the RAM source meanwhile and programs the next chunk
+             before it collects the result. Host builds supply a software
+             CRC unit through the backend.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stdint.h>
+#include <string.h>
+#include "flash_crc.h"
+#ifndef HOST_BUILD
+#include "flash_bank.h"
+#include "flash_safe.h"
+#include "flash_kernel.h"
+#endif
+
+#define FLASH_CRC_POLY          0x04C11DB7U
+#define FLASH_CRC_NONE          0xFFFFFFFFU
+
+_Static_assert((FLASH_CRC_CHUNK % FLASH_CRC_BURST) == 0U, "FLASH_CRC_CHUNK must be whole bursts");
+
+static uint32_t flash_crc_table[256];
+
+static uint32_t Flash_Crc_Wait(const Flash_Crc_Backend_t *backend, uint32_t FlashAddress, uint32_t *crc);
+static uint32_t Flash_Crc_Check(uint32_t status, uint32_t crc, uint32_t FlashAddress, uint32_t Length,
+                                uint32_t Expected, Flash_Crc_Stats_t *stats);
+static uint32_t Flash_Crc_Tail(const Flash_Crc_Backend_t *backend, uint32_t FlashAddress, const uint32_t *src,
+                               uint32_t Length, Flash_Crc_Stats_t *stats);
+
+uint32_t Flash_Crc_Soft(uint32_t crc, const void *data, uint32_t Length)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint32_t index;
+    uint32_t bit;
+    uint32_t value;
+
+    if(flash_crc_table[1] == 0U){
+        for(index = 0; index < 256U; index++){
+            value = index << 24;
+            for(bit = 0; bit < 8U; bit++){
+                value = ((value & 0x80000000U) != 0U) ? ((value << 1) ^ FLASH_CRC_POLY) : (value << 1);
+            }
+            flash_crc_table[index] = value;
+        }
+    }
+
+    /* Each little-endian word enters MSB first, as the controller feeds it */
+    for(index = 0; (index + 4U) <= Length; index += 4U){
+        crc = (crc << 8) ^ flash_crc_table[(crc >> 24) ^ bytes[index + 3U]];
+        crc = (crc << 8) ^ flash_crc_table[(crc >> 24) ^ bytes[index + 2U]];
+        crc = (crc << 8) ^ flash_crc_table[(crc >> 24) ^ bytes[index + 1U]];
+        crc = (crc << 8) ^ flash_crc_table[(crc >> 24) ^ bytes[index]];
+    }
+    return crc;
+}
+
+uint32_t Flash_Crc_Compute(const Flash_Crc_Backend_t *backend, uint32_t FlashAddress, uint32_t Length, uint32_t *crc)
+{
+    uint32_t status;
+
+    if((Length == 0U) || ((Length % FLASH_CRC_BURST) != 0U) || !FLASH_GEO_IS_ALIGNED(FlashAddress) ||
+       !FLASH_GEO_SAME_BANK(FlashAddress, Length)){
+        return FLASH_ERROR;
+    }
+    do{
+        status = backend->crc_start(FlashAddress, Length);
+    }while(status == FLASH_BUSY);
+    if(status != FLASH_OK){
+        return status;
+    }
+    return Flash_Crc_Wait(backend, FlashAddress, crc);
+}
+
+uint32_t Flash_Crc_Verify(const Flash_Crc_Backend_t *backend, uint32_t FlashAddress, uint32_t Length, uint32_t Expected)
+{
+    uint32_t crc;
+    uint32_t status = Flash_Crc_Compute(backend, FlashAddress, Length, &crc);
+
+    if(status != FLASH_OK){
+        return status;
+    }
+    return (crc == Expected) ? FLASH_OK : FLASH_ERROR;
+}
+
+uint32_t Flash_Crc_VerifySectors(const Flash_Crc_Backend_t *backend, uint32_t Bank, uint32_t FirstSector,
+                                 uint32_t NbOfSectors, uint32_t Expected)
+{
+    if((NbOfSectors == 0U) || (FirstSector >= FLASH_GEO_SECTORS_PER_BANK) ||
+       (NbOfSectors > (FLASH_GEO_SECTORS_PER_BANK - FirstSector))){
+        return FLASH_ERROR;
+    }
+    return Flash_Crc_Verify(backend, FLASH_GEO_SECTOR_BASE(Bank, FirstSector), NbOfSectors << FLASH_GEO_SECTOR_SHIFT, Expected);
+}
+
+uint32_t Flash_Crc_ProgramVerify(const Flash_Crc_Backend_t *backend, uint32_t FlashAddress, const uint32_t *src,
+                                 uint32_t NbOfFlashWords, Flash_Crc_Stats_t *stats)
+{
+    uint32_t pending_address = 0;
+    uint32_t pending_length = 0;
+    uint32_t pending_expected = 0;
+    uint32_t length;
+    uint32_t whole;
+    uint32_t status;
+    uint32_t done;
+    uint32_t crc = 0;
+
+    stats->first_bad = FLASH_CRC_NONE;
+    if((NbOfFlashWords == 0U) || !FLASH_GEO_IS_ALIGNED(FlashAddress) ||
+       !FLASH_GEO_SAME_BANK(FlashAddress, NbOfFlashWords << FLASH_GEO_FLASHWORD_SHIFT)){
+        return (NbOfFlashWords == 0U) ? FLASH_OK : FLASH_ERROR;
+    }
+
+    while(NbOfFlashWords != 0U){
+        length = NbOfFlashWords << FLASH_GEO_FLASHWORD_SHIFT;
+        if(length > FLASH_CRC_CHUNK){
+            length = FLASH_CRC_CHUNK;
+        }
+
+        /* The previous chunk is checked while this one programs */
+        done = FLASH_BUSY;
+        if(pending_length != 0U){
+            done = backend->crc_result(pending_address, &crc);
+            if(done == FLASH_BUSY){
+                stats->overlapped++;
+            }
+        }
+
+        status = backend->program(FlashAddress, src, length >> FLASH_GEO_FLASHWORD_SHIFT);
+        if(pending_length != 0U){
+            if(done == FLASH_BUSY){
+                done = Flash_Crc_Wait(backend, pending_address, &crc);
+            }
+            if(status == FLASH_OK){
+                status = Flash_Crc_Check(done, crc, pending_address, pending_length, pending_expected, stats);
+            }
+            pending_length = 0;
+        }
+        if(status != FLASH_OK){
+            return status;
+        }
+
+        whole = length & ~(FLASH_CRC_BURST - 1U);
+        if(whole != 0U){
+            status = backend->crc_start(FlashAddress, whole);
+            if(status != FLASH_OK){
+                return status;
+            }
+            pending_address = FlashAddress;
+            pending_length = whole;
+            pending_expected = Flash_Crc_Soft(FLASH_CRC_INIT, src, whole);
+        }
+        /* Less than a burst left over: the CPU reads it back */
+        if(whole != length){
+            status = Flash_Crc_Tail(backend, FlashAddress + whole, src + (whole / 4U), length - whole, stats);
+            if(status != FLASH_OK){
+                return status;
+            }
+        }
+
+        FlashAddress += length;
+        src += length / 4U;
+        NbOfFlashWords -= length >> FLASH_GEO_FLASHWORD_SHIFT;
+    }
+
+    if(pending_length != 0U){
+        status = Flash_Crc_Wait(backend, pending_address, &crc);
+        return Flash_Crc_Check(status, crc, pending_address, pending_length, pending_expected, stats);
+    }
+    return FLASH_OK;
+}
+
+static uint32_t Flash_Crc_Wait(const Flash_Crc_Backend_t *backend, uint32_t FlashAddress, uint32_t *crc)
+{
+    uint32_t status;
+
+    do{
+        status = backend->crc_result(FlashAddress, crc);
+    }while(status == FLASH_BUSY);
+    return status;
+}
+
+static uint32_t Flash_Crc_Check(uint32_t status, uint32_t crc, uint32_t FlashAddress, uint32_t Length,
+                                uint32_t Expected, Flash_Crc_Stats_t *stats)
+{
+    if(status != FLASH_OK){
+        return status;
+    }
+    stats->ranges++;
+    stats->crc_bytes += Length;
+    if(crc != Expected){
+        stats->mismatches++;
+        if(stats->first_bad == FLASH_CRC_NONE){
+            stats->first_bad = FlashAddress;
+        }
+        return FLASH_ERROR;
+    }
+    return FLASH_OK;
+}
+
+static uint32_t Flash_Crc_Tail(const Flash_Crc_Backend_t *backend, uint32_t FlashAddress, const uint32_t *src,
+                               uint32_t Length, Flash_Crc_Stats_t *stats)
+{
+    uint32_t buffer[FLASH_CRC_BURST / 4U];
+    uint32_t fail;
+    uint32_t status = backend->read(buffer, FlashAddress, Length, &fail);
+
+    stats->read_bytes += Length;
+    if((status == FLASH_OK) && (memcmp(buffer, src, Length) != 0)){
+        status = FLASH_ERROR;
+    }
+    if((status != FLASH_OK) && (stats->first_bad == FLASH_CRC_NONE)){
+        stats->mismatches++;
+        stats->first_bad = FlashAddress;
+    }
+    return status;
+}
+
+#ifndef HOST_BUILD
+static uint32_t Flash_Crc_TargetProgram(uint32_t FlashAddress, const uint32_t *src, uint32_t NbOfFlashWords)
+{
+    return Flash_Program(FlashAddress, (uint32_t)src, NbOfFlashWords);
+}
+
+/* Sector mode for whole sectors, otherwise the smallest burst so a range
+   never reads past its end */
+static uint32_t Flash_Crc_TargetStart(uint32_t FlashAddress, uint32_t Length)
+{
+    uint32_t bank = FLASH_GEO_BANK(FlashAddress);
+    Flash_Bank_TypeDef *regs = FLASH_BANK_REGS(bank);
+    uint32_t sector;
+
+    /* One result register serves both banks */
+    if((READ_BIT(FLASH_BANK_REGS(FLASH_BANK_1)->SR, FLASH_SR_CRC_BUSY) != 0U) ||
+       (READ_BIT(FLASH_BANK_REGS(FLASH_BANK_2)->SR, FLASH_SR_CRC_BUSY) != 0U)){
+        return FLASH_BUSY;
+    }
+    if(Flash_Bank_Unlock(bank) != FLASH_OK){
+        return FLASH_ERROR;
+    }
+
+    SET_BIT(regs->CR, FLASH_CR_CRC_EN);
+    WRITE_REG(regs->CCR, (FLASH_CCR_CLR_CRCEND | FLASH_CCR_CLR_CRCRDERR));
+
+    if(((FlashAddress & (FLASH_GEO_SECTOR_SIZE - 1U)) == 0U) && ((Length & (FLASH_GEO_SECTOR_SIZE - 1U)) == 0U)){
+        WRITE_REG(regs->CRCCR, (FLASH_CRCCR_CLEAN_CRC | FLASH_CRCCR_CLEAN_SECT | FLASH_CRCCR_CRC_BURST | FLASH_CRCCR_CRC_BY_SECT));
+        for(sector = FLASH_GEO_SECTOR(FlashAddress); sector < (FLASH_GEO_SECTOR(FlashAddress) + (Length >> FLASH_GEO_SECTOR_SHIFT)); sector++){
+            MODIFY_REG(regs->CRCCR, FLASH_CRCCR_CRC_SECT, (FLASH_CRCCR_ADD_SECT | (sector << FLASH_CRCCR_CRC_SECT_Pos)));
+        }
+    }else{
+        WRITE_REG(regs->CRCCR, FLASH_CRCCR_CLEAN_CRC);
+        WRITE_REG(regs->CRCSADD, FlashAddress);
+        WRITE_REG(regs->CRCEADD, FlashAddress + Length - 4U);
+    }
+
+    SET_BIT(regs->CRCCR, FLASH_CRCCR_START_CRC);
+    Flash_Bank_Lock(bank);
+    return FLASH_OK;
+}
+
+static uint32_t Flash_Crc_TargetResult(uint32_t FlashAddress, uint32_t *crc)
+{
+    uint32_t bank = FLASH_GEO_BANK(FlashAddress);
+    Flash_Bank_TypeDef *regs = FLASH_BANK_REGS(bank);
+    uint32_t status = FLASH_OK;
+
+    if(READ_BIT(regs->SR, FLASH_SR_CRC_BUSY) != 0U){
+        return FLASH_BUSY;
+    }
+    if(READ_BIT(regs->SR, FLASH_SR_CRCRDERR) != 0U){
+        status = FLASH_ERROR;
+    }
+    *crc = FLASH_BANK_REGS(FLASH_BANK_1)->CRCDATA;
+
+    if(Flash_Bank_Unlock(bank) == FLASH_OK){
+        CLEAR_BIT(regs->CR, FLASH_CR_CRC_EN);
+        Flash_Bank_Lock(bank);
+    }
+    WRITE_REG(regs->CCR, (FLASH_CCR_CLR_CRCEND | FLASH_CCR_CLR_CRCRDERR));
+    return status;
+}
+
+const Flash_Crc_Backend_t Flash_Crc_TargetBackend =
+{
+    Flash_Crc_TargetProgram,
+    Flash_Safe_Read,
+    Flash_Crc_TargetStart,
+    Flash_Crc_TargetResult
+};
+
+#ifdef FLASH_CRC_BENCHMARK
+/**
+  * @brief  Verifies one sector with the controller, with a CPU CRC over the
+  *         memory-mapped sector and, if copy is given, with a CPU compare.
+  * @retval FLASH_OK, or the status of the hardware CRC
+  */
+uint32_t Flash_Crc_Benchmark(uint32_t Bank, uint32_t Sector, const void *copy, Flash_Crc_Bench_t *results)
+{
+    uint32_t address = FLASH_GEO_SECTOR_BASE(Bank, Sector);
+    __IO uint32_t sink = 0;
+    uint32_t status;
+    uint32_t start;
+    uint32_t crc;
+
+    SET_BIT(CoreDebug->DEMCR, CoreDebug_DEMCR_TRCENA_Msk);
+    SET_BIT(DWT->CTRL, DWT_CTRL_CYCCNTENA_Msk);
+
+    start = DWT->CYCCNT;
+    status = Flash_Crc_Compute(&Flash_Crc_TargetBackend, address, FLASH_GEO_SECTOR_SIZE, &crc);
+    results->hw_cycles = DWT->CYCCNT - start;
+
+    start = DWT->CYCCNT;
+    sink += (Flash_Crc_Soft(FLASH_CRC_INIT, (const void *)address, FLASH_GEO_SECTOR_SIZE) == crc) ? 1U : 0U;
+    results->soft_cycles = DWT->CYCCNT - start;
+
+    results->read_cycles = 0;
+    if(copy != NULL){
+        start = DWT->CYCCNT;
+        sink += Flash_Kernel_Compare((const void *)address, copy, FLASH_GEO_SECTOR_SIZE);
+        results->read_cycles = DWT->CYCCNT - start;
+    }
+    (void)sink;
+    return status;
+}
+#endif
+#endif
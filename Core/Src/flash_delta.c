@@ -0,0 +1,313 @@
+/**
+  ******************************************************************************
+  * @file    flash_delta.c
+  * @brief   This file provides a streaming binary patch decoder: the old
+             image in one bank plus a bsdiff-style patch produce the new
+             image in the other bank. Only the flashword being assembled and
+             one cached flashword of the old image are held in RAM. Output
+             flashwords that come out erased are not programmed and
+             destination sectors that are already blank are not erased.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <string.h>
+#include "flash_delta.h"
+#include "flash_if.h"
+
+#define FLASH_DELTA_CHUNK       256U
+#define FLASH_DELTA_FW_WORDS    (FLASH_GEO_FLASHWORD_SIZE / 4U)
+
+enum{
+    FLASH_DELTA_HEADER = 0,
+    FLASH_DELTA_DIFF_LEN,
+    FLASH_DELTA_DIFF_ZEROS,
+    FLASH_DELTA_DIFF_COUNT,
+    FLASH_DELTA_DIFF_BYTES,
+    FLASH_DELTA_EXTRA_LEN,
+    FLASH_DELTA_EXTRA_BYTES,
+    FLASH_DELTA_SEEK,
+    FLASH_DELTA_DONE
+};
+
+static uint32_t Flash_Delta_Varint(Flash_Delta_t *delta, uint8_t byte);
+static void Flash_Delta_Record(Flash_Delta_t *delta, uint32_t value);
+static void Flash_Delta_Header(Flash_Delta_t *delta);
+static uint8_t Flash_Delta_Old(Flash_Delta_t *delta);
+static void Flash_Delta_Out(Flash_Delta_t *delta, uint8_t byte);
+static void Flash_Delta_Flush(Flash_Delta_t *delta);
+static uint32_t Flash_Delta_Crc(Flash_Delta_t *delta, uint32_t FlashAddress, uint32_t Length, uint32_t *Crc);
+
+uint32_t Flash_Delta_Init(Flash_Delta_t *delta, const Flash_Stream_Backend_t *backend,
+                          uint32_t SourceAddress, uint32_t DestAddress, uint32_t Capacity)
+{
+    memset(delta, 0, sizeof(*delta));
+    delta->backend = backend;
+    delta->src = SourceAddress;
+    delta->dst = DestAddress;
+    delta->capacity = Capacity;
+    delta->cache_addr = 0xFFFFFFFFU;
+
+    if(((FLASH_GEO_OFFSET(DestAddress) & (FLASH_GEO_SECTOR_SIZE - 1U)) != 0U) ||
+       ((Capacity & (FLASH_GEO_FLASHWORD_SIZE - 1U)) != 0U) || !FLASH_GEO_SAME_BANK(DestAddress, Capacity) ||
+       (FLASH_GEO_BANK(SourceAddress) == FLASH_GEO_BANK(DestAddress))){
+        delta->status = FLASH_ERROR;
+    }
+    return delta->status;
+}
+
+uint32_t Flash_Delta_Feed(Flash_Delta_t *delta, const void *data, uint32_t Length)
+{
+    const uint8_t *byte = (const uint8_t *)data;
+
+    delta->stats.patch_bytes += Length;
+
+    for(; (Length != 0U) && (delta->status == FLASH_OK); Length--, byte++){
+        switch(delta->state){
+        case FLASH_DELTA_HEADER:
+            ((uint8_t *)&delta->header)[delta->value++] = *byte;
+            if(delta->value == sizeof(delta->header)){
+                delta->value = 0;
+                Flash_Delta_Header(delta);
+            }
+            break;
+
+        case FLASH_DELTA_DIFF_BYTES:
+            Flash_Delta_Out(delta, (uint8_t)(Flash_Delta_Old(delta) + *byte));
+            delta->remaining--;
+            if(--delta->count == 0U){
+                delta->state = (delta->remaining == 0U) ? FLASH_DELTA_EXTRA_LEN : FLASH_DELTA_DIFF_ZEROS;
+            }
+            break;
+
+        case FLASH_DELTA_EXTRA_BYTES:
+            Flash_Delta_Out(delta, *byte);
+            if(--delta->count == 0U){
+                delta->state = FLASH_DELTA_SEEK;
+            }
+            break;
+
+        case FLASH_DELTA_DONE:
+            delta->status = FLASH_ERROR;    /* trailing bytes */
+            break;
+
+        default:
+            if(Flash_Delta_Varint(delta, *byte) != 0U){
+                Flash_Delta_Record(delta, delta->value);
+                delta->value = 0;
+                delta->shift = 0;
+            }
+            break;
+        }
+    }
+    return delta->status;
+}
+
+uint32_t Flash_Delta_Finish(Flash_Delta_t *delta)
+{
+    uint32_t crc;
+
+    if((delta->status == FLASH_OK) && (delta->state != FLASH_DELTA_DONE)){
+        delta->status = FLASH_ERROR;        /* patch cut short */
+    }
+    if((delta->status == FLASH_OK) && (delta->stage_fill != 0U)){
+        memset((uint8_t *)delta->stage + delta->stage_fill, 0xFF, FLASH_GEO_FLASHWORD_SIZE - delta->stage_fill);
+        Flash_Delta_Flush(delta);
+    }
+    if((delta->status == FLASH_OK) &&
+       ((Flash_Delta_Crc(delta, delta->dst, delta->header.new_size, &crc) != FLASH_OK) || (crc != delta->header.new_crc))){
+        delta->status = FLASH_ERROR;
+    }
+    return delta->status;
+}
+
+/* LEB128; returns 1 once the value is complete */
+static uint32_t Flash_Delta_Varint(Flash_Delta_t *delta, uint8_t byte)
+{
+    /* Five bytes at most, and the fifth has room for only 4 more bits */
+    if((delta->shift > 28U) || ((delta->shift == 28U) && ((byte & 0x70U) != 0U))){
+        delta->status = FLASH_ERROR;
+        return 0U;
+    }
+    delta->value |= (uint32_t)(byte & 0x7FU) << delta->shift;
+    delta->shift += 7U;
+    return ((byte & 0x80U) == 0U) ? 1U : 0U;
+}
+
+static void Flash_Delta_Record(Flash_Delta_t *delta, uint32_t value)
+{
+    uint32_t left = delta->header.new_size - delta->produced;
+
+    switch(delta->state){
+    case FLASH_DELTA_DIFF_LEN:
+        if(value > left){
+            delta->status = FLASH_ERROR;
+            return;
+        }
+        delta->remaining = value;
+        delta->state = (value == 0U) ? FLASH_DELTA_EXTRA_LEN : FLASH_DELTA_DIFF_ZEROS;
+        break;
+
+    case FLASH_DELTA_DIFF_ZEROS:
+        /* Unchanged bytes: straight copy from the old image */
+        if(value > delta->remaining){
+            delta->status = FLASH_ERROR;
+            return;
+        }
+        delta->remaining -= value;
+        while((value-- != 0U) && (delta->status == FLASH_OK)){
+            Flash_Delta_Out(delta, Flash_Delta_Old(delta));
+        }
+        delta->state = (delta->remaining == 0U) ? FLASH_DELTA_EXTRA_LEN : FLASH_DELTA_DIFF_COUNT;
+        break;
+
+    case FLASH_DELTA_DIFF_COUNT:
+        if((value == 0U) || (value > delta->remaining)){
+            delta->status = FLASH_ERROR;
+            return;
+        }
+        delta->count = value;
+        delta->state = FLASH_DELTA_DIFF_BYTES;
+        break;
+
+    case FLASH_DELTA_EXTRA_LEN:
+        if(value > left){
+            delta->status = FLASH_ERROR;
+            return;
+        }
+        delta->count = value;
+        delta->state = (value == 0U) ? FLASH_DELTA_SEEK : FLASH_DELTA_EXTRA_BYTES;
+        break;
+
+    case FLASH_DELTA_SEEK:
+        delta->old_pos += (value >> 1) ^ (0U - (value & 1U));
+        delta->state = (delta->produced == delta->header.new_size) ? FLASH_DELTA_DONE : FLASH_DELTA_DIFF_LEN;
+        break;
+
+    default:
+        delta->status = FLASH_ERROR;
+        break;
+    }
+}
+
+static void Flash_Delta_Header(Flash_Delta_t *delta)
+{
+    uint32_t crc;
+
+    if((delta->header.magic != FLASH_DELTA_MAGIC) || (delta->header.new_size == 0U) ||
+       (delta->header.new_size > delta->capacity) || !FLASH_GEO_SAME_BANK(delta->src, delta->header.old_size)){
+        delta->status = FLASH_ERROR;
+        return;
+    }
+    /* Against any other base image the patch produces garbage: refuse
+       before the first erase */
+    if((Flash_Delta_Crc(delta, delta->src, delta->header.old_size, &crc) != FLASH_OK) || (crc != delta->header.old_crc)){
+        delta->status = FLASH_ERROR;
+        return;
+    }
+    delta->state = FLASH_DELTA_DIFF_LEN;
+}
+
+static uint8_t Flash_Delta_Old(Flash_Delta_t *delta)
+{
+    uint32_t pos = delta->old_pos++;
+    uint32_t addr = delta->src + (pos & ~(FLASH_GEO_FLASHWORD_SIZE - 1U));
+    uint32_t fail;
+
+    if(pos >= delta->header.old_size){
+        delta->status = FLASH_ERROR;
+        return 0U;
+    }
+    if(addr != delta->cache_addr){
+        delta->status = delta->backend->read(delta->cache, addr, FLASH_GEO_FLASHWORD_SIZE, &fail);
+        delta->cache_addr = addr;
+    }
+    return ((const uint8_t *)delta->cache)[pos & (FLASH_GEO_FLASHWORD_SIZE - 1U)];
+}
+
+static void Flash_Delta_Out(Flash_Delta_t *delta, uint8_t byte)
+{
+    if(delta->produced >= delta->header.new_size){
+        delta->status = FLASH_ERROR;
+        return;
+    }
+    ((uint8_t *)delta->stage)[delta->stage_fill++] = byte;
+    delta->produced++;
+    if(delta->stage_fill == FLASH_GEO_FLASHWORD_SIZE){
+        Flash_Delta_Flush(delta);
+    }
+}
+
+static void Flash_Delta_Flush(Flash_Delta_t *delta)
+{
+    uint32_t offset = (delta->produced - 1U) & ~(FLASH_GEO_FLASHWORD_SIZE - 1U);
+    uint32_t words[FLASH_DELTA_CHUNK / 4U];
+    uint32_t index;
+    uint32_t pos;
+    uint32_t fail;
+    uint32_t dirty = 0;
+
+    delta->stage_fill = 0;
+
+    /* First flashword of a sector: erase it unless it is blank already */
+    if(offset >= delta->prepared){
+        for(pos = 0; (pos < FLASH_GEO_SECTOR_SIZE) && (dirty == 0U); pos += FLASH_DELTA_CHUNK){
+            if(delta->backend->read(words, delta->dst + delta->prepared + pos, FLASH_DELTA_CHUNK, &fail) != FLASH_OK){
+                dirty = 1;
+            }
+            for(index = 0; (index < (FLASH_DELTA_CHUNK / 4U)) && (dirty == 0U); index++){
+                dirty = (words[index] != 0xFFFFFFFFU) ? 1U : 0U;
+            }
+        }
+        if(dirty != 0U){
+            delta->status = delta->backend->erase_sector(delta->dst + delta->prepared);
+            delta->stats.erased++;
+        }else{
+            delta->stats.clean++;
+        }
+        delta->prepared += FLASH_GEO_SECTOR_SIZE;
+        if(delta->status != FLASH_OK){
+            return;
+        }
+    }
+
+    for(index = 0; index < FLASH_DELTA_FW_WORDS; index++){
+        if(delta->stage[index] != 0xFFFFFFFFU){
+            break;
+        }
+    }
+    if(index == FLASH_DELTA_FW_WORDS){
+        delta->stats.blank++;
+        return;
+    }
+    delta->status = delta->backend->program(delta->dst + offset, delta->stage, 1);
+    delta->stats.programmed++;
+}
+
+static uint32_t Flash_Delta_Crc(Flash_Delta_t *delta, uint32_t FlashAddress, uint32_t Length, uint32_t *Crc)
+{
+    uint8_t chunk[FLASH_DELTA_CHUNK];
+    uint32_t offset;
+    uint32_t step;
+    uint32_t fail;
+    uint32_t crc = 0;
+
+    for(offset = 0; offset < Length; offset += step){
+        step = ((Length - offset) < FLASH_DELTA_CHUNK) ? (Length - offset) : FLASH_DELTA_CHUNK;
+        if(delta->backend->read(chunk, FlashAddress + offset, step, &fail) != FLASH_OK){
+            return FLASH_ERROR;
+        }
+        crc = Flash_Stream_Crc(crc, chunk, step);
+    }
+    *Crc = crc;
+    return FLASH_OK;
+}
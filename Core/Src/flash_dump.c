@@ -0,0 +1,295 @@
+/**
+  ******************************************************************************
+  * @file    flash_dump.c
+  * @brief   This file provides post-mortem crash dumps. A fault handler
+             snapshots the core registers, the fault status registers, the
+             flash controller state, the recent ECC events and the top of the
+             faulting stack into a 1 Kbyte record, then programs it into the
+             next pre-erased record of a reserved sector. Programming runs
+             from RAM with the bank registers inlined: 32 flashword programs
+             and no erase, well under a millisecond. The next boot reads the
+             records back and re-arms the sector.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include "flash_dump.h"
+#include "flash_if.h"
+#include "flash_bank.h"
+#include "flash_stream.h"
+#include "flash_kernel.h"
+
+#define FLASH_DUMP_HEADER_WORDS     (FLASH_GEO_FLASHWORD_SIZE / 4U)
+#define FLASH_DUMP_SLOT(slot)       (FLASH_DUMP_BASE + ((slot) * FLASH_DUMP_SIZE))
+#define FLASH_DUMP_EXC_STD_FRAME    0x10U       /* EXC_RETURN bit 4: no FPU state stacked */
+#define FLASH_DUMP_XPSR_ALIGN       0x200U      /* xPSR bit 9: a padding word was stacked */
+
+_Static_assert(sizeof(Flash_Dump_t) == FLASH_DUMP_SIZE, "dump record size");
+_Static_assert((FLASH_DUMP_SIZE % FLASH_GEO_FLASHWORD_SIZE) == 0U, "dump record holds whole flashwords");
+_Static_assert((FLASH_GEO_OFFSET(FLASH_DUMP_BASE) & (FLASH_GEO_SECTOR_SIZE - 1U)) == 0U, "dump slot is a whole sector");
+
+typedef struct{
+    uint32_t base;
+    uint32_t size;
+}Flash_Dump_Ram_t;
+
+/* A corrupted stack pointer must not fault the dump itself */
+static const Flash_Dump_Ram_t flash_dump_ram[] =
+{
+    { 0x10000000U, 0x00048000U },   /* SRAM1-3, Cortex-M4 alias */
+    { 0x20000000U, 0x00020000U },   /* DTCM */
+    { 0x24000000U, 0x00080000U },   /* AXI SRAM */
+    { 0x30000000U, 0x00048000U },   /* SRAM1-3 */
+    { 0x38000000U, 0x00010000U },   /* SRAM4 */
+};
+
+static Flash_Dump_t flash_dump_record;
+static uint32_t flash_dump_next = FLASH_DUMP_SLOTS;    /* disarmed until Flash_Dump_Init */
+static uint32_t flash_dump_count;
+static uint32_t flash_dump_sequence;
+
+static void Flash_Dump_Save(Flash_Dump_t *dump, uint32_t reason) __attribute__((noreturn));
+static uint32_t Flash_Dump_Program(uint32_t FlashAddress, const uint32_t *record)
+    __attribute__((section(".RamFunc"), noinline, long_call));
+static uint32_t Flash_Dump_IsRam(uint32_t address);
+
+void Flash_Dump_Init(void)
+{
+    uint32_t header[FLASH_DUMP_HEADER_WORDS];
+    uint32_t slot;
+    uint32_t fail;
+
+    flash_dump_count = 0;
+    flash_dump_sequence = 0;
+    flash_dump_next = FLASH_DUMP_SLOTS;
+
+    /* Records fill in order; one cut short by a reset has data but no
+       header and is stepped over */
+    for(slot = 0; slot < FLASH_DUMP_SLOTS; slot++){
+        if(Flash_Safe_Read(header, FLASH_DUMP_SLOT(slot), sizeof(header), &fail) != FLASH_OK){
+            continue;
+        }
+        if(header[0] == FLASH_DUMP_MAGIC){
+            flash_dump_count++;
+            flash_dump_sequence = header[1];
+            continue;
+        }
+        if(Flash_Kernel_IsBlank(header, sizeof(header)) &&
+           (Flash_Safe_Read(&flash_dump_record, FLASH_DUMP_SLOT(slot), FLASH_DUMP_SIZE, &fail) == FLASH_OK) &&
+           Flash_Kernel_IsBlank(&flash_dump_record, FLASH_DUMP_SIZE)){
+            flash_dump_next = slot;
+            break;
+        }
+    }
+}
+
+uint32_t Flash_Dump_Count(void)
+{
+    return flash_dump_count;
+}
+
+uint32_t Flash_Dump_Read(uint32_t Index, Flash_Dump_t *dump)
+{
+    uint32_t slot = flash_dump_next;
+    uint32_t status;
+    uint32_t fail;
+
+    while(slot-- != 0U){
+        status = Flash_Safe_Read(dump, FLASH_DUMP_SLOT(slot), FLASH_DUMP_HEADER_WORDS * 4U, &fail);
+        if((status != FLASH_OK) || (dump->magic != FLASH_DUMP_MAGIC) || (Index-- != 0U)){
+            continue;
+        }
+        status = Flash_Safe_Read(dump, FLASH_DUMP_SLOT(slot), FLASH_DUMP_SIZE, &fail);
+        if(status != FLASH_OK){
+            return status;
+        }
+        if(Flash_Stream_Crc(0, (const uint8_t *)dump + FLASH_GEO_FLASHWORD_SIZE, FLASH_DUMP_SIZE - FLASH_GEO_FLASHWORD_SIZE) != dump->crc){
+            return FLASH_ERROR;
+        }
+        return FLASH_OK;
+    }
+    return FLASH_ERROR;
+}
+
+uint32_t Flash_Dump_Arm(void)
+{
+    uint32_t status;
+
+    if(flash_dump_next < FLASH_DUMP_SLOTS){
+        return FLASH_OK;
+    }
+    status = Flash_Sector_Erase(FLASH_GEO_BANK(FLASH_DUMP_BASE), FLASH_GEO_SECTOR(FLASH_DUMP_BASE), 1);
+    if(status == FLASH_OK){
+        flash_dump_next = 0;
+        flash_dump_count = 0;
+    }
+    return status;
+}
+
+/**
+  * @brief  C half of the fault entry stubs (FLASH_DUMP_ENTRY).
+  * @param  frame: exception stack frame (r0-r3, r12, lr, pc, xPSR)
+  * @param  exc_return: lr at exception entry
+  * @param  callee: r4-r11 pushed by the stub
+  * @param  reason: FLASH_DUMP_NMI .. FLASH_DUMP_USAGEFAULT
+  */
+void Flash_Dump_Fault(uint32_t *frame, uint32_t exc_return, uint32_t *callee, uint32_t reason)
+{
+    Flash_Dump_t *dump = &flash_dump_record;
+    uint32_t primask = __get_PRIMASK();
+    uint32_t index;
+
+    __disable_irq();
+    for(index = 0; index < (FLASH_DUMP_SIZE / 4U); index++){
+        ((uint32_t *)dump)[index] = 0;
+    }
+    dump->primask = primask;
+    dump->exc_return = exc_return;
+
+    if(Flash_Dump_IsRam((uint32_t)frame) && Flash_Dump_IsRam((uint32_t)&frame[7])){
+        for(index = 0; index < 8U; index++){
+            dump->frame[index] = frame[index];
+        }
+        dump->sp = (uint32_t)frame + ((((exc_return & FLASH_DUMP_EXC_STD_FRAME) != 0U) ? 8U : 26U) * 4U) +
+                   (((frame[7] & FLASH_DUMP_XPSR_ALIGN) != 0U) ? 4U : 0U);
+    }
+    for(index = 0; index < 8U; index++){
+        dump->callee[index] = callee[index];
+    }
+    Flash_Dump_Save(dump, reason);
+}
+
+/**
+  * @brief  Dump from thread code, e.g. Error_Handler.
+  * @param  reason: FLASH_DUMP_ERROR
+  */
+void Flash_Dump_Error(uint32_t reason)
+{
+    Flash_Dump_t *dump = &flash_dump_record;
+    uint32_t primask = __get_PRIMASK();
+    uint32_t index;
+
+    __disable_irq();
+    for(index = 0; index < (FLASH_DUMP_SIZE / 4U); index++){
+        ((uint32_t *)dump)[index] = 0;
+    }
+    dump->primask = primask;
+    /* No exception frame: the caller's address stands in for pc */
+    dump->frame[6] = (uint32_t)__builtin_return_address(0);
+    dump->sp = ((__get_CONTROL() & CONTROL_SPSEL_Msk) != 0U) ? __get_PSP() : __get_MSP();
+    Flash_Dump_Save(dump, reason);
+}
+
+__attribute__((weak)) void Flash_Dump_Notify(uint32_t reason)
+{
+    UNUSED(reason);
+}
+
+static void Flash_Dump_Save(Flash_Dump_t *dump, uint32_t reason)
+{
+    uint32_t index;
+
+    Flash_Dump_Notify(reason);
+
+    dump->sequence = flash_dump_sequence + 1U;
+    dump->reason = reason;
+    dump->tick = HAL_GetTick();
+    dump->msp = __get_MSP();
+    dump->psp = __get_PSP();
+    dump->control = __get_CONTROL();
+    dump->basepri = __get_BASEPRI();
+    dump->faultmask = __get_FAULTMASK();
+
+    dump->cfsr = SCB->CFSR;
+    dump->hfsr = SCB->HFSR;
+    dump->dfsr = SCB->DFSR;
+    dump->mmfar = SCB->MMFAR;
+    dump->bfar = SCB->BFAR;
+    dump->afsr = SCB->AFSR;
+    dump->shcsr = SCB->SHCSR;
+    dump->icsr = SCB->ICSR;
+
+    dump->flash_sr[0] = FLASH_BANK_REGS(FLASH_BANK_1)->SR;
+    dump->flash_sr[1] = FLASH_BANK_REGS(FLASH_BANK_2)->SR;
+    dump->flash_ecc_fa[0] = FLASH_BANK_REGS(FLASH_BANK_1)->ECC_FA;
+    dump->flash_ecc_fa[1] = FLASH_BANK_REGS(FLASH_BANK_2)->ECC_FA;
+    dump->ecc_single = Flash_Safe_EccLog.single_errors;
+    dump->ecc_double = Flash_Safe_EccLog.double_errors;
+    dump->ecc_recovered = Flash_Safe_EccLog.recovered_faults;
+    dump->ecc_count = Flash_Safe_EccLog.event_count;
+    for(index = 0; index < FLASH_SAFE_EVENT_DEPTH; index++){
+        dump->ecc[index] = Flash_Safe_EccLog.events[index];
+    }
+
+    /* Stops at the end of the RAM region the stack lives in */
+    for(index = 0; (index < FLASH_DUMP_STACK_WORDS) && Flash_Dump_IsRam(dump->sp + (index * 4U)); index++){
+        dump->stack[index] = ((const uint32_t *)dump->sp)[index];
+    }
+    dump->stack_words = index;
+    dump->crc = Flash_Stream_Crc(0, (const uint8_t *)dump + FLASH_GEO_FLASHWORD_SIZE, FLASH_DUMP_SIZE - FLASH_GEO_FLASHWORD_SIZE);
+    dump->magic = FLASH_DUMP_MAGIC;
+
+    if(flash_dump_next < FLASH_DUMP_SLOTS){
+        if(Flash_Dump_Program(FLASH_DUMP_SLOT(flash_dump_next), (const uint32_t *)dump) == FLASH_OK){
+            flash_dump_next++;
+        }
+    }
+
+    if((CoreDebug->DHCSR & CoreDebug_DHCSR_C_DEBUGEN_Msk) != 0U){
+        while(1){
+        }
+    }
+    NVIC_SystemReset();
+}
+
+/* Runs from RAM: the Flash_Bank_* helpers are forced inline, so nothing
+   here fetches from a bank while it is being programmed */
+static uint32_t Flash_Dump_Program(uint32_t FlashAddress, const uint32_t *record)
+{
+    uint32_t bank = FLASH_GEO_BANK(FlashAddress);
+    Flash_Bank_TypeDef *regs = FLASH_BANK_REGS(bank);
+    uint32_t offset;
+    uint32_t status;
+
+    /* The crash may have interrupted a flash operation: let it finish, then
+       drop its mode bits and error flags */
+    (void)Flash_Bank_WaitForLastOperation(bank);
+    CLEAR_BIT(regs->CR, (FLASH_CR_PG | FLASH_CR_SER | FLASH_CR_BER));
+    WRITE_REG(regs->CCR, FLASH_BANK_SR_ERRORS);
+    if(Flash_Bank_Unlock(bank) != FLASH_OK){
+        return FLASH_ERROR;
+    }
+
+    /* Header last: it is what marks the record complete */
+    status = FLASH_OK;
+    for(offset = FLASH_GEO_FLASHWORD_SIZE; (offset < FLASH_DUMP_SIZE) && (status == FLASH_OK); offset += FLASH_GEO_FLASHWORD_SIZE){
+        status = Flash_Bank_ProgramFlashWord(bank, FlashAddress + offset, &record[offset / 4U]);
+    }
+    if(status == FLASH_OK){
+        status = Flash_Bank_ProgramFlashWord(bank, FlashAddress, record);
+    }
+
+    (void)Flash_Bank_Lock(bank);
+    return status;
+}
+
+static uint32_t Flash_Dump_IsRam(uint32_t address)
+{
+    uint32_t index;
+
+    for(index = 0; index < (sizeof(flash_dump_ram) / sizeof(flash_dump_ram[0])); index++){
+        if((address - flash_dump_ram[index].base) < flash_dump_ram[index].size){
+            return 1U;
+        }
+    }
+    return 0U;
+}
@@ -0,0 +1,212 @@
+/**
+  ******************************************************************************
+  * @file    flash_fault.c
+  * @brief   This file provides the ECC fault-injection campaign engine. A
+             script of (kind, flashword range) steps is run against a
+             backend: on target, faults are made by overprogramming a
+             flashword through Flash_Program; on the host, by flipping bits
+             in the emulated array (Tools/fault_campaign.c). Each injection
+             is read back through the safe-read path and classified.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <string.h>
+#include "flash_fault.h"
+#include "flash_if.h"
+#include "flash_geometry.h"
+
+static void Flash_Fault_Sample(Flash_Fault_Range_t *range, uint32_t value);
+static uint32_t Flash_Fault_Next(uint32_t *state);
+
+uint32_t Flash_Fault_RunCampaign(const Flash_Fault_Backend_t *backend, const Flash_Fault_Step_t *script,
+                                 uint32_t NbOfSteps, Flash_Fault_Stats_t *stats)
+{
+    uint32_t readback[FLASH_NB_32BITWORD_IN_FLASHWORD];
+    uint32_t step;
+    uint32_t index;
+    uint32_t addr;
+    uint32_t fail;
+    uint32_t corrected;
+    uint32_t start;
+    uint32_t elapsed;
+    uint32_t status;
+    uint32_t observed;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->latency.min = 0xFFFFFFFFU;
+    stats->handler.min = 0xFFFFFFFFU;
+
+    for(step = 0; step < NbOfSteps; step++){
+        if(!FLASH_GEO_IS_ALIGNED(script[step].address) || (script[step].count == 0U) ||
+           !FLASH_GEO_SAME_BANK(script[step].address, script[step].count << FLASH_GEO_FLASHWORD_SHIFT)){
+            return FLASH_ERROR;
+        }
+
+        for(index = 0; index < script[step].count; index++){
+            addr = script[step].address + (index << FLASH_GEO_FLASHWORD_SHIFT);
+
+            /* Injection needs erased flashwords: start each sector clean */
+            if((index == 0U) || (FLASH_GEO_FLASHWORD(addr) == 0U)){
+                if(backend->erase_sector(addr) != FLASH_OK){
+                    return FLASH_ERROR;
+                }
+            }
+
+            stats->injections++;
+            if(backend->inject(addr, script[step].kind, stats->injections) != FLASH_OK){
+                stats->inject_failures++;
+                continue;
+            }
+
+            corrected = backend->corrected();
+            fail = 0;
+            start = backend->ticks();
+            status = backend->read(readback, addr, sizeof(readback), &fail);
+
+            /* Corrected errors are reported asynchronously by the handler */
+            while((status == FLASH_OK) && (backend->corrected() == corrected) &&
+                  ((backend->ticks() - start) < FLASH_FAULT_DETECT_WINDOW)){
+            }
+            elapsed = backend->ticks() - start;
+
+            if(status == FLASH_ECC_ERROR){
+                observed = FLASH_FAULT_DOUBLE;
+                if(fail == addr){
+                    stats->recovered++;
+                }
+            }else if(backend->corrected() != corrected){
+                observed = FLASH_FAULT_SINGLE;
+            }else{
+                observed = FLASH_FAULT_NONE;
+            }
+
+            stats->detected[observed]++;
+            if(observed != script[step].kind){
+                stats->misclassified++;
+            }
+            if(observed != FLASH_FAULT_NONE){
+                Flash_Fault_Sample(&stats->latency, elapsed);
+                Flash_Fault_Sample(&stats->handler, backend->handler_ticks());
+            }
+        }
+    }
+    return FLASH_OK;
+}
+
+/**
+  * @brief  Builds the two program images of an overprogramming injection:
+  *         second is first with Kind set bits cleared, one per 32-bit word
+  *         so the flips never share a byte lane.
+  */
+void Flash_Fault_Pattern(uint32_t Seed, uint32_t Kind, uint32_t *first, uint32_t *second)
+{
+    uint32_t state = Seed | 1U;
+    uint32_t index;
+    uint32_t word;
+    uint32_t bit;
+
+    for(index = 0; index < FLASH_NB_32BITWORD_IN_FLASHWORD; index++){
+        /* Never all-ones: every word must have bits left to clear */
+        first[index] = Flash_Fault_Next(&state) & 0x7FFFFFFEU;
+        first[index] |= 0x00010001U;
+        second[index] = first[index];
+    }
+
+    word = Flash_Fault_Next(&state) % FLASH_NB_32BITWORD_IN_FLASHWORD;
+    for(index = 0; index < Kind; index++){
+        do{
+            bit = Flash_Fault_Next(&state) & 31U;
+        }while((second[word] & (1UL << bit)) == 0U);
+        second[word] &= ~(1UL << bit);
+        word = (word + 1U) % FLASH_NB_32BITWORD_IN_FLASHWORD;
+    }
+}
+
+static void Flash_Fault_Sample(Flash_Fault_Range_t *range, uint32_t value)
+{
+    if(value < range->min){
+        range->min = value;
+    }
+    if(value > range->max){
+        range->max = value;
+    }
+    range->sum += value;
+    range->samples++;
+}
+
+/* xorshift32 */
+static uint32_t Flash_Fault_Next(uint32_t *state)
+{
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+#ifndef HOST_BUILD
+#include "flash_safe.h"
+
+static uint32_t Flash_Fault_TargetInject(uint32_t FlashAddress, uint32_t Kind, uint32_t Seed)
+{
+    uint32_t first[FLASH_NB_32BITWORD_IN_FLASHWORD];
+    uint32_t second[FLASH_NB_32BITWORD_IN_FLASHWORD];
+
+    Flash_Fault_Pattern(Seed, Kind, first, second);
+
+    /* Same trick as the FlashWord1/2/3 experiment in main.c: the second
+       program clears data bits under ECC computed for the first image */
+    if(Flash_Program(FlashAddress, (uint32_t)first, 1) != FLASH_OK){
+        return FLASH_ERROR;
+    }
+    return Flash_Program(FlashAddress, (uint32_t)second, 1);
+}
+
+static uint32_t Flash_Fault_TargetErase(uint32_t FlashAddress)
+{
+    return Flash_Sector_Erase(FLASH_GEO_BANK(FlashAddress), FLASH_GEO_SECTOR(FlashAddress), 1);
+}
+
+/* Cycle counter, started here if Flash_Safe_Init has not: stopped, it
+   would report every latency as 0 */
+static uint32_t Flash_Fault_TargetTicks(void)
+{
+    if(READ_BIT(DWT->CTRL, DWT_CTRL_CYCCNTENA_Msk) == 0U){
+        SET_BIT(CoreDebug->DEMCR, CoreDebug_DEMCR_TRCENA_Msk);
+        SET_BIT(DWT->CTRL, DWT_CTRL_CYCCNTENA_Msk);
+    }
+    return DWT->CYCCNT;
+}
+
+static uint32_t Flash_Fault_TargetCorrected(void)
+{
+    return Flash_Safe_EccLog.single_errors;
+}
+
+static uint32_t Flash_Fault_TargetHandler(void)
+{
+    return Flash_Safe_EccLog.handler_cycles;
+}
+
+const Flash_Fault_Backend_t Flash_Fault_TargetBackend =
+{
+    Flash_Fault_TargetInject,
+    Flash_Fault_TargetErase,
+    Flash_Safe_Read,
+    Flash_Fault_TargetTicks,
+    Flash_Fault_TargetCorrected,
+    Flash_Fault_TargetHandler
+};
+#endif
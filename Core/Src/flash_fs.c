@@ -0,0 +1,678 @@
+/**
+  ******************************************************************************
+  * @file    flash_fs.c
+  * @brief   This file provides a small log-structured file system for the
+             flashword/sector geometry: nothing is ever reprogrammed in
+             place. Every block is written once to the head sector and
+             described by a tag flashword in the sector's first block; the
+             directory and the per-file inodes are rewritten copy-on-write,
+             and the newest valid directory tag is the commit point. Sectors
+             are reclaimed whole by a collector that moves their live blocks,
+             and the least erased free sector is always taken next.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <string.h>
+#include "flash_fs.h"
+#include "flash_if.h"
+
+#define FLASH_FS_SECTOR_MAGIC   0x53534646U     /* "FFSS" */
+#define FLASH_FS_TAG_MAGIC      0x54534646U     /* "FFST" */
+#define FLASH_FS_DIR_MAGIC      0x44534646U     /* "FFSD" */
+#define FLASH_FS_INODE_MAGIC    0x49534646U     /* "FFSI" */
+
+enum{
+    FLASH_FS_TAG_DATA = 1,
+    FLASH_FS_TAG_INODE,
+    FLASH_FS_TAG_DIR,
+    FLASH_FS_TAG_DEAD           /* block cut short by a reset */
+};
+
+#define FLASH_FS_SECTOR(fs, s)      ((fs)->base + ((uint32_t)(s) << FLASH_GEO_SECTOR_SHIFT))
+#define FLASH_FS_ADDR(fs, b)        (FLASH_FS_SECTOR(fs, (b) / FLASH_FS_BLOCKS_PER_SECTOR) + \
+                                     (((b) % FLASH_FS_BLOCKS_PER_SECTOR) * FLASH_FS_BLOCK_SIZE))
+#define FLASH_FS_TAG_ADDR(fs, b)    (FLASH_FS_SECTOR(fs, (b) / FLASH_FS_BLOCKS_PER_SECTOR) + \
+                                     (((b) % FLASH_FS_BLOCKS_PER_SECTOR) * FLASH_GEO_FLASHWORD_SIZE))
+#define FLASH_FS_IN(b, s)           (((b) / FLASH_FS_BLOCKS_PER_SECTOR) == (s))
+#define FLASH_FS_BIT(b)             (1ULL << ((b) % FLASH_FS_BLOCKS_PER_SECTOR))
+#define FLASH_FS_VALID(fs, b)       (((b) < ((fs)->nb_sectors * FLASH_FS_BLOCKS_PER_SECTOR)) && \
+                                     (((b) % FLASH_FS_BLOCKS_PER_SECTOR) != 0U))
+#define FLASH_FS_LENGTH(size, i)    ((((size) - ((i) * FLASH_FS_BLOCK_SIZE)) < FLASH_FS_BLOCK_SIZE) ? \
+                                     ((size) - ((i) * FLASH_FS_BLOCK_SIZE)) : FLASH_FS_BLOCK_SIZE)
+
+typedef struct{
+    uint32_t magic;
+    uint32_t erase_count;
+    uint32_t reserved[6];
+}Flash_FS_Header_t;
+
+typedef struct{
+    uint32_t magic;
+    uint32_t type;
+    uint32_t sequence;
+    uint32_t id;
+    uint32_t length;
+    uint32_t crc;           /* CRC-32 of the block's length bytes */
+    uint32_t reserved[2];
+}Flash_FS_Tag_t;
+
+_Static_assert((FLASH_FS_BLOCKS_PER_SECTOR * FLASH_GEO_FLASHWORD_SIZE) == FLASH_FS_BLOCK_SIZE, "tag table is one block");
+_Static_assert(FLASH_FS_BLOCKS_PER_SECTOR <= 64U, "live map is 64 bits per sector");
+_Static_assert(sizeof(Flash_FS_Tag_t) == FLASH_GEO_FLASHWORD_SIZE, "tag is one flashword");
+_Static_assert(sizeof(Flash_FS_Header_t) == FLASH_GEO_FLASHWORD_SIZE, "header is one flashword");
+_Static_assert(sizeof(Flash_FS_Entry_t) == 32U, "directory entry");
+_Static_assert(sizeof(Flash_FS_Dir_t) <= FLASH_FS_BLOCK_SIZE, "directory fits a block");
+_Static_assert(sizeof(Flash_FS_Inode_t) <= FLASH_FS_BLOCK_SIZE, "inode fits a block");
+_Static_assert((FLASH_FS_MAX_SECTORS * FLASH_FS_BLOCKS_PER_SECTOR) <= 0x10000U, "block numbers are 16 bits");
+
+static uint32_t Flash_FS_Erase(Flash_FS_t *fs, uint32_t sector);
+static uint32_t Flash_FS_Alloc(Flash_FS_t *fs, uint16_t *block);
+static uint32_t Flash_FS_Program(Flash_FS_t *fs, uint32_t type, uint32_t id, const void *data, uint32_t Length, uint16_t *block);
+static uint32_t Flash_FS_CommitDir(Flash_FS_t *fs);
+static uint32_t Flash_FS_Reserve(Flash_FS_t *fs, uint32_t needed);
+static uint32_t Flash_FS_Collect(Flash_FS_t *fs, uint32_t victim);
+static uint32_t Flash_FS_Room(const Flash_FS_t *fs);
+static uint32_t Flash_FS_Release(Flash_FS_t *fs, const Flash_FS_Entry_t *entry);
+static const uint32_t *Flash_FS_Cached(Flash_FS_t *fs, uint16_t block);
+static Flash_FS_Entry_t *Flash_FS_Find(Flash_FS_t *fs, const char *name);
+static uint32_t Flash_FS_Live(const Flash_FS_t *fs, uint32_t sector);
+static uint32_t Flash_FS_IsBlank(const uint32_t *data, uint32_t NbOfWords);
+
+uint32_t Flash_FS_Mount(Flash_FS_t *fs, const Flash_Stream_Backend_t *backend,
+                        uint32_t FlashAddress, uint32_t NbOfSectors, uint32_t Format)
+{
+    const Flash_FS_Tag_t *tag = (const Flash_FS_Tag_t *)fs->scratch;
+    const Flash_FS_Header_t *header = (const Flash_FS_Header_t *)fs->scratch;
+    const Flash_FS_Inode_t *inode;
+    Flash_FS_Tag_t dead;
+    uint32_t sector;
+    uint32_t slot;
+    uint32_t index;
+    uint32_t known = 0;
+    uint8_t formatted[FLASH_FS_MAX_SECTORS];
+    uint64_t total = 0;
+    uint32_t newest = FLASH_FS_NO_SECTOR;
+    uint32_t dir_sequence = 0;
+    uint32_t dir_crc = 0;
+    uint32_t dir_length = 0;
+    uint32_t fail;
+
+    memset(fs, 0, sizeof(*fs));
+    fs->backend = backend;
+    fs->base = FlashAddress;
+    fs->nb_sectors = NbOfSectors;
+    fs->head = FLASH_FS_NO_SECTOR;
+    fs->dir.next_id = 1;
+
+    if(((FLASH_GEO_OFFSET(FlashAddress) & (FLASH_GEO_SECTOR_SIZE - 1U)) != 0U) || (NbOfSectors < 3U) ||
+       (NbOfSectors > FLASH_FS_MAX_SECTORS) || !FLASH_GEO_SAME_BANK(FlashAddress, NbOfSectors << FLASH_GEO_SECTOR_SHIFT)){
+        fs->status = FLASH_ERROR;
+        return fs->status;
+    }
+
+    /* Each tag table flashword by flashword: the used slots, the newest
+       tag and the newest directory */
+    memset(formatted, 0, sizeof(formatted));
+    for(sector = 0; sector < NbOfSectors; sector++){
+        if((backend->read(fs->scratch, FLASH_FS_SECTOR(fs, sector), FLASH_GEO_FLASHWORD_SIZE, &fail) != FLASH_OK) ||
+           (header->magic != FLASH_FS_SECTOR_MAGIC)){
+            continue;
+        }
+        fs->erase_count[sector] = header->erase_count;
+        total += header->erase_count;
+        formatted[sector] = 1;
+        known++;
+        if(Format != 0U){
+            continue;
+        }
+
+        /* Tags are programmed in slot order; the first blank one ends the table */
+        for(slot = 1; slot < FLASH_FS_BLOCKS_PER_SECTOR; slot++){
+            /* A tag torn while programmed reads back with an ECC error:
+               its slot is retired, the rest of the sector stays */
+            if(backend->read(fs->scratch, FLASH_FS_TAG_ADDR(fs, (sector * FLASH_FS_BLOCKS_PER_SECTOR) + slot),
+                             FLASH_GEO_FLASHWORD_SIZE, &fail) != FLASH_OK){
+                continue;
+            }
+            if(Flash_FS_IsBlank(fs->scratch, FLASH_GEO_FLASHWORD_SIZE / 4U)){
+                break;
+            }
+            /* Retired slots carry no data and do not count as the newest tag */
+            if((tag->magic != FLASH_FS_TAG_MAGIC) || (tag->type == FLASH_FS_TAG_DEAD)){
+                continue;
+            }
+            if(tag->sequence > fs->sequence){
+                fs->sequence = tag->sequence;
+                newest = sector;
+            }
+            if((tag->type == FLASH_FS_TAG_DIR) && (tag->sequence > dir_sequence)){
+                dir_sequence = tag->sequence;
+                fs->dir_block = (uint16_t)((sector * FLASH_FS_BLOCKS_PER_SECTOR) + slot);
+                dir_crc = tag->crc;
+                dir_length = tag->length;
+            }
+        }
+        fs->used[sector] = (uint8_t)slot;
+    }
+
+    /* Sectors without a header (blank, torn erase, foreign data) are
+       erased and credited with the mean erase count */
+    for(sector = 0; (sector < NbOfSectors) && (fs->status == FLASH_OK); sector++){
+        if(fs->used[sector] == 0U){
+            if(formatted[sector] == 0U){
+                fs->erase_count[sector] = (known != 0U) ? (uint32_t)(total / known) : 0U;
+            }
+            fs->status = Flash_FS_Erase(fs, sector);
+        }
+    }
+
+    /* A block whose tag never made it may still be partly programmed,
+       anywhere in it: unless the whole block reads back blank its slot is
+       retired so that nothing is programmed over it */
+    memset(&dead, 0xFF, sizeof(dead));
+    dead.magic = FLASH_FS_TAG_MAGIC;
+    dead.type = FLASH_FS_TAG_DEAD;
+    for(sector = 0; (sector < NbOfSectors) && (fs->status == FLASH_OK); sector++){
+        slot = fs->used[sector];
+        if((slot < FLASH_FS_BLOCKS_PER_SECTOR) &&
+           ((backend->read(fs->scratch, FLASH_FS_SECTOR(fs, sector) + (slot * FLASH_FS_BLOCK_SIZE), FLASH_FS_BLOCK_SIZE, &fail) != FLASH_OK) ||
+            !Flash_FS_IsBlank(fs->scratch, FLASH_FS_BLOCK_SIZE / 4U))){
+            dead.sequence = ++fs->sequence;
+            fs->status = backend->program(FLASH_FS_SECTOR(fs, sector) + (slot * FLASH_GEO_FLASHWORD_SIZE), (const uint32_t *)&dead, 1);
+            fs->used[sector]++;
+        }
+    }
+    if((newest != FLASH_FS_NO_SECTOR) && (fs->used[newest] < FLASH_FS_BLOCKS_PER_SECTOR)){
+        fs->head = newest;
+    }
+
+    if((fs->status == FLASH_OK) && (fs->dir_block != 0U)){
+        if((dir_length != sizeof(fs->dir)) ||
+           (backend->read(&fs->dir, FLASH_FS_ADDR(fs, fs->dir_block), sizeof(fs->dir), &fail) != FLASH_OK) ||
+           (Flash_Stream_Crc(0, &fs->dir, sizeof(fs->dir)) != dir_crc) || (fs->dir.magic != FLASH_FS_DIR_MAGIC) ||
+           (fs->dir.count > FLASH_FS_MAX_FILES)){
+            /* The tag is only programmed after its block, so this is
+               corruption rather than a torn update */
+            fs->status = FLASH_ERROR;
+            return fs->status;
+        }
+        fs->live[fs->dir_block / FLASH_FS_BLOCKS_PER_SECTOR] |= FLASH_FS_BIT(fs->dir_block);
+
+        for(index = 0; index < fs->dir.count; index++){
+            inode = (FLASH_FS_VALID(fs, fs->dir.entry[index].inode)) ?
+                    (const Flash_FS_Inode_t *)Flash_FS_Cached(fs, fs->dir.entry[index].inode) : NULL;
+            if((inode == NULL) || (inode->magic != FLASH_FS_INODE_MAGIC) || (inode->nb_blocks > FLASH_FS_INODE_BLOCKS)){
+                fs->status = FLASH_ERROR;
+                return fs->status;
+            }
+            fs->live[fs->dir.entry[index].inode / FLASH_FS_BLOCKS_PER_SECTOR] |= FLASH_FS_BIT(fs->dir.entry[index].inode);
+            for(slot = 0; slot < inode->nb_blocks; slot++){
+                if(FLASH_FS_VALID(fs, inode->block[slot])){
+                    fs->live[inode->block[slot] / FLASH_FS_BLOCKS_PER_SECTOR] |= FLASH_FS_BIT(inode->block[slot]);
+                }
+            }
+        }
+    }
+    if(fs->status == FLASH_OK){
+        fs->dir.magic = FLASH_FS_DIR_MAGIC;
+    }
+    return fs->status;
+}
+
+uint32_t Flash_FS_Write(Flash_FS_t *fs, const char *name, const void *data, uint32_t Size)
+{
+    Flash_FS_Entry_t *entry;
+    uint32_t nb_blocks = (Size + FLASH_FS_BLOCK_SIZE - 1U) / FLASH_FS_BLOCK_SIZE;
+    uint32_t index;
+    uint16_t inode;
+
+    if(fs->status != FLASH_OK){
+        return fs->status;
+    }
+    if((name[0] == '\0') || (strlen(name) >= FLASH_FS_NAME_MAX) || (nb_blocks > FLASH_FS_INODE_BLOCKS) ||
+       ((Flash_FS_Find(fs, name) == NULL) && (fs->dir.count == FLASH_FS_MAX_FILES))){
+        return FLASH_ERROR;
+    }
+    /* Data blocks, the inode and the directory */
+    if(Flash_FS_Reserve(fs, nb_blocks + 2U) != FLASH_OK){
+        return FLASH_ERROR;
+    }
+    entry = Flash_FS_Find(fs, name);
+
+    memset(&fs->inode, 0xFF, sizeof(fs->inode));
+    fs->inode.magic = FLASH_FS_INODE_MAGIC;
+    fs->inode.id = (entry != NULL) ? entry->id : fs->dir.next_id;
+    fs->inode.size = Size;
+    fs->inode.nb_blocks = nb_blocks;
+    for(index = 0; (index < nb_blocks) && (fs->status == FLASH_OK); index++){
+        fs->status = Flash_FS_Program(fs, FLASH_FS_TAG_DATA, fs->inode.id, (const uint8_t *)data + (index * FLASH_FS_BLOCK_SIZE),
+                                      FLASH_FS_LENGTH(Size, index), &fs->inode.block[index]);
+    }
+    if(fs->status == FLASH_OK){
+        /* Only the used part of the block list is programmed */
+        fs->status = Flash_FS_Program(fs, FLASH_FS_TAG_INODE, fs->inode.id, &fs->inode,
+                                      (uint32_t)((uint8_t *)&fs->inode.block[nb_blocks] - (uint8_t *)&fs->inode), &inode);
+    }
+    if(fs->status != FLASH_OK){
+        return fs->status;
+    }
+
+    if(entry != NULL){
+        fs->status = Flash_FS_Release(fs, entry);
+    }else{
+        entry = &fs->dir.entry[fs->dir.count++];
+        memset(entry, 0, sizeof(*entry));
+        strcpy(entry->name, name);
+        entry->id = (uint16_t)fs->dir.next_id++;
+    }
+    entry->size = Size;
+    entry->inode = inode;
+    if(fs->status == FLASH_OK){
+        fs->status = Flash_FS_CommitDir(fs);
+    }
+    return fs->status;
+}
+
+uint32_t Flash_FS_Read(Flash_FS_t *fs, const char *name, uint32_t Offset, void *dest, uint32_t Length, uint32_t *Read)
+{
+    const Flash_FS_Entry_t *entry = Flash_FS_Find(fs, name);
+    const Flash_FS_Inode_t *inode;
+    const uint32_t *data;
+    uint32_t done = 0;
+    uint32_t within;
+    uint32_t count;
+    uint32_t fail;
+    uint16_t block;
+
+    *Read = 0;
+    if((fs->status != FLASH_OK) || (entry == NULL)){
+        return FLASH_ERROR;
+    }
+    if(Offset >= entry->size){
+        return FLASH_OK;
+    }
+    if(Length > (entry->size - Offset)){
+        Length = entry->size - Offset;
+    }
+
+    while(done < Length){
+        within = (Offset + done) % FLASH_FS_BLOCK_SIZE;
+        count = ((Length - done) < (FLASH_FS_BLOCK_SIZE - within)) ? (Length - done) : (FLASH_FS_BLOCK_SIZE - within);
+
+        /* The inode is looked up again for every block so it stays the
+           most recently used cache entry */
+        inode = (const Flash_FS_Inode_t *)Flash_FS_Cached(fs, entry->inode);
+        if(inode == NULL){
+            return FLASH_ERROR;
+        }
+        block = inode->block[(Offset + done) / FLASH_FS_BLOCK_SIZE];
+
+        if(count == FLASH_FS_BLOCK_SIZE){
+            /* Whole blocks bypass the cache instead of flushing it */
+            if(fs->backend->read((uint8_t *)dest + done, FLASH_FS_ADDR(fs, block), FLASH_FS_BLOCK_SIZE, &fail) != FLASH_OK){
+                return FLASH_ERROR;
+            }
+        }else{
+            data = Flash_FS_Cached(fs, block);
+            if(data == NULL){
+                return FLASH_ERROR;
+            }
+            memcpy((uint8_t *)dest + done, (const uint8_t *)data + within, count);
+        }
+        done += count;
+        *Read = done;
+    }
+    return FLASH_OK;
+}
+
+uint32_t Flash_FS_Delete(Flash_FS_t *fs, const char *name)
+{
+    Flash_FS_Entry_t *entry;
+
+    if((fs->status != FLASH_OK) || (Flash_FS_Find(fs, name) == NULL) || (Flash_FS_Reserve(fs, 1) != FLASH_OK)){
+        return FLASH_ERROR;
+    }
+    entry = Flash_FS_Find(fs, name);
+    fs->status = Flash_FS_Release(fs, entry);
+    *entry = fs->dir.entry[--fs->dir.count];
+    if(fs->status == FLASH_OK){
+        fs->status = Flash_FS_CommitDir(fs);
+    }
+    return fs->status;
+}
+
+uint32_t Flash_FS_Size(Flash_FS_t *fs, const char *name, uint32_t *Size)
+{
+    const Flash_FS_Entry_t *entry = Flash_FS_Find(fs, name);
+
+    if((fs->status != FLASH_OK) || (entry == NULL)){
+        return FLASH_ERROR;
+    }
+    *Size = entry->size;
+    return FLASH_OK;
+}
+
+uint32_t Flash_FS_Free(Flash_FS_t *fs)
+{
+    uint32_t live = 0;
+    uint32_t sector;
+
+    for(sector = 0; sector < fs->nb_sectors; sector++){
+        live += Flash_FS_Live(fs, sector);
+    }
+    return ((fs->nb_sectors - 1U) * FLASH_FS_DATA_PER_SECTOR) - live;
+}
+
+static uint32_t Flash_FS_Erase(Flash_FS_t *fs, uint32_t sector)
+{
+    Flash_FS_Header_t header;
+    uint32_t index;
+    uint32_t status;
+
+    for(index = 0; index < FLASH_FS_CACHE_BLOCKS; index++){
+        if((fs->cache[index].block != 0U) && FLASH_FS_IN(fs->cache[index].block, sector)){
+            fs->cache[index].block = 0;
+            fs->cache[index].stamp = 0;
+        }
+    }
+
+    memset(&header, 0xFF, sizeof(header));
+    header.magic = FLASH_FS_SECTOR_MAGIC;
+    header.erase_count = ++fs->erase_count[sector];
+
+    status = fs->backend->erase_sector(FLASH_FS_SECTOR(fs, sector));
+    if(status == FLASH_OK){
+        status = fs->backend->program(FLASH_FS_SECTOR(fs, sector), (const uint32_t *)&header, 1);
+    }
+    fs->used[sector] = 1;
+    fs->live[sector] = 0;
+    fs->stats.erases++;
+    return status;
+}
+
+/* Next slot of the head sector; a new head is the least erased free
+   sector, and the last free sector is kept for the collector */
+static uint32_t Flash_FS_Alloc(Flash_FS_t *fs, uint16_t *block)
+{
+    uint32_t sector;
+    uint32_t best = FLASH_FS_NO_SECTOR;
+    uint32_t free = 0;
+
+    if((fs->head == FLASH_FS_NO_SECTOR) || (fs->used[fs->head] == FLASH_FS_BLOCKS_PER_SECTOR)){
+        for(sector = 0; sector < fs->nb_sectors; sector++){
+            if((fs->used[sector] == 1U) && (sector != fs->head)){
+                free++;
+                if((best == FLASH_FS_NO_SECTOR) || (fs->erase_count[sector] < fs->erase_count[best])){
+                    best = sector;
+                }
+            }
+        }
+        if((best == FLASH_FS_NO_SECTOR) || ((free == 1U) && (fs->collecting == 0U))){
+            return FLASH_ERROR;
+        }
+        fs->head = best;
+    }
+    *block = (uint16_t)((fs->head * FLASH_FS_BLOCKS_PER_SECTOR) + fs->used[fs->head]);
+    fs->used[fs->head]++;
+    return FLASH_OK;
+}
+
+/* Block first, tag last: a block without its tag is never referenced */
+static uint32_t Flash_FS_Program(Flash_FS_t *fs, uint32_t type, uint32_t id, const void *data, uint32_t Length, uint16_t *block)
+{
+    uint32_t stage[FLASH_GEO_FLASHWORD_SIZE / 4U];
+    Flash_FS_Tag_t tag;
+    uint32_t full = Length / FLASH_GEO_FLASHWORD_SIZE;
+    uint32_t tail = Length % FLASH_GEO_FLASHWORD_SIZE;
+    uint32_t status;
+
+    if(Flash_FS_Alloc(fs, block) != FLASH_OK){
+        return FLASH_ERROR;
+    }
+
+    status = (full != 0U) ? fs->backend->program(FLASH_FS_ADDR(fs, *block), (const uint32_t *)data, full) : FLASH_OK;
+    if((status == FLASH_OK) && (tail != 0U)){
+        memset(stage, 0xFF, sizeof(stage));
+        memcpy(stage, (const uint8_t *)data + (full * FLASH_GEO_FLASHWORD_SIZE), tail);
+        status = fs->backend->program(FLASH_FS_ADDR(fs, *block) + (full * FLASH_GEO_FLASHWORD_SIZE), stage, 1);
+        full++;
+    }
+
+    memset(&tag, 0xFF, sizeof(tag));
+    tag.magic = FLASH_FS_TAG_MAGIC;
+    tag.type = type;
+    tag.sequence = ++fs->sequence;
+    tag.id = id;
+    tag.length = Length;
+    tag.crc = Flash_Stream_Crc(0, data, Length);
+    if(status == FLASH_OK){
+        status = fs->backend->program(FLASH_FS_TAG_ADDR(fs, *block), (const uint32_t *)&tag, 1);
+    }
+
+    fs->live[*block / FLASH_FS_BLOCKS_PER_SECTOR] |= FLASH_FS_BIT(*block);
+    fs->stats.blocks++;
+    fs->stats.flashwords += full + 1U;
+    return status;
+}
+
+static uint32_t Flash_FS_CommitDir(Flash_FS_t *fs)
+{
+    uint16_t old = fs->dir_block;
+    uint32_t status;
+
+    fs->dir.sequence = fs->sequence + 1U;
+    status = Flash_FS_Program(fs, FLASH_FS_TAG_DIR, 0, &fs->dir, sizeof(fs->dir), &fs->dir_block);
+    if((status == FLASH_OK) && (old != 0U)){
+        fs->live[old / FLASH_FS_BLOCKS_PER_SECTOR] &= ~FLASH_FS_BIT(old);
+    }
+    return status;
+}
+
+/* Collects until needed blocks fit without touching the reserve sector,
+   then makes at most one wear-leveling move of cold data */
+static uint32_t Flash_FS_Reserve(Flash_FS_t *fs, uint32_t needed)
+{
+    uint32_t target = needed + FLASH_FS_DATA_PER_SECTOR;
+    uint32_t sector;
+    uint32_t victim;
+    uint32_t cold;
+    uint32_t hottest = 0;
+    uint32_t room;
+
+    while(Flash_FS_Room(fs) < target){
+        /* Greedy: the sector with the most dead blocks */
+        victim = FLASH_FS_NO_SECTOR;
+        for(sector = 0; sector < fs->nb_sectors; sector++){
+            if((sector != fs->head) && (fs->used[sector] > 1U) &&
+               ((victim == FLASH_FS_NO_SECTOR) || ((fs->used[sector] - Flash_FS_Live(fs, sector)) >
+                                                   (fs->used[victim] - Flash_FS_Live(fs, victim))))){
+                victim = sector;
+            }
+        }
+        room = Flash_FS_Room(fs);
+        /* A moved block may drag its inode along, plus one directory */
+        if((victim == FLASH_FS_NO_SECTOR) || (((2U * Flash_FS_Live(fs, victim)) + 1U) > room) ||
+           (Flash_FS_Collect(fs, victim) != FLASH_OK) || (Flash_FS_Room(fs) <= room)){
+            return FLASH_ERROR;
+        }
+    }
+
+    cold = FLASH_FS_NO_SECTOR;
+    for(sector = 0; sector < fs->nb_sectors; sector++){
+        hottest = (fs->erase_count[sector] > hottest) ? fs->erase_count[sector] : hottest;
+        if((sector != fs->head) && (fs->used[sector] > 1U) &&
+           ((cold == FLASH_FS_NO_SECTOR) || (fs->erase_count[sector] < fs->erase_count[cold]))){
+            cold = sector;
+        }
+    }
+    if((cold != FLASH_FS_NO_SECTOR) && ((hottest - fs->erase_count[cold]) > FLASH_FS_WEAR_DELTA) &&
+       ((Flash_FS_Room(fs) - target) >= ((2U * Flash_FS_Live(fs, cold)) + 1U))){
+        return Flash_FS_Collect(fs, cold);
+    }
+    return FLASH_OK;
+}
+
+/* Moves every live block out of the victim, rewriting the inodes that
+   point into it, commits a directory and erases the victim */
+static uint32_t Flash_FS_Collect(Flash_FS_t *fs, uint32_t victim)
+{
+    Flash_FS_Entry_t *entry;
+    const Flash_FS_Inode_t *inode;
+    uint32_t index;
+    uint32_t slot;
+    uint32_t touched;
+    uint32_t fail;
+    uint16_t block;
+    uint32_t status = FLASH_OK;
+
+    fs->collecting = 1;
+    fs->stats.collections++;
+    for(index = 0; (index < fs->dir.count) && (status == FLASH_OK); index++){
+        entry = &fs->dir.entry[index];
+        inode = (const Flash_FS_Inode_t *)Flash_FS_Cached(fs, entry->inode);
+        if(inode == NULL){
+            status = FLASH_ERROR;
+            break;
+        }
+        memcpy(&fs->inode, inode, sizeof(fs->inode));
+
+        touched = FLASH_FS_IN(entry->inode, victim);
+        for(slot = 0; slot < fs->inode.nb_blocks; slot++){
+            touched |= FLASH_FS_IN(fs->inode.block[slot], victim);
+        }
+        if(touched == 0U){
+            continue;
+        }
+
+        for(slot = 0; (slot < fs->inode.nb_blocks) && (status == FLASH_OK); slot++){
+            if(!FLASH_FS_IN(fs->inode.block[slot], victim)){
+                continue;
+            }
+            status = fs->backend->read(fs->scratch, FLASH_FS_ADDR(fs, fs->inode.block[slot]),
+                                       FLASH_FS_LENGTH(entry->size, slot), &fail);
+            if(status == FLASH_OK){
+                status = Flash_FS_Program(fs, FLASH_FS_TAG_DATA, entry->id, fs->scratch,
+                                          FLASH_FS_LENGTH(entry->size, slot), &fs->inode.block[slot]);
+                fs->stats.moved++;
+            }
+        }
+        if(status == FLASH_OK){
+            status = Flash_FS_Program(fs, FLASH_FS_TAG_INODE, entry->id, &fs->inode,
+                                      (uint32_t)((uint8_t *)&fs->inode.block[fs->inode.nb_blocks] - (uint8_t *)&fs->inode), &block);
+            fs->live[entry->inode / FLASH_FS_BLOCKS_PER_SECTOR] &= ~FLASH_FS_BIT(entry->inode);
+            entry->inode = block;
+        }
+    }
+    if(status == FLASH_OK){
+        status = Flash_FS_CommitDir(fs);
+    }
+    /* Only once the directory no longer points into it */
+    if(status == FLASH_OK){
+        status = Flash_FS_Erase(fs, victim);
+    }
+    fs->collecting = 0;
+    if(status != FLASH_OK){
+        fs->status = status;
+    }
+    return status;
+}
+
+static uint32_t Flash_FS_Room(const Flash_FS_t *fs)
+{
+    uint32_t room = 0;
+    uint32_t sector;
+
+    for(sector = 0; sector < fs->nb_sectors; sector++){
+        if(sector == fs->head){
+            room += FLASH_FS_BLOCKS_PER_SECTOR - fs->used[sector];
+        }else if(fs->used[sector] == 1U){
+            room += FLASH_FS_DATA_PER_SECTOR;
+        }
+    }
+    return room;
+}
+
+/* Drops the live marks of a file's current inode and data blocks */
+static uint32_t Flash_FS_Release(Flash_FS_t *fs, const Flash_FS_Entry_t *entry)
+{
+    const Flash_FS_Inode_t *inode = (const Flash_FS_Inode_t *)Flash_FS_Cached(fs, entry->inode);
+    uint32_t slot;
+
+    if(inode == NULL){
+        return FLASH_ERROR;
+    }
+    for(slot = 0; slot < inode->nb_blocks; slot++){
+        fs->live[inode->block[slot] / FLASH_FS_BLOCKS_PER_SECTOR] &= ~FLASH_FS_BIT(inode->block[slot]);
+    }
+    fs->live[entry->inode / FLASH_FS_BLOCKS_PER_SECTOR] &= ~FLASH_FS_BIT(entry->inode);
+    return FLASH_OK;
+}
+
+/* LRU block cache; empty entries have the oldest stamp and go first */
+static const uint32_t *Flash_FS_Cached(Flash_FS_t *fs, uint16_t block)
+{
+    Flash_FS_Cache_t *entry;
+    uint32_t index;
+    uint32_t victim = 0;
+    uint32_t fail;
+
+    fs->clock++;
+    for(index = 0; index < FLASH_FS_CACHE_BLOCKS; index++){
+        if(fs->cache[index].block == block){
+            fs->cache[index].stamp = fs->clock;
+            fs->stats.cache_hits++;
+            return fs->cache[index].data;
+        }
+        if(fs->cache[index].stamp < fs->cache[victim].stamp){
+            victim = index;
+        }
+    }
+
+    fs->stats.cache_misses++;
+    entry = &fs->cache[victim];
+    if(fs->backend->read(entry->data, FLASH_FS_ADDR(fs, block), FLASH_FS_BLOCK_SIZE, &fail) != FLASH_OK){
+        entry->block = 0;
+        entry->stamp = 0;
+        return NULL;
+    }
+    entry->block = block;
+    entry->stamp = fs->clock;
+    return entry->data;
+}
+
+static Flash_FS_Entry_t *Flash_FS_Find(Flash_FS_t *fs, const char *name)
+{
+    uint32_t index;
+
+    for(index = 0; index < fs->dir.count; index++){
+        if(strncmp(fs->dir.entry[index].name, name, FLASH_FS_NAME_MAX) == 0){
+            return &fs->dir.entry[index];
+        }
+    }
+    return NULL;
+}
+
+static uint32_t Flash_FS_Live(const Flash_FS_t *fs, uint32_t sector)
+{
+    return (uint32_t)__builtin_popcountll(fs->live[sector]);
+}
+
+static uint32_t Flash_FS_IsBlank(const uint32_t *data, uint32_t NbOfWords)
+{
+    while(NbOfWords-- != 0U){
+        if(*data++ != 0xFFFFFFFFU){
+            return 0U;
+        }
+    }
+    return 1U;
+}
@@ -0,0 +1,275 @@
+/**
+  ******************************************************************************
+  * @file    flash_kernel.c
+  * @brief   This file provides bulk compare, pattern check and blank check
+             kernels for memory-mapped flash. The aligned middle of a range
+             is read a flashword at a time with one 8-register LDM burst, the
+             words are XORed against the expected value and OR-reduced so a
+             whole flashword costs one branch; the byte that differs is only
+             located once a flashword fails. Unaligned heads and tails go
+             byte by byte. Host builds use a C version of the same bursts.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stdint.h>
+#include <string.h>
+#include "flash_kernel.h"
+
+#define FLASH_KERNEL_BLOCK      32U     /* one flashword, one LDM burst */
+
+/* Both return the blocks left from the first mismatching one, 0 if all
+   match; NbOfBlocks must not be 0 */
+static uint32_t Flash_Kernel_CompareBurst(const uint32_t *flash, const uint32_t *data, uint32_t NbOfBlocks);
+static uint32_t Flash_Kernel_CheckBurst(const uint32_t *flash, uint32_t NbOfBlocks, uint32_t Pattern);
+static uint32_t Flash_Kernel_CompareWords(const uint8_t *flash, const uint8_t *data, uint32_t Offset, uint32_t Length);
+static uint32_t Flash_Kernel_CompareBytes(const uint8_t *flash, const uint8_t *data, uint32_t Offset, uint32_t Length);
+static uint32_t Flash_Kernel_CheckBytes(const uint8_t *flash, uint32_t Offset, uint32_t Length, uint32_t Pattern);
+
+uint32_t Flash_Kernel_Compare(const void *flash, const void *data, uint32_t Length)
+{
+    const uint8_t *a = (const uint8_t *)flash;
+    const uint8_t *b = (const uint8_t *)data;
+    uint32_t head = (uint32_t)(-(uintptr_t)a) & (FLASH_KERNEL_BLOCK - 1U);
+    uint32_t offset;
+    uint32_t blocks;
+    uint32_t left;
+
+    /* Head: up to the next flashword boundary of the flash side */
+    offset = Flash_Kernel_CompareBytes(a, b, 0U, (head < Length) ? head : Length);
+    if(offset < head){
+        return offset;
+    }
+
+    blocks = (Length - offset) / FLASH_KERNEL_BLOCK;
+    if(blocks != 0U){
+        if((((uintptr_t)b + offset) & 3U) != 0U){
+            /* Data side not word aligned: no LDM, but still word loads */
+            return Flash_Kernel_CompareWords(a, b, offset, Length);
+        }
+        left = Flash_Kernel_CompareBurst((const uint32_t *)(a + offset), (const uint32_t *)(b + offset), blocks);
+        offset += (blocks - left) * FLASH_KERNEL_BLOCK;
+        if(left != 0U){
+            return Flash_Kernel_CompareBytes(a, b, offset, offset + FLASH_KERNEL_BLOCK);
+        }
+    }
+    return Flash_Kernel_CompareBytes(a, b, offset, Length);
+}
+
+uint32_t Flash_Kernel_Check(const void *flash, uint32_t Length, uint32_t Pattern)
+{
+    const uint8_t *a = (const uint8_t *)flash;
+    uint32_t head = (uint32_t)(-(uintptr_t)a) & (FLASH_KERNEL_BLOCK - 1U);
+    uint32_t offset;
+    uint32_t blocks;
+    uint32_t left;
+
+    offset = Flash_Kernel_CheckBytes(a, 0U, (head < Length) ? head : Length, Pattern);
+    if(offset < head){
+        return offset;
+    }
+
+    blocks = (Length - offset) / FLASH_KERNEL_BLOCK;
+    if(blocks != 0U){
+        left = Flash_Kernel_CheckBurst((const uint32_t *)(a + offset), blocks, Pattern);
+        offset += (blocks - left) * FLASH_KERNEL_BLOCK;
+        if(left != 0U){
+            return Flash_Kernel_CheckBytes(a, offset, offset + FLASH_KERNEL_BLOCK, Pattern);
+        }
+    }
+    return Flash_Kernel_CheckBytes(a, offset, Length, Pattern);
+}
+
+#ifdef HOST_BUILD
+static uint32_t Flash_Kernel_CompareBurst(const uint32_t *flash, const uint32_t *data, uint32_t NbOfBlocks)
+{
+    uint32_t diff;
+
+    do{
+        diff = ((flash[0] ^ data[0]) | (flash[1] ^ data[1])) | ((flash[2] ^ data[2]) | (flash[3] ^ data[3])) |
+               ((flash[4] ^ data[4]) | (flash[5] ^ data[5])) | ((flash[6] ^ data[6]) | (flash[7] ^ data[7]));
+        if(diff != 0U){
+            break;
+        }
+        flash += 8;
+        data += 8;
+    }while(--NbOfBlocks != 0U);
+    return NbOfBlocks;
+}
+
+static uint32_t Flash_Kernel_CheckBurst(const uint32_t *flash, uint32_t NbOfBlocks, uint32_t Pattern)
+{
+    uint32_t diff;
+
+    do{
+        diff = ((flash[0] ^ Pattern) | (flash[1] ^ Pattern)) | ((flash[2] ^ Pattern) | (flash[3] ^ Pattern)) |
+               ((flash[4] ^ Pattern) | (flash[5] ^ Pattern)) | ((flash[6] ^ Pattern) | (flash[7] ^ Pattern));
+        if(diff != 0U){
+            break;
+        }
+        flash += 8;
+    }while(--NbOfBlocks != 0U);
+    return NbOfBlocks;
+}
+#else
+/* Flash side in one LDM burst, RAM side in LDRD pairs folded in as they arrive */
+__attribute__((naked, noinline))
+static uint32_t Flash_Kernel_CompareBurst(const uint32_t *flash, const uint32_t *data, uint32_t NbOfBlocks)
+{
+    __asm volatile(
+        "push  {r4-r11}                 \n"
+        "1:                             \n"
+        "ldmia r0!, {r4-r11}            \n"
+        "ldrd  r3, r12, [r1], #8        \n"
+        "eor   r4, r4, r3               \n"
+        "eor   r5, r5, r12              \n"
+        "ldrd  r3, r12, [r1], #8        \n"
+        "eor   r6, r6, r3               \n"
+        "eor   r7, r7, r12              \n"
+        "ldrd  r3, r12, [r1], #8        \n"
+        "eor   r8, r8, r3               \n"
+        "eor   r9, r9, r12              \n"
+        "ldrd  r3, r12, [r1], #8        \n"
+        "eor   r10, r10, r3             \n"
+        "eor   r11, r11, r12            \n"
+        "orr   r4, r4, r5               \n"
+        "orr   r6, r6, r7               \n"
+        "orr   r8, r8, r9               \n"
+        "orr   r10, r10, r11            \n"
+        "orr   r4, r4, r6               \n"
+        "orr   r8, r8, r10              \n"
+        "orrs  r4, r4, r8               \n"
+        "bne   2f                       \n"
+        "subs  r2, r2, #1               \n"
+        "bne   1b                       \n"
+        "2:                             \n"
+        "mov   r0, r2                   \n"
+        "pop   {r4-r11}                 \n"
+        "bx    lr                       \n");
+}
+
+__attribute__((naked, noinline))
+static uint32_t Flash_Kernel_CheckBurst(const uint32_t *flash, uint32_t NbOfBlocks, uint32_t Pattern)
+{
+    __asm volatile(
+        "push  {r4-r11}                 \n"
+        "1:                             \n"
+        "ldmia r0!, {r4-r11}            \n"
+        "eor   r4, r4, r2               \n"
+        "eor   r5, r5, r2               \n"
+        "eor   r6, r6, r2               \n"
+        "eor   r7, r7, r2               \n"
+        "eor   r8, r8, r2               \n"
+        "eor   r9, r9, r2               \n"
+        "eor   r10, r10, r2             \n"
+        "eor   r11, r11, r2             \n"
+        "orr   r4, r4, r5               \n"
+        "orr   r6, r6, r7               \n"
+        "orr   r8, r8, r9               \n"
+        "orr   r10, r10, r11            \n"
+        "orr   r4, r4, r6               \n"
+        "orr   r8, r8, r10              \n"
+        "orrs  r4, r4, r8               \n"
+        "bne   2f                       \n"
+        "subs  r1, r1, #1               \n"
+        "bne   1b                       \n"
+        "2:                             \n"
+        "mov   r0, r1                   \n"
+        "pop   {r4-r11}                 \n"
+        "bx    lr                       \n");
+}
+#endif
+
+static uint32_t Flash_Kernel_CompareWords(const uint8_t *flash, const uint8_t *data, uint32_t Offset, uint32_t Length)
+{
+    uint32_t word;
+
+    /* memcpy of 4 bytes compiles to one unaligned LDR on Cortex-M */
+    for(; (Length - Offset) >= 4U; Offset += 4U){
+        memcpy(&word, data + Offset, 4U);
+        if(*(const uint32_t *)(flash + Offset) != word){
+            break;
+        }
+    }
+    return Flash_Kernel_CompareBytes(flash, data, Offset, Length);
+}
+
+static uint32_t Flash_Kernel_CompareBytes(const uint8_t *flash, const uint8_t *data, uint32_t Offset, uint32_t Length)
+{
+    while((Offset < Length) && (flash[Offset] == data[Offset])){
+        Offset++;
+    }
+    return Offset;
+}
+
+static uint32_t Flash_Kernel_CheckBytes(const uint8_t *flash, uint32_t Offset, uint32_t Length, uint32_t Pattern)
+{
+    while((Offset < Length) &&
+          (flash[Offset] == (uint8_t)(Pattern >> ((((uintptr_t)flash + Offset) & 3U) * 8U)))){
+        Offset++;
+    }
+    return Offset;
+}
+
+#ifdef FLASH_KERNEL_BENCHMARK
+/**
+  * @brief  Cycles of the byte loop, the word loop and the kernel for a
+  *         pattern check (results[0]) and a compare (results[1]). Fill the
+  *         range with Pattern and pass a copy as data so no loop exits early.
+  */
+void Flash_Kernel_Benchmark(const void *flash, const void *data, uint32_t Length, uint32_t Pattern,
+                            Flash_Kernel_Bench_t results[2])
+{
+    const __IO uint8_t *bytes = (const __IO uint8_t *)flash;
+    const __IO uint32_t *words = (const __IO uint32_t *)flash;
+    const uint8_t *ref = (const uint8_t *)data;
+    __IO uint32_t sink = 0;
+    uint32_t index;
+    uint32_t start;
+
+    SET_BIT(CoreDebug->DEMCR, CoreDebug_DEMCR_TRCENA_Msk);
+    SET_BIT(DWT->CTRL, DWT_CTRL_CYCCNTENA_Msk);
+
+    start = DWT->CYCCNT;
+    for(index = 0; (index < Length) && (bytes[index] == (uint8_t)(Pattern >> ((index & 3U) * 8U))); index++){
+    }
+    results[0].naive_cycles = DWT->CYCCNT - start;
+    sink += index;
+
+    start = DWT->CYCCNT;
+    for(index = 0; (index < (Length / 4U)) && (words[index] == Pattern); index++){
+    }
+    results[0].word_cycles = DWT->CYCCNT - start;
+    sink += index;
+
+    start = DWT->CYCCNT;
+    sink += Flash_Kernel_Check(flash, Length, Pattern);
+    results[0].kernel_cycles = DWT->CYCCNT - start;
+
+    start = DWT->CYCCNT;
+    for(index = 0; (index < Length) && (bytes[index] == ref[index]); index++){
+    }
+    results[1].naive_cycles = DWT->CYCCNT - start;
+    sink += index;
+
+    start = DWT->CYCCNT;
+    for(index = 0; (index < (Length / 4U)) && (words[index] == ((const uint32_t *)ref)[index]); index++){
+    }
+    results[1].word_cycles = DWT->CYCCNT - start;
+    sink += index;
+
+    start = DWT->CYCCNT;
+    sink += Flash_Kernel_Compare(flash, data, Length);
+    results[1].kernel_cycles = DWT->CYCCNT - start;
+    (void)sink;
+}
+#endif
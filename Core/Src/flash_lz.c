@@ -0,0 +1,279 @@
+/**
+  ******************************************************************************
+  * @file    flash_lz.c
+  * @brief   This file provides compressed flash objects. The compressor is
+             a streaming LZSS (one flag bit per token, 12-bit offset, 4-bit
+             length) that hands out whole flashwords as they fill; the
+             decompressor pulls one flashword at a time and keeps only the
+             history window, so neither side needs the object in RAM.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <string.h>
+#include "flash_lz.h"
+#include "flash_if.h"
+
+#define FLASH_LZ_MAGIC          0x315A4C46U     /* "FLZ1" */
+#define FLASH_LZ_MASK           (FLASH_LZ_WINDOW - 1U)
+/* The window ring also holds the lookahead, which shortens the reach */
+#define FLASH_LZ_MAX_DIST       (FLASH_LZ_WINDOW - FLASH_LZ_MAX_MATCH)
+
+_Static_assert(FLASH_LZ_WINDOW_BITS <= 12U, "match offset is 12 bits");
+_Static_assert(sizeof(Flash_Lz_Header_t) == FLASH_GEO_FLASHWORD_SIZE, "header is one flashword");
+
+static void Flash_Lz_Encode(Flash_Lz_Writer_t *writer);
+static void Flash_Lz_Emit(Flash_Lz_Writer_t *writer, const uint8_t *bytes, uint32_t Length);
+static void Flash_Lz_FlushGroup(Flash_Lz_Writer_t *writer);
+static uint32_t Flash_Lz_Fetch(Flash_Lz_Reader_t *reader);
+
+__STATIC_INLINE uint32_t Flash_Lz_Hash(const uint8_t *window, uint32_t pos)
+{
+    uint32_t key = window[pos & FLASH_LZ_MASK] | ((uint32_t)window[(pos + 1U) & FLASH_LZ_MASK] << 8) |
+                   ((uint32_t)window[(pos + 2U) & FLASH_LZ_MASK] << 16);
+
+    return (key * 2654435761U) >> (32U - FLASH_LZ_HASH_BITS);
+}
+
+uint32_t Flash_Lz_WriterInit(Flash_Lz_Writer_t *writer, const Flash_Stream_Backend_t *backend,
+                             uint32_t FlashAddress, uint32_t Capacity)
+{
+    memset(writer, 0, sizeof(*writer));
+    writer->backend = backend;
+    writer->base = FlashAddress;
+    writer->next = FlashAddress + FLASH_GEO_FLASHWORD_SIZE;
+    writer->end = FlashAddress + Capacity;
+    writer->group_fill = 1;
+
+    if(!FLASH_GEO_IS_ALIGNED(FlashAddress) || (Capacity <= FLASH_GEO_FLASHWORD_SIZE) ||
+       !FLASH_GEO_SAME_BANK(FlashAddress, Capacity)){
+        writer->status = FLASH_ERROR;
+    }
+    return writer->status;
+}
+
+uint32_t Flash_Lz_Write(Flash_Lz_Writer_t *writer, const void *data, uint32_t Length)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint32_t room;
+    uint32_t chunk;
+
+    writer->crc = Flash_Stream_Crc(writer->crc, data, Length);
+
+    while((Length != 0U) && (writer->status == FLASH_OK)){
+        /* Top up the lookahead without overwriting history still in reach */
+        room = FLASH_LZ_MAX_MATCH - (writer->pos - writer->cur);
+        chunk = (Length < room) ? Length : room;
+        Length -= chunk;
+        while(chunk-- != 0U){
+            writer->window[writer->pos++ & FLASH_LZ_MASK] = *bytes++;
+        }
+        if((writer->pos - writer->cur) == FLASH_LZ_MAX_MATCH){
+            Flash_Lz_Encode(writer);
+        }
+    }
+    return writer->status;
+}
+
+uint32_t Flash_Lz_Finish(Flash_Lz_Writer_t *writer, Flash_Lz_Header_t *header)
+{
+    while((writer->cur != writer->pos) && (writer->status == FLASH_OK)){
+        Flash_Lz_Encode(writer);
+    }
+    Flash_Lz_FlushGroup(writer);
+
+    /* Pad the last flashword with the erased value; the reader stops at
+       raw_size and never decodes the padding */
+    if((writer->stage_fill != 0U) && (writer->status == FLASH_OK)){
+        uint8_t pad[FLASH_GEO_FLASHWORD_SIZE];
+        uint32_t count = FLASH_GEO_FLASHWORD_SIZE - writer->stage_fill;
+
+        memset(pad, 0xFF, sizeof(pad));
+        Flash_Lz_Emit(writer, pad, count);
+        writer->packed -= count;
+    }
+    if(writer->status != FLASH_OK){
+        return writer->status;
+    }
+
+    memset(header, 0xFF, sizeof(*header));
+    header->magic = FLASH_LZ_MAGIC;
+    header->raw_size = writer->pos;
+    header->packed_size = writer->packed;
+    header->crc = writer->crc;
+    header->window_bits = FLASH_LZ_WINDOW_BITS;
+    writer->status = writer->backend->program(writer->base, (const uint32_t *)header, 1);
+    writer->flashwords++;
+    return writer->status;
+}
+
+/* Encodes one token at cur: a back reference when one of at least
+   FLASH_LZ_MIN_MATCH bytes is in reach, a literal otherwise */
+static void Flash_Lz_Encode(Flash_Lz_Writer_t *writer)
+{
+    const uint8_t *window = writer->window;
+    uint32_t cur = writer->cur;
+    uint32_t lookahead = writer->pos - cur;
+    uint32_t length = 0;
+    uint32_t dist = 0;
+    uint32_t cand;
+    uint32_t hash;
+
+    if(lookahead >= FLASH_LZ_MIN_MATCH){
+        hash = Flash_Lz_Hash(window, cur);
+        /* head[] keeps 16 bits of the position; the distance check and the
+           byte compare reject anything stale */
+        cand = (cur & ~0xFFFFU) | writer->head[hash];
+        if(cand >= cur){
+            cand -= 0x10000U;
+        }
+        dist = cur - cand;
+        if((dist != 0U) && (dist <= FLASH_LZ_MAX_DIST) && (dist <= cur)){
+            while((length < lookahead) && (window[(cand + length) & FLASH_LZ_MASK] == window[(cur + length) & FLASH_LZ_MASK])){
+                length++;
+            }
+        }
+    }
+
+    if(length >= FLASH_LZ_MIN_MATCH){
+        writer->group[writer->group_fill++] = (uint8_t)(dist - 1U);
+        writer->group[writer->group_fill++] = (uint8_t)(((dist - 1U) >> 8) | ((length - FLASH_LZ_MIN_MATCH) << 4));
+    }else{
+        length = 1;
+        writer->group[0] |= (uint8_t)(1U << writer->group_items);
+        writer->group[writer->group_fill++] = window[cur & FLASH_LZ_MASK];
+    }
+
+    /* Every covered position with three bytes behind it becomes a candidate */
+    for(; length != 0U; length--, cur++){
+        if((writer->pos - cur) >= FLASH_LZ_MIN_MATCH){
+            writer->head[Flash_Lz_Hash(window, cur)] = (uint16_t)cur;
+        }
+    }
+    writer->cur = cur;
+
+    if(++writer->group_items == 8U){
+        Flash_Lz_FlushGroup(writer);
+    }
+}
+
+static void Flash_Lz_FlushGroup(Flash_Lz_Writer_t *writer)
+{
+    if(writer->group_items != 0U){
+        Flash_Lz_Emit(writer, writer->group, writer->group_fill);
+    }
+    writer->group[0] = 0;
+    writer->group_fill = 1;
+    writer->group_items = 0;
+}
+
+/* Byte sink: programs a flashword as soon as it is full */
+static void Flash_Lz_Emit(Flash_Lz_Writer_t *writer, const uint8_t *bytes, uint32_t Length)
+{
+    uint8_t *stage = (uint8_t *)writer->stage;
+
+    while((Length-- != 0U) && (writer->status == FLASH_OK)){
+        stage[writer->stage_fill++] = *bytes++;
+        writer->packed++;
+        if(writer->stage_fill == FLASH_GEO_FLASHWORD_SIZE){
+            if(writer->next >= writer->end){
+                writer->status = FLASH_ERROR;   /* object does not fit */
+                return;
+            }
+            writer->status = writer->backend->program(writer->next, writer->stage, 1);
+            writer->next += FLASH_GEO_FLASHWORD_SIZE;
+            writer->flashwords++;
+            writer->stage_fill = 0;
+        }
+    }
+}
+
+uint32_t Flash_Lz_ReaderInit(Flash_Lz_Reader_t *reader, const Flash_Stream_Backend_t *backend, uint32_t FlashAddress)
+{
+    uint32_t fail;
+
+    memset(reader, 0, sizeof(*reader));
+    reader->backend = backend;
+    reader->next = FlashAddress + FLASH_GEO_FLASHWORD_SIZE;
+    reader->in_pos = sizeof(reader->in);
+
+    reader->status = backend->read(&reader->header, FlashAddress, sizeof(reader->header), &fail);
+    if((reader->status == FLASH_OK) && ((reader->header.magic != FLASH_LZ_MAGIC) ||
+       (reader->header.window_bits > FLASH_LZ_WINDOW_BITS) ||
+       !FLASH_GEO_SAME_BANK(FlashAddress, FLASH_LZ_FOOTPRINT(&reader->header)))){
+        reader->status = FLASH_ERROR;
+    }
+    return reader->status;
+}
+
+uint32_t Flash_Lz_Read(Flash_Lz_Reader_t *reader, void *dest, uint32_t Length)
+{
+    uint8_t *out = (uint8_t *)dest;
+    uint32_t produced = 0;
+    uint32_t byte;
+    uint32_t token;
+
+    if(Length > (reader->header.raw_size - reader->total)){
+        Length = reader->header.raw_size - reader->total;
+    }
+
+    while((produced < Length) && (reader->status == FLASH_OK)){
+        if(reader->match_left != 0U){
+            byte = reader->window[(reader->total - reader->match_dist) & FLASH_LZ_MASK];
+            reader->match_left--;
+        }else{
+            if(reader->items == 0U){
+                reader->flags = Flash_Lz_Fetch(reader);
+                reader->items = 8;
+            }
+            reader->items--;
+            if((reader->flags & 1U) != 0U){
+                byte = Flash_Lz_Fetch(reader);
+                reader->flags >>= 1;
+            }else{
+                reader->flags >>= 1;
+                token = Flash_Lz_Fetch(reader);
+                token |= Flash_Lz_Fetch(reader) << 8;
+                reader->match_dist = (token & 0x0FFFU) + 1U;
+                reader->match_left = (token >> 12) + FLASH_LZ_MIN_MATCH;
+                if(reader->match_dist > reader->total){
+                    reader->status = FLASH_ERROR;
+                    break;
+                }
+                continue;
+            }
+        }
+        reader->window[reader->total++ & FLASH_LZ_MASK] = (uint8_t)byte;
+        out[produced++] = (uint8_t)byte;
+    }
+
+    reader->crc = Flash_Stream_Crc(reader->crc, dest, produced);
+    if((reader->status == FLASH_OK) && (reader->total == reader->header.raw_size) && (reader->crc != reader->header.crc)){
+        reader->status = FLASH_ERROR;
+    }
+    return produced;
+}
+
+static uint32_t Flash_Lz_Fetch(Flash_Lz_Reader_t *reader)
+{
+    uint32_t fail;
+
+    if(reader->in_pos == sizeof(reader->in)){
+        if(reader->status == FLASH_OK){
+            reader->status = reader->backend->read(reader->in, reader->next, sizeof(reader->in), &fail);
+        }
+        reader->next += sizeof(reader->in);
+        reader->flashwords++;
+        reader->in_pos = 0;
+    }
+    return reader->in[reader->in_pos++];
+}
@@ -0,0 +1,266 @@
+/**
+  ******************************************************************************
+  * @file    flash_manifest.c
+  * @brief   This file provides the target side of incremental flashing: the
+             host sends the manifest of the new image (see flash_manifest.h),
+             the target hashes what it has in flash, and only the flashwords
+             that differ are requested. A sector is erased only when a
+             changed flashword is already programmed; flashwords that go
+             from erased to programmed are written in place.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <string.h>
+#include "flash_manifest.h"
+#include "flash_if.h"
+
+#define FLASH_MANIFEST_CHUNK        256U
+#define FLASH_MANIFEST_FW_WORDS     (FLASH_GEO_FLASHWORD_SIZE / 4U)
+#define FLASH_MANIFEST_ROTL(x, r)   (((x) << (r)) | ((x) >> (32U - (r))))
+
+_Static_assert((FLASH_MANIFEST_MAX_SECTORS <= 32U), "sector map is one word");
+
+static uint32_t Flash_Manifest_Mix(uint32_t hash, uint32_t value);
+static uint32_t Flash_Manifest_Final(uint32_t hash, uint32_t Length);
+
+uint32_t Flash_Manifest_Hash(const uint32_t *flashword)
+{
+    uint32_t hash = 0;
+    uint32_t index;
+
+    for(index = 0; index < FLASH_MANIFEST_FW_WORDS; index++){
+        hash = Flash_Manifest_Mix(hash, flashword[index]);
+    }
+    return Flash_Manifest_Final(hash, FLASH_GEO_FLASHWORD_SIZE);
+}
+
+uint32_t Flash_Manifest_SectorHash(const uint32_t *FlashwordHashes)
+{
+    uint32_t hash = 0;
+    uint32_t index;
+
+    for(index = 0; index < FLASH_GEO_WORDS_PER_SECTOR; index++){
+        hash = Flash_Manifest_Mix(hash, FlashwordHashes[index]);
+    }
+    return Flash_Manifest_Final(hash, FLASH_GEO_WORDS_PER_SECTOR * 4U);
+}
+
+uint32_t Flash_Manifest_Check(const Flash_Manifest_Header_t *header)
+{
+    if((header->magic != FLASH_MANIFEST_MAGIC) || (header->sectors == 0U) ||
+       ((FLASH_GEO_OFFSET(header->base) & (FLASH_GEO_SECTOR_SIZE - 1U)) != 0U) ||
+       (header->sectors > FLASH_MANIFEST_MAX_SECTORS) ||
+       !FLASH_GEO_IS_VALID(header->base + (header->sectors << FLASH_GEO_SECTOR_SHIFT) - 1U) ||
+       (header->size > (header->sectors << FLASH_GEO_SECTOR_SHIFT))){
+        return FLASH_ERROR;
+    }
+    return FLASH_OK;
+}
+
+uint32_t Flash_Manifest_ScanSector(const Flash_Stream_Backend_t *backend, uint32_t SectorAddress, uint32_t *hash)
+{
+    uint32_t words[FLASH_MANIFEST_CHUNK / 4U];
+    uint32_t offset;
+    uint32_t index;
+    uint32_t fail;
+    uint32_t sector = 0;
+
+    for(offset = 0; offset < FLASH_GEO_SECTOR_SIZE; offset += FLASH_MANIFEST_CHUNK){
+        if(backend->read(words, SectorAddress + offset, FLASH_MANIFEST_CHUNK, &fail) != FLASH_OK){
+            return FLASH_ERROR;
+        }
+        for(index = 0; index < (FLASH_MANIFEST_CHUNK / 4U); index += FLASH_MANIFEST_FW_WORDS){
+            sector = Flash_Manifest_Mix(sector, Flash_Manifest_Hash(&words[index]));
+        }
+    }
+    *hash = Flash_Manifest_Final(sector, FLASH_GEO_WORDS_PER_SECTOR * 4U);
+    return FLASH_OK;
+}
+
+uint32_t Flash_Manifest_Changed(const Flash_Stream_Backend_t *backend, const Flash_Manifest_Header_t *header,
+                                const uint32_t *SectorHashes, uint32_t *dirty)
+{
+    uint32_t sector;
+    uint32_t hash;
+
+    *dirty = 0;
+    if(Flash_Manifest_Check(header) != FLASH_OK){
+        return FLASH_ERROR;
+    }
+    for(sector = 0; sector < header->sectors; sector++){
+        /* A flashword torn by an earlier update reads back with an ECC
+           error: the sector is rewritten rather than the update refused */
+        if((Flash_Manifest_ScanSector(backend, header->base + (sector << FLASH_GEO_SECTOR_SHIFT), &hash) != FLASH_OK) ||
+           (hash != SectorHashes[sector])){
+            *dirty |= 1UL << sector;
+        }
+    }
+    return FLASH_OK;
+}
+
+void Flash_Manifest_Begin(Flash_Manifest_Sector_t *sector, uint32_t SectorAddress)
+{
+    uint32_t blank[FLASH_MANIFEST_FW_WORDS];
+
+    memset(sector, 0, sizeof(*sector));
+    memset(blank, 0xFF, sizeof(blank));
+    sector->address = SectorAddress;
+    sector->blank = Flash_Manifest_Hash(blank);
+}
+
+uint32_t Flash_Manifest_Compare(const Flash_Stream_Backend_t *backend, Flash_Manifest_Sector_t *sector,
+                                uint32_t First, const uint32_t *FlashwordHashes, uint32_t NbOfFlashWords)
+{
+    uint32_t words[FLASH_MANIFEST_FW_WORDS];
+    uint32_t index;
+    uint32_t fail;
+    uint32_t hash;
+    uint32_t bit;
+    uint32_t readable;
+
+    if((First > FLASH_GEO_WORDS_PER_SECTOR) || (NbOfFlashWords > (FLASH_GEO_WORDS_PER_SECTOR - First))){
+        return FLASH_ERROR;
+    }
+    for(index = First; index < (First + NbOfFlashWords); index++){
+        /* An unreadable flashword counts as changed and programmed */
+        readable = (backend->read(words, sector->address + (index << FLASH_GEO_FLASHWORD_SHIFT), FLASH_GEO_FLASHWORD_SIZE,
+                                  &fail) == FLASH_OK) ? 1U : 0U;
+        hash = Flash_Manifest_Hash(words);
+        bit = 1UL << (index & 31U);
+
+        if(readable && (hash == FlashwordHashes[index - First])){
+            if(hash != sector->blank){
+                sector->kept[index / 32U] |= bit;
+            }
+            continue;
+        }
+        /* Programmed bits only come back with an erase */
+        if(!readable || (hash != sector->blank)){
+            sector->erase = 1;
+        }
+        if(FlashwordHashes[index - First] != sector->blank){
+            sector->request[index / 32U] |= bit;
+            sector->requested++;
+        }
+    }
+    return FLASH_OK;
+}
+
+uint32_t Flash_Manifest_Prepare(const Flash_Stream_Backend_t *backend, Flash_Manifest_Sector_t *sector, uint32_t *save)
+{
+    uint32_t status;
+    uint32_t index;
+    uint32_t fail;
+
+    if(sector->erase == 0U){
+        return FLASH_OK;
+    }
+    sector->erase = 0;
+    /* Only the kept flashwords: the others may not read back */
+    for(index = 0; (index < FLASH_GEO_WORDS_PER_SECTOR) && (save != NULL); index++){
+        if((((sector->kept[index / 32U] >> (index & 31U)) & 1U) != 0U) &&
+           (backend->read(&save[index * FLASH_MANIFEST_FW_WORDS], sector->address + (index << FLASH_GEO_FLASHWORD_SHIFT),
+                          FLASH_GEO_FLASHWORD_SIZE, &fail) != FLASH_OK)){
+            return FLASH_ERROR;
+        }
+    }
+    status = backend->erase_sector(sector->address);
+
+    for(index = 0; (index < FLASH_GEO_WORDS_PER_SECTOR) && (status == FLASH_OK); index++){
+        if(((sector->kept[index / 32U] >> (index & 31U)) & 1U) == 0U){
+            continue;
+        }
+        if(save != NULL){
+            status = backend->program(sector->address + (index << FLASH_GEO_FLASHWORD_SHIFT),
+                                      &save[index * FLASH_MANIFEST_FW_WORDS], 1);
+        }else{
+            sector->request[index / 32U] |= 1UL << (index & 31U);
+            sector->requested++;
+        }
+    }
+    memset(sector->kept, 0, sizeof(sector->kept));
+    return status;
+}
+
+uint32_t Flash_Manifest_Next(const Flash_Manifest_Sector_t *sector, uint32_t Index)
+{
+    uint32_t map;
+
+    while(Index < FLASH_GEO_WORDS_PER_SECTOR){
+        map = sector->request[Index / 32U] >> (Index & 31U);
+        if(map != 0U){
+            while((map & 1U) == 0U){
+                map >>= 1;
+                Index++;
+            }
+            return Index;
+        }
+        Index = (Index | 31U) + 1U;
+    }
+    return FLASH_GEO_WORDS_PER_SECTOR;
+}
+
+uint32_t Flash_Manifest_Write(const Flash_Stream_Backend_t *backend, Flash_Manifest_Sector_t *sector,
+                              uint32_t Index, const uint32_t *flashword)
+{
+    uint32_t bit = 1UL << (Index & 31U);
+
+    /* Each requested flashword is programmed once, over erased cells */
+    if((Index >= FLASH_GEO_WORDS_PER_SECTOR) || (sector->erase != 0U) || ((sector->request[Index / 32U] & bit) == 0U)){
+        return FLASH_ERROR;
+    }
+    sector->request[Index / 32U] &= ~bit;
+    sector->requested--;
+    return backend->program(sector->address + (Index << FLASH_GEO_FLASHWORD_SHIFT), flashword, 1);
+}
+
+uint32_t Flash_Manifest_Finish(const Flash_Stream_Backend_t *backend, const Flash_Manifest_Header_t *header)
+{
+    uint8_t chunk[FLASH_MANIFEST_CHUNK];
+    uint32_t size = header->sectors << FLASH_GEO_SECTOR_SHIFT;
+    uint32_t offset;
+    uint32_t fail;
+    uint32_t crc = 0;
+
+    if(Flash_Manifest_Check(header) != FLASH_OK){
+        return FLASH_ERROR;
+    }
+    for(offset = 0; offset < size; offset += FLASH_MANIFEST_CHUNK){
+        if(backend->read(chunk, header->base + offset, FLASH_MANIFEST_CHUNK, &fail) != FLASH_OK){
+            return FLASH_ERROR;
+        }
+        crc = Flash_Stream_Crc(crc, chunk, FLASH_MANIFEST_CHUNK);
+    }
+    return (crc == header->crc) ? FLASH_OK : FLASH_ERROR;
+}
+
+static uint32_t Flash_Manifest_Mix(uint32_t hash, uint32_t value)
+{
+    value *= 0xCC9E2D51U;
+    value = FLASH_MANIFEST_ROTL(value, 15U);
+    value *= 0x1B873593U;
+    hash ^= value;
+    hash = FLASH_MANIFEST_ROTL(hash, 13U);
+    return (hash * 5U) + 0xE6546B64U;
+}
+
+static uint32_t Flash_Manifest_Final(uint32_t hash, uint32_t Length)
+{
+    hash ^= Length;
+    hash ^= hash >> 16;
+    hash *= 0x85EBCA6BU;
+    hash ^= hash >> 13;
+    hash *= 0xC2B2AE35U;
+    hash ^= hash >> 16;
+    return hash;
+}
@@ -0,0 +1,230 @@
+/**
+  ******************************************************************************
+  * @file    flash_recover.c
+  * @brief   This file provides flash error classification and a recovery
+             policy that does the least work each error requires. The bank
+             driver latches the SR error bits and the failing address; the
+             failed flashword is read back before anything is decided, so an
+             erase is only spent on a flashword that really holds wrong data.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stdint.h>
+#include <string.h>
+#include "flash_recover.h"
+#ifndef HOST_BUILD
+#include "flash_safe.h"
+#endif
+
+#define FLASH_ERR_SEQUENCE_MASK     (FLASH_ERR_PGSERR | FLASH_ERR_STRBERR | FLASH_ERR_INCERR)
+#define FLASH_ERR_PROTECTED_MASK    (FLASH_ERR_WRPERR | FLASH_ERR_RDPERR | FLASH_ERR_RDSERR)
+#define FLASH_ERR_ECC_MASK          (FLASH_ERR_SNECCERR | FLASH_ERR_DBECCERR)
+
+#define FLASH_RECOVER_FW_WORDS      (FLASH_GEO_FLASHWORD_SIZE / 4U)
+
+#ifndef HOST_BUILD
+_Static_assert((FLASH_ERR_WRPERR == FLASH_SR_WRPERR) && (FLASH_ERR_PGSERR == FLASH_SR_PGSERR) &&
+               (FLASH_ERR_STRBERR == FLASH_SR_STRBERR) && (FLASH_ERR_INCERR == FLASH_SR_INCERR) &&
+               (FLASH_ERR_OPERR == FLASH_SR_OPERR) && (FLASH_ERR_RDPERR == FLASH_SR_RDPERR) &&
+               (FLASH_ERR_RDSERR == FLASH_SR_RDSERR) && (FLASH_ERR_SNECCERR == FLASH_SR_SNECCERR) &&
+               (FLASH_ERR_DBECCERR == FLASH_SR_DBECCERR), "FLASH_SR error bits");
+#endif
+
+enum{
+    FLASH_RECOVER_SAME = 0,     /* the flashword holds the intended data */
+    FLASH_RECOVER_BLANK,        /* nothing was programmed */
+    FLASH_RECOVER_CORRUPT       /* wrong data or an ECC error on read-back */
+};
+
+static uint32_t Flash_Recover_Verify(const Flash_Recover_Backend_t *backend, uint32_t FlashAddress, const uint32_t *src);
+static uint64_t Flash_Recover_Baseline(uint32_t Start, uint32_t FlashAddress);
+
+/* The most damaging cause wins when the controller reports several */
+uint32_t Flash_Err_Classify(const Flash_Error_t *error)
+{
+    if(error->status == FLASH_OK){
+        return FLASH_ERR_NONE;
+    }
+    if(error->status == FLASH_TIMEOUT){
+        return FLASH_ERR_TIMEOUT;
+    }
+    if((error->flags & FLASH_ERR_ECC_MASK) != 0U){
+        return FLASH_ERR_ECC;
+    }
+    if((error->flags & FLASH_ERR_OPERR) != 0U){
+        return FLASH_ERR_OPERATION;
+    }
+    if((error->flags & FLASH_ERR_PROTECTED_MASK) != 0U){
+        return FLASH_ERR_PROTECTED;
+    }
+    /* Sequence bits, or a refused unlock that left no bits at all */
+    if(((error->flags & FLASH_ERR_SEQUENCE_MASK) != 0U) || (error->flags == 0U)){
+        return FLASH_ERR_SEQUENCE;
+    }
+    return FLASH_ERR_OPERATION;
+}
+
+uint32_t Flash_Recover_Program(const Flash_Recover_Backend_t *backend, uint32_t FlashAddress, const uint32_t *src,
+                               uint32_t NbOfFlashWords, uint32_t Policy, Flash_Recover_Report_t *report)
+{
+    uint32_t end = FlashAddress + (NbOfFlashWords << FLASH_GEO_FLASHWORD_SHIFT);
+    uint32_t address = FlashAddress;
+    uint32_t retry_address = 0xFFFFFFFFU;
+    uint32_t attempts = 0;
+    uint32_t erases = 0;
+    uint32_t status = FLASH_OK;
+    uint32_t fail;
+    uint32_t next;
+    Flash_Error_t error;
+    Flash_Error_t first_skip = { FLASH_OK, 0U, 0U };
+
+    if((NbOfFlashWords == 0U) || !FLASH_GEO_IS_ALIGNED(FlashAddress) ||
+       !FLASH_GEO_SAME_BANK(FlashAddress, NbOfFlashWords << FLASH_GEO_FLASHWORD_SHIFT)){
+        return (NbOfFlashWords == 0U) ? FLASH_OK : FLASH_ERROR;
+    }
+
+    while(address < end){
+        const uint32_t *data = src + (((address - FlashAddress) >> FLASH_GEO_FLASHWORD_SHIFT) * FLASH_RECOVER_FW_WORDS);
+
+        if(backend->program(address, data, (end - address) >> FLASH_GEO_FLASHWORD_SHIFT) == FLASH_OK){
+            break;
+        }
+
+        /* Everything before the failing flashword was programmed by this call */
+        backend->last_error(address, &error);
+        if(error.status == FLASH_OK){
+            error.status = FLASH_ERROR;
+            error.flags = 0U;
+            error.address = address;
+        }
+        fail = ((error.address >= address) && (error.address < end)) ?
+               (error.address & ~(FLASH_GEO_FLASHWORD_SIZE - 1U)) : address;
+        error.address = fail;
+        report->errors++;
+        report->classes[Flash_Err_Classify(&error)]++;
+        report->last = error;
+        data = src + (((fail - FlashAddress) >> FLASH_GEO_FLASHWORD_SHIFT) * FLASH_RECOVER_FW_WORDS);
+        address = fail;
+
+        /* Write protection covers whole sectors: carry on after this one */
+        if(Flash_Err_Classify(&error) == FLASH_ERR_PROTECTED){
+            next = FLASH_GEO_SECTOR_BASE(FLASH_GEO_BANK(fail), FLASH_GEO_SECTOR(fail)) + FLASH_GEO_SECTOR_SIZE;
+            if(next > end){
+                next = end;
+            }
+            report->skipped += (next - fail) >> FLASH_GEO_FLASHWORD_SHIFT;
+            if(status == FLASH_OK){
+                first_skip = error;
+                status = FLASH_ERROR;
+            }
+            address = next;
+            continue;
+        }
+
+        if(fail != retry_address){
+            retry_address = fail;
+            attempts = 0;
+        }
+
+        switch(Flash_Recover_Verify(backend, fail, data)){
+        case FLASH_RECOVER_SAME:
+            /* Reported failure, but the cells took the data */
+            report->verified++;
+            report->saved_us += Flash_Recover_Baseline(FlashAddress, fail);
+            address = fail + FLASH_GEO_FLASHWORD_SIZE;
+            break;
+
+        case FLASH_RECOVER_BLANK:
+            if(attempts >= FLASH_RECOVER_RETRIES){
+                return FLASH_ERROR;
+            }
+            attempts++;
+            report->retries++;
+            report->saved_us += Flash_Recover_Baseline(FlashAddress, fail);
+            break;
+
+        default:
+            /* Only an erase brings a flashword with wrong data back */
+            if(((Policy & FLASH_RECOVER_ERASE) == 0U) || (erases >= FLASH_RECOVER_RETRIES)){
+                return FLASH_ERROR;
+            }
+            next = FLASH_GEO_SECTOR_BASE(FLASH_GEO_BANK(fail), FLASH_GEO_SECTOR(fail));
+            if(backend->erase_sector(next) != FLASH_OK){
+                backend->last_error(next, &report->last);
+                return FLASH_ERROR;
+            }
+            erases++;
+            report->escalations++;
+            address = (next > FlashAddress) ? next : FlashAddress;
+            retry_address = 0xFFFFFFFFU;
+            break;
+        }
+    }
+
+    if(status != FLASH_OK){
+        report->last = first_skip;
+    }
+    return status;
+}
+
+static uint32_t Flash_Recover_Verify(const Flash_Recover_Backend_t *backend, uint32_t FlashAddress, const uint32_t *src)
+{
+    uint32_t readback[FLASH_RECOVER_FW_WORDS];
+    uint32_t blank = 0xFFFFFFFFU;
+    uint32_t index;
+
+    if(backend->read(readback, FlashAddress, sizeof(readback), NULL) != FLASH_OK){
+        return FLASH_RECOVER_CORRUPT;
+    }
+    if(memcmp(readback, src, sizeof(readback)) == 0){
+        return FLASH_RECOVER_SAME;
+    }
+    for(index = 0; index < FLASH_RECOVER_FW_WORDS; index++){
+        blank &= readback[index];
+    }
+    return (blank == 0xFFFFFFFFU) ? FLASH_RECOVER_BLANK : FLASH_RECOVER_CORRUPT;
+}
+
+/* What erasing the sector and replaying this call's part of it would cost */
+static uint64_t Flash_Recover_Baseline(uint32_t Start, uint32_t FlashAddress)
+{
+    uint32_t sector = FLASH_GEO_SECTOR_BASE(FLASH_GEO_BANK(FlashAddress), FLASH_GEO_SECTOR(FlashAddress));
+    uint32_t replay = (FlashAddress - ((sector > Start) ? sector : Start)) >> FLASH_GEO_FLASHWORD_SHIFT;
+
+    return FLASH_RECOVER_ERASE_US + ((uint64_t)replay * FLASH_RECOVER_PROGRAM_US);
+}
+
+#ifndef HOST_BUILD
+static uint32_t Flash_Recover_TargetErase(uint32_t FlashAddress)
+{
+    return Flash_Sector_Erase(FLASH_GEO_BANK(FlashAddress), FLASH_GEO_SECTOR(FlashAddress), 1);
+}
+
+static uint32_t Flash_Recover_TargetProgram(uint32_t FlashAddress, const uint32_t *src, uint32_t NbOfFlashWords)
+{
+    return Flash_Program(FlashAddress, (uint32_t)src, NbOfFlashWords);
+}
+
+static void Flash_Recover_TargetError(uint32_t FlashAddress, Flash_Error_t *error)
+{
+    Flash_GetLastError(FLASH_GEO_BANK(FlashAddress), error);
+}
+
+const Flash_Recover_Backend_t Flash_Recover_TargetBackend =
+{
+    Flash_Recover_TargetErase,
+    Flash_Recover_TargetProgram,
+    Flash_Safe_Read,
+    Flash_Recover_TargetError
+};
+#endif
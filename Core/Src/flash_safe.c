@@ -0,0 +1,187 @@
+/**
+  ******************************************************************************
+  * @file    flash_safe.c
+  * @brief   This file provides an ECC-safe flash read. A double-bit ECC error
+             during the copy raises a precise bus fault; BusFault_Handler
+             redirects the faulting context to a landing pad that unwinds
+             back into Flash_Safe_Read, which returns FLASH_ECC_ERROR and the
+             failing address instead of hanging.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <setjmp.h>
+#include <string.h>
+#include "flash_safe.h"
+#include "flash_if.h"
+#include "flash_bank.h"
+#include "flash_geometry.h"
+#include "flash_dump.h"
+
+#define FLASH_SAFE_ECC_FLAGS    (FLASH_SR_SNECCERR | FLASH_SR_DBECCERR)
+#define FLASH_SAFE_XPSR_IT_ICI  0x0600FC00U     /* IT/ICI state of the interrupted instruction */
+
+Flash_Safe_Log_t Flash_Safe_EccLog;
+
+static jmp_buf *volatile flash_safe_env;
+static volatile uint32_t flash_safe_fault_addr;
+
+static void Flash_Safe_Landing(void) __attribute__((noreturn, used));
+static uint32_t Flash_Safe_Collect(uint32_t bank);
+static uint32_t Flash_Safe_FailAddress(uint32_t FlashAddress, uint32_t Length);
+
+void Flash_Safe_Init(void)
+{
+    /* Precise data bus errors must reach BusFault_Handler, not escalate to HardFault */
+    SET_BIT(SCB->SHCSR, SCB_SHCSR_BUSFAULTENA_Msk);
+
+    /* Cycle counter for the handler timing in Flash_Safe_EccLog */
+    SET_BIT(CoreDebug->DEMCR, CoreDebug_DEMCR_TRCENA_Msk);
+    SET_BIT(DWT->CTRL, DWT_CTRL_CYCCNTENA_Msk);
+
+    /* ECC events on either bank are logged from FLASH_IRQHandler */
+    if(Flash_Bank_Unlock(FLASH_BANK_1) == FLASH_OK){
+        SET_BIT(FLASH_BANK_REGS(FLASH_BANK_1)->CR, (FLASH_CR_SNECCERRIE | FLASH_CR_DBECCERRIE));
+        Flash_Bank_Lock(FLASH_BANK_1);
+    }
+    if(Flash_Bank_Unlock(FLASH_BANK_2) == FLASH_OK){
+        SET_BIT(FLASH_BANK_REGS(FLASH_BANK_2)->CR, (FLASH_CR_SNECCERRIE | FLASH_CR_DBECCERRIE));
+        Flash_Bank_Lock(FLASH_BANK_2);
+    }
+}
+
+uint32_t Flash_Safe_Read(void *dest, uint32_t FlashAddress, uint32_t Length, uint32_t *FailAddress)
+{
+    jmp_buf env;
+    jmp_buf *volatile outer = flash_safe_env;
+    uint32_t bank;
+
+    if(Length == 0U){
+        return FLASH_OK;
+    }
+    if(!FLASH_GEO_SAME_BANK(FlashAddress, Length)){
+        return FLASH_ERROR;
+    }
+    bank = FLASH_GEO_BANK(FlashAddress);
+
+    if(setjmp(env) != 0){
+        /* Arrived from the landing pad after a bus fault in the copy */
+        flash_safe_env = outer;
+        Flash_Safe_Collect(bank);
+        if(FailAddress != NULL){
+            *FailAddress = (flash_safe_fault_addr != 0U) ? flash_safe_fault_addr
+                         : Flash_Safe_FailAddress(FlashAddress, Length);
+        }
+        return FLASH_ECC_ERROR;
+    }
+
+    /* Fast path: arm, copy, disarm, one status read */
+    flash_safe_fault_addr = 0;
+    flash_safe_env = &env;
+    memcpy(dest, (const void *)FlashAddress, Length);
+    flash_safe_env = outer;
+
+    /* An uncorrectable error that did not fault the copy still latches in SR */
+    if(READ_BIT(FLASH_BANK_REGS(bank)->SR, FLASH_SR_DBECCERR) != 0U){
+        Flash_Safe_Collect(bank);
+        if(FailAddress != NULL){
+            *FailAddress = Flash_Safe_FailAddress(FlashAddress, Length);
+        }
+        return FLASH_ECC_ERROR;
+    }
+    return FLASH_OK;
+}
+
+void Flash_Safe_EccIrq(void)
+{
+    uint32_t start = DWT->CYCCNT;
+
+    Flash_Safe_Collect(FLASH_BANK_1);
+    Flash_Safe_Collect(FLASH_BANK_2);
+    Flash_Safe_EccLog.handler_cycles = DWT->CYCCNT - start;
+}
+
+/**
+  * @brief  C half of BusFault_Handler.
+  * @param  frame: exception stack frame (r0-r3, r12, lr, pc, xPSR)
+  * @param  exc_return: lr at exception entry
+  * @param  callee: r4-r11 pushed by the handler, for the crash dump
+  */
+void Flash_Safe_BusFault(uint32_t *frame, uint32_t exc_return, uint32_t *callee)
+{
+    uint32_t cfsr = SCB->CFSR;
+
+    if((flash_safe_env != NULL) && ((cfsr & SCB_CFSR_PRECISERR_Msk) != 0U)){
+        flash_safe_fault_addr = ((cfsr & SCB_CFSR_BFARVALID_Msk) != 0U) ? SCB->BFAR : 0U;
+        /* Bus fault status bits are write-one-to-clear */
+        SCB->CFSR = cfsr & SCB_CFSR_BUSFAULTSR_Msk;
+        Flash_Safe_EccLog.recovered_faults++;
+
+        /* Return from the exception into the landing pad instead of
+           re-executing the faulting load */
+        frame[6] = (uint32_t)Flash_Safe_Landing & ~1U;
+        frame[7] &= ~FLASH_SAFE_XPSR_IT_ICI;
+        return;
+    }
+
+    Flash_Dump_Fault(frame, exc_return, callee, FLASH_DUMP_BUSFAULT);
+}
+
+static void Flash_Safe_Landing(void)
+{
+    longjmp(*flash_safe_env, 1);
+}
+
+static uint32_t Flash_Safe_Collect(uint32_t bank)
+{
+    Flash_Bank_TypeDef *regs = FLASH_BANK_REGS(bank);
+    Flash_Safe_Event_t *event;
+    uint32_t flags = regs->SR & FLASH_SAFE_ECC_FLAGS;
+
+    if(flags == 0U){
+        return 0U;
+    }
+
+    event = &Flash_Safe_EccLog.events[Flash_Safe_EccLog.event_count & (FLASH_SAFE_EVENT_DEPTH - 1U)];
+    event->address = FLASH_GEO_BANK_BASE(bank) + ((regs->ECC_FA & FLASH_ECC_FA_FAIL_ECC_ADDR) << FLASH_GEO_FLASHWORD_SHIFT);
+    event->flags = flags;
+    event->tick = HAL_GetTick();
+    Flash_Safe_EccLog.event_count++;
+
+    if((flags & FLASH_SR_DBECCERR) != 0U){
+        Flash_Safe_EccLog.double_errors++;
+    }else{
+        Flash_Safe_EccLog.single_errors++;
+    }
+
+    WRITE_REG(regs->CCR, flags);
+    return flags;
+}
+
+/* Newest logged uncorrectable error inside the read, which the interrupt
+   may have collected first; FLASH_SAFE_NO_ADDRESS when none is */
+static uint32_t Flash_Safe_FailAddress(uint32_t FlashAddress, uint32_t Length)
+{
+    uint32_t first = FlashAddress & ~(FLASH_GEO_FLASHWORD_SIZE - 1U);
+    uint32_t count = Flash_Safe_EccLog.event_count;
+    uint32_t depth = (count < FLASH_SAFE_EVENT_DEPTH) ? count : FLASH_SAFE_EVENT_DEPTH;
+    const Flash_Safe_Event_t *event;
+
+    while(depth-- != 0U){
+        event = &Flash_Safe_EccLog.events[--count & (FLASH_SAFE_EVENT_DEPTH - 1U)];
+        if(((event->flags & FLASH_SR_DBECCERR) != 0U) &&
+           (event->address >= first) && (event->address < (FlashAddress + Length))){
+            return event->address;
+        }
+    }
+    return FLASH_SAFE_NO_ADDRESS;
+}
@@ -0,0 +1,445 @@
+/**
+  ******************************************************************************
+  * @file    flash_sched.c
+  * @brief   Deadline-aware scheduler in front of both bank drivers. Callers
+             queue erases and programs with a priority class and a time
+             budget instead of running them inline, and Flash_Sched_Poll
+             hands each bank one flashword or one sector erase at a time,
+             so a bulk flush no longer holds an urgent commit back by whole
+             sector erases. The banks are served independently: an erase
+             on one leaves the other free for programming.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stddef.h>
+#include <string.h>
+#include "flash_sched.h"
+#ifndef HOST_BUILD
+#include "flash_bank.h"
+#endif
+
+#define FLASH_SCHED_FW_WORDS        (FLASH_GEO_FLASHWORD_SIZE / 4U)
+#define FLASH_SCHED_INDEX(addr)     (FLASH_GEO_BANK(addr) - FLASH_BANK_1)
+
+static uint32_t Flash_Sched_Remaining(const Flash_Sched_t *sched, const Flash_Sched_Request_t *req);
+static uint32_t Flash_Sched_Class(const Flash_Sched_t *sched, const Flash_Sched_Request_t *req, uint32_t now);
+static uint32_t Flash_Sched_Before(const Flash_Sched_t *sched, const Flash_Sched_Request_t *a,
+                                   const Flash_Sched_Request_t *b, uint32_t now);
+static uint32_t Flash_Sched_Gap(const Flash_Sched_t *sched, uint32_t index, const Flash_Sched_Request_t *erase, uint32_t now);
+static void Flash_Sched_Range(const Flash_Sched_Request_t *req, uint32_t *first, uint32_t *end);
+static uint32_t Flash_Sched_Overlap(const Flash_Sched_Request_t *a, const Flash_Sched_Request_t *b);
+static uint32_t Flash_Sched_Blocked(const Flash_Sched_t *sched, uint32_t index, const Flash_Sched_Request_t *req);
+static Flash_Sched_Request_t *Flash_Sched_Next(Flash_Sched_t *sched, uint32_t index, uint32_t now);
+static void Flash_Sched_Complete(Flash_Sched_t *sched, uint32_t index, Flash_Sched_Request_t *req, uint32_t status,
+                                 uint32_t now);
+
+void Flash_Sched_Init(Flash_Sched_t *sched, const Flash_Sched_Backend_t *backend)
+{
+    memset(sched, 0, sizeof(*sched));
+    sched->backend = backend;
+    sched->erase_us = FLASH_SCHED_ERASE_US;
+}
+
+uint32_t Flash_Sched_Submit(Flash_Sched_t *sched, Flash_Sched_Request_t *req, uint32_t Op, uint32_t Priority,
+                            uint32_t Address, const uint32_t *data, uint32_t Count, uint32_t BudgetUs)
+{
+    Flash_Sched_Request_t **tail;
+
+    if((Priority >= FLASH_SCHED_CLASSES) || (Count == 0U) || !FLASH_GEO_IS_VALID(Address)){
+        return FLASH_ERROR;
+    }
+    if(Op == FLASH_SCHED_PROGRAM){
+        if((data == NULL) || !FLASH_GEO_IS_ALIGNED(Address) || (Count > (FLASH_GEO_BANK_SIZE >> FLASH_GEO_FLASHWORD_SHIFT)) ||
+           !FLASH_GEO_SAME_BANK(Address, Count << FLASH_GEO_FLASHWORD_SHIFT)){
+            return FLASH_ERROR;
+        }
+    }else if(Op == FLASH_SCHED_ERASE){
+        if(((FLASH_GEO_OFFSET(Address) & (FLASH_GEO_SECTOR_SIZE - 1U)) != 0U) ||
+           (Count > (FLASH_GEO_SECTORS_PER_BANK - FLASH_GEO_SECTOR(Address)))){
+            return FLASH_ERROR;
+        }
+    }else{
+        return FLASH_ERROR;
+    }
+
+    req->next = NULL;
+    req->op = Op;
+    req->priority = Priority;
+    req->address = Address;
+    req->data = data;
+    req->count = Count;
+    req->submitted = sched->backend->now_us();
+    req->deadline = req->submitted + BudgetUs;
+    req->has_deadline = (BudgetUs != 0U) ? 1U : 0U;
+    req->done = 0;
+    req->started = 0;
+    req->status = FLASH_BUSY;
+
+    /* Queue order is arrival order, the tie break of Flash_Sched_Next */
+    for(tail = &sched->queue[FLASH_SCHED_INDEX(Address)]; *tail != NULL; tail = &(*tail)->next){
+    }
+    *tail = req;
+    return FLASH_OK;
+}
+
+uint32_t Flash_Sched_Poll(Flash_Sched_t *sched)
+{
+    const Flash_Sched_Backend_t *backend = sched->backend;
+    Flash_Sched_Request_t *req;
+    uint32_t busy = 0;
+    uint32_t index;
+    uint32_t bank;
+    uint32_t quantum;
+    uint32_t status;
+    uint32_t elapsed;
+    uint32_t now;
+
+    for(index = 0; index < FLASH_GEO_NB_BANKS; index++){
+        bank = FLASH_BANK_1 + index;
+
+        req = sched->erasing[index];
+        if(req != NULL){
+            status = backend->erase_poll(bank);
+            if(status == FLASH_BUSY){
+                busy = 1;
+                continue;
+            }
+            now = backend->now_us();
+            elapsed = now - sched->erase_start[index];
+            if(elapsed > sched->erase_us){
+                sched->erase_us = elapsed;
+            }
+            if(elapsed > sched->stats.erase_max_us){
+                sched->stats.erase_max_us = elapsed;
+            }
+            sched->erasing[index] = NULL;
+            req->done++;
+            if((status != FLASH_OK) || (req->done == req->count)){
+                Flash_Sched_Complete(sched, index, req, status, now);
+            }
+        }
+
+        for(quantum = FLASH_SCHED_QUANTUM; quantum != 0U; quantum--){
+            now = backend->now_us();
+            req = Flash_Sched_Next(sched, index, now);
+            if(req == NULL){
+                break;
+            }
+            if(!req->started){
+                req->started = 1;
+                elapsed = now - req->submitted;
+                sched->stats.cls[req->priority].wait_us += elapsed;
+                if(elapsed > sched->stats.cls[req->priority].wait_max_us){
+                    sched->stats.cls[req->priority].wait_max_us = elapsed;
+                }
+            }
+
+            if(req->op == FLASH_SCHED_ERASE){
+                status = backend->erase_start(req->address + (req->done << FLASH_GEO_SECTOR_SHIFT));
+                if(status != FLASH_OK){
+                    Flash_Sched_Complete(sched, index, req, status, now);
+                    continue;
+                }
+                sched->erasing[index] = req;
+                sched->erase_start[index] = now;
+                break;
+            }
+
+            status = backend->program(req->address + (req->done << FLASH_GEO_FLASHWORD_SHIFT),
+                                      req->data + (req->done * FLASH_SCHED_FW_WORDS));
+            req->done++;
+            if((status != FLASH_OK) || (req->done == req->count)){
+                Flash_Sched_Complete(sched, index, req, status, backend->now_us());
+            }
+        }
+
+        if((sched->queue[index] != NULL) || (sched->erasing[index] != NULL)){
+            busy = 1;
+        }
+    }
+    return busy ? FLASH_BUSY : FLASH_OK;
+}
+
+uint32_t Flash_Sched_Wait(Flash_Sched_t *sched, Flash_Sched_Request_t *req)
+{
+    while(req->status == FLASH_BUSY){
+        (void)Flash_Sched_Poll(sched);
+    }
+    return req->status;
+}
+
+static uint32_t Flash_Sched_Remaining(const Flash_Sched_t *sched, const Flash_Sched_Request_t *req)
+{
+    uint32_t left = req->count - req->done;
+
+    if(req->op == FLASH_SCHED_ERASE){
+        return left * sched->erase_us;
+    }
+    return left * FLASH_SCHED_PROGRAM_US;
+}
+
+/* The class a request is served in: its own, or urgent once its slack
+   is down to FLASH_SCHED_SLACK_US */
+static uint32_t Flash_Sched_Class(const Flash_Sched_t *sched, const Flash_Sched_Request_t *req, uint32_t now)
+{
+    int32_t slack;
+
+    if(!req->has_deadline){
+        return req->priority;
+    }
+    slack = (int32_t)(req->deadline - now - Flash_Sched_Remaining(sched, req));
+    return (slack < (int32_t)FLASH_SCHED_SLACK_US) ? FLASH_SCHED_URGENT : req->priority;
+}
+
+/* Class, then earliest deadline, then arrival; a goes first only when
+   strictly better, which keeps equal requests in queue order */
+static uint32_t Flash_Sched_Before(const Flash_Sched_t *sched, const Flash_Sched_Request_t *a,
+                                   const Flash_Sched_Request_t *b, uint32_t now)
+{
+    uint32_t class_a = Flash_Sched_Class(sched, a, now);
+    uint32_t class_b = Flash_Sched_Class(sched, b, now);
+
+    if(class_a != class_b){
+        return class_a < class_b;
+    }
+    if(a->has_deadline != b->has_deadline){
+        return a->has_deadline;
+    }
+    return a->has_deadline && ((int32_t)(a->deadline - b->deadline) < 0);
+}
+
+/* An erase holds the bank for erase_us: it fits when every other queued
+   request that can still make its deadline can also make it afterwards.
+   Requests held behind the erase wait for it anyway and do not count. */
+static uint32_t Flash_Sched_Gap(const Flash_Sched_t *sched, uint32_t index, const Flash_Sched_Request_t *erase, uint32_t now)
+{
+    const Flash_Sched_Request_t *req;
+    uint32_t behind = 0;
+    int32_t slack;
+
+    for(req = sched->queue[index]; req != NULL; req = req->next){
+        if(req == erase){
+            behind = 1;
+            continue;
+        }
+        if(!req->has_deadline || (behind && Flash_Sched_Overlap(req, erase))){
+            continue;
+        }
+        slack = (int32_t)(req->deadline - now - Flash_Sched_Remaining(sched, req));
+        if((slack >= 0) && (slack < (int32_t)sched->erase_us)){
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/* What req has still to program or erase: [*first, *end) */
+static void Flash_Sched_Range(const Flash_Sched_Request_t *req, uint32_t *first, uint32_t *end)
+{
+    uint32_t shift = (req->op == FLASH_SCHED_ERASE) ? FLASH_GEO_SECTOR_SHIFT : FLASH_GEO_FLASHWORD_SHIFT;
+
+    *first = req->address + (req->done << shift);
+    *end = req->address + (req->count << shift);
+}
+
+/* 1 when what a and b have left share an address */
+static uint32_t Flash_Sched_Overlap(const Flash_Sched_Request_t *a, const Flash_Sched_Request_t *b)
+{
+    uint32_t a_first;
+    uint32_t a_end;
+    uint32_t b_first;
+    uint32_t b_end;
+
+    Flash_Sched_Range(a, &a_first, &a_end);
+    Flash_Sched_Range(b, &b_first, &b_end);
+    return ((a_first < b_end) && (b_first < a_end)) ? 1U : 0U;
+}
+
+/* 1 when a request queued before req overlaps what req has left and one
+   of the two is an erase; two programs never share a flashword */
+static uint32_t Flash_Sched_Blocked(const Flash_Sched_t *sched, uint32_t index, const Flash_Sched_Request_t *req)
+{
+    const Flash_Sched_Request_t *prior;
+
+    for(prior = sched->queue[index]; prior != req; prior = prior->next){
+        if(((prior->op == FLASH_SCHED_ERASE) || (req->op == FLASH_SCHED_ERASE)) && Flash_Sched_Overlap(prior, req)){
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static Flash_Sched_Request_t *Flash_Sched_Next(Flash_Sched_t *sched, uint32_t index, uint32_t now)
+{
+    Flash_Sched_Request_t *best = NULL;
+    Flash_Sched_Request_t *req;
+    uint32_t erases = 0;
+    uint32_t deferred = 0;
+    uint32_t blocked;
+
+    for(req = sched->queue[index]; req != NULL; req = req->next){
+        /* Whatever the classes, nothing passes an erase queued before it
+           on a sector both touch, nor does an erase pass a program there:
+           the program would land first and be erased */
+        blocked = (((req->op == FLASH_SCHED_ERASE) || erases) && Flash_Sched_Blocked(sched, index, req)) ? 1U : 0U;
+        if(req->op == FLASH_SCHED_ERASE){
+            erases = 1;
+        }
+        if(blocked){
+            continue;
+        }
+        if(req->op == FLASH_SCHED_ERASE){
+            /* Urgent erases go at once, the others wait for a gap */
+            if((Flash_Sched_Class(sched, req, now) != FLASH_SCHED_URGENT) && !Flash_Sched_Gap(sched, index, req, now)){
+                deferred = 1;
+                continue;
+            }
+        }
+        if((best == NULL) || Flash_Sched_Before(sched, req, best, now)){
+            best = req;
+        }
+    }
+
+    if(deferred){
+        sched->stats.erases_deferred++;
+    }
+    if(best != NULL){
+        if((best->priority != FLASH_SCHED_URGENT) && (Flash_Sched_Class(sched, best, now) == FLASH_SCHED_URGENT) &&
+           (sched->last[index] != best)){
+            sched->stats.promotions++;
+        }
+        if((sched->last[index] != NULL) && (sched->last[index] != best)){
+            sched->stats.preemptions++;
+        }
+        sched->last[index] = best;
+    }
+    return best;
+}
+
+static void Flash_Sched_Complete(Flash_Sched_t *sched, uint32_t index, Flash_Sched_Request_t *req, uint32_t status,
+                                 uint32_t now)
+{
+    Flash_Sched_Class_Stats_t *stats = &sched->stats.cls[req->priority];
+    Flash_Sched_Request_t **link;
+    uint32_t latency = now - req->submitted;
+
+    for(link = &sched->queue[index]; *link != NULL; link = &(*link)->next){
+        if(*link == req){
+            *link = req->next;
+            break;
+        }
+    }
+    if(sched->last[index] == req){
+        sched->last[index] = NULL;
+    }
+
+    if(status == FLASH_OK){
+        stats->completed++;
+    }else{
+        stats->failed++;
+    }
+    stats->latency_us += latency;
+    if(latency > stats->latency_max_us){
+        stats->latency_max_us = latency;
+    }
+    if(req->has_deadline){
+        stats->deadlines++;
+        if((int32_t)(now - req->deadline) > 0){
+            stats->misses++;
+        }
+    }
+    req->status = status;
+}
+
+#ifndef HOST_BUILD
+/* Starts the erase and returns with the bank unlocked; interrupts stay
+   enabled, the other bank is served meanwhile */
+static uint32_t Flash_Sched_TargetEraseStart(uint32_t FlashAddress)
+{
+    uint32_t bank = FLASH_GEO_BANK(FlashAddress);
+    Flash_Bank_TypeDef *regs = FLASH_BANK_REGS(bank);
+    uint32_t status;
+
+    FLASH_BANK_ERROR(bank)->status = FLASH_OK;
+    if(Flash_Bank_Unlock(bank) != FLASH_OK){
+        FLASH_BANK_ERROR(bank)->status = FLASH_ERROR;
+        FLASH_BANK_ERROR(bank)->flags = 0U;
+        FLASH_BANK_ERROR(bank)->address = FlashAddress;
+        return FLASH_ERROR;
+    }
+    status = Flash_Bank_WaitForLastOperation(bank);
+    if(status != FLASH_OK){
+        FLASH_BANK_ERROR(bank)->address = FlashAddress;
+        (void)Flash_Bank_Lock(bank);
+        return status;
+    }
+    MODIFY_REG(regs->CR, (FLASH_CR_PSIZE | FLASH_CR_SNB),
+               (FLASH_CR_SER | Flash_Timing_GetPsize() | (FLASH_GEO_SECTOR(FlashAddress) << FLASH_CR_SNB_Pos) | FLASH_CR_START));
+    return FLASH_OK;
+}
+
+static uint32_t Flash_Sched_TargetErasePoll(uint32_t Bank)
+{
+    Flash_Bank_TypeDef *regs = FLASH_BANK_REGS(Bank);
+    uint32_t sector = (regs->CR & FLASH_CR_SNB) >> FLASH_CR_SNB_Pos;
+    uint32_t status;
+
+    if(READ_BIT(regs->SR, FLASH_SR_QW) != 0U){
+        return FLASH_BUSY;
+    }
+    status = Flash_Bank_WaitForLastOperation(Bank);
+    CLEAR_BIT(regs->CR, (FLASH_CR_SER | FLASH_CR_SNB));
+    if(status != FLASH_OK){
+        FLASH_BANK_ERROR(Bank)->address = FLASH_GEO_SECTOR_BASE(Bank, sector);
+    }
+    if((Flash_Bank_Lock(Bank) != FLASH_OK) && (status == FLASH_OK)){
+        status = FLASH_ERROR;
+    }
+    return status;
+}
+
+static uint32_t Flash_Sched_TargetProgram(uint32_t FlashAddress, const uint32_t *src)
+{
+    return Flash_Program(FlashAddress, (uint32_t)src, 1);
+}
+
+/* Microseconds from the cycle counter; keeps counting across its wrap as
+   long as it is read at least once per wrap (about 17 s at 240 MHz) */
+static uint32_t Flash_Sched_TargetNow(void)
+{
+    static uint32_t last;
+    static uint32_t rest;
+    static uint32_t us;
+    uint32_t per_us = SystemCoreClock / 1000000U;
+    uint32_t cycles;
+
+    if(READ_BIT(DWT->CTRL, DWT_CTRL_CYCCNTENA_Msk) == 0U){
+        SET_BIT(CoreDebug->DEMCR, CoreDebug_DEMCR_TRCENA_Msk);
+        SET_BIT(DWT->CTRL, DWT_CTRL_CYCCNTENA_Msk);
+    }
+    cycles = DWT->CYCCNT;
+    rest += cycles - last;
+    last = cycles;
+    us += rest / per_us;
+    rest %= per_us;
+    return us;
+}
+
+const Flash_Sched_Backend_t Flash_Sched_TargetBackend =
+{
+    Flash_Sched_TargetEraseStart,
+    Flash_Sched_TargetErasePoll,
+    Flash_Sched_TargetProgram,
+    Flash_Sched_TargetNow
+};
+#endif
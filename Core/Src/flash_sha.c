@@ -0,0 +1,367 @@
+/**
+  ******************************************************************************
+  * @file    flash_sha.c
+  * @brief   This file provides SHA-256 image authentication without a
+             second pass over flash. An update feeds every block to the
+             digest as soon as the stream has verified it in flash, so the
+             image digest is ready when the last block lands and is checked
+             against the HMAC-signed manifest sent with it. At boot the image
+             is hashed sector by sector; with a digest cache, sectors whose
+             controller CRC has not moved are not read by the CPU at all.
+             The compression function keeps the message schedule in a
+             16-word ring and renames the working variables instead of
+             moving them, which keeps the Cortex-M4 working set in
+             registers.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <string.h>
+#include "flash_sha.h"
+
+#define FLASH_SHA_CHUNK             256U
+
+#define FLASH_SHA_ROR(x, n)         (((x) >> (n)) | ((x) << (32U - (n))))
+#define FLASH_SHA_S0(x)             (FLASH_SHA_ROR((x), 2U) ^ FLASH_SHA_ROR((x), 13U) ^ FLASH_SHA_ROR((x), 22U))
+#define FLASH_SHA_S1(x)             (FLASH_SHA_ROR((x), 6U) ^ FLASH_SHA_ROR((x), 11U) ^ FLASH_SHA_ROR((x), 25U))
+#define FLASH_SHA_G0(x)             (FLASH_SHA_ROR((x), 7U) ^ FLASH_SHA_ROR((x), 18U) ^ ((x) >> 3))
+#define FLASH_SHA_G1(x)             (FLASH_SHA_ROR((x), 17U) ^ FLASH_SHA_ROR((x), 19U) ^ ((x) >> 10))
+#define FLASH_SHA_CH(x, y, z)       ((z) ^ ((x) & ((y) ^ (z))))
+#define FLASH_SHA_MAJ(x, y, z)      (((x) & (y)) | ((z) & ((x) | (y))))
+
+/* One round; the caller rotates the names, so only d and h are written */
+#define FLASH_SHA_ROUND(a, b, c, d, e, f, g, h, k)                                          \
+    do{                                                                                     \
+        t = h + FLASH_SHA_S1(e) + FLASH_SHA_CH(e, f, g) + Flash_Sha_K[round + (k)] + w[k];  \
+        d += t;                                                                             \
+        h = t + FLASH_SHA_S0(a) + FLASH_SHA_MAJ(a, b, c);                                   \
+    }while(0)
+
+static const uint32_t Flash_Sha_K[64] =
+{
+    0x428A2F98U, 0x71374491U, 0xB5C0FBCFU, 0xE9B5DBA5U, 0x3956C25BU, 0x59F111F1U, 0x923F82A4U, 0xAB1C5ED5U,
+    0xD807AA98U, 0x12835B01U, 0x243185BEU, 0x550C7DC3U, 0x72BE5D74U, 0x80DEB1FEU, 0x9BDC06A7U, 0xC19BF174U,
+    0xE49B69C1U, 0xEFBE4786U, 0x0FC19DC6U, 0x240CA1CCU, 0x2DE92C6FU, 0x4A7484AAU, 0x5CB0A9DCU, 0x76F988DAU,
+    0x983E5152U, 0xA831C66DU, 0xB00327C8U, 0xBF597FC7U, 0xC6E00BF3U, 0xD5A79147U, 0x06CA6351U, 0x14292967U,
+    0x27B70A85U, 0x2E1B2138U, 0x4D2C6DFCU, 0x53380D13U, 0x650A7354U, 0x766A0ABBU, 0x81C2C92EU, 0x92722C85U,
+    0xA2BFE8A1U, 0xA81A664BU, 0xC24B8B70U, 0xC76C51A3U, 0xD192E819U, 0xD6990624U, 0xF40E3585U, 0x106AA070U,
+    0x19A4C116U, 0x1E376C08U, 0x2748774CU, 0x34B0BCB5U, 0x391C0CB3U, 0x4ED8AA4AU, 0x5B9CCA4FU, 0x682E6FF3U,
+    0x748F82EEU, 0x78A5636FU, 0x84C87814U, 0x8CC70208U, 0x90BEFFFAU, 0xA4506CEBU, 0xBEF9A3F7U, 0xC67178F2U
+};
+
+static void Flash_Sha_Compress(uint32_t *state, const uint8_t *data, uint32_t NbOfBlocks);
+static uint32_t Flash_Sha_Equal(const uint8_t *a, const uint8_t *b, uint32_t Length);
+
+void Flash_Sha_Init(Flash_Sha_t *sha)
+{
+    static const uint32_t initial[8] =
+    {
+        0x6A09E667U, 0xBB67AE85U, 0x3C6EF372U, 0xA54FF53AU, 0x510E527FU, 0x9B05688CU, 0x1F83D9ABU, 0x5BE0CD19U
+    };
+
+    memcpy(sha->state, initial, sizeof(initial));
+    sha->count = 0;
+    sha->fill = 0;
+}
+
+void Flash_Sha_Update(Flash_Sha_t *sha, const void *data, uint32_t Length)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint8_t *block = (uint8_t *)sha->block;
+    uint32_t part;
+
+    sha->count += Length;
+    if(sha->fill != 0U){
+        part = FLASH_SHA_BLOCK_SIZE - sha->fill;
+        part = (Length < part) ? Length : part;
+        memcpy(&block[sha->fill], bytes, part);
+        sha->fill += part;
+        bytes += part;
+        Length -= part;
+        if(sha->fill < FLASH_SHA_BLOCK_SIZE){
+            return;
+        }
+        Flash_Sha_Compress(sha->state, block, 1);
+        sha->fill = 0;
+    }
+    /* Whole blocks straight from the source, no copy */
+    if(Length >= FLASH_SHA_BLOCK_SIZE){
+        Flash_Sha_Compress(sha->state, bytes, Length / FLASH_SHA_BLOCK_SIZE);
+        bytes += Length & ~(FLASH_SHA_BLOCK_SIZE - 1U);
+        Length &= FLASH_SHA_BLOCK_SIZE - 1U;
+    }
+    memcpy(block, bytes, Length);
+    sha->fill = Length;
+}
+
+void Flash_Sha_Final(Flash_Sha_t *sha, uint8_t *digest)
+{
+    uint8_t *block = (uint8_t *)sha->block;
+    uint32_t index;
+
+    block[sha->fill++] = 0x80U;
+    if(sha->fill > (FLASH_SHA_BLOCK_SIZE - 8U)){
+        memset(&block[sha->fill], 0, FLASH_SHA_BLOCK_SIZE - sha->fill);
+        Flash_Sha_Compress(sha->state, block, 1);
+        sha->fill = 0;
+    }
+    memset(&block[sha->fill], 0, FLASH_SHA_BLOCK_SIZE - 8U - sha->fill);
+    sha->block[14] = __builtin_bswap32(sha->count >> 29);
+    sha->block[15] = __builtin_bswap32(sha->count << 3);
+    Flash_Sha_Compress(sha->state, block, 1);
+
+    for(index = 0; index < 8U; index++){
+        sha->state[index] = __builtin_bswap32(sha->state[index]);
+    }
+    memcpy(digest, sha->state, FLASH_SHA_DIGEST_SIZE);
+}
+
+void Flash_Sha_Hmac(const uint8_t *key, uint32_t KeyLength, const void *data, uint32_t Length, uint8_t *mac)
+{
+    uint8_t pad[FLASH_SHA_BLOCK_SIZE];
+    uint8_t inner[FLASH_SHA_DIGEST_SIZE];
+    Flash_Sha_t sha;
+    uint32_t index;
+
+    memset(pad, 0, sizeof(pad));
+    if(KeyLength > FLASH_SHA_BLOCK_SIZE){
+        Flash_Sha_Init(&sha);
+        Flash_Sha_Update(&sha, key, KeyLength);
+        Flash_Sha_Final(&sha, pad);
+    }
+    else{
+        memcpy(pad, key, KeyLength);
+    }
+
+    for(index = 0; index < FLASH_SHA_BLOCK_SIZE; index++){
+        pad[index] ^= 0x36U;
+    }
+    Flash_Sha_Init(&sha);
+    Flash_Sha_Update(&sha, pad, sizeof(pad));
+    Flash_Sha_Update(&sha, data, Length);
+    Flash_Sha_Final(&sha, inner);
+
+    for(index = 0; index < FLASH_SHA_BLOCK_SIZE; index++){
+        pad[index] ^= 0x36U ^ 0x5CU;
+    }
+    Flash_Sha_Init(&sha);
+    Flash_Sha_Update(&sha, pad, sizeof(pad));
+    Flash_Sha_Update(&sha, inner, sizeof(inner));
+    Flash_Sha_Final(&sha, mac);
+    memset(pad, 0, sizeof(pad));
+}
+
+void Flash_Sha_ImageInit(Flash_Sha_Image_t *image)
+{
+    Flash_Sha_Init(&image->sector);
+    image->size = 0;
+}
+
+void Flash_Sha_ImageUpdate(Flash_Sha_Image_t *image, const void *data, uint32_t Length)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+    uint32_t part;
+
+    if(Length > (FLASH_GEO_BANK_SIZE - image->size)){
+        /* Cannot be a slot image: leave a digest nothing will match */
+        image->size = FLASH_GEO_BANK_SIZE;
+        return;
+    }
+    while(Length != 0U){
+        part = FLASH_GEO_SECTOR_SIZE - (image->size & (FLASH_GEO_SECTOR_SIZE - 1U));
+        part = (Length < part) ? Length : part;
+        Flash_Sha_Update(&image->sector, bytes, part);
+        image->size += part;
+        bytes += part;
+        Length -= part;
+        if((image->size & (FLASH_GEO_SECTOR_SIZE - 1U)) == 0U){
+            Flash_Sha_Final(&image->sector, image->digest[(image->size >> FLASH_GEO_SECTOR_SHIFT) - 1U]);
+            Flash_Sha_Init(&image->sector);
+        }
+    }
+}
+
+void Flash_Sha_ImageFinal(Flash_Sha_Image_t *image, uint8_t *digest)
+{
+    Flash_Sha_t root;
+    uint32_t sectors = image->size >> FLASH_GEO_SECTOR_SHIFT;
+
+    if((image->size & (FLASH_GEO_SECTOR_SIZE - 1U)) != 0U){
+        Flash_Sha_Final(&image->sector, image->digest[sectors]);
+        sectors++;
+    }
+    Flash_Sha_Init(&root);
+    Flash_Sha_Update(&root, image->digest, sectors * FLASH_SHA_DIGEST_SIZE);
+    Flash_Sha_Final(&root, digest);
+}
+
+void Flash_Sha_StreamHook(void *context, uint32_t Offset, const void *data, uint32_t Length)
+{
+    Flash_Sha_Image_t *image = (Flash_Sha_Image_t *)context;
+
+    /* Blocks come in order; a gap leaves a digest the manifest rejects */
+    if(Offset == image->size){
+        Flash_Sha_ImageUpdate(image, data, Length);
+    }
+}
+
+uint32_t Flash_Sha_ManifestCheck(const Flash_Sha_Manifest_t *manifest, const uint8_t *key, uint32_t KeyLength,
+                                 const uint8_t *digest)
+{
+    uint8_t mac[FLASH_SHA_DIGEST_SIZE];
+
+    if(manifest->magic != FLASH_SHA_MANIFEST_MAGIC){
+        return FLASH_ERROR;
+    }
+    Flash_Sha_Hmac(key, KeyLength, manifest, (uint32_t)((uintptr_t)&manifest->mac - (uintptr_t)manifest), mac);
+    if(!Flash_Sha_Equal(mac, manifest->mac, sizeof(mac))){
+        return FLASH_ERROR;
+    }
+    if((digest != NULL) && !Flash_Sha_Equal(digest, manifest->digest, FLASH_SHA_DIGEST_SIZE)){
+        return FLASH_ERROR;
+    }
+    return FLASH_OK;
+}
+
+void Flash_Sha_ManifestSign(Flash_Sha_Manifest_t *manifest, const uint8_t *key, uint32_t KeyLength)
+{
+    manifest->magic = FLASH_SHA_MANIFEST_MAGIC;
+    Flash_Sha_Hmac(key, KeyLength, manifest, (uint32_t)((uintptr_t)&manifest->mac - (uintptr_t)manifest),
+                   manifest->mac);
+}
+
+uint32_t Flash_Sha_ImageCompute(const Flash_Crc_Backend_t *backend, uint32_t FlashAddress, uint32_t Size,
+                                Flash_Sha_Cache_t *cache, uint8_t *digest)
+{
+    static uint8_t sector_digest[FLASH_GEO_SECTORS_PER_BANK][FLASH_SHA_DIGEST_SIZE];
+    uint32_t chunk[FLASH_SHA_CHUNK / 4U];
+    uint32_t sectors = (Size + FLASH_GEO_SECTOR_SIZE - 1U) >> FLASH_GEO_SECTOR_SHIFT;
+    uint32_t sector;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t end;
+    uint32_t crc = 0;
+    uint32_t keep;
+    uint32_t fail;
+    Flash_Sha_t sha;
+
+    if((Size > FLASH_GEO_BANK_SIZE) || ((FLASH_GEO_OFFSET(FlashAddress) & (FLASH_GEO_SECTOR_SIZE - 1U)) != 0U) ||
+       !FLASH_GEO_SAME_BANK(FlashAddress, Size)){
+        return FLASH_ERROR;
+    }
+    if(cache != NULL){
+        cache->reused = 0;
+        cache->hashed = 0;
+    }
+
+    for(sector = 0; sector < sectors; sector++){
+        offset = sector << FLASH_GEO_SECTOR_SHIFT;
+        keep = 0;
+        if(cache != NULL){
+            keep = (Flash_Crc_Compute(backend, FlashAddress + offset, FLASH_GEO_SECTOR_SIZE, &crc) == FLASH_OK) ? 1U : 0U;
+            if((keep != 0U) && ((cache->valid & (1UL << sector)) != 0U) && (cache->crc[sector] == crc)){
+                memcpy(sector_digest[sector], cache->digest[sector], FLASH_SHA_DIGEST_SIZE);
+                cache->reused++;
+                continue;
+            }
+        }
+
+        end = ((Size - offset) < FLASH_GEO_SECTOR_SIZE) ? Size : (offset + FLASH_GEO_SECTOR_SIZE);
+        Flash_Sha_Init(&sha);
+        for(; offset < end; offset += length){
+            length = ((end - offset) < FLASH_SHA_CHUNK) ? (end - offset) : FLASH_SHA_CHUNK;
+            if(backend->read(chunk, FlashAddress + offset, length, &fail) != FLASH_OK){
+                if(cache != NULL){
+                    cache->valid &= ~(1UL << sector);
+                }
+                return FLASH_ERROR;
+            }
+            Flash_Sha_Update(&sha, chunk, length);
+        }
+        Flash_Sha_Final(&sha, sector_digest[sector]);
+
+        if(cache != NULL){
+            cache->hashed++;
+            cache->valid &= ~(1UL << sector);
+            if(keep != 0U){
+                cache->crc[sector] = crc;
+                memcpy(cache->digest[sector], sector_digest[sector], FLASH_SHA_DIGEST_SIZE);
+                cache->valid |= 1UL << sector;
+            }
+        }
+    }
+
+    Flash_Sha_Init(&sha);
+    Flash_Sha_Update(&sha, sector_digest, sectors * FLASH_SHA_DIGEST_SIZE);
+    Flash_Sha_Final(&sha, digest);
+    return FLASH_OK;
+}
+
+/* SHA-256 compression: 16 rounds unrolled per pass so every schedule
+   index is a constant, the ring refilled in place between passes */
+static void Flash_Sha_Compress(uint32_t *state, const uint8_t *data, uint32_t NbOfBlocks)
+{
+    uint32_t w[16];
+    uint32_t a, b, c, d, e, f, g, h, t;
+    uint32_t round;
+    uint32_t k;
+
+    while(NbOfBlocks-- != 0U){
+        /* The M4 loads unaligned words; REV makes them big endian */
+        memcpy(w, data, sizeof(w));
+        for(k = 0; k < 16U; k++){
+            w[k] = __builtin_bswap32(w[k]);
+        }
+        data += FLASH_SHA_BLOCK_SIZE;
+
+        a = state[0]; b = state[1]; c = state[2]; d = state[3];
+        e = state[4]; f = state[5]; g = state[6]; h = state[7];
+        for(round = 0; round < 64U; round += 16U){
+            FLASH_SHA_ROUND(a, b, c, d, e, f, g, h, 0U);
+            FLASH_SHA_ROUND(h, a, b, c, d, e, f, g, 1U);
+            FLASH_SHA_ROUND(g, h, a, b, c, d, e, f, 2U);
+            FLASH_SHA_ROUND(f, g, h, a, b, c, d, e, 3U);
+            FLASH_SHA_ROUND(e, f, g, h, a, b, c, d, 4U);
+            FLASH_SHA_ROUND(d, e, f, g, h, a, b, c, 5U);
+            FLASH_SHA_ROUND(c, d, e, f, g, h, a, b, 6U);
+            FLASH_SHA_ROUND(b, c, d, e, f, g, h, a, 7U);
+            FLASH_SHA_ROUND(a, b, c, d, e, f, g, h, 8U);
+            FLASH_SHA_ROUND(h, a, b, c, d, e, f, g, 9U);
+            FLASH_SHA_ROUND(g, h, a, b, c, d, e, f, 10U);
+            FLASH_SHA_ROUND(f, g, h, a, b, c, d, e, 11U);
+            FLASH_SHA_ROUND(e, f, g, h, a, b, c, d, 12U);
+            FLASH_SHA_ROUND(d, e, f, g, h, a, b, c, 13U);
+            FLASH_SHA_ROUND(c, d, e, f, g, h, a, b, 14U);
+            FLASH_SHA_ROUND(b, c, d, e, f, g, h, a, 15U);
+            if(round == 48U){
+                break;
+            }
+            /* W[i] = G1(W[i-2]) + W[i-7] + G0(W[i-15]) + W[i-16], in a ring of 16 */
+            for(k = 0; k < 16U; k++){
+                w[k] += FLASH_SHA_G1(w[(k + 14U) & 15U]) + w[(k + 9U) & 15U] + FLASH_SHA_G0(w[(k + 1U) & 15U]);
+            }
+        }
+        state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+        state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    }
+}
+
+/* Time independent of where the first difference is */
+static uint32_t Flash_Sha_Equal(const uint8_t *a, const uint8_t *b, uint32_t Length)
+{
+    uint8_t diff = 0;
+
+    while(Length-- != 0U){
+        diff |= *a++ ^ *b++;
+    }
+    return diff == 0U;
+}
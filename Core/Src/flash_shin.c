@@ -1,199 +1,113 @@
 #include "main.h"
 #include "flash_if.h"
+#include "flash_bank.h"
+#include "flash_geometry.h"
+#include "flash_trace.h"
 #include "string.h"
 
-static uint32_t FLASH_Get_Page(uint32_t Addr_base, uint32_t Addr_target);
-
-static int32_t FLASH_BANK1_Access_Lock(void);
-static int32_t FLASH_BANK1_Access_Unlock(void);
-static int32_t FLASH_BANK1_WaitForLastOperation(uint32_t msTimeout);
-static int32_t FLASH_BANK1_Erase_Page(uint32_t FirstPage, uint32_t NbOfPages);
+static uint32_t FLASH_Bank_Erase_Page(uint32_t Bank, uint32_t FirstPage, uint32_t LastPage);
+static uint32_t FLASH_Bank_Program_Words(uint32_t Bank, uint32_t u32Addr, const uint32_t *pu32Data, uint32_t NbOfFlashWords);
+static int32_t FLASH_Result_Code(uint32_t status);
 
 int32_t Flash_Result;
 
 void  FLASH_Program(UINT32 u32Addr, UINT32* p_pu32Data, UINT32 p32Length)
 {
-  UINT08 i = 0;
-  UINT08 i_max = ((((p32Length-1)/32)+1)*32);
-  UINT08 j = 0;
-  UINT32 pu32Data[40];
-  INT32 status = 0;
-  UINT08 u08index = FLASH_NB_32BITWORD_IN_FLASHWORD;
-  UINT08 u08addroffset = 0;
-
-  memset(&pu32Data, 0xff, sizeof(pu32Data));
-
-  for(i=0; i<i_max; i+=4)
+  UINT32 pu32Data[FLASH_NB_32BITWORD_IN_FLASHWORD];
+  UINT32 u32FlashWords = p32Length / sizeof(pu32Data);
+  UINT32 u32Tail = p32Length % sizeof(pu32Data);
+  UINT32 u32Bank = FLASH_GEO_BANK(u32Addr);
+  uint32_t status = FLASH_OK;
+  UINT32 u32Trace = FLASH_TRACE_BEGIN();
+
+  if ((p32Length == 0) || !FLASH_GEO_IS_ALIGNED(u32Addr) || !FLASH_GEO_SAME_BANK(u32Addr, p32Length))
   {
-    if(i < p32Length)
-    {
-      pu32Data[j] = p_pu32Data[j];
-    }
-    else
-    {
-      pu32Data[j] = 0xFFFFFFFF;
-    }
-    //------------------
-    j++;
+    FLASH_TRACE_END(u32Trace, FLASH_TRACE_OP_PROGRAM_BYTES, u32Addr, p32Length, FLASH_ERROR);
+    Flash_Result = FLASH_Result_Code(FLASH_ERROR);
+    return;
   }
 
-  j = 0;
-
-  for(i=0; i<i_max; i+=32)
+  if (u32FlashWords != 0)
   {
-    FLASH_BANK1_Access_Unlock();
-
-    status = FLASH_BANK1_WaitForLastOperation(0xFFFFFFFF);
-    if( status != 0 )
-    {
-      return;
-    }
-
-    SET_BIT( FLASH->CR1, FLASH_CR_PG );
-
-    __ISB( );
-    __DSB( );
-
-    #if 0
-    *(uint32_t*)(u32Addr + i)= pu32Data[j];
-    #else
-    for( u08index = 0; u08index < FLASH_NB_32BITWORD_IN_FLASHWORD ; u08index++ )
-    {
-      *(uint32_t*)(u32Addr + u08addroffset)= pu32Data[j];
-      u08addroffset+=4;
-      j++;
-    }
-    #endif
-
-    __ISB( );
-    __DSB( );
-
-    status = FLASH_BANK1_WaitForLastOperation(0xFFFFFFFF); ////////////////// too short period
-
-    CLEAR_BIT( FLASH->CR1, FLASH_CR_PG );
-
-    FLASH_BANK1_Access_Lock();
+    status = FLASH_Bank_Program_Words(u32Bank, u32Addr, p_pu32Data, u32FlashWords);
+  }
 
-    //HAL_Delay(1);
+  /* Pad the last partial flashword with the erased value */
+  if ((status == FLASH_OK) && (u32Tail != 0))
+  {
+    memset(pu32Data, 0xff, sizeof(pu32Data));
+    memcpy(pu32Data, (UINT08 *)p_pu32Data + (u32FlashWords * sizeof(pu32Data)), u32Tail);
+    status = FLASH_Bank_Program_Words(u32Bank, u32Addr + (u32FlashWords * sizeof(pu32Data)), pu32Data, 1);
   }
 
+  FLASH_TRACE_END(u32Trace, FLASH_TRACE_OP_PROGRAM_BYTES, u32Addr, p32Length, status);
+  Flash_Result = FLASH_Result_Code(status);
 }
 
 void FLASH_Erase(UINT32 u32StartAddr, UINT32 u32EndAddr)
 {
-  UINT08 s08FlashResult = 0;
+  uint32_t status = FLASH_OK;
+  UINT32 u32Bank = 0;
   UINT32 FirstPage_t = 0;
-  UINT32 NbOfPages_t = 0;
+  UINT32 LastPage_t = 0;
+  UINT32 u32Trace = FLASH_TRACE_BEGIN();
 
   if (u32StartAddr > u32EndAddr)
   {
     u32EndAddr = u32StartAddr;
   }
-
-  //HAL_CLEAR_WATCHDOG();
-  FirstPage_t = FLASH_Get_Page(FLASH_BANK1_BASE, u32StartAddr);
-  NbOfPages_t = FLASH_Get_Page(FLASH_BANK1_BASE, u32EndAddr) - FirstPage_t + 1;
-
-  //=====================================================================================================
-  s08FlashResult = FLASH_BANK1_Access_Unlock();
-  if( s08FlashResult != RESET )
+  if (!FLASH_GEO_IS_VALID(u32StartAddr))
   {
+    FLASH_TRACE_END(u32Trace, FLASH_TRACE_OP_ERASE_RANGE, u32StartAddr, u32EndAddr - u32StartAddr + 1, FLASH_ERROR);
+    Flash_Result = FLASH_Result_Code(FLASH_ERROR);
     return;
   }
-  Flash_Result = FLASH_BANK1_Erase_Page(FirstPage_t, NbOfPages_t);
-  FLASH_BANK1_Access_Lock(); // Flash E/W Lock
-
-}
-
-
-uint32_t FLASH_Get_Page(uint32_t Addr_base, uint32_t Addr_target)
-{
-  return (Addr_target - Addr_base) / FLASH_PAGE_SIZE;
-}
-
-int32_t FLASH_BANK1_Access_Lock(void)
-{
-  SET_BIT(FLASH->CR1, FLASH_CR_LOCK);
-
-  if (READ_BIT(FLASH->CR1, FLASH_CR_LOCK) != 0U)
+  if (!FLASH_GEO_IS_VALID(u32EndAddr))
   {
-    return 0;
+    u32EndAddr = FLASH_END;
   }
-  return -1;
-}
 
-int32_t FLASH_BANK1_Access_Unlock(void)
-{
-  if(READ_BIT(FLASH->CR1, FLASH_CR_LOCK) != 0U)
+  //HAL_CLEAR_WATCHDOG();
+  for (u32Bank = FLASH_GEO_BANK(u32StartAddr); (status == FLASH_OK) && (u32Bank <= FLASH_GEO_BANK(u32EndAddr)); u32Bank++)
   {
-    WRITE_REG(FLASH->KEYR1, FLASH_KEY1);
-    WRITE_REG(FLASH->KEYR1, FLASH_KEY2);
-
-    if(READ_BIT(FLASH->CR1, FLASH_CR_LOCK) != 0U)
-    {
-      return -1;
-    }
+    FirstPage_t = (u32Bank == FLASH_GEO_BANK(u32StartAddr)) ? FLASH_GEO_SECTOR(u32StartAddr) : 0;
+    LastPage_t = (u32Bank == FLASH_GEO_BANK(u32EndAddr)) ? FLASH_GEO_SECTOR(u32EndAddr) : (FLASH_GEO_SECTORS_PER_BANK - 1);
+    status = FLASH_Bank_Erase_Page(u32Bank, FirstPage_t, LastPage_t);
   }
-  return 0;
+
+  FLASH_TRACE_END(u32Trace, FLASH_TRACE_OP_ERASE_RANGE, u32StartAddr, u32EndAddr - u32StartAddr + 1, status);
+  Flash_Result = FLASH_Result_Code(status);
 }
 
-int32_t FLASH_BANK1_WaitForLastOperation(uint32_t msTimeout)
+/* One instantiation of the bank driver per bank keeps register access constant */
+uint32_t FLASH_Bank_Erase_Page(uint32_t Bank, uint32_t FirstPage, uint32_t LastPage)
 {
-  uint32_t loop = 0;
-  uint32_t error;
-
-  while((READ_BIT(FLASH->SR1, ((FLASH_FLAG_QW_BANK1) & 0x7FFFFFFFU)) == (((FLASH_FLAG_QW_BANK1) & 0x7FFFFFFFU))))
-  {
-    if(loop++ > msTimeout)
-    {
-      return -100;
-    }
-  }
-
-  error = ( FLASH->SR1 & FLASH_FLAG_ALL_ERRORS_BANK1 ) | 0x80000000U;
-
-  if( ( error & 0x7FFFFFFFU) != 0U )
+  if (Bank == FLASH_BANK_1)
   {
-    WRITE_REG(FLASH->CCR1, (error & 0x7FFFFFFFU));
-    return -101;
+    return Flash_Bank_Erase(FLASH_BANK_1, FirstPage, LastPage - FirstPage + 1);
   }
+  return Flash_Bank_Erase(FLASH_BANK_2, FirstPage, LastPage - FirstPage + 1);
+}
 
-  if( READ_BIT( FLASH->SR1, (FLASH_FLAG_EOP_BANK1 & 0x7FFFFFFFU)) == ((FLASH_FLAG_EOP_BANK1 & 0x7FFFFFFFU)))
+uint32_t FLASH_Bank_Program_Words(uint32_t Bank, uint32_t u32Addr, const uint32_t *pu32Data, uint32_t NbOfFlashWords)
+{
+  if (Bank == FLASH_BANK_1)
   {
-    WRITE_REG(FLASH->CCR1, (FLASH_FLAG_EOP_BANK1 & 0x7FFFFFFFU));
+    return Flash_Bank_Program(FLASH_BANK_1, u32Addr, pu32Data, NbOfFlashWords);
   }
-
-  return 0;
+  return Flash_Bank_Program(FLASH_BANK_2, u32Addr, pu32Data, NbOfFlashWords);
 }
 
-int32_t FLASH_BANK1_Erase_Page(uint32_t FirstPage, uint32_t NbOfPages)
+/* Flash_Result keeps the historical bank1 codes: -100 timeout, -101 error */
+int32_t FLASH_Result_Code(uint32_t status)
 {
-  uint32_t page_index = 0;
-  int32_t status = 0;
-
-  status = FLASH_BANK1_WaitForLastOperation( 0xFFFFFFFFU );
-  if( status != 0 )
+  if (status == FLASH_OK)
   {
-    return status;
+    return 0;
   }
-
-  for (page_index = FirstPage; page_index < (FirstPage + NbOfPages); page_index++)
+  if (status == FLASH_TIMEOUT)
   {
-    FLASH->CR1 &= ~(FLASH_CR_PSIZE | FLASH_CR_SNB);
-    FLASH->CR1 |= (FLASH_CR_SER | FLASH_CR_PSIZE | (page_index << FLASH_CR_SNB_Pos) | FLASH_CR_START);
-
-    status = FLASH_BANK1_WaitForLastOperation( 0xFFFFFFFFU );
-    //HAL_CLEAR_WATCHDOG();
-
-    CLEAR_BIT( FLASH->CR1, ( FLASH_CR_SER | FLASH_CR_SNB ) );
-
-    if (status != 0)
-    {
-      break;
-    }
+    return -100;
   }
-
-  return status;
+  return -101;
 }
-
-
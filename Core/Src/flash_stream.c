@@ -0,0 +1,283 @@
+/**
+  ******************************************************************************
+  * @file    flash_stream.c
+  * @brief   This file provides a streaming image writer with two block
+             buffers: the transport fills one while the main loop programs
+             the other, so an update takes max(link time, flash time)
+             instead of their sum. Blocks carry their image offset and a
+             CRC; a rejected block is simply sent again from
+             Flash_Stream_NextOffset(), and an interrupted transfer resumes
+             from what is already in flash.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <string.h>
+#include "flash_stream.h"
+#include "flash_if.h"
+#include "flash_geometry.h"
+
+_Static_assert((FLASH_STREAM_BLOCK_SIZE % FLASH_GEO_FLASHWORD_SIZE) == 0U, "block holds whole flashwords");
+_Static_assert((FLASH_GEO_SECTOR_SIZE % FLASH_STREAM_BLOCK_SIZE) == 0U, "blocks tile a sector");
+
+/* Buffer ownership moves between interrupt and main loop (or two threads
+   on the host): the data must be visible before the state that hands it over */
+#ifdef HOST_BUILD
+#define FLASH_STREAM_BARRIER()      __sync_synchronize()
+#else
+#define FLASH_STREAM_BARRIER()      __DMB()
+#endif
+
+#define FLASH_STREAM_FW_WORDS       (FLASH_GEO_FLASHWORD_SIZE / 4U)
+
+static uint32_t Flash_Stream_IsBlank(const uint32_t *data, uint32_t NbOfWords);
+static uint32_t Flash_Stream_Write(Flash_Stream_t *stream, uint32_t *block, const Flash_Stream_Header_t *header);
+
+uint32_t Flash_Stream_Init(Flash_Stream_t *stream, const Flash_Stream_Backend_t *backend,
+                           uint32_t FlashAddress, uint32_t Size, uint32_t Resume)
+{
+    uint32_t offset;
+    uint32_t length;
+    uint32_t fail;
+
+    memset(stream, 0, sizeof(*stream));
+    stream->backend = backend;
+    stream->base = FlashAddress;
+    stream->size = Size;
+
+    if(((FLASH_GEO_OFFSET(FlashAddress) & (FLASH_GEO_SECTOR_SIZE - 1U)) != 0U) ||
+       ((Size & (FLASH_GEO_FLASHWORD_SIZE - 1U)) != 0U) || !FLASH_GEO_SAME_BANK(FlashAddress, Size)){
+        stream->status = FLASH_ERROR;
+        return FLASH_ERROR;
+    }
+
+    if(Resume != 0U){
+        /* The last block holding anything is sent again: flashwords that
+           already match are skipped, so a block cut short by a reset is
+           completed without reprogramming a flashword */
+        for(offset = (Size + FLASH_STREAM_BLOCK_SIZE - 1U) & ~(FLASH_STREAM_BLOCK_SIZE - 1U);
+            offset != 0U; offset -= FLASH_STREAM_BLOCK_SIZE){
+            /* A region that ends inside a block only looks that far */
+            length = (offset > Size) ? (Size - (offset - FLASH_STREAM_BLOCK_SIZE)) : FLASH_STREAM_BLOCK_SIZE;
+            if((backend->read(stream->buffer[0], FlashAddress + offset - FLASH_STREAM_BLOCK_SIZE,
+                              length, &fail) != FLASH_OK) ||
+               !Flash_Stream_IsBlank(stream->buffer[0], length / 4U)){
+                stream->written = offset - FLASH_STREAM_BLOCK_SIZE;
+                stream->erased = (stream->written & ~(FLASH_GEO_SECTOR_SIZE - 1U)) + FLASH_GEO_SECTOR_SIZE;
+                break;
+            }
+        }
+        stream->expected = stream->written;
+    }
+    return FLASH_OK;
+}
+
+uint8_t *Flash_Stream_Acquire(Flash_Stream_t *stream)
+{
+    uint32_t index = stream->fill;
+
+    if((stream->state[index] != FLASH_STREAM_FREE) || (stream->status != FLASH_OK)){
+        /* Back-pressure: the transport must hold off until a buffer drains */
+        stream->stalls++;
+        return NULL;
+    }
+    stream->state[index] = FLASH_STREAM_FILLING;
+    return (uint8_t *)stream->buffer[index];
+}
+
+uint32_t Flash_Stream_Commit(Flash_Stream_t *stream, const Flash_Stream_Header_t *header)
+{
+    uint32_t index = stream->fill;
+
+    if(stream->state[index] != FLASH_STREAM_FILLING){
+        return FLASH_ERROR;
+    }
+    if((header->offset != stream->expected) || ((header->offset % FLASH_STREAM_BLOCK_SIZE) != 0U) ||
+       (header->length == 0U) || (header->length > FLASH_STREAM_BLOCK_SIZE) ||
+       (header->length > (stream->size - header->offset)) ||
+       (Flash_Stream_Crc(0, stream->buffer[index], header->length) != header->crc)){
+        stream->rejected++;
+        stream->state[index] = FLASH_STREAM_FREE;
+        return FLASH_ERROR;
+    }
+
+    stream->header[index] = *header;
+    stream->expected = header->offset + header->length;
+    stream->fill = index ^ 1U;
+    FLASH_STREAM_BARRIER();
+    stream->state[index] = FLASH_STREAM_FULL;
+    return FLASH_OK;
+}
+
+uint32_t Flash_Stream_NextOffset(const Flash_Stream_t *stream)
+{
+    return stream->expected;
+}
+
+uint32_t Flash_Stream_Process(Flash_Stream_t *stream)
+{
+    uint32_t index = stream->drain;
+
+    if((stream->status != FLASH_OK) || (stream->state[index] != FLASH_STREAM_FULL)){
+        return stream->status;
+    }
+    FLASH_STREAM_BARRIER();
+
+    stream->status = Flash_Stream_Write(stream, stream->buffer[index], &stream->header[index]);
+    if(stream->status == FLASH_OK){
+        stream->written = stream->header[index].offset + stream->header[index].length;
+        stream->blocks++;
+        if(stream->hook != NULL){
+            stream->hook(stream->hook_context, stream->header[index].offset, stream->buffer[index],
+                         stream->header[index].length);
+        }
+    }
+
+    stream->drain = index ^ 1U;
+    FLASH_STREAM_BARRIER();
+    stream->state[index] = FLASH_STREAM_FREE;
+    return stream->status;
+}
+
+/* Every committed block is in flash; a buffer the transport still holds
+   for a block that never came does not count */
+uint32_t Flash_Stream_Idle(const Flash_Stream_t *stream)
+{
+    return (stream->state[0] != FLASH_STREAM_FULL) && (stream->state[1] != FLASH_STREAM_FULL);
+}
+
+/* Reflected CRC-32, four bits per step: 64 bytes of table, no alignment needs */
+uint32_t Flash_Stream_Crc(uint32_t crc, const void *data, uint32_t Length)
+{
+    static const uint32_t nibble[16] =
+    {
+        0x00000000U, 0x1DB71064U, 0x3B6E20C8U, 0x26D930ACU, 0x76DC4190U, 0x6B6B51F4U, 0x4DB26158U, 0x5005713CU,
+        0xEDB88320U, 0xF00F9344U, 0xD6D6A3E8U, 0xCB61B38CU, 0x9B64C2B0U, 0x86D3D2D4U, 0xA00AE278U, 0xBDBDF21CU
+    };
+    const uint8_t *byte = (const uint8_t *)data;
+
+    crc = ~crc;
+    while(Length-- != 0U){
+        crc ^= *byte++;
+        crc = (crc >> 4) ^ nibble[crc & 0x0FU];
+        crc = (crc >> 4) ^ nibble[crc & 0x0FU];
+    }
+    return ~crc;
+}
+
+static uint32_t Flash_Stream_IsBlank(const uint32_t *data, uint32_t NbOfWords)
+{
+    while(NbOfWords-- != 0U){
+        if(*data++ != 0xFFFFFFFFU){
+            return 0U;
+        }
+    }
+    return 1U;
+}
+
+static uint32_t Flash_Stream_Write(Flash_Stream_t *stream, uint32_t *block, const Flash_Stream_Header_t *header)
+{
+    const Flash_Stream_Backend_t *backend = stream->backend;
+    uint32_t current[FLASH_STREAM_FW_WORDS];
+    uint32_t address = stream->base + header->offset;
+    uint32_t padded = (header->length + FLASH_GEO_FLASHWORD_SIZE - 1U) & ~(FLASH_GEO_FLASHWORD_SIZE - 1U);
+    uint32_t run = 0;
+    uint32_t fw;
+    uint32_t fail;
+    uint32_t status;
+
+    /* A sector is erased the first time a block lands in it */
+    while(stream->erased < (header->offset + header->length)){
+        status = backend->erase_sector(stream->base + stream->erased);
+        if(status != FLASH_OK){
+            return status;
+        }
+        stream->erased += FLASH_GEO_SECTOR_SIZE;
+    }
+
+    /* The last block pads its final flashword with the erased value */
+    memset((uint8_t *)block + header->length, 0xFF, padded - header->length);
+
+    /* Program runs of blank flashwords; skip the ones a resumed transfer
+       already wrote. Anything else in the way needs a fresh transfer. */
+    for(fw = 0; fw < padded; fw += FLASH_GEO_FLASHWORD_SIZE){
+        status = backend->read(current, address + fw, FLASH_GEO_FLASHWORD_SIZE, &fail);
+        if((status == FLASH_OK) && Flash_Stream_IsBlank(current, FLASH_STREAM_FW_WORDS)){
+            run++;
+            continue;
+        }
+        if(run != 0U){
+            if(backend->program(address + fw - (run * FLASH_GEO_FLASHWORD_SIZE),
+                                &block[(fw / 4U) - (run * FLASH_STREAM_FW_WORDS)], run) != FLASH_OK){
+                return FLASH_ERROR;
+            }
+            run = 0;
+        }
+        if((status != FLASH_OK) || (memcmp(current, &block[fw / 4U], FLASH_GEO_FLASHWORD_SIZE) != 0)){
+            return FLASH_ERROR;
+        }
+        stream->skipped++;
+    }
+    if((run != 0U) && (backend->program(address + padded - (run * FLASH_GEO_FLASHWORD_SIZE),
+                                        &block[(padded / 4U) - (run * FLASH_STREAM_FW_WORDS)], run) != FLASH_OK)){
+        return FLASH_ERROR;
+    }
+
+    /* Read back through ECC before the block counts as written */
+    for(fw = 0; fw < padded; fw += FLASH_GEO_FLASHWORD_SIZE){
+        if((backend->read(current, address + fw, FLASH_GEO_FLASHWORD_SIZE, &fail) != FLASH_OK) ||
+           (memcmp(current, &block[fw / 4U], FLASH_GEO_FLASHWORD_SIZE) != 0)){
+            return FLASH_ERROR;
+        }
+    }
+    return FLASH_OK;
+}
+
+#ifndef HOST_BUILD
+#include "flash_safe.h"
+#include "flash_batch.h"
+#include "flash_sched.h"
+
+/* The scheduler's erase backend with interrupts enabled throughout: the
+   main loop waits out the erase (about 1 s) while the transport interrupt
+   keeps filling the other buffer. Flash_Sector_Erase would mask them for
+   the whole erase and overrun the link at every sector boundary. */
+static uint32_t Flash_Stream_TargetErase(uint32_t FlashAddress)
+{
+    uint32_t status = Flash_Sched_TargetBackend.erase_start(FlashAddress);
+
+    if(status != FLASH_OK){
+        return status;
+    }
+    do{
+        status = Flash_Sched_TargetBackend.erase_poll(FLASH_GEO_BANK(FlashAddress));
+    }while(status == FLASH_BUSY);
+    return status;
+}
+
+/* One unlock session per run with IRQs masked per flashword only, so the
+   transport interrupt keeps filling the other buffer while this one programs */
+static uint32_t Flash_Stream_TargetProgram(uint32_t FlashAddress, const uint32_t *src, uint32_t NbOfFlashWords)
+{
+    Flash_Batch_Op_t op = { FlashAddress, (const uint8_t *)src, NbOfFlashWords << FLASH_GEO_FLASHWORD_SHIFT };
+    Flash_Batch_Stats_t stats;
+
+    return Flash_Batch_Program(&op, 1, &stats);
+}
+
+const Flash_Stream_Backend_t Flash_Stream_TargetBackend =
+{
+    Flash_Stream_TargetErase,
+    Flash_Stream_TargetProgram,
+    Flash_Safe_Read
+};
+#endif
@@ -0,0 +1,253 @@
+/**
+  ******************************************************************************
+  * @file    flash_timing.c
+  * @brief   This file derives the flash read latency, WRHIGHFREQ programming
+             delay and program/erase parallelism from the clock tree, the
+             voltage scale and the supply, and applies them to FLASH_ACR
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include "flash_timing.h"
+#include "flash_if.h"
+
+#define FLASH_TIMING_MAX_LATENCY    7U
+#define FLASH_TIMING_TIMEOUT        0x00FFFFFFU
+
+typedef struct{
+    uint32_t vos;
+    uint32_t max_hz;
+    uint8_t latency;
+    uint8_t wrhighfreq;
+}Flash_Timing_Row_t;
+
+/* RM0399 "FLASH recommended number of wait states and programming delay",
+   AXI interface clock. Rows are sorted by increasing frequency per scale. */
+static const Flash_Timing_Row_t flash_timing_table[] =
+{
+    { PWR_REGULATOR_VOLTAGE_SCALE0,  70000000U, 0, 0 },
+    { PWR_REGULATOR_VOLTAGE_SCALE0, 140000000U, 1, 1 },
+    { PWR_REGULATOR_VOLTAGE_SCALE0, 185000000U, 2, 1 },
+    { PWR_REGULATOR_VOLTAGE_SCALE0, 210000000U, 2, 2 },
+    { PWR_REGULATOR_VOLTAGE_SCALE0, 225000000U, 3, 2 },
+    { PWR_REGULATOR_VOLTAGE_SCALE0, 240000000U, 4, 3 },
+
+    { PWR_REGULATOR_VOLTAGE_SCALE1,  70000000U, 0, 0 },
+    { PWR_REGULATOR_VOLTAGE_SCALE1, 140000000U, 1, 1 },
+    { PWR_REGULATOR_VOLTAGE_SCALE1, 185000000U, 2, 1 },
+    { PWR_REGULATOR_VOLTAGE_SCALE1, 210000000U, 2, 2 },
+    { PWR_REGULATOR_VOLTAGE_SCALE1, 225000000U, 3, 2 },
+
+    { PWR_REGULATOR_VOLTAGE_SCALE2,  55000000U, 0, 0 },
+    { PWR_REGULATOR_VOLTAGE_SCALE2, 110000000U, 1, 1 },
+    { PWR_REGULATOR_VOLTAGE_SCALE2, 165000000U, 2, 1 },
+    { PWR_REGULATOR_VOLTAGE_SCALE2, 225000000U, 3, 2 },
+
+    { PWR_REGULATOR_VOLTAGE_SCALE3,  45000000U, 0, 0 },
+    { PWR_REGULATOR_VOLTAGE_SCALE3,  90000000U, 1, 1 },
+    { PWR_REGULATOR_VOLTAGE_SCALE3, 135000000U, 2, 1 },
+    { PWR_REGULATOR_VOLTAGE_SCALE3, 180000000U, 3, 2 },
+    { PWR_REGULATOR_VOLTAGE_SCALE3, 225000000U, 4, 2 },
+};
+
+/* Program/erase parallelism allowed by the supply range */
+static const struct{
+    uint32_t min_mv;
+    uint32_t psize;
+}flash_psize_table[] =
+{
+    { 2700U, FLASH_CR_PSIZE },      /* x64 */
+    { 2100U, FLASH_CR_PSIZE_1 },    /* x32 */
+    { 1800U, FLASH_CR_PSIZE_0 },    /* x16 */
+    {    0U, 0U },                  /* x8  */
+};
+
+/* Reset state until a profile is applied: the drivers keep using maximum
+   parallelism, as they always did */
+static Flash_Timing_t flash_timing_active = { 0U, 0U, FLASH_TIMING_MAX_LATENCY, 3U, FLASH_CR_PSIZE };
+static Flash_Timing_t flash_timing_pending;
+static uint32_t flash_timing_has_pending;
+
+uint32_t Flash_Timing_Derive(uint32_t hclk_hz, uint32_t vos, uint32_t vdd_mv, Flash_Timing_t *profile)
+{
+    uint32_t index;
+    uint32_t found = 0;
+
+    for(index = 0; index < (sizeof(flash_timing_table) / sizeof(flash_timing_table[0])); index++){
+        if((flash_timing_table[index].vos == vos) && (hclk_hz <= flash_timing_table[index].max_hz)){
+            found = 1;
+            break;
+        }
+    }
+    if(found == 0){
+        /* Frequency out of range for this voltage scale */
+        return FLASH_ERROR;
+    }
+
+    profile->hclk_hz = hclk_hz;
+    profile->vos = vos;
+    profile->latency = flash_timing_table[index].latency;
+    profile->wrhighfreq = flash_timing_table[index].wrhighfreq;
+
+    for(index = 0; index < (sizeof(flash_psize_table) / sizeof(flash_psize_table[0])); index++){
+        if(vdd_mv >= flash_psize_table[index].min_mv){
+            profile->psize = flash_psize_table[index].psize;
+            break;
+        }
+    }
+    return FLASH_OK;
+}
+
+uint32_t Flash_Timing_Current(uint32_t vdd_mv, Flash_Timing_t *profile)
+{
+    return Flash_Timing_Derive(HAL_RCC_GetHCLKFreq(), HAL_PWREx_GetVoltageRange(), vdd_mv, profile);
+}
+
+uint32_t Flash_Timing_Apply(const Flash_Timing_t *profile)
+{
+    uint32_t primask = __get_PRIMASK();
+    uint32_t count = 0;
+    uint32_t acr;
+    uint32_t status = FLASH_OK;
+
+    acr = (profile->latency & FLASH_ACR_LATENCY) | (profile->wrhighfreq << FLASH_ACR_WRHIGHFREQ_Pos);
+
+    __disable_irq();
+
+    /* ACR must not change under a pending program/erase on either bank */
+    while((READ_BIT(FLASH->SR1, FLASH_SR_QW) != 0U) || (READ_BIT(FLASH->SR2, FLASH_SR_QW) != 0U)){
+        if(count++ > FLASH_TIMING_TIMEOUT){
+            __set_PRIMASK(primask);
+            return FLASH_TIMEOUT;
+        }
+    }
+
+    /* Latency and programming delay land in one write */
+    MODIFY_REG(FLASH->ACR, (FLASH_ACR_LATENCY | FLASH_ACR_WRHIGHFREQ), acr);
+
+    if((READ_REG(FLASH->ACR) & (FLASH_ACR_LATENCY | FLASH_ACR_WRHIGHFREQ)) != acr){
+        status = FLASH_ERROR;
+    }else{
+        flash_timing_active = *profile;
+    }
+
+    __set_PRIMASK(primask);
+    return status;
+}
+
+uint32_t Flash_Timing_PrepareClockChange(uint32_t new_hclk_hz, uint32_t new_vos, uint32_t vdd_mv)
+{
+    Flash_Timing_t interim;
+    uint32_t acr = READ_REG(FLASH->ACR);
+    uint32_t status;
+
+    status = Flash_Timing_Derive(new_hclk_hz, new_vos, vdd_mv, &flash_timing_pending);
+    if(status != FLASH_OK){
+        return status;
+    }
+
+    /* Wait states and programming delay that go up must be in place before
+       the clock goes up, the ones that go down only after it has come
+       down; the same for a parallelism the new supply does not allow */
+    interim = flash_timing_pending;
+    if((acr & FLASH_ACR_LATENCY) > interim.latency){
+        interim.latency = acr & FLASH_ACR_LATENCY;
+    }
+    if(((acr & FLASH_ACR_WRHIGHFREQ) >> FLASH_ACR_WRHIGHFREQ_Pos) > interim.wrhighfreq){
+        interim.wrhighfreq = (acr & FLASH_ACR_WRHIGHFREQ) >> FLASH_ACR_WRHIGHFREQ_Pos;
+    }
+    if(flash_timing_active.psize < interim.psize){
+        interim.psize = flash_timing_active.psize;
+    }
+    flash_timing_has_pending = (interim.latency != flash_timing_pending.latency)
+                            || (interim.wrhighfreq != flash_timing_pending.wrhighfreq)
+                            || (interim.psize != flash_timing_pending.psize);
+    return Flash_Timing_Apply(&interim);
+}
+
+uint32_t Flash_Timing_CommitClockChange(void)
+{
+    if(flash_timing_has_pending == 0){
+        return FLASH_OK;
+    }
+    flash_timing_has_pending = 0;
+    return Flash_Timing_Apply(&flash_timing_pending);
+}
+
+uint32_t Flash_Timing_GetPsize(void)
+{
+    return flash_timing_active.psize;
+}
+
+#ifdef FLASH_TIMING_BENCHMARK
+/**
+  * @brief  Measures read time and bank2 sector erase time for every latency
+  *         from the derived minimum upwards, crossed with every PSIZE the
+  *         supply allows, so each result changes one setting at a time.
+  *         EraseSector is destroyed and must not hold code or data in use.
+  * @retval Number of results filled
+  */
+uint32_t Flash_Timing_Benchmark(uint32_t ReadAddress, uint32_t ReadLength, uint32_t EraseSector,
+                                Flash_Timing_Bench_t *results, uint32_t NbOfResults)
+{
+    static const uint32_t psize_sweep[] = { FLASH_CR_PSIZE, FLASH_CR_PSIZE_1, FLASH_CR_PSIZE_0, 0U };
+    Flash_Timing_t saved = flash_timing_active;
+    Flash_Timing_t profile;
+    Flash_Timing_t trial;
+    __IO uint32_t sink = 0;
+    uint32_t count = 0;
+    uint32_t stop = 0;
+    uint32_t latency;
+    uint32_t sweep;
+    uint32_t addr;
+    uint32_t start;
+
+    if(Flash_Timing_Current(FLASH_TIMING_VDD_MV, &profile) != FLASH_OK){
+        return 0;
+    }
+
+    SET_BIT(CoreDebug->DEMCR, CoreDebug_DEMCR_TRCENA_Msk);
+    SET_BIT(DWT->CTRL, DWT_CTRL_CYCCNTENA_Msk);
+
+    for(latency = profile.latency; (latency <= FLASH_TIMING_MAX_LATENCY) && (stop == 0U); latency++){
+        for(sweep = 0; (sweep < (sizeof(psize_sweep) / sizeof(psize_sweep[0]))) && (stop == 0U); sweep++){
+            /* Never exceed the parallelism the supply allows */
+            if(psize_sweep[sweep] > profile.psize){
+                continue;
+            }
+            trial = profile;
+            trial.latency = latency;
+            trial.psize = psize_sweep[sweep];
+            if((count == NbOfResults) || (Flash_Timing_Apply(&trial) != FLASH_OK)){
+                stop = 1;
+                continue;
+            }
+
+            start = DWT->CYCCNT;
+            for(addr = ReadAddress; addr < (ReadAddress + ReadLength); addr += 4){
+                sink += *(__IO uint32_t *)addr;
+            }
+            results[count].latency = trial.latency;
+            results[count].read_cycles = DWT->CYCCNT - start;
+
+            start = DWT->CYCCNT;
+            Flash_Sector_Erase(FLASH_BANK_2, EraseSector, 1);
+            results[count].psize = trial.psize;
+            results[count].erase_cycles = DWT->CYCCNT - start;
+            count++;
+        }
+    }
+
+    Flash_Timing_Apply(&saved);
+    return count;
+}
+#endif
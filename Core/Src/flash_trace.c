@@ -0,0 +1,43 @@
+/**
+  ******************************************************************************
+  * @file    flash_trace.c
+  * @brief   This file provides the RAM ring that records every erase and
+             program call when FLASH_TRACE_ENABLE is defined. The records
+             are replayed on the host by Tools/trace_replay.c.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include "flash_trace.h"
+
+#ifdef FLASH_TRACE_ENABLE
+
+#if (FLASH_TRACE_DEPTH & (FLASH_TRACE_DEPTH - 1U)) != 0U
+#error "FLASH_TRACE_DEPTH must be a power of two"
+#endif
+
+Flash_Trace_t Flash_Trace;
+
+void Flash_Trace_Init(void)
+{
+    SET_BIT(CoreDebug->DEMCR, CoreDebug_DEMCR_TRCENA_Msk);
+    SET_BIT(DWT->CTRL, DWT_CTRL_CYCCNTENA_Msk);
+
+    Flash_Trace.magic = FLASH_TRACE_MAGIC;
+    Flash_Trace.version = FLASH_TRACE_VERSION;
+    Flash_Trace.record_size = sizeof(Flash_Trace_Record_t);
+    Flash_Trace.depth = FLASH_TRACE_DEPTH;
+    Flash_Trace.head = 0;
+    Flash_Trace.clock_hz = SystemCoreClock;
+}
+
+#endif /* FLASH_TRACE_ENABLE */
@@ -0,0 +1,367 @@
+/**
+  ******************************************************************************
+  * @file    flash_ts.c
+  * @brief   This file provides a flash time-series ring. Samples are
+             appended a flashword at a time; each sector opens with a header
+             flashword carrying its ring sequence and closes with a summary
+             flashword (time range, count, min, max, sum). A range query
+             binary-searches the summaries, takes sectors that lie wholly
+             inside the range from their summary, and reads data flashwords
+             only at the two edges.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stdint.h>
+#include <string.h>
+#include "flash_ts.h"
+#include "flash_if.h"
+
+#define FLASH_TS_HEADER_MAGIC   0x48535446U     /* "FTSH" */
+#define FLASH_TS_SUMMARY_MAGIC  0x53535446U     /* "FTSS" */
+#define FLASH_TS_UNUSED         0xFFFFFFFFU
+
+#define FLASH_TS_SECTOR(ts, index)      ((ts)->base + ((index) << FLASH_GEO_SECTOR_SHIFT))
+#define FLASH_TS_DATA(ts, index, word)  (FLASH_TS_SECTOR(ts, index) + (((word) + 1U) << FLASH_GEO_FLASHWORD_SHIFT))
+#define FLASH_TS_SUMMARY(ts, index)     (FLASH_TS_SECTOR(ts, index) + FLASH_GEO_SECTOR_SIZE - FLASH_GEO_FLASHWORD_SIZE)
+#define FLASH_TS_RING(ts, k)            (((ts)->oldest + (k)) % (ts)->nb_sectors)
+#define FLASH_TS_OPEN(ts)               FLASH_TS_RING(ts, (ts)->used - 1U)
+
+typedef struct{
+    uint32_t magic;
+    uint32_t sequence;
+    uint32_t reserved[6];
+}Flash_TS_Header_t;
+
+_Static_assert(sizeof(Flash_TS_Header_t) == FLASH_GEO_FLASHWORD_SIZE, "header is one flashword");
+_Static_assert(sizeof(Flash_TS_Summary_t) == FLASH_GEO_FLASHWORD_SIZE, "summary is one flashword");
+_Static_assert((FLASH_GEO_FLASHWORD_SIZE % sizeof(Flash_TS_Sample_t)) == 0U, "samples tile a flashword");
+
+static uint32_t Flash_TS_Open(Flash_TS_t *ts, uint32_t index);
+static uint32_t Flash_TS_Advance(Flash_TS_t *ts, uint32_t seal);
+static uint32_t Flash_TS_Scan(Flash_TS_t *ts, uint32_t index, uint32_t from, uint32_t to, uint32_t First, uint32_t Last,
+                              Flash_TS_Summary_t *acc, uint32_t *flashwords);
+static void Flash_TS_Add(Flash_TS_Summary_t *acc, uint32_t time, int32_t value);
+static void Flash_TS_Merge(Flash_TS_Result_t *result, const Flash_TS_Summary_t *summary);
+
+uint32_t Flash_TS_Init(Flash_TS_t *ts, const Flash_Stream_Backend_t *backend, uint32_t FlashAddress, uint32_t NbOfSectors)
+{
+    Flash_TS_Header_t header;
+    Flash_TS_Summary_t *summary;
+    uint32_t sequence[FLASH_TS_MAX_SECTORS];
+    uint32_t index;
+    uint32_t newest = 0;
+    uint32_t open;
+    uint32_t lo;
+    uint32_t hi;
+    uint32_t mid;
+    uint32_t reads = 0;
+    uint32_t fail;
+
+    memset(ts, 0, sizeof(*ts));
+    ts->backend = backend;
+    ts->base = FlashAddress;
+    ts->nb_sectors = NbOfSectors;
+
+    if(((FLASH_GEO_OFFSET(FlashAddress) & (FLASH_GEO_SECTOR_SIZE - 1U)) != 0U) || (NbOfSectors < 2U) ||
+       (NbOfSectors > FLASH_TS_MAX_SECTORS) || !FLASH_GEO_SAME_BANK(FlashAddress, NbOfSectors << FLASH_GEO_SECTOR_SHIFT)){
+        ts->status = FLASH_ERROR;
+        return ts->status;
+    }
+
+    for(index = 0; index < NbOfSectors; index++){
+        sequence[index] = 0;
+        if((backend->read(&header, FLASH_TS_SECTOR(ts, index), sizeof(header), &fail) == FLASH_OK) &&
+           (header.magic == FLASH_TS_HEADER_MAGIC)){
+            sequence[index] = header.sequence;
+            if(sequence[index] > sequence[newest]){
+                newest = index;
+            }
+        }
+    }
+    if(sequence[newest] == 0U){
+        /* Empty ring */
+        ts->used = 1;
+        ts->status = Flash_TS_Open(ts, 0);
+        return ts->status;
+    }
+
+    /* Walk back from the newest sector while the sequence stays unbroken */
+    ts->sequence = sequence[newest];
+    ts->oldest = newest;
+    ts->used = 1;
+    while(ts->used < NbOfSectors){
+        index = (ts->oldest + NbOfSectors - 1U) % NbOfSectors;
+        if((sequence[index] == 0U) || (sequence[index] != (ts->sequence - ts->used))){
+            break;
+        }
+        ts->oldest = index;
+        ts->used++;
+    }
+
+    for(index = 0; (index < ts->used) && (ts->status == FLASH_OK); index++){
+        summary = &ts->summary[FLASH_TS_RING(ts, index)];
+        if((backend->read(summary, FLASH_TS_SUMMARY(ts, FLASH_TS_RING(ts, index)), sizeof(*summary), &fail) == FLASH_OK) &&
+           (summary->magic == FLASH_TS_SUMMARY_MAGIC)){
+            continue;
+        }
+        memset(summary, 0, sizeof(*summary));
+        summary->magic = FLASH_TS_SUMMARY_MAGIC;
+        if(index != (ts->used - 1U)){
+            /* A full sector whose summary was lost to a reset */
+            ts->status = Flash_TS_Scan(ts, FLASH_TS_RING(ts, index), 0, FLASH_TS_DATA_WORDS, 0, FLASH_TS_UNUSED, summary, &reads);
+            if(ts->status == FLASH_OK){
+                ts->status = ts->backend->program(FLASH_TS_SUMMARY(ts, FLASH_TS_RING(ts, index)), (const uint32_t *)summary, 1);
+            }
+        }
+    }
+    if(ts->status != FLASH_OK){
+        return ts->status;
+    }
+
+    /* Open sector: data flashwords fill in order, so the first blank one
+       is found by bisection, then the RAM summary is rebuilt */
+    open = FLASH_TS_OPEN(ts);
+    if(ts->summary[open].count != 0U){
+        /* Sealed just before a reset */
+        ts->status = Flash_TS_Advance(ts, 0);
+        return ts->status;
+    }
+    lo = 0;
+    hi = FLASH_TS_DATA_WORDS;
+    while(lo < hi){
+        Flash_TS_Sample_t first;
+
+        mid = (lo + hi) / 2U;
+        if((backend->read(&first, FLASH_TS_DATA(ts, open, mid), sizeof(first), &fail) == FLASH_OK) &&
+           (first.time == FLASH_TS_UNUSED) && (first.value == -1)){
+            hi = mid;
+        }else{
+            lo = mid + 1U;
+        }
+    }
+    ts->fill = lo;
+    ts->status = Flash_TS_Scan(ts, open, 0, ts->fill, 0, FLASH_TS_UNUSED, &ts->summary[open], &reads);
+    if((ts->status == FLASH_OK) && (ts->fill == FLASH_TS_DATA_WORDS)){
+        ts->status = Flash_TS_Advance(ts, 1);
+    }
+    return ts->status;
+}
+
+uint32_t Flash_TS_Append(Flash_TS_t *ts, uint32_t Time, int32_t Value)
+{
+    Flash_TS_Summary_t *open = &ts->summary[FLASH_TS_OPEN(ts)];
+    uint32_t newest = (open->count != 0U) ? open->last :
+                      ((ts->used > 1U) ? ts->summary[FLASH_TS_RING(ts, ts->used - 2U)].last : 0U);
+
+    if(ts->status != FLASH_OK){
+        return ts->status;
+    }
+    if((Time < newest) || (Time == FLASH_TS_UNUSED)){
+        return FLASH_ERROR;
+    }
+
+    ts->batch[ts->pending].time = Time;
+    ts->batch[ts->pending].value = Value;
+    Flash_TS_Add(open, Time, Value);
+    if(++ts->pending == FLASH_TS_PER_FLASHWORD){
+        return Flash_TS_Flush(ts);
+    }
+    return FLASH_OK;
+}
+
+uint32_t Flash_TS_Flush(Flash_TS_t *ts)
+{
+    if((ts->status != FLASH_OK) || (ts->pending == 0U)){
+        return ts->status;
+    }
+    memset(&ts->batch[ts->pending], 0xFF, (FLASH_TS_PER_FLASHWORD - ts->pending) * sizeof(Flash_TS_Sample_t));
+
+    ts->status = ts->backend->program(FLASH_TS_DATA(ts, FLASH_TS_OPEN(ts), ts->fill), (const uint32_t *)ts->batch, 1);
+    ts->pending = 0;
+    if((ts->status == FLASH_OK) && (++ts->fill == FLASH_TS_DATA_WORDS)){
+        ts->status = Flash_TS_Advance(ts, 1);
+    }
+    return ts->status;
+}
+
+uint32_t Flash_TS_Query(Flash_TS_t *ts, uint32_t First, uint32_t Last, Flash_TS_Result_t *result)
+{
+    const Flash_TS_Summary_t *summary;
+    Flash_TS_Summary_t edge;
+    uint32_t index;
+    uint32_t words;
+    uint32_t lo = 0;
+    uint32_t hi;
+    uint32_t mid;
+    uint32_t k;
+    uint32_t fail;
+    Flash_TS_Sample_t probe;
+
+    memset(result, 0, sizeof(*result));
+    result->min = INT32_MAX;
+    result->max = INT32_MIN;
+    if(ts->status != FLASH_OK){
+        return ts->status;
+    }
+
+    /* Sectors are in time order from the oldest: first one ending at or after First */
+    hi = ts->used;
+    while(lo < hi){
+        mid = (lo + hi) / 2U;
+        summary = &ts->summary[FLASH_TS_RING(ts, mid)];
+        if((summary->count != 0U) && (summary->last < First)){
+            lo = mid + 1U;
+        }else{
+            hi = mid;
+        }
+    }
+
+    for(k = lo; k < ts->used; k++){
+        index = FLASH_TS_RING(ts, k);
+        summary = &ts->summary[index];
+        if((summary->count == 0U) || (summary->first > Last)){
+            break;
+        }
+        if((summary->first >= First) && (summary->last <= Last)){
+            Flash_TS_Merge(result, summary);
+            result->summaries++;
+            continue;
+        }
+
+        /* Edge sector: bisect on the first sample of each data flashword */
+        words = (k == (ts->used - 1U)) ? ts->fill : FLASH_TS_DATA_WORDS;
+        lo = 0;
+        hi = words;
+        while(lo < hi){
+            mid = (lo + hi) / 2U;
+            result->flashwords++;
+            if(ts->backend->read(&probe, FLASH_TS_DATA(ts, index, mid), sizeof(probe), &fail) != FLASH_OK){
+                return FLASH_ERROR;
+            }
+            if(probe.time < First){
+                lo = mid + 1U;
+            }else{
+                hi = mid;
+            }
+        }
+        memset(&edge, 0, sizeof(edge));
+        /* The flashword before the first one starting at or after First
+           may still end inside the range */
+        if(Flash_TS_Scan(ts, index, (lo != 0U) ? (lo - 1U) : 0U, words, First, Last, &edge, &result->flashwords) != FLASH_OK){
+            return FLASH_ERROR;
+        }
+        if(k == (ts->used - 1U)){
+            for(mid = 0; mid < ts->pending; mid++){
+                if((ts->batch[mid].time >= First) && (ts->batch[mid].time <= Last)){
+                    Flash_TS_Add(&edge, ts->batch[mid].time, ts->batch[mid].value);
+                }
+            }
+        }
+        Flash_TS_Merge(result, &edge);
+    }
+    return FLASH_OK;
+}
+
+static uint32_t Flash_TS_Open(Flash_TS_t *ts, uint32_t index)
+{
+    Flash_TS_Header_t header;
+    uint32_t status;
+
+    memset(&header, 0xFF, sizeof(header));
+    header.magic = FLASH_TS_HEADER_MAGIC;
+    header.sequence = ++ts->sequence;
+
+    status = ts->backend->erase_sector(FLASH_TS_SECTOR(ts, index));
+    if(status == FLASH_OK){
+        status = ts->backend->program(FLASH_TS_SECTOR(ts, index), (const uint32_t *)&header, 1);
+    }
+    memset(&ts->summary[index], 0, sizeof(ts->summary[index]));
+    ts->summary[index].magic = FLASH_TS_SUMMARY_MAGIC;
+    ts->fill = 0;
+    return status;
+}
+
+/* Seals the open sector with its summary and opens the next one,
+   dropping the oldest sector once the ring is full */
+static uint32_t Flash_TS_Advance(Flash_TS_t *ts, uint32_t seal)
+{
+    uint32_t open = FLASH_TS_OPEN(ts);
+    uint32_t status;
+
+    if(seal != 0U){
+        status = ts->backend->program(FLASH_TS_SUMMARY(ts, open), (const uint32_t *)&ts->summary[open], 1);
+        if(status != FLASH_OK){
+            return status;
+        }
+    }
+    if(ts->used == ts->nb_sectors){
+        ts->oldest = (ts->oldest + 1U) % ts->nb_sectors;
+    }else{
+        ts->used++;
+    }
+    return Flash_TS_Open(ts, (open + 1U) % ts->nb_sectors);
+}
+
+/* Adds samples of data flashwords [from, to) within [First, Last];
+   stops at the first sample past Last */
+static uint32_t Flash_TS_Scan(Flash_TS_t *ts, uint32_t index, uint32_t from, uint32_t to, uint32_t First, uint32_t Last,
+                              Flash_TS_Summary_t *acc, uint32_t *flashwords)
+{
+    Flash_TS_Sample_t word[FLASH_TS_PER_FLASHWORD];
+    uint32_t slot;
+    uint32_t fail;
+
+    for(; from < to; from++){
+        (*flashwords)++;
+        if(ts->backend->read(word, FLASH_TS_DATA(ts, index, from), sizeof(word), &fail) != FLASH_OK){
+            return FLASH_ERROR;
+        }
+        for(slot = 0; slot < FLASH_TS_PER_FLASHWORD; slot++){
+            if(word[slot].time == FLASH_TS_UNUSED){
+                continue;
+            }
+            if(word[slot].time > Last){
+                return FLASH_OK;
+            }
+            if(word[slot].time >= First){
+                Flash_TS_Add(acc, word[slot].time, word[slot].value);
+            }
+        }
+    }
+    return FLASH_OK;
+}
+
+static void Flash_TS_Add(Flash_TS_Summary_t *acc, uint32_t time, int32_t value)
+{
+    if(acc->count == 0U){
+        acc->first = time;
+        acc->min = value;
+        acc->max = value;
+    }
+    acc->last = time;
+    acc->min = (value < acc->min) ? value : acc->min;
+    acc->max = (value > acc->max) ? value : acc->max;
+    acc->sum += value;
+    acc->count++;
+}
+
+static void Flash_TS_Merge(Flash_TS_Result_t *result, const Flash_TS_Summary_t *summary)
+{
+    if(summary->count == 0U){
+        return;
+    }
+    result->count += summary->count;
+    result->min = (summary->min < result->min) ? summary->min : result->min;
+    result->max = (summary->max > result->max) ? summary->max : result->max;
+    result->sum += summary->sum;
+}
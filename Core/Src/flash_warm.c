@@ -0,0 +1,140 @@
+/**
+  ******************************************************************************
+  * @file    flash_warm.c
+  * @brief   This file provides warm restarts for RAM indexes over flash
+             (file system tables, time-series summaries): they live in
+             memory the startup code does not clear, and a planned reset
+             seals them with a checksum and a generation number. After the
+             reset each index checks its region in a few microseconds instead
+             of rescanning its sectors; after a power-on, a fault or any
+             reset that did not go through Flash_Warm_Save it is rebuilt.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stdint.h>
+#include <string.h>
+#include "flash_warm.h"
+
+#define FLASH_WARM_MAGIC        0x4D524157U     /* "WARM" */
+
+static FLASH_WARM Flash_Warm_Record_t flash_warm_record;
+static Flash_Warm_Record_t flash_warm_saved;     /* what the previous run left */
+static uint32_t flash_warm_valid;
+static uint32_t flash_warm_build;
+static uint32_t flash_warm_count;
+static const void *flash_warm_state[FLASH_WARM_MAX_REGIONS];
+#ifndef HOST_BUILD
+static volatile uint32_t flash_warm_requested;
+#endif
+
+static uint32_t Flash_Warm_Check(const void *state, uint32_t Size);
+
+void Flash_Warm_Begin(void)
+{
+    Flash_Warm_Record_t *record = &flash_warm_record;
+
+    flash_warm_build = FLASH_WARM_BUILD_ID;
+    flash_warm_saved = *record;
+    flash_warm_count = 0;
+    flash_warm_valid = ((record->magic == FLASH_WARM_MAGIC) && (record->commit == record->generation) &&
+                        (record->build == flash_warm_build) && (record->count <= FLASH_WARM_MAX_REGIONS)) ? 1U : 0U;
+
+    /* From here the regions change again: a reset that skips
+       Flash_Warm_Save must not find them valid */
+    record->magic = 0;
+    record->generation = (flash_warm_valid != 0U) ? (record->generation + 1U) : 0U;
+    record->count = 0;
+}
+
+uint32_t Flash_Warm_Attach(void *state, uint32_t Size)
+{
+    Flash_Warm_Region_t *saved = &flash_warm_saved.region[flash_warm_count];
+    Flash_Warm_Region_t *region = &flash_warm_record.region[flash_warm_count];
+    uint32_t intact;
+
+    if(flash_warm_count >= FLASH_WARM_MAX_REGIONS){
+        return 0U;
+    }
+    intact = ((flash_warm_valid != 0U) && (flash_warm_count < flash_warm_saved.count) &&
+              (saved->address == (uint32_t)(uintptr_t)state) && (saved->size == Size) &&
+              (saved->check == Flash_Warm_Check(state, Size))) ? 1U : 0U;
+
+    region->address = (uint32_t)(uintptr_t)state;
+    region->size = Size;
+    region->check = 0;
+    flash_warm_state[flash_warm_count] = state;
+    flash_warm_count++;
+    return intact;
+}
+
+void Flash_Warm_Save(void)
+{
+    Flash_Warm_Record_t *record = &flash_warm_record;
+    uint32_t index;
+
+    record->magic = 0;
+    record->commit = ~record->generation;
+    for(index = 0; index < flash_warm_count; index++){
+        record->region[index].check = Flash_Warm_Check(flash_warm_state[index], record->region[index].size);
+    }
+    record->count = flash_warm_count;
+    record->build = flash_warm_build;
+    record->commit = record->generation;
+    record->magic = FLASH_WARM_MAGIC;
+}
+
+uint32_t Flash_Warm_Generation(void)
+{
+    return flash_warm_record.generation;
+}
+
+#ifndef HOST_BUILD
+void Flash_Warm_Restart(void)
+{
+    Flash_Warm_Save();
+    __DSB();
+    __NVIC_SystemReset();
+}
+
+void Flash_Warm_Request(void)
+{
+    flash_warm_requested = 1;
+}
+
+void Flash_Warm_Poll(void)
+{
+    if(flash_warm_requested != 0U){
+        Flash_Warm_Restart();
+    }
+}
+#endif
+
+/* Word-wise multiplicative hash: about three cycles a word, so tens of
+   Kbytes check in tens of microseconds */
+static uint32_t Flash_Warm_Check(const void *state, uint32_t Size)
+{
+    const uint8_t *bytes = (const uint8_t *)state;
+    uint32_t hash = Size ^ 0x811C9DC5U;
+    uint32_t word;
+    uint32_t index;
+
+    for(index = 0; (index + 4U) <= Size; index += 4U){
+        memcpy(&word, &bytes[index], 4);
+        hash = (hash ^ word) * 0x9E3779B1U;
+        hash ^= hash >> 15;
+    }
+    for(; index < Size; index++){
+        hash = (hash ^ bytes[index]) * 0x9E3779B1U;
+    }
+    return hash;
+}
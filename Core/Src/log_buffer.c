@@ -0,0 +1,251 @@
+/**
+  ******************************************************************************
+  * @file    log_buffer.c
+  * @brief   This file provides a ring-buffered _write() backend so printf
+             output costs a memcpy on the caller side. The ring is drained
+             to the ITM stimulus port, to a UART by DMA, or to stdout on a
+             host build.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <string.h>
+#include "log_buffer.h"
+
+#if (LOG_BUFFER_SIZE & (LOG_BUFFER_SIZE - 1U)) != 0U
+#error "LOG_BUFFER_SIZE must be a power of two"
+#endif
+
+#define LOG_MASK    (LOG_BUFFER_SIZE - 1U)
+
+#ifdef HOST_BUILD
+#include <stdio.h>
+#define LOG_ENTER_CRITICAL()    uint32_t primask = 0U
+#define LOG_EXIT_CRITICAL()     (void)primask
+#define LOG_CAN_BLOCK()         (1)
+#define UNUSED(X)               (void)X
+#else
+#define LOG_ENTER_CRITICAL()    uint32_t primask = __get_PRIMASK(); __disable_irq()
+#define LOG_EXIT_CRITICAL()     __set_PRIMASK(primask)
+/* Blocking is only possible when the drain can make progress: thread mode
+   with interrupts enabled (the UART DMA completion is an interrupt). */
+#define LOG_CAN_BLOCK()         ((__get_PRIMASK() == 0U) && ((SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk) == 0U))
+#endif
+
+static uint8_t log_ring[LOG_BUFFER_SIZE];
+static volatile uint32_t log_head;      /* free running write index */
+static volatile uint32_t log_tail;      /* free running read index */
+static volatile uint32_t log_inflight;  /* bytes owned by the DMA transfer */
+static volatile uint32_t log_draining;
+static Log_Stats_t log_stats;
+
+static void Log_Copy(uint32_t index, const char *ptr, uint32_t len);
+static uint32_t Log_Contiguous(void);
+static uint32_t Log_Drain(void);
+
+void Log_Buffer_Init(void)
+{
+    log_head = 0;
+    log_tail = 0;
+    log_inflight = 0;
+    log_draining = 0;
+    memset(&log_stats, 0, sizeof(log_stats));
+}
+
+uint32_t Log_Buffer_Write(const char *ptr, uint32_t len)
+{
+    uint32_t accepted = 0;
+    uint32_t head;
+    uint32_t level;
+    uint32_t chunk;
+
+    while(len != 0){
+        {
+            LOG_ENTER_CRITICAL();
+            head = log_head;
+            level = head - log_tail;
+            chunk = LOG_BUFFER_SIZE - level;
+            if(chunk > len){
+                chunk = len;
+            }
+            if(chunk != 0){
+                Log_Copy(head, ptr, chunk);
+                log_head = head + chunk;
+                log_stats.written += chunk;
+                if((level + chunk) > log_stats.high_water){
+                    log_stats.high_water = level + chunk;
+                }
+            }
+#if (LOG_OVERFLOW_POLICY == LOG_OVERFLOW_DROP)
+            if(chunk != len){
+                log_stats.dropped += (len - chunk);
+                len = chunk;
+            }
+#else
+            if((chunk != len) && !LOG_CAN_BLOCK()){
+                log_stats.dropped += (len - chunk);
+                len = chunk;
+            }
+#endif
+            LOG_EXIT_CRITICAL();
+        }
+        ptr += chunk;
+        len -= chunk;
+        accepted += chunk;
+
+        if((len != 0) && (Log_Drain() != 0U)){
+            /* LOG_OVERFLOW_BLOCK with nothing to drain into: waiting would
+               never make room */
+            LOG_ENTER_CRITICAL();
+            log_stats.dropped += len;
+            LOG_EXIT_CRITICAL();
+            break;
+        }
+    }
+    return accepted;
+}
+
+void Log_Buffer_Drain(void)
+{
+    (void)Log_Drain();
+}
+
+void Log_Buffer_DrainComplete(uint32_t len)
+{
+    if(len > log_inflight){
+        len = log_inflight;
+    }
+    log_tail += len;
+    log_stats.drained += len;
+    log_inflight = 0;
+
+    /* Chain the next transfer straight from the completion interrupt */
+    Log_Buffer_Drain();
+}
+
+void Log_Buffer_GetStats(Log_Stats_t *stats)
+{
+    LOG_ENTER_CRITICAL();
+    *stats = log_stats;
+    LOG_EXIT_CRITICAL();
+}
+
+__attribute__((weak)) int32_t Log_Transport_Start(const uint8_t *buf, uint32_t len)
+{
+    UNUSED(buf);
+    UNUSED(len);
+    return -1;
+}
+
+#ifndef HOST_BUILD
+/* Overrides the weak, per-character _write() in syscalls.c */
+int _write(int file, char *ptr, int len)
+{
+    UNUSED(file);
+
+    if(len > 0){
+        Log_Buffer_Write(ptr, (uint32_t)len);
+    }
+    /* Always report success: newlib retries short writes forever */
+    return len;
+}
+#endif
+
+static void Log_Copy(uint32_t index, const char *ptr, uint32_t len)
+{
+    uint32_t offset = index & LOG_MASK;
+    uint32_t first = LOG_BUFFER_SIZE - offset;
+
+    if(first >= len){
+        memcpy(&log_ring[offset], ptr, len);
+    }else{
+        memcpy(&log_ring[offset], ptr, first);
+        memcpy(&log_ring[0], ptr + first, len - first);
+    }
+}
+
+static uint32_t Log_Contiguous(void)
+{
+    uint32_t used = log_head - log_tail;
+    uint32_t to_end = LOG_BUFFER_SIZE - (log_tail & LOG_MASK);
+
+    return (used < to_end) ? used : to_end;
+}
+
+/* Returns nonzero when the backend took nothing and never will by waiting */
+static uint32_t Log_Drain(void)
+{
+    uint32_t chunk;
+    uint32_t stalled = 0;
+    uint32_t busy;
+
+    /* The DMA completion drains from its interrupt: claim atomically */
+    {
+        LOG_ENTER_CRITICAL();
+        busy = log_draining;
+        log_draining = 1;
+        LOG_EXIT_CRITICAL();
+    }
+    if(busy != 0U){
+        return 0;
+    }
+
+#if (LOG_BACKEND == LOG_BACKEND_ITM)
+    if(((ITM->TCR & ITM_TCR_ITMENA_Msk) == 0U) || ((ITM->TER & (1UL << LOG_ITM_PORT)) == 0U)){
+        /* No trace probe listening: account and discard */
+        chunk = log_head - log_tail;
+        log_stats.dropped += chunk;
+        log_tail += chunk;
+    }else{
+        while(log_tail != log_head){
+            if(ITM->PORT[LOG_ITM_PORT].u32 == 0U){
+                break;  /* stimulus FIFO full, resume on the next call */
+            }
+            chunk = Log_Contiguous();
+            if(chunk >= 4U){
+                uint32_t word;
+                memcpy(&word, &log_ring[log_tail & LOG_MASK], 4U);
+                ITM->PORT[LOG_ITM_PORT].u32 = word;
+                chunk = 4U;
+            }else{
+                ITM->PORT[LOG_ITM_PORT].u8 = log_ring[log_tail & LOG_MASK];
+                chunk = 1U;
+            }
+            log_tail += chunk;
+            log_stats.drained += chunk;
+        }
+    }
+#elif (LOG_BACKEND == LOG_BACKEND_UART_DMA)
+    if(log_inflight == 0U){
+        chunk = Log_Contiguous();
+        if(chunk != 0U){
+            log_inflight = chunk;
+            if(Log_Transport_Start(&log_ring[log_tail & LOG_MASK], chunk) != 0){
+                log_inflight = 0;
+                stalled = 1;
+            }
+        }
+    }
+#elif (LOG_BACKEND == LOG_BACKEND_HOST)
+    while((chunk = Log_Contiguous()) != 0U){
+        fwrite(&log_ring[log_tail & LOG_MASK], 1, chunk, stdout);
+        log_tail += chunk;
+        log_stats.drained += chunk;
+    }
+    fflush(stdout);
+#else
+#error "Unknown LOG_BACKEND"
+#endif
+
+    log_draining = 0;
+    return stalled;
+}
@@ -21,6 +21,23 @@
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "log_buffer.h"
+#include "flash_timing.h"
+#include "flash_geometry.h"
+#include "flash_safe.h"
+#include "flash_trace.h"
+#include "pc_prof.h"
+#if !defined(BOOT_SYNC_DUAL_CORE) || defined(FLASH_AB_SIGNED)
+/* A/B updates need this core to own the flash alone (flash_ab.h) */
+#include "flash_ab.h"
+#endif
+#include "flash_if.h"
+#include "flash_warm.h"
+#include "flash_dump.h"
+#include "flash_kernel.h"
+#include "boot_sync.h"
+#include <stdio.h>
+#include <string.h>
 
 /* USER CODE END Includes */
 
@@ -66,31 +83,34 @@ uint32_t buffer[8*4] =
 
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 {
-  __NVIC_SystemReset();
+  /* RAM indexes over flash are kept and checked instead of rescanned;
+     the main loop restarts once they are consistent */
+  Flash_Warm_Request();
 }
 
 
-#define ADDR_FLASH_SECTOR_0_BANK1     ((uint32_t)0x08000000) /* Base @ of Sector 0, 128 Kbytes */
-#define ADDR_FLASH_SECTOR_1_BANK1     ((uint32_t)0x08020000) /* Base @ of Sector 1, 128 Kbytes */
-#define ADDR_FLASH_SECTOR_2_BANK1     ((uint32_t)0x08040000) /* Base @ of Sector 2, 128 Kbytes */
-#define ADDR_FLASH_SECTOR_3_BANK1     ((uint32_t)0x08060000) /* Base @ of Sector 3, 128 Kbytes */
-#define ADDR_FLASH_SECTOR_4_BANK1     ((uint32_t)0x08080000) /* Base @ of Sector 4, 128 Kbytes */
-#define ADDR_FLASH_SECTOR_5_BANK1     ((uint32_t)0x080A0000) /* Base @ of Sector 5, 128 Kbytes */
-#define ADDR_FLASH_SECTOR_6_BANK1     ((uint32_t)0x080C0000) /* Base @ of Sector 6, 128 Kbytes */
-#define ADDR_FLASH_SECTOR_7_BANK1     ((uint32_t)0x080E0000) /* Base @ of Sector 7, 128 Kbytes */
+#define ADDR_FLASH_SECTOR_0_BANK1     FLASH_GEO_SECTOR_BASE(FLASH_BANK_1, 0) /* Base @ of Sector 0, 128 Kbytes */
+#define ADDR_FLASH_SECTOR_1_BANK1     FLASH_GEO_SECTOR_BASE(FLASH_BANK_1, 1) /* Base @ of Sector 1, 128 Kbytes */
+#define ADDR_FLASH_SECTOR_2_BANK1     FLASH_GEO_SECTOR_BASE(FLASH_BANK_1, 2) /* Base @ of Sector 2, 128 Kbytes */
+#define ADDR_FLASH_SECTOR_3_BANK1     FLASH_GEO_SECTOR_BASE(FLASH_BANK_1, 3) /* Base @ of Sector 3, 128 Kbytes */
+#define ADDR_FLASH_SECTOR_4_BANK1     FLASH_GEO_SECTOR_BASE(FLASH_BANK_1, 4) /* Base @ of Sector 4, 128 Kbytes */
+#define ADDR_FLASH_SECTOR_5_BANK1     FLASH_GEO_SECTOR_BASE(FLASH_BANK_1, 5) /* Base @ of Sector 5, 128 Kbytes */
+#define ADDR_FLASH_SECTOR_6_BANK1     FLASH_GEO_SECTOR_BASE(FLASH_BANK_1, 6) /* Base @ of Sector 6, 128 Kbytes */
+#define ADDR_FLASH_SECTOR_7_BANK1     FLASH_GEO_SECTOR_BASE(FLASH_BANK_1, 7) /* Base @ of Sector 7, 128 Kbytes */
 
 /* Base address of the Flash sectors Bank 2 */
-#define ADDR_FLASH_SECTOR_0_BANK2     ((uint32_t)0x08100000) /* Base @ of Sector 0, 128 Kbytes */
-#define ADDR_FLASH_SECTOR_1_BANK2     ((uint32_t)0x08120000) /* Base @ of Sector 1, 128 Kbytes */
-#define ADDR_FLASH_SECTOR_2_BANK2     ((uint32_t)0x08140000) /* Base @ of Sector 2, 128 Kbytes */
-#define ADDR_FLASH_SECTOR_3_BANK2     ((uint32_t)0x08160000) /* Base @ of Sector 3, 128 Kbytes */
-#define ADDR_FLASH_SECTOR_4_BANK2     ((uint32_t)0x08180000) /* Base @ of Sector 4, 128 Kbytes */
-#define ADDR_FLASH_SECTOR_5_BANK2     ((uint32_t)0x081A0000) /* Base @ of Sector 5, 128 Kbytes */
-#define ADDR_FLASH_SECTOR_6_BANK2     ((uint32_t)0x081C0000) /* Base @ of Sector 6, 128 Kbytes */
-#define ADDR_FLASH_SECTOR_7_BANK2     ((uint32_t)0x081E0000) /* Base @ of Sector 7, 128 Kbytes */
-#define FLASH_END_ADDR       (uint32_t)(0x081FFFFF)
+#define ADDR_FLASH_SECTOR_0_BANK2     FLASH_GEO_SECTOR_BASE(FLASH_BANK_2, 0) /* Base @ of Sector 0, 128 Kbytes */
+#define ADDR_FLASH_SECTOR_1_BANK2     FLASH_GEO_SECTOR_BASE(FLASH_BANK_2, 1) /* Base @ of Sector 1, 128 Kbytes */
+#define ADDR_FLASH_SECTOR_2_BANK2     FLASH_GEO_SECTOR_BASE(FLASH_BANK_2, 2) /* Base @ of Sector 2, 128 Kbytes */
+#define ADDR_FLASH_SECTOR_3_BANK2     FLASH_GEO_SECTOR_BASE(FLASH_BANK_2, 3) /* Base @ of Sector 3, 128 Kbytes */
+#define ADDR_FLASH_SECTOR_4_BANK2     FLASH_GEO_SECTOR_BASE(FLASH_BANK_2, 4) /* Base @ of Sector 4, 128 Kbytes */
+#define ADDR_FLASH_SECTOR_5_BANK2     FLASH_GEO_SECTOR_BASE(FLASH_BANK_2, 5) /* Base @ of Sector 5, 128 Kbytes */
+#define ADDR_FLASH_SECTOR_6_BANK2     FLASH_GEO_SECTOR_BASE(FLASH_BANK_2, 6) /* Base @ of Sector 6, 128 Kbytes */
+#define ADDR_FLASH_SECTOR_7_BANK2     FLASH_GEO_SECTOR_BASE(FLASH_BANK_2, 7) /* Base @ of Sector 7, 128 Kbytes */
+#define FLASH_END_ADDR       (FLASH_GEO_BASE + FLASH_GEO_TOTAL_SIZE - 1U)
 #define FLASH_USER_START_ADDR         ADDR_FLASH_SECTOR_0_BANK1      /* Start @ of user Flash area Bank1 */
 #define FLASH_USER_END_ADDR          (ADDR_FLASH_SECTOR_1_BANK1 - 1)  /* End @ of user Flash area Bank1*/
+FLASH_GEO_STATIC_ASSERT_SECTOR(FLASH_USER_START_ADDR, FLASH_USER_END_ADDR - FLASH_USER_START_ADDR + 1);
 
 
 uint32_t Address = 0;
@@ -112,6 +132,75 @@ uint64_t FlashWord3[4] = { 0x2498575827409845,
                            0xddddddddaaaaaaaa
                         };
 __IO uint32_t reading = 0;
+
+/* Reports the newest crash dump left by a previous run; Flash_Dump_Arm
+   then makes sure a pre-erased record is ready for the next one */
+static void Crash_Report(void)
+{
+  static Flash_Dump_t crash;
+
+  Flash_Dump_Init();
+  if((Flash_Dump_Count() != 0U) && (Flash_Dump_Read(0, &crash) == FLASH_OK))
+  {
+    printf("crash #%lu of %lu: reason %lu pc %08lx lr %08lx sp %08lx cfsr %08lx hfsr %08lx bfar %08lx ecc %lu/%lu\r\n",
+           crash.sequence, Flash_Dump_Count(), crash.reason, crash.frame[6], crash.frame[5], crash.sp,
+           crash.cfsr, crash.hfsr, crash.bfar, crash.ecc_single, crash.ecc_double);
+    /* Out now: Flash_AB_Boot may reset before the next drain */
+    Log_Buffer_Drain();
+  }
+}
+
+#ifdef FLASH_AB_SIGNED
+/* Digests of unchanged sectors come through a warm restart */
+static FLASH_WARM Flash_Sha_Cache_t image_cache;
+
+/* Running image against its signed manifest. A cold boot finds no cache
+   and hashes every sector: that check authenticates the image. After a
+   warm restart, sectors with an unchanged CRC keep their digest, which
+   only shows the image did not change since. */
+static void Image_Check(void)
+{
+  if (Flash_Warm_Attach(&image_cache, sizeof(image_cache)) == 0U)
+  {
+    memset(&image_cache, 0, sizeof(image_cache));
+  }
+  if (Flash_AB_Verify(&image_cache, Flash_AB_Key, Flash_AB_KeySize) != FLASH_OK)
+  {
+    printf("image does not match its manifest\r\n");
+    return;
+  }
+  if (image_cache.reused == 0U)
+  {
+    printf("image authenticated: %lu sectors hashed\r\n", image_cache.hashed);
+  }
+  else
+  {
+    printf("image matches its manifest: %lu sectors hashed, %lu unchanged by CRC only\r\n",
+           image_cache.hashed, image_cache.reused);
+  }
+}
+#endif
+
+#ifdef BOOT_SYNC_DUAL_CORE
+/* Boot times of both cores, once the CM7 has reported ready as well */
+static void Boot_Report(void)
+{
+  static uint32_t reported = 0;
+  Boot_Sync_Record_t boot;
+  Boot_Sync_Core_t *cm7 = &boot.core[BOOT_SYNC_CM7];
+  Boot_Sync_Core_t *cm4 = &boot.core[BOOT_SYNC_CM4];
+
+  if ((reported != 0U) || (Boot_Sync_Report(&boot) != 0U))
+  {
+    return;
+  }
+  reported = 1;
+  printf("boot cm7: clocks %lu us, ready %lu us; cm4: local %lu us, clocks %lu us (waited %lu us), ready %lu us; total %lu us\r\n",
+         cm7->us[BOOT_SYNC_CLOCKS], cm7->us[BOOT_SYNC_READY], cm4->us[BOOT_SYNC_LOCAL], cm4->us[BOOT_SYNC_CLOCKS],
+         cm4->waited_us, cm4->us[BOOT_SYNC_READY],
+         (cm7->us[BOOT_SYNC_READY] > cm4->us[BOOT_SYNC_READY]) ? cm7->us[BOOT_SYNC_READY] : cm4->us[BOOT_SYNC_READY]);
+}
+#endif
 /* USER CODE END 0 */
 
 /**
@@ -125,19 +214,10 @@ int main(void)
   /* USER CODE END 1 */
 
 /* USER CODE BEGIN Boot_Mode_Sequence_1 */
-#if 0
-  /*HW semaphore Clock enable*/
-  __HAL_RCC_HSEM_CLK_ENABLE();
-  /* Activate HSEM notification for Cortex-M4*/
-  HAL_HSEM_ActivateNotification(__HAL_HSEM_SEMID_TO_MASK(HSEM_ID_0));
-  /*
-  Domain D2 goes to STOP mode (Cortex-M4 in deep-sleep) waiting for Cortex-M7 to
-  perform system initialization (system clock config, external memory configuration.. )
-  */
-  HAL_PWREx_ClearPendingEvent();
-  HAL_PWREx_EnterSTOPMode(PWR_MAINREGULATOR_ON, PWR_STOPENTRY_WFE, PWR_D2_DOMAIN);
-  /* Clear HSEM flag */
-  __HAL_HSEM_CLEAR_FLAG(__HAL_HSEM_SEMID_TO_MASK(HSEM_ID_0));
+#ifdef BOOT_SYNC_DUAL_CORE
+  /* No STOP-mode wait for the CM7's system init: this core boots alongside
+     it and only waits where the clocks are needed (boot_sync.c) */
+  Boot_Sync_Begin();
 #endif
 /* USER CODE END Boot_Mode_Sequence_1 */
   /* MCU Configuration--------------------------------------------------------*/
@@ -146,10 +226,49 @@ int main(void)
   HAL_Init();
 
   /* USER CODE BEGIN Init */
+  /* Before anything attaches to warm RAM */
+  Flash_Warm_Begin();
+#ifdef BOOT_SYNC_DUAL_CORE
+  /* Nothing here needs the CM7: it runs while the clocks are set up */
+  Log_Buffer_Init();
+  Flash_Safe_Init();
+  Crash_Report();
+  Boot_Sync_Mark(BOOT_SYNC_LOCAL);
+  if (Boot_Sync_WaitClocks(BOOT_SYNC_TIMEOUT_MS) != 0U)
+  {
+    /* No CM7 image running: this core owns the clocks */
+    SystemClock_Config();
+  }
+#else
   SystemClock_Config();
+  Log_Buffer_Init();
+  Flash_Safe_Init();
+  Crash_Report();
+#endif
+  /* Flash writes and cycle timing need the final clock and flash timing */
+  Flash_Trace_Init();
+  Pc_Prof_Start(PC_PROF_RATE_HZ);
+  Flash_Dump_Arm();
+#ifndef BOOT_SYNC_DUAL_CORE
+  Flash_AB_Boot();
+#endif
+#ifdef FLASH_AB_SIGNED
+  Image_Check();
+#endif
+#ifdef BOOT_SYNC_DUAL_CORE
+  /* This core is up: stamped before the flash test code below, which
+     may not return */
+  Boot_Sync_Ready();
+  Boot_Report();
+#endif
+  /* Boot and crash reports out before anything that may not return */
+  Log_Buffer_Drain();
   /* USER CODE END Init */
 
   /* USER CODE BEGIN SysInit */
+#ifdef FLASH_ECC_OVERPROGRAM_TEST
+  /* ECC experiment: overprograms a flashword in bank1, which is the A/B
+     spare slot, and never leaves; the application does not run */
   HAL_NVIC_SetPriority(FLASH_IRQn, 0, 0);
   HAL_NVIC_EnableIRQ(FLASH_IRQn);
   HAL_FLASH_Unlock();
@@ -176,6 +295,7 @@ int main(void)
   {
     reading = *(uint32_t*)0x08000000;
   }
+#endif
   /* USER CODE END SysInit */
 
   /* Initialize all configured peripherals */
@@ -207,13 +327,9 @@ int main(void)
     HAL_GPIO_TogglePin(GPIOB, GPIO_PIN_14);
   }
 
-  for(uint32_t i=0x08120000; i<0x081FFFFF; i++)
-  {
-    if(*(uint8_t *)i != 0xAA)
-    {
-      break;
-    }
-  }
+  /* Offset of the first byte that did not take 0xAA */
+  uint32_t verified = Flash_Kernel_Check((const void *)0x08120000, 0x081FFFFF - 0x08120000, 0xAAAAAAAA);
+  (void)verified;
 #else
 
   HAL_NVIC_SetPriority(FLASH_IRQn, 0, 0);
@@ -245,10 +361,19 @@ int main(void)
 
   /* Infinite loop */
   /* USER CODE BEGIN WHILE */
+#ifndef BOOT_SYNC_DUAL_CORE
+  /* Reaching the main loop is this application's health check */
+  Flash_AB_Confirm();
+#endif
   while (1)
   {
     HAL_Delay(1000);
     HAL_GPIO_TogglePin(GPIOB, GPIO_PIN_14);
+#ifdef BOOT_SYNC_DUAL_CORE
+    Boot_Report();
+#endif
+    Log_Buffer_Drain();
+    Flash_Warm_Poll();
     /* USER CODE END WHILE */
 
     /* USER CODE BEGIN 3 */
@@ -307,6 +432,8 @@ void SystemClock_Config(void)
 {
   RCC_OscInitTypeDef RCC_OscInitStruct = {0};
   RCC_ClkInitTypeDef RCC_ClkInitStruct = {0};
+  Flash_Timing_t flash_timing = {0};
+  uint32_t hclk;
 
   /** Supply configuration update enable
   */
@@ -352,7 +479,20 @@ void SystemClock_Config(void)
   RCC_ClkInitStruct.APB2CLKDivider = RCC_APB2_DIV2;
   RCC_ClkInitStruct.APB4CLKDivider = RCC_APB4_DIV2;
 
-  if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_2) != HAL_OK)
+  /* HSI / PLLM * PLLN / PLLP = SYSCLK, then the AHB /2 prescaler */
+  hclk = ((HSI_VALUE / RCC_OscInitStruct.PLL.PLLM) * RCC_OscInitStruct.PLL.PLLN / RCC_OscInitStruct.PLL.PLLP) / 2U;
+  if (Flash_Timing_Derive(hclk, PWR_REGULATOR_VOLTAGE_SCALE1, FLASH_TIMING_VDD_MV, &flash_timing) != 0U)
+  {
+    Error_Handler();
+  }
+
+  if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, flash_timing.latency) != HAL_OK)
+  {
+    Error_Handler();
+  }
+
+  /* HAL only programs LATENCY; add WRHIGHFREQ and the PSIZE used by the erase drivers */
+  if (Flash_Timing_Apply(&flash_timing) != 0U)
   {
     Error_Handler();
   }
@@ -367,10 +507,7 @@ void Error_Handler(void)
 {
   /* USER CODE BEGIN Error_Handler_Debug */
   /* User can add his own implementation to report the HAL error return state */
-  __disable_irq();
-  while (1)
-  {
-  }
+  Flash_Dump_Error(FLASH_DUMP_ERROR);
   /* USER CODE END Error_Handler_Debug */
 }
 
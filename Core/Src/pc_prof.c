@@ -0,0 +1,131 @@
+/**
+  ******************************************************************************
+  * @file    pc_prof.c
+  * @brief   Statistical PC sampling from SysTick. Each tick the stacked PC
+             (and with PC_PROF_LR the stacked LR) of the interrupted code
+             bumps one counter of a RAM histogram keyed by address bucket;
+             a sample is a subtraction, a compare and an increment. To
+             sample faster than the HAL tick, SysTick is sped up and
+             HAL_IncTick called on every Nth interrupt. Tools/prof_report.c
+             turns a dump of Pc_Prof into a per-function profile. Time with
+             interrupts masked (all flash program and erase waits) is not
+             sampled; the cycle counter between ticks tells how many ticks
+             it swallowed, and those are counted apart.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <string.h>
+#include "pc_prof.h"
+
+#ifdef PC_PROF_ENABLE
+
+#if PC_PROF_BUCKETS == 0U
+#error "PC_PROF_SIZE must cover at least one bucket"
+#endif
+
+Pc_Prof_t Pc_Prof;
+
+static uint32_t pc_prof_divider = 1U;   /* interrupts per HAL tick */
+static uint32_t pc_prof_phase;
+static uint32_t pc_prof_period;         /* core cycles per sample */
+static uint32_t pc_prof_last;           /* CYCCNT at the previous sample */
+
+static uint32_t Pc_Prof_TickHz(void);
+
+void Pc_Prof_Start(uint32_t RateHz)
+{
+    uint32_t tick_hz = Pc_Prof_TickHz();
+    uint32_t divider = RateHz / tick_hz;
+    uint32_t primask = __get_PRIMASK();
+
+    if(divider == 0U){
+        divider = 1U;
+    }
+    if(READ_BIT(DWT->CTRL, DWT_CTRL_CYCCNTENA_Msk) == 0U){
+        SET_BIT(CoreDebug->DEMCR, CoreDebug_DEMCR_TRCENA_Msk);
+        SET_BIT(DWT->CTRL, DWT_CTRL_CYCCNTENA_Msk);
+    }
+
+    __disable_irq();
+    memset(&Pc_Prof, 0, sizeof(Pc_Prof));
+    Pc_Prof.magic = PC_PROF_MAGIC;
+    Pc_Prof.version = PC_PROF_VERSION;
+    Pc_Prof.histograms = PC_PROF_HISTOGRAMS;
+    Pc_Prof.base = PC_PROF_BASE;
+    Pc_Prof.shift = PC_PROF_SHIFT;
+    Pc_Prof.buckets = PC_PROF_BUCKETS;
+    Pc_Prof.rate_hz = tick_hz * divider;
+    pc_prof_divider = divider;
+    pc_prof_phase = 0;
+    pc_prof_period = SystemCoreClock / Pc_Prof.rate_hz;
+    SysTick->LOAD = pc_prof_period - 1U;
+    SysTick->VAL = 0;
+    pc_prof_last = DWT->CYCCNT;
+    __set_PRIMASK(primask);
+}
+
+void Pc_Prof_Stop(void)
+{
+    uint32_t primask = __get_PRIMASK();
+
+    __disable_irq();
+    Pc_Prof.rate_hz = 0;
+    pc_prof_divider = 1U;
+    pc_prof_phase = 0;
+    SysTick->LOAD = (SystemCoreClock / Pc_Prof_TickHz()) - 1U;
+    SysTick->VAL = 0;
+    __set_PRIMASK(primask);
+}
+
+void Pc_Prof_Tick(const uint32_t *frame)
+{
+    uint32_t offset;
+    uint32_t now;
+    uint32_t elapsed;
+
+    if(Pc_Prof.rate_hz != 0U){
+        /* Ticks that fell due while interrupts were masked collapse into
+           this one: only the count of them is known */
+        now = DWT->CYCCNT;
+        elapsed = now - pc_prof_last;
+        pc_prof_last = now;
+        if(elapsed > (pc_prof_period + (pc_prof_period >> 1))){
+            Pc_Prof.masked += ((elapsed + (pc_prof_period >> 1)) / pc_prof_period) - 1U;
+        }
+        Pc_Prof.samples++;
+        offset = frame[6] - PC_PROF_BASE;
+        if(offset < PC_PROF_SIZE){
+            Pc_Prof.pc[offset >> PC_PROF_SHIFT]++;
+        }else{
+            Pc_Prof.outside++;
+        }
+#ifdef PC_PROF_LR
+        offset = (frame[5] & ~1U) - PC_PROF_BASE;
+        if(offset < PC_PROF_SIZE){
+            Pc_Prof.lr[offset >> PC_PROF_SHIFT]++;
+        }
+#endif
+    }
+
+    if(++pc_prof_phase >= pc_prof_divider){
+        pc_prof_phase = 0;
+        HAL_IncTick();
+    }
+}
+
+static uint32_t Pc_Prof_TickHz(void)
+{
+    return 1000U / (uint32_t)HAL_GetTickFreq();
+}
+
+#endif /* PC_PROF_ENABLE */
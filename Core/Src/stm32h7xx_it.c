@@ -22,6 +22,9 @@
 #include "stm32h7xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "flash_safe.h"
+#include "flash_dump.h"
+#include "pc_prof.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -66,76 +69,67 @@
 /**
   * @brief This function handles Non maskable interrupt.
   */
-void NMI_Handler(void)
+__attribute__((naked)) void NMI_Handler(void)
 {
   /* USER CODE BEGIN NonMaskableInt_IRQn 0 */
-
+  FLASH_DUMP_ENTRY(FLASH_DUMP_NMI);
   /* USER CODE END NonMaskableInt_IRQn 0 */
   /* USER CODE BEGIN NonMaskableInt_IRQn 1 */
-  while (1)
-  {
-  }
+
   /* USER CODE END NonMaskableInt_IRQn 1 */
 }
 
 /**
   * @brief This function handles Hard fault interrupt.
   */
-void HardFault_Handler(void)
+__attribute__((naked)) void HardFault_Handler(void)
 {
   /* USER CODE BEGIN HardFault_IRQn 0 */
-  HAL_GPIO_WritePin(GPIOB, GPIO_PIN_14, GPIO_PIN_RESET);
+  /* Crash dump to flash, then reset (or halt under a debugger) */
+  FLASH_DUMP_ENTRY(FLASH_DUMP_HARDFAULT);
   /* USER CODE END HardFault_IRQn 0 */
-  //while (1)
-  {
-    /* USER CODE BEGIN W1_HardFault_IRQn 0 */
-    /* USER CODE END W1_HardFault_IRQn 0 */
-  }
 }
 
 /**
   * @brief This function handles Memory management fault.
   */
-void MemManage_Handler(void)
+__attribute__((naked)) void MemManage_Handler(void)
 {
   /* USER CODE BEGIN MemoryManagement_IRQn 0 */
-
+  FLASH_DUMP_ENTRY(FLASH_DUMP_MEMMANAGE);
   /* USER CODE END MemoryManagement_IRQn 0 */
-  while (1)
-  {
-    /* USER CODE BEGIN W1_MemoryManagement_IRQn 0 */
-    /* USER CODE END W1_MemoryManagement_IRQn 0 */
-  }
 }
 
 /**
   * @brief This function handles Pre-fetch fault, memory access fault.
   */
-void BusFault_Handler(void)
+__attribute__((naked)) void BusFault_Handler(void)
 {
   /* USER CODE BEGIN BusFault_IRQn 0 */
-
+  /* Pass the stacked frame to Flash_Safe_BusFault: it unwinds faults raised
+     inside Flash_Safe_Read and writes a crash dump on anything else. r4-r11
+     are saved for the dump; r3 only keeps the stack 8-byte aligned. */
+  __asm volatile(
+      "tst   lr, #4                 \n"
+      "ite   eq                     \n"
+      "mrseq r0, msp                \n"
+      "mrsne r0, psp                \n"
+      "mov   r1, lr                 \n"
+      "push  {r3-r11, lr}           \n"
+      "add   r2, sp, #4             \n"
+      "bl    Flash_Safe_BusFault    \n"
+      "pop   {r3-r11, pc}           \n");
   /* USER CODE END BusFault_IRQn 0 */
-  while (1)
-  {
-    /* USER CODE BEGIN W1_BusFault_IRQn 0 */
-    /* USER CODE END W1_BusFault_IRQn 0 */
-  }
 }
 
 /**
   * @brief This function handles Undefined instruction or illegal state.
   */
-void UsageFault_Handler(void)
+__attribute__((naked)) void UsageFault_Handler(void)
 {
   /* USER CODE BEGIN UsageFault_IRQn 0 */
-
+  FLASH_DUMP_ENTRY(FLASH_DUMP_USAGEFAULT);
   /* USER CODE END UsageFault_IRQn 0 */
-  while (1)
-  {
-    /* USER CODE BEGIN W1_UsageFault_IRQn 0 */
-    /* USER CODE END W1_UsageFault_IRQn 0 */
-  }
 }
 
 /**
@@ -180,6 +174,13 @@ void PendSV_Handler(void)
 /**
   * @brief This function handles System tick timer.
   */
+#ifdef PC_PROF_ENABLE
+__attribute__((naked)) void SysTick_Handler(void)
+{
+  /* Samples the interrupted PC, then calls HAL_IncTick itself */
+  PC_PROF_ENTRY();
+}
+#else
 void SysTick_Handler(void)
 {
   /* USER CODE BEGIN SysTick_IRQn 0 */
@@ -190,6 +191,7 @@ void SysTick_Handler(void)
 
   /* USER CODE END SysTick_IRQn 1 */
 }
+#endif
 
 /******************************************************************************/
 /* STM32H7xx Peripheral Interrupt Handlers                                    */
@@ -213,10 +215,19 @@ void EXTI15_10_IRQHandler(void)
 }
 
 /* USER CODE BEGIN 1 */
+/* Called by the crash dump before it writes flash */
+void Flash_Dump_Notify(uint32_t reason)
+{
+  if (reason == FLASH_DUMP_HARDFAULT)
+  {
+    HAL_GPIO_WritePin(GPIOB, GPIO_PIN_14, GPIO_PIN_RESET);
+  }
+}
+
 void FLASH_IRQHandler(void)
 {
-  FLASH->CCR1 |= (1<<26);
-  FLASH->CCR1 |= (1<<25);
+  /* Logs and clears SNECCERR/DBECCERR on both banks */
+  Flash_Safe_EccIrq();
   //while(1)
   {
     HAL_GPIO_WritePin(GPIOB, GPIO_PIN_14, GPIO_PIN_SET);
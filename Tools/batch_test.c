@@ -0,0 +1,169 @@
+/**
+  ******************************************************************************
+  * @file    batch_test.c
+  * @brief   Host check of the scatter-gather merge in Core/Src/flash_batch.c
+             on the emulated flash (flash_emu.c): fragments sharing a
+             flashword go out as one program, empty ops anywhere in the batch
+             program nothing, and ops that leave flash or wrap around fail
+             the batch before anything is written.
+
+             gcc -O2 -DHOST_BUILD -ICore/Inc -ITools Tools/batch_test.c Tools/flash_emu.c \
+                 Core/Src/flash_batch.c -o batch_test
+             ./batch_test
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <string.h>
+#include "flash_emu.h"
+#include "flash_batch.h"
+#include "flash_if.h"
+
+#define BASE            FLASH_BANK2_BASE
+
+static const uint8_t Config[12] = "config:v2.1";
+static const uint8_t Counter[4] = { 0x11, 0x22, 0x33, 0x44 };
+static const uint8_t Tail[40] = "forty bytes crossing a flashword border";
+static uint8_t Expect[2U * FLASH_GEO_SECTOR_SIZE];
+
+uint32_t Flash_Batch_HostProgram(uint32_t FlashAddress, const uint32_t *src)
+{
+    return Flash_Emu_Program(FlashAddress, src, 1);
+}
+
+/* Expected image of the first two sectors of bank2 */
+static void Expect_Put(uint32_t FlashAddress, const void *data, uint32_t length)
+{
+    memcpy(&Expect[FlashAddress - BASE], data, length);
+}
+
+static uint32_t Expect_Check(const char *name)
+{
+    if(memcmp(Flash_Emu_Memory(BASE), Expect, sizeof(Expect)) != 0){
+        printf("FAIL %s: flash content differs\n", name);
+        return 1;
+    }
+    return 0;
+}
+
+static uint32_t Check_Merge(void)
+{
+    Flash_Batch_Op_t ops[4] =
+    {
+        { BASE + 0x48U, Tail, sizeof(Tail) },
+        { BASE + 0x04U, Counter, sizeof(Counter) },
+        { BASE + 0x10U, Config, sizeof(Config) },
+        { BASE + FLASH_GEO_SECTOR_SIZE, Counter, sizeof(Counter) },
+    };
+    Flash_Batch_Stats_t stats;
+    uint32_t status;
+
+    Flash_Emu_Init();
+    memset(Expect, 0xFF, sizeof(Expect));
+    Expect_Put(BASE + 0x48U, Tail, sizeof(Tail));
+    Expect_Put(BASE + 0x04U, Counter, sizeof(Counter));
+    Expect_Put(BASE + 0x10U, Config, sizeof(Config));
+    Expect_Put(BASE + FLASH_GEO_SECTOR_SIZE, Counter, sizeof(Counter));
+
+    status = Flash_Batch_Program(ops, 4, &stats);
+    printf("merge:        status %u, %u ops in %u flashwords (%u saved)\n", (unsigned)status,
+           (unsigned)stats.ops, (unsigned)stats.flashwords, (unsigned)stats.flashwords_saved);
+    /* Counter and Config share the first flashword, Tail spans two */
+    if((status != FLASH_OK) || (stats.ops != 4U) || (stats.flashwords != 4U) || (stats.flashwords_saved != 1U)){
+        printf("FAIL merge: unexpected stats\n");
+        return 1;
+    }
+    return Expect_Check("merge");
+}
+
+static uint32_t Check_Empty(void)
+{
+    Flash_Batch_Op_t ops[5] =
+    {
+        { BASE + 0x04U, Counter, sizeof(Counter) },
+        { BASE + 0x400U, Config, 0 },
+        { BASE + 0x800U, Tail, sizeof(Tail) },
+        { BASE + 0x1000U, NULL, 0 },
+        { BASE + 0x1FFFFU, NULL, 0 },
+    };
+    Flash_Batch_Stats_t stats;
+    uint32_t status;
+
+    Flash_Emu_Init();
+    memset(Expect, 0xFF, sizeof(Expect));
+    Expect_Put(BASE + 0x04U, Counter, sizeof(Counter));
+    Expect_Put(BASE + 0x800U, Tail, sizeof(Tail));
+
+    status = Flash_Batch_Program(ops, 5, &stats);
+    printf("empty ops:    status %u, %u ops in %u flashwords (%u saved)\n", (unsigned)status,
+           (unsigned)stats.ops, (unsigned)stats.flashwords, (unsigned)stats.flashwords_saved);
+    if((status != FLASH_OK) || (stats.ops != 2U) || (stats.flashwords != 3U) || (stats.flashwords_saved != 0U)){
+        printf("FAIL empty ops: unexpected stats\n");
+        return 1;
+    }
+    return Expect_Check("empty ops");
+}
+
+static uint32_t Check_Range(void)
+{
+    static const struct{
+        const char *name;
+        uint32_t address;
+        uint32_t length;
+    }bad[] =
+    {
+        { "past the end", 0xFFFFFFF0U, 16U },
+        { "below flash", FLASH_BANK1_BASE - 8U, 16U },
+        { "wraps around", BASE + 0x10U, 0xFFFFFFF8U },
+        { "straddles banks", BASE - 8U, 16U },
+    };
+    Flash_Batch_Op_t ops[3];
+    Flash_Batch_Stats_t stats;
+    uint32_t fail = 0;
+    uint32_t index;
+
+    for(index = 0; index < (sizeof(bad) / sizeof(bad[0])); index++){
+        Flash_Emu_Init();
+        memset(Expect, 0xFF, sizeof(Expect));
+        ops[0].address = BASE + 0x04U;
+        ops[0].data = Counter;
+        ops[0].length = sizeof(Counter);
+        ops[1].address = bad[index].address;
+        ops[1].data = Tail;
+        ops[1].length = bad[index].length;
+        ops[2].address = BASE + 0x800U;
+        ops[2].data = Config;
+        ops[2].length = sizeof(Config);
+
+        if(Flash_Batch_Program(ops, 3, &stats) != FLASH_ERROR){
+            printf("FAIL out of range (%s): accepted\n", bad[index].name);
+            fail = 1;
+        }else{
+            fail |= Expect_Check(bad[index].name);
+        }
+    }
+    printf("out of range: %u bad ops %s\n", (unsigned)(sizeof(bad) / sizeof(bad[0])),
+           (fail != 0U) ? "not all rejected" : "rejected, nothing written");
+    return fail;
+}
+
+int main(void)
+{
+    uint32_t fail = 0;
+
+    fail |= Check_Merge();
+    fail |= Check_Empty();
+    fail |= Check_Range();
+    printf("%s\n", (fail != 0U) ? "FAILED" : "passed");
+    return (int)fail;
+}
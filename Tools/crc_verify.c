@@ -0,0 +1,243 @@
+/**
+  ******************************************************************************
+  * @file    crc_verify.c
+  * @brief   Host check of the CRC verify pipeline in Core/Src/flash_crc.c
+             against the emulated flash (flash_emu.c). The controller CRC
+             unit is modelled in software: it reads the array at the
+             emulator's read rate, in the background, but never at the same
+             time as a program on its bank. Checks that weak flashwords are
+             caught in the right chunk, and compares emulated time and CPU flash
+             reads of program only, program + CPU read-back and the CRC
+             pipeline on a clean image.
+
+             gcc -O2 -DHOST_BUILD -ICore/Inc -ITools Tools/crc_verify.c \
+                 Tools/flash_emu.c Core/Src/flash_crc.c -o crc_verify
+             ./crc_verify [weak flashwords]
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flash_emu.h"
+#include "flash_crc.h"
+
+#define IMAGE_BASE      FLASH_BANK2_BASE
+#define IMAGE_SIZE      (FLASH_GEO_BANK_SIZE - FLASH_GEO_SECTOR_SIZE + 4000U)
+#define IMAGE_WORDS     (IMAGE_SIZE / FLASH_GEO_FLASHWORD_SIZE)
+#define CRC_SETUP_NS    200U        /* register writes to start a computation */
+#define POLL_NS         100U
+
+static uint32_t Image[IMAGE_SIZE / 4U];
+static uint32_t Weak[16];           /* flashword indexes where one 0 bit fails to program */
+static uint32_t NbOfWeak;
+
+static uint64_t crc_done_ns;        /* background computation finishes */
+static uint32_t crc_value;
+static uint32_t crc_reads;          /* flashwords read by the CRC unit */
+
+static uint32_t Host_Program(uint32_t FlashAddress, const uint32_t *src, uint32_t NbOfFlashWords)
+{
+    uint32_t word[FLASH_GEO_FLASHWORD_SIZE / 4U];
+    uint32_t index;
+    uint32_t fw;
+
+    /* The array of a bank does one thing at a time */
+    if(Flash_Emu_Stats.now_ns < crc_done_ns){
+        Flash_Emu_Stats.now_ns = crc_done_ns;
+    }
+    for(fw = 0; fw < NbOfFlashWords; fw++){
+        const uint32_t *data = src + (fw * (FLASH_GEO_FLASHWORD_SIZE / 4U));
+        uint32_t number = ((FlashAddress - IMAGE_BASE) >> FLASH_GEO_FLASHWORD_SHIFT) + fw;
+
+        for(index = 0; index < NbOfWeak; index++){
+            if(Weak[index] == number){
+                memcpy(word, data, sizeof(word));
+                word[number % 8U] |= ~word[number % 8U] & (0U - ~word[number % 8U]);
+                data = word;
+            }
+        }
+        if(Flash_Emu_Program(FlashAddress + (fw << FLASH_GEO_FLASHWORD_SHIFT), data, 1) != FLASH_OK){
+            return FLASH_ERROR;
+        }
+    }
+    return FLASH_OK;
+}
+
+static uint32_t Host_CrcStart(uint32_t FlashAddress, uint32_t Length)
+{
+    static uint32_t buffer[FLASH_GEO_SECTOR_SIZE / 4U];
+    uint64_t now = Flash_Emu_Stats.now_ns;
+    uint32_t reads = Flash_Emu_Stats.reads;
+    uint32_t fail;
+    uint32_t part;
+
+    if(now < crc_done_ns){
+        return FLASH_BUSY;
+    }
+    crc_value = FLASH_CRC_INIT;
+    for(; Length != 0U; Length -= part, FlashAddress += part){
+        part = (Length < sizeof(buffer)) ? Length : sizeof(buffer);
+        if(Flash_Emu_Read(buffer, FlashAddress, part, &fail) != FLASH_OK){
+            return FLASH_ERROR;
+        }
+        crc_value = Flash_Crc_Soft(crc_value, buffer, part);
+    }
+    /* The unit's reads happen in the background, not on the CPU timeline */
+    crc_reads += Flash_Emu_Stats.reads - reads;
+    crc_done_ns = now + CRC_SETUP_NS + (Flash_Emu_Stats.now_ns - now);
+    Flash_Emu_Stats.now_ns = now + CRC_SETUP_NS;
+    Flash_Emu_Stats.reads = reads;
+    return FLASH_OK;
+}
+
+static uint32_t Host_CrcResult(uint32_t FlashAddress, uint32_t *crc)
+{
+    (void)FlashAddress;
+    if(Flash_Emu_Stats.now_ns < crc_done_ns){
+        Flash_Emu_Stats.now_ns += POLL_NS;
+        return FLASH_BUSY;
+    }
+    *crc = crc_value;
+    return FLASH_OK;
+}
+
+static const Flash_Crc_Backend_t Host_Backend =
+{
+    Host_Program, Flash_Emu_Read, Host_CrcStart, Host_CrcResult
+};
+
+static void Reset(void)
+{
+    Flash_Emu_Init();
+    crc_done_ns = 0;
+    crc_reads = 0;
+}
+
+/* Bit by bit definition of the controller CRC, to check the table version */
+static uint32_t Reference(const uint32_t *data, uint32_t NbOfWords)
+{
+    uint32_t crc = FLASH_CRC_INIT;
+    uint32_t bit;
+
+    while(NbOfWords-- != 0U){
+        crc ^= *data++;
+        for(bit = 0; bit < 32U; bit++){
+            crc = ((crc & 0x80000000U) != 0U) ? ((crc << 1) ^ 0x04C11DB7U) : (crc << 1);
+        }
+    }
+    return crc;
+}
+
+static uint32_t ReadBack(void)
+{
+    static uint32_t check[FLASH_CRC_CHUNK / 4U];
+    uint32_t offset;
+    uint32_t length;
+    uint32_t fail;
+    uint32_t bad = 0;
+
+    for(offset = 0; offset < IMAGE_SIZE; offset += length){
+        length = ((IMAGE_SIZE - offset) < FLASH_CRC_CHUNK) ? (IMAGE_SIZE - offset) : FLASH_CRC_CHUNK;
+        Host_Program(IMAGE_BASE + offset, &Image[offset / 4U], length / FLASH_GEO_FLASHWORD_SIZE);
+        if((Flash_Emu_Read(check, IMAGE_BASE + offset, length, &fail) != FLASH_OK) ||
+           (memcmp(check, &Image[offset / 4U], length) != 0)){
+            bad++;
+        }
+    }
+    return bad;
+}
+
+int main(int argc, char **argv)
+{
+    Flash_Crc_Stats_t stats;
+    uint32_t weak = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 3U;
+    uint64_t program_ns;
+    uint64_t readback_ns;
+    uint64_t pipeline_ns;
+    uint32_t readback_reads;
+    uint32_t pipeline_reads;
+    uint32_t background_reads;
+    uint32_t expected;
+    uint32_t status;
+    uint32_t index;
+
+    for(index = 0; index < (IMAGE_SIZE / 4U); index++){
+        Image[index] = (index * 2654435761U) ^ 0x5A5A0000U;
+    }
+    if(Flash_Crc_Soft(FLASH_CRC_INIT, Image, IMAGE_SIZE) != Reference(Image, IMAGE_SIZE / 4U)){
+        printf("software CRC differs from the reference\n");
+        return 1;
+    }
+
+    /* Clean image: what verifying costs */
+    Reset();
+    Host_Program(IMAGE_BASE, Image, IMAGE_WORDS);
+    program_ns = Flash_Emu_Stats.now_ns;
+
+    Reset();
+    ReadBack();
+    readback_ns = Flash_Emu_Stats.now_ns;
+    readback_reads = Flash_Emu_Stats.reads;
+
+    Reset();
+    memset(&stats, 0, sizeof(stats));
+    status = Flash_Crc_ProgramVerify(&Host_Backend, IMAGE_BASE, Image, IMAGE_WORDS, &stats);
+    pipeline_ns = Flash_Emu_Stats.now_ns;
+    pipeline_reads = Flash_Emu_Stats.reads;
+    background_reads = crc_reads;
+    if((status != FLASH_OK) || (stats.mismatches != 0U) ||
+       (Flash_Crc_Verify(&Host_Backend, IMAGE_BASE, FLASH_GEO_BANK_SIZE - FLASH_GEO_SECTOR_SIZE,
+                         Flash_Crc_Soft(FLASH_CRC_INIT, Image, FLASH_GEO_BANK_SIZE - FLASH_GEO_SECTOR_SIZE)) != FLASH_OK)){
+        printf("clean image FAILED verification\n");
+        return 1;
+    }
+
+    printf("%u Kbytes into bank 2 in %u byte chunks\n", (uint32_t)(IMAGE_SIZE / 1024U), (uint32_t)FLASH_CRC_CHUNK);
+    printf("%-22s %10s %12s %14s\n", "", "time ms", "verify ms", "CPU fw reads");
+    printf("%-22s %10.3f %12s %14s\n", "program only", (double)program_ns / 1e6, "-", "0");
+    printf("%-22s %10.3f %12.3f %14u\n", "program + read-back", (double)readback_ns / 1e6,
+           (double)(readback_ns - program_ns) / 1e6, readback_reads);
+    printf("%-22s %10.3f %12.3f %14u\n", "CRC pipeline", (double)pipeline_ns / 1e6,
+           (double)(pipeline_ns - program_ns) / 1e6, pipeline_reads);
+    printf("CRC unit read %u flashwords in the background; %u of %u ranges still running when the next program began\n",
+           background_reads, stats.overlapped, stats.ranges);
+    printf("verify throughput over the added time: read-back %.1f Mbyte/s, CRC pipeline %.1f Mbyte/s\n",
+           ((double)IMAGE_SIZE * 1e3) / (double)(readback_ns - program_ns),
+           ((double)IMAGE_SIZE * 1e3) / (double)(pipeline_ns - program_ns));
+
+    /* Weak flashwords: the pipeline must stop at the chunk of the first one */
+    NbOfWeak = (weak < 16U) ? weak : 16U;
+    srand(7);
+    expected = 0xFFFFFFFFU;
+    for(index = 0; index < NbOfWeak; index++){
+        Weak[index] = (uint32_t)rand() % IMAGE_WORDS;
+        if((Weak[index] << FLASH_GEO_FLASHWORD_SHIFT) < expected){
+            expected = Weak[index] << FLASH_GEO_FLASHWORD_SHIFT;
+        }
+    }
+    if(NbOfWeak == 0U){
+        return 0;
+    }
+    expected = IMAGE_BASE + (expected & ~(FLASH_CRC_CHUNK - 1U));
+    if(expected >= (IMAGE_BASE + (IMAGE_SIZE & ~(FLASH_CRC_BURST - 1U)))){
+        expected = IMAGE_BASE + (IMAGE_SIZE & ~(FLASH_CRC_BURST - 1U));
+    }
+
+    Reset();
+    memset(&stats, 0, sizeof(stats));
+    status = Flash_Crc_ProgramVerify(&Host_Backend, IMAGE_BASE, Image, IMAGE_WORDS, &stats);
+    printf("%u weak flashwords: pipeline stopped at 0x%08X, first weak chunk 0x%08X, %s\n",
+           NbOfWeak, stats.first_bad, expected, ((status != FLASH_OK) && (stats.first_bad == expected)) ? "ok" : "FAILED");
+    return ((status != FLASH_OK) && (stats.first_bad == expected)) ? 0 : 1;
+}
@@ -0,0 +1,358 @@
+/**
+  ******************************************************************************
+  * @file    delta_gen.c
+  * @brief   Host generator for the binary patches applied by
+             Core/Src/flash_delta.c. Matches are seeded by an 8-byte hash
+             index of the old image and extended bsdiff-style, tolerating
+             scattered byte changes such as relocated addresses, which end
+             up as sparse non-zero runs in the diff section.
+             The patch is then applied to the emulated flash (flash_emu.c),
+             old image in bank2 and new image into bank1, and the transfer
+             size and programming time are reported against a full image.
+
+             gcc -O2 -DHOST_BUILD -ICore/Inc -ITools Tools/delta_gen.c \
+                 Tools/flash_emu.c Core/Src/flash_delta.c Core/Src/flash_stream.c -o delta_gen
+             ./delta_gen [old.bin new.bin [patch.bin]]
+
+             Without files, a synthetic 640 Kbytes image and a relinked
+             version of it with a 2 Kbytes insertion are used.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flash_emu.h"
+#include "flash_delta.h"
+
+#define OLD_BASE        FLASH_BANK2_BASE
+#define NEW_BASE        FLASH_BANK1_BASE
+#define HASH_BITS       20U
+#define SEED_LEN        8U
+#define MIN_MATCH       16U
+#define MAX_CANDIDATES  32U
+#define GIVE_UP         64U     /* bytes of falling score before a match ends */
+
+typedef struct{
+    uint8_t *data;
+    uint32_t size;
+    uint32_t capacity;
+}Buffer_t;
+
+static void Put(Buffer_t *buf, const void *data, uint32_t length)
+{
+    if((buf->size + length) > buf->capacity){
+        buf->capacity = (buf->size + length) * 2U;
+        buf->data = realloc(buf->data, buf->capacity);
+    }
+    memcpy(buf->data + buf->size, data, length);
+    buf->size += length;
+}
+
+static void Put_Varint(Buffer_t *buf, uint32_t value)
+{
+    uint8_t byte;
+
+    do{
+        byte = (uint8_t)(value & 0x7FU);
+        value >>= 7;
+        if(value != 0U){
+            byte |= 0x80U;
+        }
+        Put(buf, &byte, 1);
+    }while(value != 0U);
+}
+
+static uint32_t Hash(const uint8_t *p)
+{
+    uint64_t key;
+
+    memcpy(&key, p, sizeof(key));
+    return (uint32_t)((key * 0x9E3779B97F4A7C15ULL) >> (64U - HASH_BITS));
+}
+
+/* Diff section: runs of unchanged bytes and runs of byte differences;
+   a gap of fewer than three unchanged bytes stays inside a difference run */
+static void Put_Diff(Buffer_t *patch, const uint8_t *old, const uint8_t *new, uint32_t length)
+{
+    uint32_t i = 0;
+    uint32_t start;
+    uint32_t zeros;
+    uint8_t d;
+
+    Put_Varint(patch, length);
+    while(i < length){
+        start = i;
+        while((i < length) && (old[i] == new[i])){
+            i++;
+        }
+        Put_Varint(patch, i - start);
+        if(i == length){
+            break;
+        }
+        start = i;
+        while(i < length){
+            for(zeros = 0; ((i + zeros) < length) && (old[i + zeros] == new[i + zeros]); zeros++){
+            }
+            if((zeros >= 3U) || ((i + zeros) == length)){
+                break;
+            }
+            i += (zeros != 0U) ? zeros : 1U;
+        }
+        Put_Varint(patch, i - start);
+        for(; start < i; start++){
+            d = (uint8_t)(new[start] - old[start]);
+            Put(patch, &d, 1);
+        }
+    }
+}
+
+static void Put_Record(Buffer_t *patch, const uint8_t *old, const uint8_t *new, uint32_t old_start, uint32_t new_start,
+                       uint32_t diff_len, uint32_t extra_len, int32_t seek)
+{
+    Put_Diff(patch, old + old_start, new + new_start, diff_len);
+    Put_Varint(patch, extra_len);
+    Put(patch, new + new_start + diff_len, extra_len);
+    Put_Varint(patch, ((uint32_t)seek << 1) ^ (uint32_t)(seek >> 31));
+}
+
+static Buffer_t Generate(const uint8_t *old, uint32_t old_size, const uint8_t *new, uint32_t new_size)
+{
+    Buffer_t patch = { NULL, 0, 0 };
+    Flash_Delta_Header_t header;
+    int32_t *head = malloc(sizeof(int32_t) << HASH_BITS);
+    int32_t *chain = malloc(sizeof(int32_t) * (old_size + 1U));
+    uint32_t pend_old = 0;
+    uint32_t pend_new = 0;
+    uint32_t pend_len = 0;
+    uint32_t pos = 0;
+    uint32_t best_old;
+    uint32_t best_len;
+    uint32_t tries;
+    uint32_t len;
+    uint32_t i;
+    uint32_t matches;
+    int32_t score;
+    int32_t best_score;
+    uint32_t best_i;
+    int32_t cand;
+
+    header.magic = FLASH_DELTA_MAGIC;
+    header.old_size = old_size;
+    header.old_crc = Flash_Stream_Crc(0, old, old_size);
+    header.new_size = new_size;
+    header.new_crc = Flash_Stream_Crc(0, new, new_size);
+    Put(&patch, &header, sizeof(header));
+
+    memset(head, 0xFF, sizeof(int32_t) << HASH_BITS);
+    for(i = 0; (i + SEED_LEN) <= old_size; i++){
+        chain[i] = head[Hash(old + i)];
+        head[Hash(old + i)] = (int32_t)i;
+    }
+
+    while((pos + SEED_LEN) <= new_size){
+        /* Prefer staying on the current alignment, then search the index */
+        best_old = pend_old + (pos - pend_new);
+        best_len = 0;
+        if(best_old < old_size){
+            while(((best_old + best_len) < old_size) && ((pos + best_len) < new_size) &&
+                  (old[best_old + best_len] == new[pos + best_len])){
+                best_len++;
+            }
+        }
+        for(cand = head[Hash(new + pos)], tries = 0; (cand >= 0) && (tries < MAX_CANDIDATES); cand = chain[cand], tries++){
+            for(len = 0; (((uint32_t)cand + len) < old_size) && ((pos + len) < new_size) &&
+                         (old[cand + len] == new[pos + len]); len++){
+            }
+            if(len > best_len){
+                best_len = len;
+                best_old = (uint32_t)cand;
+            }
+        }
+
+        if((best_len < MIN_MATCH) || ((best_old == (pend_old + (pos - pend_new))) && (pos < (pend_new + pend_len)))){
+            pos++;
+            continue;
+        }
+
+        /* Extend past mismatches while matches keep outnumbering them */
+        matches = 0;
+        best_score = 0;
+        best_i = 0;
+        for(i = 0; ((best_old + i) < old_size) && ((pos + i) < new_size) && ((i - best_i) <= GIVE_UP); i++){
+            matches += (old[best_old + i] == new[pos + i]) ? 1U : 0U;
+            score = (int32_t)(2U * matches) - (int32_t)(i + 1U);
+            if(score > best_score){
+                best_score = score;
+                best_i = i + 1U;
+            }
+        }
+
+        Put_Record(&patch, old, new, pend_old, pend_new, pend_len, pos - (pend_new + pend_len),
+                   (int32_t)(best_old - (pend_old + pend_len)));
+        pend_old = best_old;
+        pend_new = pos;
+        pend_len = best_i;
+        pos += best_i;
+    }
+    Put_Record(&patch, old, new, pend_old, pend_new, pend_len, new_size - (pend_new + pend_len), 0);
+
+    free(head);
+    free(chain);
+    return patch;
+}
+
+static uint32_t Host_Erase(uint32_t FlashAddress)
+{
+    return Flash_Emu_Erase(FLASH_GEO_BANK(FlashAddress), FLASH_GEO_SECTOR(FlashAddress), 1);
+}
+
+static uint32_t Host_Program(uint32_t FlashAddress, const uint32_t *src, uint32_t NbOfFlashWords)
+{
+    Flash_Emu_Session();
+    return Flash_Emu_Program(FlashAddress, src, NbOfFlashWords);
+}
+
+static const Flash_Stream_Backend_t Host_Backend =
+{
+    Host_Erase, Host_Program, Flash_Emu_Read
+};
+
+static void Load_Bank(uint32_t base, const uint8_t *data, uint32_t size)
+{
+    uint8_t fw[FLASH_GEO_FLASHWORD_SIZE];
+    uint32_t offset;
+
+    for(offset = 0; offset < size; offset += FLASH_GEO_FLASHWORD_SIZE){
+        memset(fw, 0xFF, sizeof(fw));
+        memcpy(fw, data + offset, ((size - offset) < sizeof(fw)) ? (size - offset) : sizeof(fw));
+        Flash_Emu_Program(base + offset, fw, 1);
+    }
+}
+
+static uint8_t *Read_File(const char *path, uint32_t *size)
+{
+    uint8_t *data = malloc(FLASH_GEO_BANK_SIZE);
+    FILE *f = fopen(path, "rb");
+
+    if(f == NULL){
+        perror(path);
+        exit(1);
+    }
+    *size = (uint32_t)fread(data, 1, FLASH_GEO_BANK_SIZE, f);
+    fclose(f);
+    return data;
+}
+
+static void Synthetic(uint8_t **old, uint32_t *old_size, uint8_t **new, uint32_t *new_size)
+{
+    uint32_t size = 640U * 1024U;
+    uint32_t insert_at = 100U * 1024U;
+    uint32_t insert = 2048U;
+    uint32_t word;
+    uint32_t i;
+
+    *old = malloc(size);
+    *new = malloc(size + insert);
+    srand(7);
+    /* Instruction-like bytes with a literal pool word every 64 bytes */
+    for(i = 0; i < size; i += 4U){
+        word = ((i % 64U) == 60U) ? (0x08100000U + ((uint32_t)rand() % size)) : ((uint32_t)rand() & 0x0F0FFFFFU);
+        memcpy(*old + i, &word, 4);
+    }
+
+    memcpy(*new, *old, insert_at);
+    for(i = 0; i < insert; i++){
+        (*new)[insert_at + i] = (uint8_t)rand();
+    }
+    memcpy(*new + insert_at + insert, *old + insert_at, size - insert_at);
+    /* Relink: every pool address past the insertion moves */
+    for(i = 60U; i < (size + insert); i += 64U){
+        memcpy(&word, *new + i, 4);
+        if((word >= (0x08100000U + insert_at)) && (word < (0x08100000U + size))){
+            word += insert;
+            memcpy(*new + i, &word, 4);
+        }
+    }
+    *old_size = size;
+    *new_size = size + insert;
+}
+
+int main(int argc, char **argv)
+{
+    static Flash_Delta_t delta;
+    Buffer_t patch;
+    uint8_t *old;
+    uint8_t *new;
+    uint32_t old_size;
+    uint32_t new_size;
+    uint32_t offset;
+    uint32_t step;
+    uint64_t delta_ns;
+    uint64_t full_ns;
+    uint32_t sectors;
+    FILE *f;
+
+    if(argc >= 3){
+        old = Read_File(argv[1], &old_size);
+        new = Read_File(argv[2], &new_size);
+    }else{
+        Synthetic(&old, &old_size, &new, &new_size);
+    }
+
+    patch = Generate(old, old_size, new, new_size);
+    if(argc >= 4){
+        f = fopen(argv[3], "wb");
+        if((f == NULL) || (fwrite(patch.data, 1, patch.size, f) != patch.size)){
+            perror(argv[3]);
+            return 1;
+        }
+        fclose(f);
+    }
+
+    /* Old image running from bank2; bank1 still holds something older */
+    Flash_Emu_Init();
+    Load_Bank(OLD_BASE, old, old_size);
+    Load_Bank(NEW_BASE, new + (new_size / 2U), new_size / 4U);
+    Flash_Emu_Stats.now_ns = 0;
+
+    Flash_Delta_Init(&delta, &Host_Backend, OLD_BASE, NEW_BASE, FLASH_GEO_BANK_SIZE);
+    srand(3);
+    for(offset = 0; offset < patch.size; offset += step){
+        step = 1U + ((uint32_t)rand() % 300U);
+        if(step > (patch.size - offset)){
+            step = patch.size - offset;
+        }
+        Flash_Delta_Feed(&delta, patch.data + offset, step);
+    }
+    Flash_Delta_Finish(&delta);
+    delta_ns = Flash_Emu_Stats.now_ns;
+
+    if((delta.status != FLASH_OK) || (memcmp(Flash_Emu_Memory(NEW_BASE), new, new_size) != 0)){
+        printf("patch apply FAILED\n");
+        return 2;
+    }
+
+    sectors = (new_size + FLASH_GEO_SECTOR_SIZE - 1U) >> FLASH_GEO_SECTOR_SHIFT;
+    full_ns = (uint64_t)sectors * Flash_Emu_Timing.erase_ns +
+              (uint64_t)((new_size + FLASH_GEO_FLASHWORD_SIZE - 1U) >> FLASH_GEO_FLASHWORD_SHIFT) *
+              (Flash_Emu_Timing.program_ns + Flash_Emu_Timing.session_ns);
+
+    printf("old %u bytes, new %u bytes\n", old_size, new_size);
+    printf("transfer        patch %u bytes (%.1f%% of the new image)\n", patch.size, 100.0 * patch.size / new_size);
+    printf("flash           %u fw programmed, %u fw left erased, %u sectors erased, %u already blank\n",
+           delta.stats.programmed, delta.stats.blank, delta.stats.erased, delta.stats.clean);
+    printf("flash time      delta %.1f ms (verify reads included), full image %.1f ms\n", delta_ns / 1e6, full_ns / 1e6);
+    printf("new image verified\n");
+    return 0;
+}
@@ -0,0 +1,134 @@
+/**
+  ******************************************************************************
+  * @file    dump_decode.c
+  * @brief   Host decoder for the crash dumps written by Core/Src/flash_dump.c.
+             Takes a raw read of the dump sector (or of single records), e.g.
+
+             st-flash read dump.bin 0x08020000 0x20000
+
+             and prints every complete record: reason, registers, decoded
+             fault status bits, flash/ECC state and the top of the stack.
+
+             gcc -O2 -DHOST_BUILD -ICore/Inc -ITools Tools/dump_decode.c \
+                 Core/Src/flash_stream.c -o dump_decode
+             ./dump_decode dump.bin
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <string.h>
+#include "flash_dump.h"
+#include "flash_stream.h"
+
+typedef struct{
+    uint32_t mask;
+    const char *name;
+}Bit_t;
+
+static const char *const Reasons[] = { "?", "NMI", "HardFault", "MemManage", "BusFault", "UsageFault", "Error_Handler" };
+
+static const Bit_t CfsrBits[] =
+{
+    { 1U << 0, "IACCVIOL" }, { 1U << 1, "DACCVIOL" }, { 1U << 3, "MUNSTKERR" }, { 1U << 4, "MSTKERR" },
+    { 1U << 5, "MLSPERR" }, { 1U << 7, "MMARVALID" }, { 1U << 8, "IBUSERR" }, { 1U << 9, "PRECISERR" },
+    { 1U << 10, "IMPRECISERR" }, { 1U << 11, "UNSTKERR" }, { 1U << 12, "STKERR" }, { 1U << 13, "LSPERR" },
+    { 1U << 15, "BFARVALID" }, { 1U << 16, "UNDEFINSTR" }, { 1U << 17, "INVSTATE" }, { 1U << 18, "INVPC" },
+    { 1U << 19, "NOCP" }, { 1U << 24, "UNALIGNED" }, { 1U << 25, "DIVBYZERO" },
+};
+
+static const Bit_t HfsrBits[] =
+{
+    { 1U << 1, "VECTTBL" }, { 1U << 30, "FORCED" }, { 1U << 31, "DEBUGEVT" },
+};
+
+static const Bit_t FlashBits[] =
+{
+    { 1U << 17, "WRPERR" }, { 1U << 18, "PGSERR" }, { 1U << 19, "STRBERR" }, { 1U << 21, "INCERR" },
+    { 1U << 22, "OPERR" }, { 1U << 23, "RDPERR" }, { 1U << 24, "RDSERR" }, { 1U << 25, "SNECCERR" },
+    { 1U << 26, "DBECCERR" },
+};
+
+static void Bits(const char *label, uint32_t value, const Bit_t *bits, uint32_t count)
+{
+    uint32_t index;
+
+    printf("  %-8s %08x", label, value);
+    for(index = 0; index < count; index++){
+        if((value & bits[index].mask) != 0U){
+            printf(" %s", bits[index].name);
+        }
+    }
+    printf("\n");
+}
+
+static void Decode(const Flash_Dump_t *dump, uint32_t slot)
+{
+    static const char *const names[8] = { "r0", "r1", "r2", "r3", "r12", "lr", "pc", "xpsr" };
+    uint32_t crc = Flash_Stream_Crc(0, (const uint8_t *)dump + FLASH_GEO_FLASHWORD_SIZE, FLASH_DUMP_SIZE - FLASH_GEO_FLASHWORD_SIZE);
+    uint32_t index;
+
+    printf("record %u: crash #%u, %s at tick %u%s\n", slot, dump->sequence,
+           Reasons[(dump->reason < (sizeof(Reasons) / sizeof(Reasons[0]))) ? dump->reason : 0U], dump->tick,
+           (crc == dump->crc) ? "" : "  (CRC MISMATCH)");
+    for(index = 0; index < 8U; index++){
+        printf("  %-4s %08x%s", names[index], dump->frame[index], ((index % 4U) == 3U) ? "\n" : "");
+    }
+    for(index = 0; index < 8U; index++){
+        printf("  r%-3u %08x%s", index + 4U, dump->callee[index], ((index % 4U) == 3U) ? "\n" : "");
+    }
+    printf("  sp   %08x  msp  %08x  psp  %08x  exc_return %08x\n", dump->sp, dump->msp, dump->psp, dump->exc_return);
+    printf("  control %x primask %x basepri %x faultmask %x\n", dump->control, dump->primask, dump->basepri, dump->faultmask);
+    Bits("cfsr", dump->cfsr, CfsrBits, sizeof(CfsrBits) / sizeof(CfsrBits[0]));
+    Bits("hfsr", dump->hfsr, HfsrBits, sizeof(HfsrBits) / sizeof(HfsrBits[0]));
+    printf("  mmfar    %08x  bfar %08x  afsr %08x  shcsr %08x  icsr %08x\n", dump->mmfar, dump->bfar, dump->afsr, dump->shcsr, dump->icsr);
+    Bits("flash sr1", dump->flash_sr[0], FlashBits, sizeof(FlashBits) / sizeof(FlashBits[0]));
+    Bits("flash sr2", dump->flash_sr[1], FlashBits, sizeof(FlashBits) / sizeof(FlashBits[0]));
+    printf("  ecc: %u corrected, %u uncorrectable, %u faults recovered, %u events\n",
+           dump->ecc_single, dump->ecc_double, dump->ecc_recovered, dump->ecc_count);
+    for(index = 0; (index < FLASH_SAFE_EVENT_DEPTH) && (index < dump->ecc_count); index++){
+        printf("    %08x flags %08x tick %u\n", dump->ecc[index].address, dump->ecc[index].flags, dump->ecc[index].tick);
+    }
+    printf("  stack (%u words):", dump->stack_words);
+    for(index = 0; (index < dump->stack_words) && (index < FLASH_DUMP_STACK_WORDS); index++){
+        printf("%s%08x", ((index % 8U) == 0U) ? "\n    " : " ", dump->stack[index]);
+    }
+    printf("\n\n");
+}
+
+int main(int argc, char **argv)
+{
+    static Flash_Dump_t dump;
+    uint32_t slot = 0;
+    uint32_t found = 0;
+    FILE *f;
+
+    if(argc != 2){
+        fprintf(stderr, "usage: %s dump.bin\n", argv[0]);
+        return 1;
+    }
+    f = fopen(argv[1], "rb");
+    if(f == NULL){
+        perror(argv[1]);
+        return 1;
+    }
+    while(fread(&dump, 1, sizeof(dump), f) == sizeof(dump)){
+        if(dump.magic == FLASH_DUMP_MAGIC){
+            Decode(&dump, slot);
+            found++;
+        }
+        slot++;
+    }
+    fclose(f);
+    printf("%u dump(s) in %u records\n", found, slot);
+    return (found != 0U) ? 0 : 2;
+}
@@ -0,0 +1,166 @@
+/**
+  ******************************************************************************
+  * @file    flash_emu.c
+  * @brief   This file provides the host-side flash array emulation used by
+             the tools in this directory. Every flashword keeps the data it
+             was programmed with, so bit flips in the backing store show up
+             on read as corrected (1 bit) or uncorrectable (2+ bits) ECC
+             errors, and programming a flashword twice breaks its ECC like
+             it does on the device.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <string.h>
+#include "flash_emu.h"
+
+#define EMU_NB_FLASHWORDS   (FLASH_GEO_TOTAL_SIZE >> FLASH_GEO_FLASHWORD_SHIFT)
+
+enum{
+    EMU_ERASED = 0,
+    EMU_PROGRAMMED,
+    EMU_ECC_BROKEN      /* programmed twice with different data */
+};
+
+/* Typical figures at PSIZE x64 */
+Flash_Emu_Timing_t Flash_Emu_Timing = { 1000000000U, 16000U, 40U, 200U };
+Flash_Emu_Stats_t Flash_Emu_Stats;
+
+static uint8_t emu_mem[FLASH_GEO_TOTAL_SIZE];       /* what a read returns */
+static uint8_t emu_golden[FLASH_GEO_TOTAL_SIZE];    /* what ECC protects */
+static uint8_t emu_state[EMU_NB_FLASHWORDS];
+
+void Flash_Emu_Init(void)
+{
+    memset(emu_mem, 0xFF, sizeof(emu_mem));
+    memset(emu_golden, 0xFF, sizeof(emu_golden));
+    memset(emu_state, EMU_ERASED, sizeof(emu_state));
+    memset(&Flash_Emu_Stats, 0, sizeof(Flash_Emu_Stats));
+}
+
+uint8_t *Flash_Emu_Memory(uint32_t FlashAddress)
+{
+    if(!FLASH_GEO_IS_VALID(FlashAddress)){
+        return NULL;
+    }
+    return &emu_mem[FLASH_GEO_OFFSET(FlashAddress)];
+}
+
+uint32_t Flash_Emu_Erase(uint32_t Bank, uint32_t FirstSector, uint32_t NbOfSectors)
+{
+    uint32_t offset;
+
+    if(((Bank != FLASH_BANK_1) && (Bank != FLASH_BANK_2)) || (NbOfSectors == 0U) ||
+       ((FirstSector + NbOfSectors) > FLASH_GEO_SECTORS_PER_BANK)){
+        return FLASH_ERROR;
+    }
+
+    offset = FLASH_GEO_OFFSET(FLASH_GEO_SECTOR_BASE(Bank, FirstSector));
+    memset(&emu_mem[offset], 0xFF, NbOfSectors << FLASH_GEO_SECTOR_SHIFT);
+    memset(&emu_golden[offset], 0xFF, NbOfSectors << FLASH_GEO_SECTOR_SHIFT);
+    memset(&emu_state[offset >> FLASH_GEO_FLASHWORD_SHIFT], EMU_ERASED,
+           NbOfSectors << (FLASH_GEO_SECTOR_SHIFT - FLASH_GEO_FLASHWORD_SHIFT));
+
+    Flash_Emu_Stats.erases += NbOfSectors;
+    Flash_Emu_Stats.now_ns += (uint64_t)Flash_Emu_Timing.erase_ns * NbOfSectors;
+    return FLASH_OK;
+}
+
+uint32_t Flash_Emu_Program(uint32_t FlashAddress, const void *src, uint32_t NbOfFlashWords)
+{
+    const uint8_t *data = (const uint8_t *)src;
+    uint32_t offset;
+    uint32_t index;
+
+    if((NbOfFlashWords == 0U) || !FLASH_GEO_IS_ALIGNED(FlashAddress) ||
+       !FLASH_GEO_SAME_BANK(FlashAddress, NbOfFlashWords << FLASH_GEO_FLASHWORD_SHIFT)){
+        return FLASH_ERROR;
+    }
+
+    offset = FLASH_GEO_OFFSET(FlashAddress);
+    while(NbOfFlashWords-- != 0U){
+        uint8_t *state = &emu_state[offset >> FLASH_GEO_FLASHWORD_SHIFT];
+
+        if(*state == EMU_ERASED){
+            memcpy(&emu_mem[offset], data, FLASH_GEO_FLASHWORD_SIZE);
+            memcpy(&emu_golden[offset], data, FLASH_GEO_FLASHWORD_SIZE);
+            *state = EMU_PROGRAMMED;
+        }else{
+            /* Cells can only go 1 -> 0; the stored ECC no longer matches
+               unless the very same data was written again */
+            if(memcmp(&emu_golden[offset], data, FLASH_GEO_FLASHWORD_SIZE) != 0){
+                *state = EMU_ECC_BROKEN;
+            }
+            for(index = 0; index < FLASH_GEO_FLASHWORD_SIZE; index++){
+                emu_mem[offset + index] &= data[index];
+                emu_golden[offset + index] &= data[index];
+            }
+        }
+        Flash_Emu_Stats.programs++;
+        Flash_Emu_Stats.now_ns += Flash_Emu_Timing.program_ns;
+        offset += FLASH_GEO_FLASHWORD_SIZE;
+        data += FLASH_GEO_FLASHWORD_SIZE;
+    }
+    return FLASH_OK;
+}
+
+uint32_t Flash_Emu_Read(void *dest, uint32_t FlashAddress, uint32_t Length, uint32_t *FailAddress)
+{
+    uint8_t *out = (uint8_t *)dest;
+    uint32_t offset;
+    uint32_t fw;
+    uint32_t flips;
+    uint32_t index;
+
+    if((Length == 0U) || !FLASH_GEO_SAME_BANK(FlashAddress, Length)){
+        return (Length == 0U) ? FLASH_OK : FLASH_ERROR;
+    }
+
+    offset = FLASH_GEO_OFFSET(FlashAddress);
+    for(fw = offset & ~(FLASH_GEO_FLASHWORD_SIZE - 1U); fw < (offset + Length); fw += FLASH_GEO_FLASHWORD_SIZE){
+        flips = 0;
+        for(index = 0; index < FLASH_GEO_FLASHWORD_SIZE; index++){
+            flips += (uint32_t)__builtin_popcount(emu_mem[fw + index] ^ emu_golden[fw + index]);
+        }
+        Flash_Emu_Stats.reads++;
+        Flash_Emu_Stats.now_ns += Flash_Emu_Timing.read_ns;
+
+        if((flips > 1U) || (emu_state[fw >> FLASH_GEO_FLASHWORD_SHIFT] == EMU_ECC_BROKEN)){
+            Flash_Emu_Stats.uncorrectable++;
+            Flash_Emu_Stats.last_fail = FLASH_GEO_BASE + fw;
+            if(FailAddress != NULL){
+                *FailAddress = FLASH_GEO_BASE + fw;
+            }
+            return FLASH_ECC_ERROR;
+        }
+        if(flips == 1U){
+            Flash_Emu_Stats.corrected++;
+        }
+    }
+
+    /* Corrected data comes from the ECC-protected copy */
+    memcpy(out, &emu_golden[offset], Length);
+    return FLASH_OK;
+}
+
+void Flash_Emu_FlipBit(uint32_t FlashAddress, uint32_t Bit)
+{
+    uint32_t fw = FLASH_GEO_OFFSET(FlashAddress) & ~(FLASH_GEO_FLASHWORD_SIZE - 1U);
+
+    Bit &= (FLASH_GEO_FLASHWORD_SIZE * 8U) - 1U;
+    emu_mem[fw + (Bit >> 3)] ^= (uint8_t)(1U << (Bit & 7U));
+}
+
+void Flash_Emu_Session(void)
+{
+    Flash_Emu_Stats.now_ns += Flash_Emu_Timing.session_ns;
+}
@@ -0,0 +1,62 @@
+/**
+  ******************************************************************************
+  * @file    flash_emu.h
+  * @brief   Host-side emulation of the STM32H745 flash array: two banks of
+  *          8 x 128 Kbytes sectors, 256-bit flashwords with ECC, and a
+  *          simple erase/program/read timing model
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __FLASH_EMU_H__
+#define __FLASH_EMU_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+#include "flash_if.h"
+#include "flash_geometry.h"
+
+typedef struct{
+    uint32_t erase_ns;          /* one sector erase */
+    uint32_t program_ns;        /* one flashword program */
+    uint32_t read_ns;           /* one flashword read */
+    uint32_t session_ns;        /* unlock + lock pair */
+}Flash_Emu_Timing_t;
+
+typedef struct{
+    uint64_t now_ns;            /* emulated time consumed so far */
+    uint32_t erases;
+    uint32_t programs;
+    uint32_t reads;
+    uint32_t corrected;         /* single-bit errors corrected on read */
+    uint32_t uncorrectable;     /* double-bit errors reported on read */
+    uint32_t last_fail;         /* flashword address of the last uncorrectable error */
+}Flash_Emu_Stats_t;
+
+extern Flash_Emu_Timing_t Flash_Emu_Timing;
+extern Flash_Emu_Stats_t Flash_Emu_Stats;
+
+void Flash_Emu_Init(void);
+uint8_t *Flash_Emu_Memory(uint32_t FlashAddress);
+uint32_t Flash_Emu_Erase(uint32_t Bank, uint32_t FirstSector, uint32_t NbOfSectors);
+uint32_t Flash_Emu_Program(uint32_t FlashAddress, const void *src, uint32_t NbOfFlashWords);
+uint32_t Flash_Emu_Read(void *dest, uint32_t FlashAddress, uint32_t Length, uint32_t *FailAddress);
+void Flash_Emu_FlipBit(uint32_t FlashAddress, uint32_t Bit);
+void Flash_Emu_Session(void);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* __FLASH_EMU_H__ */
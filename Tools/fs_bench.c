@@ -0,0 +1,313 @@
+/**
+  ******************************************************************************
+  * @file    fs_bench.c
+  * @brief   Host check of the file system in Core/Src/flash_fs.c against the
+             emulated flash (flash_emu.c). A workload of small, frequently
+             rewritten configuration files next to large, cold ones is run
+             on the file system, remounting and checking every file against
+             a RAM copy along the way, and then on a naive fixed-address
+             layout (one sector per file, erased on every rewrite). Reports
+             write throughput, erase counts and mount time for both, in
+             emulated flash time. Torn blocks and a torn tag are checked
+             first: mount must retire their slots without losing files or
+             letting later writes roll back.
+
+             gcc -O2 -DHOST_BUILD -ICore/Inc -ITools Tools/fs_bench.c \
+                 Tools/flash_emu.c Core/Src/flash_fs.c Core/Src/flash_stream.c -o fs_bench
+             ./fs_bench [writes]
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flash_emu.h"
+#include "flash_fs.h"
+
+#define REGION_BASE     FLASH_BANK2_BASE
+#define REGION_SECTORS  FLASH_GEO_SECTORS_PER_BANK
+#define NB_FILES        REGION_SECTORS      /* the naive layout has a sector per file */
+#define REMOUNT_EVERY   250U
+
+typedef struct{
+    const char *name;
+    uint32_t max_size;
+    uint32_t weight;        /* relative rewrite frequency */
+}File_t;
+
+static const File_t Files[NB_FILES] =
+{
+    { "calibration",  96U * 1024U, 1U },
+    { "firmware.cfg", 24U * 1024U, 2U },
+    { "net.cfg",       512U,      30U },
+    { "sensor.cfg",   1500U,      30U },
+    { "counters",       64U,      60U },
+    { "ui.cfg",       3000U,      10U },
+    { "log.idx",      6000U,      15U },
+    { "keys",          800U,       1U },
+};
+
+static uint8_t Shadow[NB_FILES][96U * 1024U];
+static uint32_t ShadowSize[NB_FILES];
+static uint8_t Check[96U * 1024U];
+
+static uint32_t Host_Erase(uint32_t FlashAddress)
+{
+    return Flash_Emu_Erase(FLASH_GEO_BANK(FlashAddress), FLASH_GEO_SECTOR(FlashAddress), 1);
+}
+
+static uint32_t Host_Program(uint32_t FlashAddress, const uint32_t *src, uint32_t NbOfFlashWords)
+{
+    return Flash_Emu_Program(FlashAddress, src, NbOfFlashWords);
+}
+
+static const Flash_Stream_Backend_t Host_Backend =
+{
+    Host_Erase, Host_Program, Flash_Emu_Read
+};
+
+/* Same sequence of (file, size, contents) for both layouts */
+static uint32_t NextWrite(uint32_t *size)
+{
+    uint32_t total = 0;
+    uint32_t pick;
+    uint32_t file;
+    uint32_t index;
+
+    for(file = 0; file < NB_FILES; file++){
+        total += Files[file].weight;
+    }
+    pick = (uint32_t)rand() % total;
+    for(file = 0; pick >= Files[file].weight; file++){
+        pick -= Files[file].weight;
+    }
+    *size = (Files[file].max_size / 2U) + ((uint32_t)rand() % (Files[file].max_size / 2U + 1U));
+    for(index = 0; index < *size; index++){
+        Shadow[file][index] = (uint8_t)(((index * 7U) + (uint32_t)rand()) >> ((index & 3U) * 2U));
+    }
+    ShadowSize[file] = *size;
+    return file;
+}
+
+static uint32_t Verify(Flash_FS_t *fs)
+{
+    uint32_t file;
+    uint32_t got;
+    uint32_t offset;
+
+    for(file = 0; file < NB_FILES; file++){
+        if(ShadowSize[file] == 0U){
+            continue;
+        }
+        if((Flash_FS_Read(fs, Files[file].name, 0, Check, sizeof(Check), &got) != FLASH_OK) ||
+           (got != ShadowSize[file]) || (memcmp(Check, Shadow[file], got) != 0)){
+            printf("%s: read back FAILED\n", Files[file].name);
+            return 1;
+        }
+        /* An unaligned window through the cache */
+        offset = (uint32_t)rand() % ShadowSize[file];
+        if((Flash_FS_Read(fs, Files[file].name, offset, Check, 100, &got) != FLASH_OK) ||
+           (memcmp(Check, Shadow[file] + offset, got) != 0)){
+            printf("%s: window read FAILED\n", Files[file].name);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* A reset while a block was programmed: remounting retires its slot, and
+   what is written after that must survive the next mount. Offset is where
+   in the block the torn data lies; data may well start with 0xFF. */
+static uint32_t TornBlock(uint32_t Offset)
+{
+    static Flash_FS_t fs;
+    static const char first[] = "A";
+    static const char second[] = "B";
+    uint32_t junk[FLASH_GEO_FLASHWORD_SIZE / 4U];
+    char check[4];
+    uint32_t got = 0;
+    uint32_t mount;
+    uint32_t sector;
+    uint32_t slot;
+
+    Flash_Emu_Init();
+    if((Flash_FS_Mount(&fs, &Host_Backend, REGION_BASE, REGION_SECTORS, 1) != FLASH_OK) ||
+       (Flash_FS_Write(&fs, "torn.cfg", first, sizeof(first)) != FLASH_OK)){
+        printf("torn block: setup FAILED\n");
+        return 1;
+    }
+    /* Data of the next block went out, its tag did not */
+    sector = fs.head;
+    slot = fs.used[sector];
+    memset(junk, 0x5A, sizeof(junk));
+    Host_Program(REGION_BASE + (sector << FLASH_GEO_SECTOR_SHIFT) + (slot * FLASH_FS_BLOCK_SIZE) + Offset, junk, 1);
+
+    for(mount = 0; mount < 2U; mount++){
+        if(Flash_FS_Mount(&fs, &Host_Backend, REGION_BASE, REGION_SECTORS, 0) != FLASH_OK){
+            printf("torn block: remount FAILED\n");
+            return 1;
+        }
+    }
+    if(fs.used[sector] <= slot){
+        printf("torn block: slot with data at +%u left in use\n", (unsigned)Offset);
+        return 1;
+    }
+    if((Flash_FS_Write(&fs, "torn.cfg", second, sizeof(second)) != FLASH_OK) ||
+       (Flash_FS_Mount(&fs, &Host_Backend, REGION_BASE, REGION_SECTORS, 0) != FLASH_OK) ||
+       (Flash_FS_Read(&fs, "torn.cfg", 0, check, sizeof(check), &got) != FLASH_OK) ||
+       (got != sizeof(second)) || (memcmp(check, second, got) != 0)){
+        printf("torn block: write after the retired slot rolled back, read '%s'\n", (got != 0U) ? check : "");
+        return 1;
+    }
+    printf("torn block: retired, later write kept (data at +%u)\n", (unsigned)Offset);
+    return 0;
+}
+
+/* A reset while a tag was programmed leaves it unreadable: remounting
+   retires that slot and keeps the sector, with the directory in it */
+static uint32_t TornTag(void)
+{
+    static Flash_FS_t fs;
+    static const char first[] = "A";
+    static const char second[] = "B";
+    uint32_t junk[FLASH_GEO_FLASHWORD_SIZE / 4U];
+    uint32_t address;
+    char check[4];
+    uint32_t got = 0;
+
+    Flash_Emu_Init();
+    if((Flash_FS_Mount(&fs, &Host_Backend, REGION_BASE, REGION_SECTORS, 1) != FLASH_OK) ||
+       (Flash_FS_Write(&fs, "torn.cfg", first, sizeof(first)) != FLASH_OK)){
+        printf("torn tag: setup FAILED\n");
+        return 1;
+    }
+    /* The next tag programmed twice breaks its ECC */
+    address = REGION_BASE + (fs.head << FLASH_GEO_SECTOR_SHIFT) + (fs.used[fs.head] * FLASH_GEO_FLASHWORD_SIZE);
+    memset(junk, 0x5A, sizeof(junk));
+    Host_Program(address, junk, 1);
+    memset(junk, 0x21, sizeof(junk));
+    Host_Program(address, junk, 1);
+
+    if((Flash_FS_Mount(&fs, &Host_Backend, REGION_BASE, REGION_SECTORS, 0) != FLASH_OK) ||
+       (Flash_FS_Read(&fs, "torn.cfg", 0, check, sizeof(check), &got) != FLASH_OK) ||
+       (got != sizeof(first)) || (memcmp(check, first, got) != 0)){
+        printf("torn tag: file lost on remount, read '%s'\n", (got != 0U) ? check : "");
+        return 1;
+    }
+    got = 0;
+    if((Flash_FS_Write(&fs, "torn.cfg", second, sizeof(second)) != FLASH_OK) ||
+       (Flash_FS_Mount(&fs, &Host_Backend, REGION_BASE, REGION_SECTORS, 0) != FLASH_OK) ||
+       (Flash_FS_Read(&fs, "torn.cfg", 0, check, sizeof(check), &got) != FLASH_OK) ||
+       (got != sizeof(second)) || (memcmp(check, second, got) != 0)){
+        printf("torn tag: write after the unreadable slot lost, read '%s'\n", (got != 0U) ? check : "");
+        return 1;
+    }
+    printf("torn tag: slot retired, sector and files kept\n");
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    static Flash_FS_t fs;
+    uint32_t writes = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 3000U;
+    uint32_t naive_erase[NB_FILES] = { 0 };
+    uint32_t header[FLASH_GEO_FLASHWORD_SIZE / 4U];
+    uint64_t bytes = 0;
+    uint64_t fs_ns;
+    uint64_t fs_mount_ns;
+    uint64_t naive_ns;
+    uint64_t naive_mount_ns;
+    uint32_t min_erase = 0xFFFFFFFFU;
+    uint32_t max_erase = 0;
+    uint32_t naive_max = 0;
+    uint32_t index;
+    uint32_t file;
+    uint32_t size;
+    uint32_t fail;
+
+    if((TornBlock(0) != 0U) || (TornBlock(FLASH_FS_BLOCK_SIZE - FLASH_GEO_FLASHWORD_SIZE) != 0U) || (TornTag() != 0U)){
+        return 3;
+    }
+
+    /* File system */
+    srand(1);
+    Flash_Emu_Init();
+    if(Flash_FS_Mount(&fs, &Host_Backend, REGION_BASE, REGION_SECTORS, 1) != FLASH_OK){
+        printf("mount FAILED\n");
+        return 1;
+    }
+    Flash_Emu_Stats.now_ns = 0;
+    fs_mount_ns = 0;
+    for(index = 0; index < writes; index++){
+        file = NextWrite(&size);
+        bytes += size;
+        if(Flash_FS_Write(&fs, Files[file].name, Shadow[file], size) != FLASH_OK){
+            printf("write %u (%s, %u bytes) FAILED, %u blocks free\n", index, Files[file].name, size, Flash_FS_Free(&fs));
+            return 1;
+        }
+        if(((index + 1U) % REMOUNT_EVERY) == 0U){
+            uint64_t start = Flash_Emu_Stats.now_ns;
+
+            Flash_FS_Stats_t stats = fs.stats;
+            if(Flash_FS_Mount(&fs, &Host_Backend, REGION_BASE, REGION_SECTORS, 0) != FLASH_OK){
+                printf("remount FAILED\n");
+                return 1;
+            }
+            fs.stats = stats;
+            fs_mount_ns = Flash_Emu_Stats.now_ns - start;
+            Flash_Emu_Stats.now_ns = start;
+            if(Verify(&fs) != 0U){
+                return 2;
+            }
+            Flash_Emu_Stats.now_ns = start;
+        }
+    }
+    fs_ns = Flash_Emu_Stats.now_ns;
+    for(index = 0; index < REGION_SECTORS; index++){
+        min_erase = (fs.erase_count[index] < min_erase) ? fs.erase_count[index] : min_erase;
+        max_erase = (fs.erase_count[index] > max_erase) ? fs.erase_count[index] : max_erase;
+    }
+
+    /* Naive layout: file i owns sector i, a size flashword then the data */
+    srand(1);
+    memset(ShadowSize, 0, sizeof(ShadowSize));
+    Flash_Emu_Init();
+    Flash_Emu_Stats.now_ns = 0;
+    for(index = 0; index < writes; index++){
+        file = NextWrite(&size);
+        memset(header, 0xFF, sizeof(header));
+        header[0] = size;
+        Host_Erase(REGION_BASE + (file << FLASH_GEO_SECTOR_SHIFT));
+        Host_Program(REGION_BASE + (file << FLASH_GEO_SECTOR_SHIFT), header, 1);
+        memset(Shadow[file] + size, 0xFF, FLASH_GEO_FLASHWORD_SIZE);
+        Host_Program(REGION_BASE + (file << FLASH_GEO_SECTOR_SHIFT) + FLASH_GEO_FLASHWORD_SIZE, (const uint32_t *)Shadow[file],
+                     (size + FLASH_GEO_FLASHWORD_SIZE - 1U) / FLASH_GEO_FLASHWORD_SIZE);
+        naive_erase[file]++;
+    }
+    naive_ns = Flash_Emu_Stats.now_ns;
+    Flash_Emu_Stats.now_ns = 0;
+    for(file = 0; file < NB_FILES; file++){
+        Flash_Emu_Read(header, REGION_BASE + (file << FLASH_GEO_SECTOR_SHIFT), sizeof(header), &fail);
+        naive_max = (naive_erase[file] > naive_max) ? naive_erase[file] : naive_max;
+    }
+    naive_mount_ns = Flash_Emu_Stats.now_ns;
+
+    printf("%u writes, %.1f Kbytes, %u files in %u sectors\n", writes, bytes / 1024.0, (unsigned)NB_FILES, (unsigned)REGION_SECTORS);
+    printf("fs:    %7.1f s flash time, %6.1f Kbytes/s, %u erases (per sector %u..%u), %u collections moved %u blocks\n",
+           fs_ns / 1e9, (bytes / 1024.0) / (fs_ns / 1e9), fs.stats.erases, min_erase, max_erase,
+           fs.stats.collections, fs.stats.moved);
+    printf("       cache %u hits / %u misses, mount %.1f us\n", fs.stats.cache_hits, fs.stats.cache_misses, fs_mount_ns / 1e3);
+    printf("naive: %7.1f s flash time, %6.1f Kbytes/s, %u erases (hottest sector %u), mount %.1f us\n",
+           naive_ns / 1e9, (bytes / 1024.0) / (naive_ns / 1e9), writes, naive_max, naive_mount_ns / 1e3);
+    return 0;
+}
@@ -0,0 +1,396 @@
+/**
+  ******************************************************************************
+  * @file    image_pack.c
+  * @brief   Host image packer for incremental flashing (Core/Src/flash_manifest.c).
+             Pads an image with 0xFF to whole sectors and hashes every
+             flashword and every sector on several threads; writes the padded
+             image and its manifest (Flash_Manifest_Header_t, sector hashes,
+             flashword hashes). The old image is then put into the emulated
+             flash (flash_emu.c) and brought up to date through the target
+             API, and the transfer and flash time are reported against
+             rewriting the whole image. A last run starts from a flashword
+             torn by an earlier update, which must be repaired.
+
+             gcc -O2 -pthread -DHOST_BUILD -ICore/Inc -ITools Tools/image_pack.c \
+                 Tools/flash_emu.c Core/Src/flash_manifest.c Core/Src/flash_stream.c -o image_pack
+             ./image_pack [-t threads] [-b base] [old.bin new.bin [new.img new.mfst]]
+
+             Without files, a synthetic 2 Mbytes image at 0x08000000 and a
+             version of it with a few functions patched in place, a table
+             rewritten and data appended are used. -b defaults to
+             0x08100000 (bank2) for files.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include "flash_emu.h"
+#include "flash_manifest.h"
+
+#define MAX_THREADS     16U
+#define REPEAT          20U
+#define PIECE           512U        /* flashword hashes per manifest packet */
+
+typedef struct{
+    Flash_Manifest_Header_t header;
+    uint8_t *image;                 /* padded to whole sectors */
+    uint32_t sector_hash[FLASH_MANIFEST_MAX_SECTORS];
+    uint32_t *fw_hash;
+}Manifest_t;
+
+typedef struct{
+    const Manifest_t *old;
+    Manifest_t *new;
+    uint32_t first;                 /* sectors [first, last) */
+    uint32_t last;
+    uint32_t changed;               /* flashwords that differ from old */
+}Worker_t;
+
+typedef struct{
+    uint32_t down;                  /* bytes to the target */
+    uint32_t up;                    /* bytes back to the host */
+    uint32_t sent;                  /* flashwords transferred */
+    uint32_t dirty;
+    uint32_t erased;
+    uint64_t ns;                    /* emulated flash time */
+}Run_t;
+
+static Manifest_t Old;
+static Manifest_t New;
+static uint32_t Save[FLASH_GEO_SECTOR_SIZE / 4U];
+
+static double Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec * 1e-9);
+}
+
+static void Load(Manifest_t *m, const uint8_t *data, uint32_t size, uint32_t base)
+{
+    m->header.magic = FLASH_MANIFEST_MAGIC;
+    m->header.base = base;
+    m->header.size = size;
+    m->header.sectors = (size + FLASH_GEO_SECTOR_SIZE - 1U) >> FLASH_GEO_SECTOR_SHIFT;
+    m->image = malloc(m->header.sectors << FLASH_GEO_SECTOR_SHIFT);
+    m->fw_hash = malloc((m->header.sectors * FLASH_GEO_WORDS_PER_SECTOR) * 4U);
+    memset(m->image, 0xFF, m->header.sectors << FLASH_GEO_SECTOR_SHIFT);
+    memcpy(m->image, data, size);
+    m->header.crc = Flash_Stream_Crc(0, m->image, m->header.sectors << FLASH_GEO_SECTOR_SHIFT);
+}
+
+/* Hashes its sectors of new and, if old is given, counts the flashwords
+   that differ in sectors present in both */
+static void *Work(void *arg)
+{
+    Worker_t *w = (Worker_t *)arg;
+    uint32_t sector;
+    uint32_t fw;
+    uint32_t index;
+
+    w->changed = 0;
+    for(sector = w->first; sector < w->last; sector++){
+        for(fw = 0; fw < FLASH_GEO_WORDS_PER_SECTOR; fw++){
+            index = (sector * FLASH_GEO_WORDS_PER_SECTOR) + fw;
+            w->new->fw_hash[index] = Flash_Manifest_Hash((const uint32_t *)(w->new->image + ((size_t)index << FLASH_GEO_FLASHWORD_SHIFT)));
+            if((w->old != NULL) && (sector < w->old->header.sectors) && (w->old->fw_hash[index] != w->new->fw_hash[index])){
+                w->changed++;
+            }
+        }
+        w->new->sector_hash[sector] = Flash_Manifest_SectorHash(&w->new->fw_hash[sector * FLASH_GEO_WORDS_PER_SECTOR]);
+    }
+    return NULL;
+}
+
+/* Returns the flashwords that differ from old */
+static uint32_t Pack(const Manifest_t *old, Manifest_t *new, uint32_t threads)
+{
+    pthread_t thread[MAX_THREADS];
+    Worker_t worker[MAX_THREADS];
+    uint32_t sectors = new->header.sectors;
+    uint32_t changed = 0;
+    uint32_t index;
+
+    if(threads > sectors){
+        threads = sectors;
+    }
+    for(index = 0; index < threads; index++){
+        worker[index].old = old;
+        worker[index].new = new;
+        worker[index].first = (sectors * index) / threads;
+        worker[index].last = (sectors * (index + 1U)) / threads;
+        pthread_create(&thread[index], NULL, Work, &worker[index]);
+    }
+    for(index = 0; index < threads; index++){
+        pthread_join(thread[index], NULL);
+        changed += worker[index].changed;
+    }
+    return changed;
+}
+
+static uint32_t Host_Erase(uint32_t FlashAddress)
+{
+    return Flash_Emu_Erase(FLASH_GEO_BANK(FlashAddress), FLASH_GEO_SECTOR(FlashAddress), 1);
+}
+
+static uint32_t Host_Program(uint32_t FlashAddress, const uint32_t *src, uint32_t NbOfFlashWords)
+{
+    Flash_Emu_Session();
+    return Flash_Emu_Program(FlashAddress, src, NbOfFlashWords);
+}
+
+static const Flash_Stream_Backend_t Host_Backend =
+{
+    Host_Erase, Host_Program, Flash_Emu_Read
+};
+
+static uint32_t Is_Blank(const uint8_t *fw)
+{
+    uint32_t index;
+
+    for(index = 0; (index < FLASH_GEO_FLASHWORD_SIZE) && (fw[index] == 0xFFU); index++){
+    }
+    return (index == FLASH_GEO_FLASHWORD_SIZE) ? 1U : 0U;
+}
+
+/* Target side: old image in flash, new manifest arriving. With Torn set,
+   a programmed flashword in a sector the update leaves alone is made
+   unreadable, as a reset during an earlier update would: the update must
+   take that sector in and repair it. */
+static uint32_t Apply(uint32_t base, uint32_t *save, uint32_t Torn, Run_t *run)
+{
+    static Flash_Manifest_Sector_t sector;
+    uint32_t dirty;
+    uint32_t piece;
+    uint32_t fw;
+    uint32_t s;
+
+    for(s = 0; (Torn != 0U) && (s < New.header.sectors) && (Old.sector_hash[s] != New.sector_hash[s]); s++){
+    }
+    Torn = (Torn != 0U) ? (s * FLASH_GEO_WORDS_PER_SECTOR) : 0xFFFFFFFFU;
+    Flash_Emu_Init();
+    for(fw = 0; fw < (Old.header.sectors * FLASH_GEO_WORDS_PER_SECTOR); fw++){
+        if(Is_Blank(Old.image + (fw << FLASH_GEO_FLASHWORD_SHIFT)) == 0U){
+            Flash_Emu_Program(base + (fw << FLASH_GEO_FLASHWORD_SHIFT), Old.image + (fw << FLASH_GEO_FLASHWORD_SHIFT), 1);
+            if(fw >= Torn){
+                Flash_Emu_FlipBit(base + (fw << FLASH_GEO_FLASHWORD_SHIFT), 3);
+                Flash_Emu_FlipBit(base + (fw << FLASH_GEO_FLASHWORD_SHIFT), 100);
+                Torn = 0xFFFFFFFFU;
+            }
+        }
+    }
+    Flash_Emu_Stats.now_ns = 0;
+    Flash_Emu_Stats.erases = 0;
+
+    memset(run, 0, sizeof(*run));
+    run->down = sizeof(New.header) + (New.header.sectors * 4U);
+    run->up = 4U;
+    if(Flash_Manifest_Changed(&Host_Backend, &New.header, New.sector_hash, &dirty) != FLASH_OK){
+        return FLASH_ERROR;
+    }
+    for(s = 0; s < New.header.sectors; s++){
+        if((dirty & (1UL << s)) == 0U){
+            continue;
+        }
+        run->dirty++;
+        Flash_Manifest_Begin(&sector, base + (s << FLASH_GEO_SECTOR_SHIFT));
+        for(piece = 0; piece < FLASH_GEO_WORDS_PER_SECTOR; piece += PIECE){
+            Flash_Manifest_Compare(&Host_Backend, &sector, piece, &New.fw_hash[(s * FLASH_GEO_WORDS_PER_SECTOR) + piece], PIECE);
+        }
+        run->down += FLASH_GEO_WORDS_PER_SECTOR * 4U;
+        if(Flash_Manifest_Prepare(&Host_Backend, &sector, save) != FLASH_OK){
+            return FLASH_ERROR;
+        }
+        /* The request bitmap goes back, the flashwords come in its order */
+        run->up += sizeof(sector.request);
+        run->sent += sector.requested;
+        for(fw = Flash_Manifest_Next(&sector, 0); fw < FLASH_GEO_WORDS_PER_SECTOR; fw = Flash_Manifest_Next(&sector, fw + 1U)){
+            if(Flash_Manifest_Write(&Host_Backend, &sector, fw,
+                                    (const uint32_t *)(New.image + ((size_t)((s * FLASH_GEO_WORDS_PER_SECTOR) + fw) << FLASH_GEO_FLASHWORD_SHIFT))) != FLASH_OK){
+                return FLASH_ERROR;
+            }
+        }
+    }
+    run->down += run->sent * FLASH_GEO_FLASHWORD_SIZE;
+    run->erased = Flash_Emu_Stats.erases;
+    run->ns = Flash_Emu_Stats.now_ns;
+    if((Flash_Manifest_Finish(&Host_Backend, &New.header) != FLASH_OK) ||
+       (memcmp(Flash_Emu_Memory(base), New.image, New.header.sectors << FLASH_GEO_SECTOR_SHIFT) != 0)){
+        return FLASH_ERROR;
+    }
+    return FLASH_OK;
+}
+
+static uint8_t *Read_File(const char *path, uint32_t *size)
+{
+    uint8_t *data = malloc(FLASH_GEO_TOTAL_SIZE);
+    FILE *f = fopen(path, "rb");
+
+    if(f == NULL){
+        perror(path);
+        exit(1);
+    }
+    *size = (uint32_t)fread(data, 1, FLASH_GEO_TOTAL_SIZE, f);
+    fclose(f);
+    return data;
+}
+
+static void Write_File(const char *path, const void *a, size_t a_len, const void *b, size_t b_len, const void *c, size_t c_len)
+{
+    FILE *f = fopen(path, "wb");
+
+    if((f == NULL) || (fwrite(a, 1, a_len, f) != a_len) || (fwrite(b, 1, b_len, f) != b_len) ||
+       (fwrite(c, 1, c_len, f) != c_len)){
+        perror(path);
+        exit(1);
+    }
+    fclose(f);
+}
+
+static void Synthetic(uint8_t **old, uint32_t *old_size, uint8_t **new, uint32_t *new_size)
+{
+    static const uint32_t patch_at[] = { 0x01234U, 0x2F0A8U, 0x61C40U, 0x9E004U, 0x123450U, 0x1D72C0U };
+    uint32_t size = 2000U * 1024U;
+    uint32_t append = 5U * 1024U;
+    uint32_t word;
+    uint32_t i;
+    uint32_t j;
+
+    *old = malloc(size);
+    *new = malloc(size + append);
+    srand(11);
+    /* Instruction-like bytes with a literal pool word every 64 bytes */
+    for(i = 0; i < size; i += 4U){
+        word = ((i % 64U) == 60U) ? (FLASH_BANK1_BASE + ((uint32_t)rand() % size)) : ((uint32_t)rand() & 0x0F0FFFFFU);
+        memcpy(*old + i, &word, 4);
+    }
+    memcpy(*new, *old, size);
+    /* Functions edited in place */
+    for(i = 0; i < (sizeof(patch_at) / sizeof(patch_at[0])); i++){
+        for(j = 0; j < (100U + (i * 100U)); j++){
+            (*new)[patch_at[i] + j] = (uint8_t)rand();
+        }
+    }
+    /* A 4 Kbytes calibration table rewritten */
+    for(j = 0; j < 4096U; j++){
+        (*new)[0xC0000U + j] = (uint8_t)rand();
+    }
+    /* Data appended into the erased space */
+    for(j = 0; j < append; j++){
+        (*new)[size + j] = (uint8_t)rand();
+    }
+    *old_size = size;
+    *new_size = size + append;
+}
+
+int main(int argc, char **argv)
+{
+    Run_t run[2];
+    Run_t torn;
+    uint32_t threads = (uint32_t)sysconf(_SC_NPROCESSORS_ONLN);
+    uint32_t base = FLASH_BANK2_BASE;
+    uint8_t *old_data;
+    uint8_t *new_data;
+    uint32_t old_size;
+    uint32_t new_size;
+    uint32_t changed = 0;
+    uint32_t index;
+    uint32_t fw;
+    uint32_t repeat;
+    uint32_t fws = 0;
+    uint64_t full_ns;
+    double best[2];
+    double t0;
+    int arg = 1;
+
+    while((arg < argc) && (argv[arg][0] == '-') && ((arg + 1) < argc)){
+        if(strcmp(argv[arg], "-t") == 0){
+            threads = (uint32_t)strtoul(argv[arg + 1], NULL, 0);
+        }else if(strcmp(argv[arg], "-b") == 0){
+            base = (uint32_t)strtoul(argv[arg + 1], NULL, 0);
+        }
+        arg += 2;
+    }
+    threads = (threads == 0U) ? 1U : ((threads > MAX_THREADS) ? MAX_THREADS : threads);
+
+    if((argc - arg) >= 2){
+        old_data = Read_File(argv[arg], &old_size);
+        new_data = Read_File(argv[arg + 1], &new_size);
+    }else{
+        Synthetic(&old_data, &old_size, &new_data, &new_size);
+        base = FLASH_BANK1_BASE;
+    }
+    Load(&Old, old_data, old_size, base);
+    Load(&New, new_data, new_size, base);
+    if((Flash_Manifest_Check(&Old.header) != FLASH_OK) || (Flash_Manifest_Check(&New.header) != FLASH_OK)){
+        printf("image does not fit in flash from 0x%08X\n", base);
+        return 1;
+    }
+    Pack(NULL, &Old, threads);
+
+    /* Hash the new image and diff it against the old manifest */
+    for(index = 0; index < 2U; index++){
+        best[index] = 1e9;
+        for(repeat = 0; repeat < REPEAT; repeat++){
+            t0 = Now();
+            changed = Pack(&Old, &New, (index == 0U) ? 1U : threads);
+            if((Now() - t0) < best[index]){
+                best[index] = Now() - t0;
+            }
+        }
+    }
+    if((argc - arg) >= 4){
+        Write_File(argv[arg + 2], New.image, New.header.sectors << FLASH_GEO_SECTOR_SHIFT, NULL, 0, NULL, 0);
+        Write_File(argv[arg + 3], &New.header, sizeof(New.header), New.sector_hash, New.header.sectors * 4U,
+                   New.fw_hash, (New.header.sectors * FLASH_GEO_WORDS_PER_SECTOR) * 4U);
+    }
+
+    for(index = 0; index < 2U; index++){
+        if(Apply(base, (index == 0U) ? NULL : Save, 0, &run[index]) != FLASH_OK){
+            printf("incremental flash FAILED\n");
+            return 1;
+        }
+    }
+    if(Apply(base, Save, 1, &torn) != FLASH_OK){
+        printf("incremental flash over a torn flashword FAILED\n");
+        return 1;
+    }
+
+    for(fw = 0; fw < (New.header.sectors * FLASH_GEO_WORDS_PER_SECTOR); fw++){
+        fws += (Is_Blank(New.image + (fw << FLASH_GEO_FLASHWORD_SHIFT)) == 0U) ? 1U : 0U;
+    }
+    full_ns = ((uint64_t)New.header.sectors * Flash_Emu_Timing.erase_ns) +
+              ((uint64_t)fws * (Flash_Emu_Timing.program_ns + Flash_Emu_Timing.session_ns));
+
+    printf("image %u bytes at 0x%08X, %u sectors, %u flashwords changed\n", new_size, base, New.header.sectors, changed);
+    printf("hash + diff     %.2f ms on 1 thread, %.2f ms on %u thread(s)\n", best[0] * 1e3, best[1] * 1e3, threads);
+    printf("manifest        %u bytes (sector level %u bytes)\n",
+           (uint32_t)(sizeof(New.header) + (New.header.sectors * 4U) + (New.header.sectors * FLASH_GEO_WORDS_PER_SECTOR * 4U)),
+           (uint32_t)(sizeof(New.header) + (New.header.sectors * 4U)));
+    for(index = 0; index < 2U; index++){
+        printf("%-15s %u bytes to the target (%u flashwords, %.1f%% of the image), %u bytes back\n",
+               (index == 0U) ? "transfer" : "  sector saved", run[index].down, run[index].sent,
+               (100.0 * run[index].down) / new_size, run[index].up);
+    }
+    printf("flash           %u sectors dirty, %u erased\n", run[0].dirty, run[0].erased);
+    printf("flash time      incremental %.1f ms, %.1f ms with the sector saved (hashing reads included), full image %.1f ms\n",
+           run[0].ns / 1e6, run[1].ns / 1e6, full_ns / 1e6);
+    printf("torn flashword  repaired, %u sectors dirty instead of %u\n", torn.dirty, run[1].dirty);
+    printf("new image verified\n");
+    return 0;
+}
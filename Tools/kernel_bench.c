@@ -0,0 +1,167 @@
+/**
+  ******************************************************************************
+  * @file    kernel_bench.c
+  * @brief   Host check of the compare and pattern check kernels in
+             Core/Src/flash_kernel.c (C burst fallback) against byte loops
+             over random alignments, lengths and mismatch positions, then
+             throughput of byte loop, word loop and kernel. Cycle counts on
+             target come from Flash_Kernel_Benchmark (FLASH_KERNEL_BENCHMARK).
+
+             gcc -O2 -DHOST_BUILD -ICore/Inc -ITools Tools/kernel_bench.c \
+                 Core/Src/flash_kernel.c -o kernel_bench
+             ./kernel_bench [trials]
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "flash_kernel.h"
+
+#define AREA_SIZE       (128U * 1024U)      /* one sector */
+#define PASSES          200U
+
+static uint32_t Flash[(AREA_SIZE / 4U) + 16U];
+static uint32_t Copy[(AREA_SIZE / 4U) + 16U];
+
+static uint32_t NaiveCompare(const uint8_t *a, const uint8_t *b, uint32_t Length)
+{
+    uint32_t index;
+
+    for(index = 0; (index < Length) && (a[index] == b[index]); index++){
+    }
+    return index;
+}
+
+static uint32_t NaiveCheck(const uint8_t *a, uint32_t Length, uint32_t Pattern)
+{
+    uint32_t index;
+
+    for(index = 0; (index < Length) && (a[index] == (uint8_t)(Pattern >> ((((uintptr_t)a + index) & 3U) * 8U))); index++){
+    }
+    return index;
+}
+
+static uint32_t WordCompare(const volatile uint32_t *a, const uint32_t *b, uint32_t Length)
+{
+    uint32_t index;
+
+    for(index = 0; (index < (Length / 4U)) && (a[index] == b[index]); index++){
+    }
+    return index * 4U;
+}
+
+static uint32_t WordCheck(const volatile uint32_t *a, uint32_t Length, uint32_t Pattern)
+{
+    uint32_t index;
+
+    for(index = 0; (index < (Length / 4U)) && (a[index] == Pattern); index++){
+    }
+    return index * 4U;
+}
+
+static double Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + ((double)ts.tv_nsec * 1e-9);
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t trials = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 200000U;
+    uint8_t *flash = (uint8_t *)Flash;
+    uint8_t *copy = (uint8_t *)Copy;
+    volatile uint32_t sink = 0;
+    uint32_t failures = 0;
+    uint32_t trial;
+    uint32_t pass;
+    uint32_t pattern;
+    uint32_t start;
+    uint32_t shift;
+    uint32_t length;
+    uint32_t index;
+    double t0;
+    double naive;
+    double word;
+    double kernel;
+
+    srand(1);
+    for(trial = 0; trial < trials; trial++){
+        /* Random window, data side at an independent alignment */
+        pattern = (rand() & 1) ? 0xFFFFFFFFU : (uint32_t)rand() * 2654435761U;
+        for(index = 0; index < (sizeof(Flash) / 4U); index++){
+            Flash[index] = pattern;
+        }
+        start = (uint32_t)rand() % 64U;
+        shift = (uint32_t)rand() % 8U;
+        length = (uint32_t)rand() % ((rand() & 1) ? 100U : 4000U);
+        memcpy(copy + shift, flash + start, length);
+        if((length != 0U) && (rand() & 1)){
+            index = (uint32_t)rand() % length;
+            flash[start + index] ^= (uint8_t)(1U << (rand() % 8));
+        }
+        if((Flash_Kernel_Compare(flash + start, copy + shift, length) != NaiveCompare(flash + start, copy + shift, length)) ||
+           (Flash_Kernel_Check(flash + start, length, pattern) != NaiveCheck(flash + start, length, pattern))){
+            if(failures++ < 5U){
+                printf("MISMATCH start %u shift %u length %u\n", start, shift, length);
+            }
+        }
+    }
+    printf("%u random windows, %u mismatches\n", trials, failures);
+
+    /* Throughput over a matching sector, so nothing exits early */
+    memset(Flash, 0xFF, sizeof(Flash));
+    memset(Copy, 0xFF, sizeof(Copy));
+    printf("%-14s %12s %12s %12s\n", "bytes/ns", "byte loop", "word loop", "kernel");
+
+    t0 = Now();
+    for(pass = 0; pass < PASSES; pass++){
+        sink += NaiveCheck(flash, AREA_SIZE, 0xFFFFFFFFU);
+    }
+    naive = Now() - t0;
+    t0 = Now();
+    for(pass = 0; pass < PASSES; pass++){
+        sink += WordCheck(Flash, AREA_SIZE, 0xFFFFFFFFU);
+    }
+    word = Now() - t0;
+    t0 = Now();
+    for(pass = 0; pass < PASSES; pass++){
+        sink += Flash_Kernel_IsBlank(flash, AREA_SIZE);
+    }
+    kernel = Now() - t0;
+    printf("%-14s %12.2f %12.2f %12.2f\n", "blank check", (AREA_SIZE * (double)PASSES) / (naive * 1e9),
+           (AREA_SIZE * (double)PASSES) / (word * 1e9), (AREA_SIZE * (double)PASSES) / (kernel * 1e9));
+
+    t0 = Now();
+    for(pass = 0; pass < PASSES; pass++){
+        sink += NaiveCompare(flash, copy, AREA_SIZE);
+    }
+    naive = Now() - t0;
+    t0 = Now();
+    for(pass = 0; pass < PASSES; pass++){
+        sink += WordCompare(Flash, (const uint32_t *)Copy, AREA_SIZE);
+    }
+    word = Now() - t0;
+    t0 = Now();
+    for(pass = 0; pass < PASSES; pass++){
+        sink += Flash_Kernel_Compare(flash, copy, AREA_SIZE);
+    }
+    kernel = Now() - t0;
+    printf("%-14s %12.2f %12.2f %12.2f\n", "compare", (AREA_SIZE * (double)PASSES) / (naive * 1e9),
+           (AREA_SIZE * (double)PASSES) / (word * 1e9), (AREA_SIZE * (double)PASSES) / (kernel * 1e9));
+    (void)sink;
+    return (failures != 0U) ? 1 : 0;
+}
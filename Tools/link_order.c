@@ -0,0 +1,635 @@
+/**
+  ******************************************************************************
+  * @file    link_order.c
+  * @brief   Host tool for profile-guided code layout. The CM4 fetches its
+             code from bank2 through the ART accelerator, and the linker
+             script otherwise places functions in link order, so a hot loop
+             shares its cache lines with cold code and the hot set needs far
+             more lines than its size. From a symbol table and a profile this
+             picks the hot functions, chains the ones that run one after the
+             other (Pettis-Hansen on transitions between functions), orders
+             the chains by samples per byte and writes the list as
+             *(.text.<name>) lines between the HOT_TEXT markers of the linker
+             scripts. With addresses in execution order it replays the fetch
+             stream through an LRU model of the ART for the link order and
+             for the new order and reports the stall cycles saved.
+
+             gcc -O2 Tools/link_order.c -o link_order
+             ./link_order [-n lines] [-l line bytes] [-p miss cycles] [-c coverage %]
+                          [-k function]... [-w script.ld]... [symbols.txt profile.txt]
+
+             symbols.txt: arm-none-eabi-nm -S -n --defined-only CM4.elf
+             profile.txt, one entry per line, any mix of:
+               0x0810abcd           an address: DWT_PCSR read by the
+                                    debugger (OpenOCD: mdw 0xE000101C), the
+                                    SysTick sampler, or a decoded ETM trace
+               Trace ...[x/0810abcd/...]  QEMU -d exec,nochain
+               name count           a weight from any other profiler
+             Addresses in execution order give an exact fetch stream; sparse
+             PC samples give weights, and the stall figure from them is only
+             an estimate. Needs -ffunction-sections (the CubeIDE default).
+             -k adds a function to the hot set whatever its samples
+             (FLASH_IRQHandler, the flash wait loops). Without files, a
+             synthetic image and trace are used.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#define MAX_FUNCTIONS   8192U
+#define MAX_KEEP        64U
+#define MAX_SCRIPTS     4U
+#define NAME_SIZE       96U
+#define FUNC_ALIGN      4U
+#define NONE            0xFFFFFFFFU
+
+#define MARK_BEGIN      "/* HOT_TEXT_BEGIN"
+#define MARK_END        "/* HOT_TEXT_END"
+
+typedef struct{
+    char name[NAME_SIZE];
+    uint32_t address;
+    uint32_t size;
+    uint32_t moved;         /* address in the profiled order */
+    uint64_t weight;
+    uint32_t hot;
+    uint32_t chain;         /* first function of its chain */
+    uint32_t next;          /* following function in the chain */
+    uint32_t tail;          /* valid for the chain head */
+}Function_t;
+
+typedef struct{
+    uint64_t key;           /* (a << 32) | b, a < b */
+    uint64_t count;
+}Edge_t;
+
+static Function_t Functions[MAX_FUNCTIONS];
+static uint32_t NbOfFunctions;
+static uint32_t *Trace;                 /* addresses in execution order */
+static uint32_t TraceLength;
+static uint32_t TraceSize;
+static uint32_t Order[MAX_FUNCTIONS];   /* hot functions, final order */
+static uint32_t NbOfHot;
+
+static uint32_t LineCount = 64U;
+static uint32_t LineSize = 32U;
+static uint32_t MissCycles = 7U;
+static double Coverage = 99.0;
+
+static void Add_Trace(uint32_t Address)
+{
+    if(TraceLength == TraceSize){
+        TraceSize = (TraceSize == 0U) ? 65536U : (TraceSize * 2U);
+        Trace = realloc(Trace, TraceSize * sizeof(uint32_t));
+        if(Trace == NULL){
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    Trace[TraceLength++] = Address;
+}
+
+static int By_Address(const void *a, const void *b)
+{
+    const Function_t *fa = (const Function_t *)a;
+    const Function_t *fb = (const Function_t *)b;
+
+    return (fa->address > fb->address) - (fa->address < fb->address);
+}
+
+static uint32_t Find_Function(uint32_t Address)
+{
+    uint32_t low = 0;
+    uint32_t high = NbOfFunctions;
+    uint32_t mid;
+
+    while(low < high){
+        mid = (low + high) / 2U;
+        if(Address < Functions[mid].address){
+            high = mid;
+        }else if(Address >= (Functions[mid].address + Functions[mid].size)){
+            low = mid + 1U;
+        }else{
+            return mid;
+        }
+    }
+    return NONE;
+}
+
+static uint32_t Find_Name(const char *name)
+{
+    uint32_t index;
+
+    for(index = 0; index < NbOfFunctions; index++){
+        if(strcmp(Functions[index].name, name) == 0){
+            return index;
+        }
+    }
+    return NONE;
+}
+
+/* nm -S -n: "08100298 0000004c T main" */
+static void Read_Symbols(const char *path)
+{
+    char line[256];
+    char name[NAME_SIZE];
+    char type;
+    unsigned int address;
+    unsigned int size;
+    FILE *file = fopen(path, "r");
+
+    if(file == NULL){
+        perror(path);
+        exit(1);
+    }
+    while(fgets(line, sizeof(line), file) != NULL){
+        if((sscanf(line, "%x %x %c %95s", &address, &size, &type, name) != 4) || (size == 0U) ||
+           ((type != 't') && (type != 'T') && (type != 'w') && (type != 'W'))){
+            continue;
+        }
+        if(NbOfFunctions == MAX_FUNCTIONS){
+            fprintf(stderr, "more than %u functions\n", MAX_FUNCTIONS);
+            exit(1);
+        }
+        /* Thumb symbols carry bit 0 */
+        Functions[NbOfFunctions].address = address & ~1U;
+        Functions[NbOfFunctions].size = size;
+        strcpy(Functions[NbOfFunctions].name, name);
+        NbOfFunctions++;
+    }
+    fclose(file);
+    qsort(Functions, NbOfFunctions, sizeof(Function_t), By_Address);
+}
+
+static void Read_Profile(const char *path)
+{
+    char line[512];
+    char name[NAME_SIZE];
+    unsigned long long count;
+    const char *field;
+    uint32_t index;
+    FILE *file = fopen(path, "r");
+
+    if(file == NULL){
+        perror(path);
+        exit(1);
+    }
+    while(fgets(line, sizeof(line), file) != NULL){
+        field = strchr(line, '[');
+        if((field != NULL) && ((field = strchr(field, '/')) != NULL)){
+            Add_Trace((uint32_t)strtoul(field + 1, NULL, 16));
+        }else if((line[0] == '0') && ((line[1] == 'x') || (line[1] == 'X'))){
+            Add_Trace((uint32_t)strtoul(line, NULL, 16));
+        }else if(sscanf(line, "%95s %llu", name, &count) == 2){
+            index = Find_Name(name);
+            if(index != NONE){
+                Functions[index].weight += count;
+            }
+        }
+    }
+    fclose(file);
+}
+
+/* A made-up image: 600 functions in link order, a hot set of 36 small
+   ones spread through it, a main loop walking the hot set with the flash
+   interrupt and the tick interrupt breaking in, and now and then a cold
+   call. Packed, the hot set fits the ART; scattered, each small function
+   drags one or two lines of cold neighbours in with it and it does not. */
+static void Synthetic(void)
+{
+    static const char *const named[] =
+    {
+        "FLASH_IRQHandler", "Flash_Safe_EccIrq", "SysTick_Handler", "HAL_IncTick", "HAL_GetTick",
+        "Flash_Batch_Word", "Flash_Batch_Program", "Flash_Stream_Process", "Flash_Stream_Write",
+        "Flash_Kernel_Compare", "Flash_Sha_Update", "main"
+    };
+    uint32_t hot[36];
+    uint32_t address = 0x08100298U;
+    uint32_t index;
+    uint32_t step;
+    uint32_t function;
+    uint32_t offset;
+    uint32_t pass;
+    uint32_t current = 0;
+
+    srand(1);
+    NbOfFunctions = 600U;
+    for(index = 0; index < NbOfFunctions; index++){
+        Functions[index].size = 24U + (((uint32_t)rand() % 200U) * 4U);
+        sprintf(Functions[index].name, "f%03u", index);
+    }
+    for(index = 0; index < 36U; index++){
+        hot[index] = ((index * 599U) / 35U + ((uint32_t)rand() % 7U)) % NbOfFunctions;
+        Functions[hot[index]].size = 16U + (((uint32_t)rand() % 20U) * 4U);
+        if(index < (sizeof(named) / sizeof(named[0]))){
+            strcpy(Functions[hot[index]].name, named[index]);
+        }
+    }
+    for(index = 0; index < NbOfFunctions; index++){
+        Functions[index].address = address;
+        address += Functions[index].size;
+    }
+    for(step = 0; step < 200000U; step++){
+        if((step % 97U) == 0U){
+            function = hot[(step % 2U)];            /* flash interrupt, then its handler */
+        }else if((step % 250U) == 1U){
+            function = hot[2U + (step % 2U)];       /* tick */
+        }else if(((uint32_t)rand() % 200U) == 0U){
+            /* a few instructions of something cold */
+            function = (uint32_t)rand() % NbOfFunctions;
+            for(offset = 0; offset < 32U; offset += 8U){
+                Add_Trace(Functions[function].address + offset);
+            }
+            continue;
+        }else{
+            current = (current + 1U + ((uint32_t)rand() % 3U)) % 32U;
+            function = hot[4U + current];
+        }
+        /* A short loop in the body */
+        for(pass = 0; pass < 3U; pass++){
+            for(offset = 0; offset < Functions[function].size; offset += 8U){
+                Add_Trace(Functions[function].address + offset);
+            }
+        }
+    }
+}
+
+static int By_Count(const void *a, const void *b)
+{
+    const Edge_t *ea = (const Edge_t *)a;
+    const Edge_t *eb = (const Edge_t *)b;
+
+    return (ea->count < eb->count) - (ea->count > eb->count);
+}
+
+static int By_Key(const void *a, const void *b)
+{
+    const Edge_t *ea = (const Edge_t *)a;
+    const Edge_t *eb = (const Edge_t *)b;
+
+    return (ea->key > eb->key) - (ea->key < eb->key);
+}
+
+static int By_Weight(const void *a, const void *b)
+{
+    const Function_t *fa = &Functions[*(const uint32_t *)a];
+    const Function_t *fb = &Functions[*(const uint32_t *)b];
+
+    return (fa->weight < fb->weight) - (fa->weight > fb->weight);
+}
+
+/* Chain score: samples per byte */
+static double Density(uint32_t Head)
+{
+    uint64_t weight = 0;
+    uint64_t size = 0;
+    uint32_t index;
+
+    for(index = Head; index != NONE; index = Functions[index].next){
+        weight += Functions[index].weight;
+        size += Functions[index].size;
+    }
+    return (double)weight / (double)size;
+}
+
+static int By_Density(const void *a, const void *b)
+{
+    double da = Density(*(const uint32_t *)a);
+    double db = Density(*(const uint32_t *)b);
+
+    return (da < db) - (da > db);
+}
+
+static void Layout(char Keep[][NAME_SIZE], uint32_t NbOfKeep)
+{
+    static uint32_t candidates[MAX_FUNCTIONS];
+    static uint32_t heads[MAX_FUNCTIONS];
+    Edge_t *edges;
+    uint64_t total = 0;
+    uint64_t covered = 0;
+    uint32_t nb_edges = 0;
+    uint32_t nb_candidates = 0;
+    uint32_t nb_heads = 0;
+    uint32_t index;
+    uint32_t from;
+    uint32_t to;
+    uint32_t previous = NONE;
+    uint32_t function;
+    uint32_t a;
+    uint32_t b;
+    uint32_t address;
+
+    /* Samples per function and transitions between functions */
+    edges = calloc((TraceLength != 0U) ? TraceLength : 1U, sizeof(Edge_t));
+    for(index = 0; index < TraceLength; index++){
+        function = Find_Function(Trace[index]);
+        if(function == NONE){
+            continue;
+        }
+        Functions[function].weight++;
+        if((previous != NONE) && (previous != function)){
+            a = (previous < function) ? previous : function;
+            b = (previous < function) ? function : previous;
+            edges[nb_edges].key = ((uint64_t)a << 32) | b;
+            edges[nb_edges].count = 1;
+            nb_edges++;
+        }
+        previous = function;
+    }
+    qsort(edges, nb_edges, sizeof(Edge_t), By_Key);
+    for(from = 0, to = 0; from < nb_edges; from++){
+        if((to != 0U) && (edges[to - 1U].key == edges[from].key)){
+            edges[to - 1U].count++;
+        }else{
+            edges[to++] = edges[from];
+        }
+    }
+    nb_edges = to;
+    qsort(edges, nb_edges, sizeof(Edge_t), By_Count);
+
+    /* Hot set: the heaviest functions up to the coverage, plus -k */
+    for(index = 0; index < NbOfFunctions; index++){
+        total += Functions[index].weight;
+        Functions[index].chain = index;
+        Functions[index].next = NONE;
+        Functions[index].tail = index;
+        if(Functions[index].weight != 0U){
+            candidates[nb_candidates++] = index;
+        }
+    }
+    qsort(candidates, nb_candidates, sizeof(uint32_t), By_Weight);
+    for(index = 0; (index < nb_candidates) && ((double)covered < ((double)total * Coverage / 100.0)); index++){
+        Functions[candidates[index]].hot = 1;
+        covered += Functions[candidates[index]].weight;
+    }
+    for(index = 0; index < NbOfKeep; index++){
+        function = Find_Name(Keep[index]);
+        if(function == NONE){
+            fprintf(stderr, "-k %s: no such function\n", Keep[index]);
+            continue;
+        }
+        Functions[function].hot = 1;
+    }
+
+    /* Pettis-Hansen: join the chains at the ends of the heaviest edges */
+    for(index = 0; index < nb_edges; index++){
+        a = Functions[(uint32_t)(edges[index].key >> 32)].chain;
+        b = Functions[(uint32_t)edges[index].key].chain;
+        if(!Functions[a].hot || !Functions[b].hot || (a == b)){
+            continue;
+        }
+        Functions[Functions[a].tail].next = b;
+        Functions[a].tail = Functions[b].tail;
+        for(function = b; function != NONE; function = Functions[function].next){
+            Functions[function].chain = a;
+        }
+    }
+    free(edges);
+
+    for(index = 0; index < NbOfFunctions; index++){
+        if(Functions[index].hot && (Functions[index].chain == index)){
+            heads[nb_heads++] = index;
+        }
+    }
+    qsort(heads, nb_heads, sizeof(uint32_t), By_Density);
+    NbOfHot = 0;
+    for(index = 0; index < nb_heads; index++){
+        for(function = heads[index]; function != NONE; function = Functions[function].next){
+            Order[NbOfHot++] = function;
+        }
+    }
+
+    /* Hot block first, line aligned, then everything else in link order */
+    address = (NbOfFunctions != 0U) ? ((Functions[0].address + LineSize - 1U) & ~(LineSize - 1U)) : 0U;
+    for(index = 0; index < NbOfHot; index++){
+        Functions[Order[index]].moved = address;
+        address = (address + Functions[Order[index]].size + FUNC_ALIGN - 1U) & ~(FUNC_ALIGN - 1U);
+    }
+    for(index = 0; index < NbOfFunctions; index++){
+        if(!Functions[index].hot){
+            Functions[index].moved = address;
+            address = (address + Functions[index].size + FUNC_ALIGN - 1U) & ~(FUNC_ALIGN - 1U);
+        }
+    }
+}
+
+/* Fully associative LRU cache of LineCount lines; returns the misses */
+static uint64_t Replay(uint32_t Moved, uint64_t *Fetches)
+{
+    static uint32_t tag[1024];
+    static uint64_t used[1024];
+    uint64_t misses = 0;
+    uint64_t clock = 0;
+    uint32_t line;
+    uint32_t address;
+    uint32_t function;
+    uint32_t index;
+    uint32_t oldest;
+    uint32_t slot;
+
+    memset(tag, 0xFF, sizeof(tag));
+    memset(used, 0, sizeof(used));
+    *Fetches = 0;
+    for(index = 0; index < TraceLength; index++){
+        address = Trace[index];
+        function = Find_Function(address);
+        if(Moved && (function != NONE)){
+            address = Functions[function].moved + (address - Functions[function].address);
+        }
+        line = address / LineSize;
+        (*Fetches)++;
+        clock++;
+        oldest = 0;
+        for(slot = 0; slot < LineCount; slot++){
+            if(tag[slot] == line){
+                break;
+            }
+            if(used[slot] < used[oldest]){
+                oldest = slot;
+            }
+        }
+        if(slot == LineCount){
+            misses++;
+            slot = oldest;
+            tag[slot] = line;
+        }
+        used[slot] = clock;
+    }
+    return misses;
+}
+
+/* Lines the hot set spans in a layout */
+static uint32_t Lines(uint32_t Moved)
+{
+    static uint8_t seen[1U << 16];
+    uint32_t lines = 0;
+    uint32_t index;
+    uint32_t line;
+    uint32_t start;
+    uint32_t end;
+
+    memset(seen, 0, sizeof(seen));
+    for(index = 0; index < NbOfFunctions; index++){
+        if(!Functions[index].hot){
+            continue;
+        }
+        start = Moved ? Functions[index].moved : Functions[index].address;
+        end = start + Functions[index].size - 1U;
+        for(line = start / LineSize; line <= (end / LineSize); line++){
+            if(seen[line & 0xFFFFU] == 0U){
+                seen[line & 0xFFFFU] = 1;
+                lines++;
+            }
+        }
+    }
+    return lines;
+}
+
+static void Fragment(FILE *out)
+{
+    uint32_t index;
+
+    for(index = 0; index < NbOfHot; index++){
+        fprintf(out, "    *(.text.%s)\n", Functions[Order[index]].name);
+    }
+}
+
+/* Replaces the lines between the HOT_TEXT markers */
+static void Rewrite(const char *path)
+{
+    static char text[1U << 20];
+    char *begin;
+    char *end;
+    size_t length;
+    FILE *file = fopen(path, "r");
+
+    if(file == NULL){
+        perror(path);
+        exit(1);
+    }
+    length = fread(text, 1, sizeof(text) - 1U, file);
+    fclose(file);
+    text[length] = '\0';
+    begin = strstr(text, MARK_BEGIN);
+    end = (begin != NULL) ? strstr(begin, MARK_END) : NULL;
+    if(end == NULL){
+        fprintf(stderr, "%s: no HOT_TEXT markers\n", path);
+        exit(1);
+    }
+    begin = strchr(begin, '\n') + 1;
+    while((end > text) && (end[-1] != '\n')){
+        end--;
+    }
+
+    file = fopen(path, "w");
+    if(file == NULL){
+        perror(path);
+        exit(1);
+    }
+    fwrite(text, 1, (size_t)(begin - text), file);
+    Fragment(file);
+    fputs(end, file);
+    fclose(file);
+    printf("%s: %u hot functions written\n", path, NbOfHot);
+}
+
+int main(int argc, char **argv)
+{
+    static char keep[MAX_KEEP][NAME_SIZE];
+    const char *scripts[MAX_SCRIPTS];
+    uint32_t nb_keep = 0;
+    uint32_t nb_scripts = 0;
+    uint64_t total = 0;
+    uint64_t covered = 0;
+    uint64_t fetches;
+    uint64_t before;
+    uint64_t after;
+    uint32_t size = 0;
+    uint32_t index;
+    int arg = 1;
+
+    while((arg < argc) && (argv[arg][0] == '-') && ((arg + 1) < argc)){
+        if(strcmp(argv[arg], "-n") == 0){
+            LineCount = (uint32_t)strtoul(argv[arg + 1], NULL, 0);
+        }else if(strcmp(argv[arg], "-l") == 0){
+            LineSize = (uint32_t)strtoul(argv[arg + 1], NULL, 0);
+        }else if(strcmp(argv[arg], "-p") == 0){
+            MissCycles = (uint32_t)strtoul(argv[arg + 1], NULL, 0);
+        }else if(strcmp(argv[arg], "-c") == 0){
+            Coverage = strtod(argv[arg + 1], NULL);
+        }else if((strcmp(argv[arg], "-k") == 0) && (nb_keep < MAX_KEEP)){
+            snprintf(keep[nb_keep++], NAME_SIZE, "%s", argv[arg + 1]);
+        }else if((strcmp(argv[arg], "-w") == 0) && (nb_scripts < MAX_SCRIPTS)){
+            scripts[nb_scripts++] = argv[arg + 1];
+        }else{
+            break;
+        }
+        arg += 2;
+    }
+    if((LineCount == 0U) || (LineCount > 1024U) || (LineSize == 0U) || ((LineSize & (LineSize - 1U)) != 0U)){
+        fprintf(stderr, "-n 1..1024, -l a power of two\n");
+        return 1;
+    }
+
+    if((argc - arg) >= 2){
+        Read_Symbols(argv[arg]);
+        Read_Profile(argv[arg + 1]);
+    }else{
+        printf("synthetic image and trace\n");
+        Synthetic();
+        if(nb_keep == 0U){
+            strcpy(keep[nb_keep++], "FLASH_IRQHandler");
+        }
+    }
+    if(NbOfFunctions == 0U){
+        fprintf(stderr, "no functions\n");
+        return 1;
+    }
+    Layout(keep, nb_keep);
+
+    for(index = 0; index < NbOfFunctions; index++){
+        total += Functions[index].weight;
+        if(Functions[index].hot){
+            covered += Functions[index].weight;
+            size += Functions[index].size;
+        }
+    }
+    printf("profile:    %u functions, %llu samples; %u hot functions, %u bytes, cover %.1f%%\n",
+           NbOfFunctions, (unsigned long long)total, NbOfHot, size,
+           (total != 0U) ? (100.0 * (double)covered / (double)total) : 0.0);
+    printf("hot lines:  %u in link order, %u profiled (%u x %u-byte ART lines)\n",
+           Lines(0), Lines(1), LineCount, LineSize);
+
+    if(TraceLength != 0U){
+        before = Replay(0, &fetches);
+        after = Replay(1, &fetches);
+        printf("fetches:    %llu, LRU model, %u cycles per miss\n", (unsigned long long)fetches, MissCycles);
+        printf("link order: %10llu misses (%5.2f%%), %12llu stall cycles\n", (unsigned long long)before,
+               100.0 * (double)before / (double)fetches, (unsigned long long)before * MissCycles);
+        printf("profiled:   %10llu misses (%5.2f%%), %12llu stall cycles, %.1f%% fewer\n", (unsigned long long)after,
+               100.0 * (double)after / (double)fetches, (unsigned long long)after * MissCycles,
+               (before != 0U) ? (100.0 * (double)(before - ((after < before) ? after : before)) / (double)before) : 0.0);
+    }
+
+    if(nb_scripts == 0U){
+        Fragment(stdout);
+    }
+    for(index = 0; index < nb_scripts; index++){
+        Rewrite(scripts[index]);
+    }
+    free(Trace);
+    return 0;
+}
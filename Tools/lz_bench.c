@@ -0,0 +1,189 @@
+/**
+  ******************************************************************************
+  * @file    lz_bench.c
+  * @brief   Host check of the compressed flash objects in
+             Core/Src/flash_lz.c against the emulated flash (flash_emu.c).
+             Reports the compression ratio, the flash write time saved
+             (sector erases plus flashword programs, emulator figures) and
+             the read throughput with decompression included.
+
+             gcc -O2 -DHOST_BUILD -ICore/Inc -ITools Tools/lz_bench.c \
+                 Tools/flash_emu.c Core/Src/flash_lz.c Core/Src/flash_stream.c -o lz_bench
+             ./lz_bench [file ...]
+
+             Without files, a synthetic calibration table and log are used.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "flash_emu.h"
+#include "flash_lz.h"
+
+#define OBJECT_BASE     FLASH_BANK2_BASE
+#define READ_CHUNK      100U    /* deliberately not a flashword multiple */
+
+static uint32_t Host_Erase(uint32_t FlashAddress)
+{
+    return Flash_Emu_Erase(FLASH_GEO_BANK(FlashAddress), FLASH_GEO_SECTOR(FlashAddress), 1);
+}
+
+static uint32_t Host_Program(uint32_t FlashAddress, const uint32_t *src, uint32_t NbOfFlashWords)
+{
+    return Flash_Emu_Program(FlashAddress, src, NbOfFlashWords);
+}
+
+static const Flash_Stream_Backend_t Host_Backend =
+{
+    Host_Erase, Host_Program, Flash_Emu_Read
+};
+
+static double Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static uint8_t *Calibration(uint32_t *size)
+{
+    uint32_t count = 96U * 1024U;
+    int16_t *table = malloc(count * sizeof(*table));
+    uint32_t index;
+
+    /* Quantized correction curves, one per 512 entries, with sparse noise */
+    for(index = 0; index < count; index++){
+        table[index] = (int16_t)((((index % 512U) >> 3) * 5U) + ((index / 512U) * 40U) +
+                                 (((index % 16U) == 0U) ? (rand() % 3) : 0));
+    }
+    *size = count * sizeof(*table);
+    return (uint8_t *)table;
+}
+
+static uint8_t *Log(uint32_t *size)
+{
+    uint32_t capacity = 384U * 1024U;
+    char *log = malloc(capacity);
+    uint32_t used = 0;
+    uint32_t line = 0;
+    static const char *const events[] = { "flash erase ok", "ecc corrected", "link up", "sensor sample" };
+
+    while((capacity - used) > 80U){
+        used += (uint32_t)snprintf(log + used, capacity - used, "[%08u] %-5s %s value=%d\n", line * 125U,
+                                   ((line % 7U) == 0U) ? "WARN" : "INFO", events[line % 4U], (int)(rand() % 1000));
+        line++;
+    }
+    *size = used;
+    return (uint8_t *)log;
+}
+
+static int Bench(const char *name, const uint8_t *data, uint32_t size)
+{
+    static Flash_Lz_Writer_t writer;
+    static Flash_Lz_Reader_t reader;
+    Flash_Lz_Header_t header;
+    uint8_t *check = malloc(size + READ_CHUNK);
+    uint32_t raw_fw = (size + FLASH_GEO_FLASHWORD_SIZE - 1U) >> FLASH_GEO_FLASHWORD_SHIFT;
+    uint32_t raw_sectors = (size + FLASH_GEO_SECTOR_SIZE - 1U) >> FLASH_GEO_SECTOR_SHIFT;
+    uint32_t lz_sectors;
+    uint32_t got = 0;
+    uint32_t step;
+    uint64_t read_ns;
+    double t0;
+    double compress_s;
+    double decode_s;
+    double raw_write_ms;
+    double lz_write_ms;
+
+    if(size > FLASH_GEO_BANK_SIZE - FLASH_GEO_FLASHWORD_SIZE){
+        fprintf(stderr, "%s: too large\n", name);
+        return 1;
+    }
+
+    Flash_Emu_Init();
+    t0 = Now();
+    Flash_Lz_WriterInit(&writer, &Host_Backend, OBJECT_BASE, FLASH_GEO_BANK_SIZE);
+    for(step = 0; step < size; step += 1000U){
+        Flash_Lz_Write(&writer, data + step, ((size - step) < 1000U) ? (size - step) : 1000U);
+    }
+    if(Flash_Lz_Finish(&writer, &header) != FLASH_OK){
+        fprintf(stderr, "%s: write failed\n", name);
+        return 1;
+    }
+    compress_s = Now() - t0;
+
+    Flash_Emu_Stats.now_ns = 0;
+    t0 = Now();
+    if(Flash_Lz_ReaderInit(&reader, &Host_Backend, OBJECT_BASE) == FLASH_OK){
+        while((step = Flash_Lz_Read(&reader, check + got, READ_CHUNK)) != 0U){
+            got += step;
+        }
+    }
+    decode_s = Now() - t0;
+    read_ns = Flash_Emu_Stats.now_ns;
+
+    if((reader.status != FLASH_OK) || (got != size) || (memcmp(check, data, size) != 0)){
+        printf("%-12s round trip FAILED\n", name);
+        return 2;
+    }
+
+    lz_sectors = (FLASH_LZ_FOOTPRINT(&header) + FLASH_GEO_SECTOR_SIZE - 1U) >> FLASH_GEO_SECTOR_SHIFT;
+    raw_write_ms = ((double)raw_sectors * Flash_Emu_Timing.erase_ns + (double)raw_fw * Flash_Emu_Timing.program_ns) / 1e6;
+    lz_write_ms = ((double)lz_sectors * Flash_Emu_Timing.erase_ns + (double)writer.flashwords * Flash_Emu_Timing.program_ns) / 1e6;
+
+    printf("%-12s raw %7u  packed %7u  ratio %.2f\n", name, size, header.packed_size, (double)size / header.packed_size);
+    printf("%-12s write: raw %u fw %u sect %.1f ms, lz %u fw %u sect %.1f ms (+%.1f ms compress on host)\n", "",
+           raw_fw, raw_sectors, raw_write_ms, writer.flashwords, lz_sectors, lz_write_ms, compress_s * 1e3);
+    printf("%-12s read: raw %.1f MB/s flash, lz %u fw %.1f us flash + %.1f us decode = %.1f MB/s on host\n", "",
+           (1e3 / Flash_Emu_Timing.read_ns) * FLASH_GEO_FLASHWORD_SIZE, reader.flashwords, read_ns / 1e3, decode_s * 1e6,
+           size / ((read_ns / 1e9) + decode_s) / 1e6);
+    free(check);
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    uint8_t *data;
+    uint32_t size;
+    int status = 0;
+    int index;
+    FILE *f;
+
+    if(argc == 1){
+        srand(1);
+        data = Calibration(&size);
+        status |= Bench("calibration", data, size);
+        free(data);
+        data = Log(&size);
+        status |= Bench("log", data, size);
+        free(data);
+        return status;
+    }
+
+    for(index = 1; index < argc; index++){
+        f = fopen(argv[index], "rb");
+        if(f == NULL){
+            perror(argv[index]);
+            return 1;
+        }
+        data = malloc(FLASH_GEO_BANK_SIZE);
+        size = (uint32_t)fread(data, 1, FLASH_GEO_BANK_SIZE, f);
+        fclose(f);
+        status |= Bench(argv[index], data, size);
+        free(data);
+    }
+    return status;
+}
@@ -0,0 +1,452 @@
+/**
+  ******************************************************************************
+  * @file    prof_report.c
+  * @brief   Host report of a PC sampling profile taken on the target
+             (Core/Src/pc_prof.c, built with PC_PROF_ENABLE). Buckets are
+             matched against the function symbols of the ELF; a bucket
+             shared by two functions is split by the bytes each covers.
+             Each function is listed with its share of the samples and its
+             hottest bucket, which addr2line turns into the loop in
+             question. With an LR histogram a second table shows where the
+             sampled code returns to, i.e. whose calls the time is spent
+             under. Time with interrupts masked, which includes every flash
+             program and erase wait, cannot be sampled: it is reported as
+             one held-off figure and is in no function's share.
+
+             gcc -O2 -DHOST_BUILD -ICore/Inc Tools/prof_report.c -o prof_report
+             ./prof_report [-n lines] [-w weights.txt] [CM4.elf prof.bin]
+
+             prof.bin is the RAM image of Pc_Prof, e.g. from gdb:
+             dump binary memory prof.bin &Pc_Prof (char *)&Pc_Prof + sizeof(Pc_Prof)
+             -w writes "name samples" lines for Tools/link_order.c. Without
+             files, a synthetic image and profile are used.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pc_prof.h"
+
+#define MAX_FUNCTIONS   8192U
+#define NAME_SIZE       96U
+#define DEFAULT_LINES   20U
+
+#define SHT_SYMTAB      2U
+#define STT_FUNC        2U
+#define SHN_UNDEF       0U
+
+typedef struct{
+    char name[NAME_SIZE];
+    uint32_t address;
+    uint32_t size;
+    double samples;
+    double callers;         /* from the LR histogram */
+    uint32_t hottest;       /* bucket address */
+    uint32_t hottest_count;
+}Function_t;
+
+static Function_t Functions[MAX_FUNCTIONS];
+static uint32_t NbOfFunctions;
+static Pc_Prof_t Header;
+static uint32_t *Pc;
+static uint32_t *Lr;
+
+static uint32_t Le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t Le16(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8);
+}
+
+static uint8_t *Load(const char *path, size_t *Size)
+{
+    uint8_t *data;
+    long length;
+    FILE *file = fopen(path, "rb");
+
+    if(file == NULL){
+        perror(path);
+        exit(1);
+    }
+    fseek(file, 0, SEEK_END);
+    length = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    data = malloc((size_t)length + 1U);
+    if((data == NULL) || (fread(data, 1, (size_t)length, file) != (size_t)length)){
+        fprintf(stderr, "%s: read failed\n", path);
+        exit(1);
+    }
+    fclose(file);
+    *Size = (size_t)length;
+    return data;
+}
+
+static int By_Address(const void *a, const void *b)
+{
+    const Function_t *fa = (const Function_t *)a;
+    const Function_t *fb = (const Function_t *)b;
+
+    return (fa->address > fb->address) - (fa->address < fb->address);
+}
+
+static void Add_Function(const char *name, uint32_t address, uint32_t size)
+{
+    if(NbOfFunctions == MAX_FUNCTIONS){
+        fprintf(stderr, "more than %u functions\n", MAX_FUNCTIONS);
+        exit(1);
+    }
+    snprintf(Functions[NbOfFunctions].name, NAME_SIZE, "%s", name);
+    Functions[NbOfFunctions].address = address & ~1U;      /* Thumb bit */
+    Functions[NbOfFunctions].size = size;
+    NbOfFunctions++;
+}
+
+/* ELF32 little endian: STT_FUNC symbols of every SHT_SYMTAB section */
+static void Read_Elf(const char *path)
+{
+    size_t size;
+    uint8_t *elf = Load(path, &size);
+    const uint8_t *section;
+    const uint8_t *symbol;
+    const char *strings;
+    uint32_t shoff;
+    uint32_t shentsize;
+    uint32_t shnum;
+    uint32_t index;
+    uint32_t offset;
+    uint32_t length;
+    uint32_t entsize;
+    uint32_t link;
+    uint32_t name;
+
+    if((size < 52U) || (memcmp(elf, "\177ELF", 4) != 0) || (elf[4] != 1U) || (elf[5] != 1U)){
+        fprintf(stderr, "%s: not a 32-bit little endian ELF\n", path);
+        exit(1);
+    }
+    shoff = Le32(&elf[0x20]);
+    shentsize = Le16(&elf[0x2E]);
+    shnum = Le16(&elf[0x30]);
+    if(((size_t)shoff + ((size_t)shentsize * shnum)) > size){
+        fprintf(stderr, "%s: truncated\n", path);
+        exit(1);
+    }
+    for(index = 0; index < shnum; index++){
+        section = &elf[shoff + (index * shentsize)];
+        if(Le32(&section[4]) != SHT_SYMTAB){
+            continue;
+        }
+        offset = Le32(&section[0x10]);
+        length = Le32(&section[0x14]);
+        link = Le32(&section[0x18]);
+        entsize = Le32(&section[0x24]);
+        strings = (const char *)&elf[Le32(&elf[shoff + (link * shentsize) + 0x10])];
+        for(symbol = &elf[offset]; symbol < &elf[offset + length]; symbol += entsize){
+            name = Le32(&symbol[0]);
+            if(((symbol[12] & 0x0FU) == STT_FUNC) && (Le16(&symbol[14]) != SHN_UNDEF)){
+                Add_Function(&strings[name], Le32(&symbol[4]), Le32(&symbol[8]));
+            }
+        }
+    }
+    free(elf);
+}
+
+static void Read_Profile(const char *path)
+{
+    size_t size;
+    size_t need;
+    uint8_t *data = Load(path, &size);
+
+    if(size < offsetof(Pc_Prof_t, pc)){
+        fprintf(stderr, "%s: too short\n", path);
+        exit(1);
+    }
+    memcpy(&Header, data, offsetof(Pc_Prof_t, pc));
+    need = offsetof(Pc_Prof_t, pc) + ((size_t)Header.buckets * Header.histograms * sizeof(uint32_t));
+    if((Header.magic != PC_PROF_MAGIC) || (Header.version != PC_PROF_VERSION) ||
+       (Header.histograms == 0U) || (Header.histograms > 2U) || (Header.shift > 16U) || (size < need)){
+        fprintf(stderr, "%s: not a profile dump\n", path);
+        exit(1);
+    }
+    Pc = (uint32_t *)malloc((size_t)Header.buckets * sizeof(uint32_t));
+    memcpy(Pc, &data[offsetof(Pc_Prof_t, pc)], (size_t)Header.buckets * sizeof(uint32_t));
+    if(Header.histograms == 2U){
+        Lr = (uint32_t *)malloc((size_t)Header.buckets * sizeof(uint32_t));
+        memcpy(Lr, &data[offsetof(Pc_Prof_t, pc) + ((size_t)Header.buckets * sizeof(uint32_t))],
+               (size_t)Header.buckets * sizeof(uint32_t));
+    }
+    free(data);
+}
+
+/* A made-up image and profile: a main loop streaming an update, most of
+   its time in flashword waits, which run masked and so only show up as
+   held-off ticks */
+static void Synthetic(void)
+{
+    static const struct{
+        const char *name;
+        uint32_t size;
+        uint32_t weight;        /* samples per 10000 */
+        uint32_t loop;          /* offset of the hot loop */
+    }image[] =
+    {
+        { "Reset_Handler",               80U,    0U,   0U },
+        { "FLASH_IRQHandler",            40U,   12U,   8U },
+        { "Flash_Safe_EccIrq",          180U,    9U,  64U },
+        { "SysTick_Handler",             12U,   40U,   0U },
+        { "HAL_IncTick",                 24U,   25U,   0U },
+        { "HAL_GetTick",                 12U,  310U,   0U },
+        { "main",                       900U,  120U, 700U },
+        { "Flash_Stream_Process",       610U,  430U, 256U },
+        { "Flash_Stream_Crc",           120U,  905U,  40U },
+        { "Flash_Batch_Program",        380U,  360U, 160U },
+        { "Flash_Batch_Word",           148U,  420U,  96U },
+        { "Flash_Kernel_Compare",       220U,  610U,  48U },
+        { "Flash_Sha_Update",           160U,  140U,  32U },
+        { "Flash_Sha_Transform",       1480U, 1630U, 512U },
+        { "Log_Buffer_Write",           260U,  210U,  64U },
+        { "HAL_UART_IRQHandler",        620U,   79U, 128U },
+        { "Error_Handler",                8U,    0U,   0U },
+    };
+    uint32_t address = 0x08100298U;
+    uint32_t index;
+    uint32_t offset;
+    uint32_t bucket;
+    uint32_t count;
+    uint32_t caller;
+
+    srand(1);
+    Header.magic = PC_PROF_MAGIC;
+    Header.version = PC_PROF_VERSION;
+    Header.histograms = 2U;
+    Header.base = 0x08100000U;
+    Header.shift = 5U;
+    Header.buckets = 0x20000U >> 5;
+    Header.rate_hz = 10000U;
+    Pc = (uint32_t *)calloc(Header.buckets, sizeof(uint32_t));
+    Lr = (uint32_t *)calloc(Header.buckets, sizeof(uint32_t));
+
+    for(index = 0; index < (sizeof(image) / sizeof(image[0])); index++){
+        Add_Function(image[index].name, address, image[index].size);
+        /* Three quarters in the loop, the rest spread over the body */
+        for(count = 0; count < (image[index].weight * 12U); count++){
+            offset = ((count % 4U) != 0U) ? (image[index].loop + ((uint32_t)rand() % 24U))
+                                          : ((uint32_t)rand() % image[index].size);
+            Pc[(address + offset - Header.base) >> Header.shift]++;
+            Header.samples++;
+        }
+        address = (address + image[index].size + 7U) & ~7U;
+    }
+    /* Leaves return into their callers */
+    for(index = 0; index < NbOfFunctions; index++){
+        caller = 6U;                                            /* main */
+        if((strcmp(Functions[index].name, "Flash_Batch_Word") == 0) ||
+           (strcmp(Functions[index].name, "HAL_GetTick") == 0)){
+            caller = 9U;                                        /* Flash_Batch_Program */
+        }else if(strcmp(Functions[index].name, "Flash_Sha_Transform") == 0){
+            caller = 12U;                                       /* Flash_Sha_Update */
+        }else if(strncmp(Functions[index].name, "Flash_Stream_Crc", 16) == 0){
+            caller = 7U;                                        /* Flash_Stream_Process */
+        }
+        bucket = (Functions[caller].address + (Functions[caller].size / 2U) - Header.base) >> Header.shift;
+        for(offset = 0; offset < Functions[index].size; offset += 32U){
+            Lr[bucket] += Pc[(Functions[index].address + offset - Header.base) >> Header.shift] / 2U;
+        }
+    }
+    Header.outside = Header.samples / 200U;
+    Header.samples += Header.outside;
+    Header.masked = 4700U * 12U;
+}
+
+static void Attribute(const uint32_t *histogram, int Callers)
+{
+    uint32_t bucket;
+    uint32_t start;
+    uint32_t end;
+    uint32_t low;
+    uint32_t high;
+    uint32_t index;
+    uint32_t first;
+    uint32_t covered;
+    uint32_t overlap;
+    uint32_t size = 1U << Header.shift;
+    Function_t *function;
+
+    for(bucket = 0; bucket < Header.buckets; bucket++){
+        if(histogram[bucket] == 0U){
+            continue;
+        }
+        start = Header.base + (bucket << Header.shift);
+        end = start + size;
+
+        /* First function ending after the start of the bucket */
+        low = 0;
+        high = NbOfFunctions;
+        while(low < high){
+            index = (low + high) / 2U;
+            if((Functions[index].address + Functions[index].size) <= start){
+                low = index + 1U;
+            }else{
+                high = index;
+            }
+        }
+        first = low;
+
+        covered = 0;
+        for(index = first; (index < NbOfFunctions) && (Functions[index].address < end); index++){
+            low = (Functions[index].address > start) ? Functions[index].address : start;
+            high = ((Functions[index].address + Functions[index].size) < end) ?
+                   (Functions[index].address + Functions[index].size) : end;
+            covered += (high > low) ? (high - low) : 0U;
+        }
+        if(covered == 0U){
+            continue;
+        }
+        for(index = first; (index < NbOfFunctions) && (Functions[index].address < end); index++){
+            function = &Functions[index];
+            low = (function->address > start) ? function->address : start;
+            high = ((function->address + function->size) < end) ? (function->address + function->size) : end;
+            overlap = (high > low) ? (high - low) : 0U;
+            if(overlap == 0U){
+                continue;
+            }
+            if(Callers){
+                function->callers += (double)histogram[bucket] * overlap / covered;
+            }else{
+                function->samples += (double)histogram[bucket] * overlap / covered;
+                if(histogram[bucket] > function->hottest_count){
+                    function->hottest_count = histogram[bucket];
+                    function->hottest = start;
+                }
+            }
+        }
+    }
+}
+
+static int By_Samples(const void *a, const void *b)
+{
+    const Function_t *fa = (const Function_t *)a;
+    const Function_t *fb = (const Function_t *)b;
+
+    return (fa->samples < fb->samples) - (fa->samples > fb->samples);
+}
+
+static int By_Callers(const void *a, const void *b)
+{
+    const Function_t *fa = (const Function_t *)a;
+    const Function_t *fb = (const Function_t *)b;
+
+    return (fa->callers < fb->callers) - (fa->callers > fb->callers);
+}
+
+int main(int argc, char **argv)
+{
+    const char *weights = NULL;
+    uint32_t lines = DEFAULT_LINES;
+    uint64_t histogram_total = 0;
+    double attributed = 0.0;
+    double total;
+    uint32_t index;
+    FILE *out;
+    int arg = 1;
+
+    while((arg < argc) && (argv[arg][0] == '-') && ((arg + 1) < argc)){
+        if(strcmp(argv[arg], "-n") == 0){
+            lines = (uint32_t)strtoul(argv[arg + 1], NULL, 0);
+        }else if(strcmp(argv[arg], "-w") == 0){
+            weights = argv[arg + 1];
+        }else{
+            break;
+        }
+        arg += 2;
+    }
+
+    if((argc - arg) >= 2){
+        Read_Elf(argv[arg]);
+        Read_Profile(argv[arg + 1]);
+    }else{
+        printf("synthetic image and profile\n");
+        Synthetic();
+    }
+
+    /* Sizeless symbols (assembly) run up to the next one */
+    qsort(Functions, NbOfFunctions, sizeof(Function_t), By_Address);
+    for(index = 0; index < NbOfFunctions; index++){
+        if((Functions[index].size == 0U) && ((index + 1U) < NbOfFunctions)){
+            Functions[index].size = Functions[index + 1U].address - Functions[index].address;
+        }
+    }
+
+    Attribute(Pc, 0);
+    if(Lr != NULL){
+        Attribute(Lr, 1);
+    }
+    for(index = 0; index < Header.buckets; index++){
+        histogram_total += Pc[index];
+    }
+    for(index = 0; index < NbOfFunctions; index++){
+        attributed += Functions[index].samples;
+    }
+
+    /* Shares are of the whole run, held-off ticks included */
+    total = ((Header.samples + Header.masked) != 0U) ? ((double)Header.samples + Header.masked) : 1.0;
+    printf("%u samples", Header.samples);
+    if(Header.rate_hz != 0U){
+        printf(" at %u Hz (%.1f s)", Header.rate_hz, ((double)Header.samples + Header.masked) / Header.rate_hz);
+    }
+    printf(", %u-byte buckets over 0x%08X-0x%08X\n", 1U << Header.shift, Header.base,
+           Header.base + (Header.buckets << Header.shift));
+    printf("outside the histogram: %u (%.1f%%), in no function: %.0f (%.1f%%)\n",
+           Header.outside, 100.0 * Header.outside / total,
+           (double)histogram_total - attributed, 100.0 * ((double)histogram_total - attributed) / total);
+    printf("held off with interrupts masked (flash program/erase waits among them), not sampled: %u (%.1f%%)\n",
+           Header.masked, 100.0 * Header.masked / total);
+
+    qsort(Functions, NbOfFunctions, sizeof(Function_t), By_Samples);
+    printf("\n      %%    samples  function                          hottest bucket\n");
+    for(index = 0; (index < NbOfFunctions) && (index < lines) && (Functions[index].samples > 0.0); index++){
+        printf("  %5.1f  %9.0f  %-32s  0x%08X (%.1f%%)\n", 100.0 * Functions[index].samples / total,
+               Functions[index].samples, Functions[index].name, Functions[index].hottest,
+               100.0 * Functions[index].hottest_count / total);
+    }
+
+    if(weights != NULL){
+        out = fopen(weights, "w");
+        if(out == NULL){
+            perror(weights);
+            return 1;
+        }
+        for(index = 0; (index < NbOfFunctions) && (Functions[index].samples > 0.0); index++){
+            fprintf(out, "%s %.0f\n", Functions[index].name, Functions[index].samples);
+        }
+        fclose(out);
+        printf("\n%s: weights for link_order\n", weights);
+    }
+
+    if(Lr != NULL){
+        qsort(Functions, NbOfFunctions, sizeof(Function_t), By_Callers);
+        printf("\n      %%    samples  returning into (stacked LR)\n");
+        for(index = 0; (index < NbOfFunctions) && (index < lines) && (Functions[index].callers > 0.0); index++){
+            printf("  %5.1f  %9.0f  %s\n", 100.0 * Functions[index].callers / total,
+                   Functions[index].callers, Functions[index].name);
+        }
+    }
+
+    free(Pc);
+    free(Lr);
+    return 0;
+}
@@ -0,0 +1,211 @@
+/**
+  ******************************************************************************
+  * @file    recover_bench.c
+  * @brief   Host comparison of the flash recovery policy in
+             Core/Src/flash_recover.c with erasing the sector and starting
+             again on every error. The emulated flash (flash_emu.c) fails one
+             flashword program in RATE with a sequence error (nothing written),
+             a timeout (written, reported late) or an operation error (wrong
+             data written); one sector of the image is write-protected.
+
+             gcc -O2 -DHOST_BUILD -ICore/Inc -ITools Tools/recover_bench.c \
+                 Tools/flash_emu.c Core/Src/flash_recover.c -o recover_bench
+             ./recover_bench [rate [runs]]
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flash_emu.h"
+#include "flash_recover.h"
+
+#define IMAGE_BASE          FLASH_BANK2_BASE
+#define IMAGE_SECTORS       6U
+#define PROTECTED_SECTOR    3U
+#define FW_WORDS            (FLASH_GEO_FLASHWORD_SIZE / 4U)
+#define SECTOR_WORDS        (FLASH_GEO_SECTOR_SIZE / 4U)
+#define BASELINE_ATTEMPTS   10U
+
+static uint32_t Image[IMAGE_SECTORS * SECTOR_WORDS];
+static uint32_t Rate;
+static uint32_t Seed;
+static Flash_Error_t Host_Error;
+
+static uint32_t Random(void)
+{
+    Seed = (Seed * 1103515245U) + 12345U;
+    return Seed >> 8;
+}
+
+static uint32_t Host_Protected(uint32_t FlashAddress)
+{
+    return FLASH_GEO_SECTOR(FlashAddress) == (FLASH_GEO_SECTOR(IMAGE_BASE) + PROTECTED_SECTOR);
+}
+
+static uint32_t Host_Fail(uint32_t status, uint32_t flags, uint32_t FlashAddress)
+{
+    Host_Error.status = status;
+    Host_Error.flags = flags;
+    Host_Error.address = FlashAddress;
+    return status;
+}
+
+static uint32_t Host_Erase(uint32_t FlashAddress)
+{
+    Host_Error.status = FLASH_OK;
+    if(Host_Protected(FlashAddress)){
+        return Host_Fail(FLASH_ERROR, FLASH_ERR_WRPERR, FlashAddress);
+    }
+    return Flash_Emu_Erase(FLASH_GEO_BANK(FlashAddress), FLASH_GEO_SECTOR(FlashAddress), 1);
+}
+
+static uint32_t Host_Program(uint32_t FlashAddress, const uint32_t *src, uint32_t NbOfFlashWords)
+{
+    static const uint32_t sequence[3] = { FLASH_ERR_PGSERR, FLASH_ERR_STRBERR, FLASH_ERR_INCERR };
+    uint32_t word[FW_WORDS];
+    uint32_t kind;
+
+    Host_Error.status = FLASH_OK;
+    for(; NbOfFlashWords != 0U; NbOfFlashWords--){
+        if(Host_Protected(FlashAddress)){
+            return Host_Fail(FLASH_ERROR, FLASH_ERR_WRPERR, FlashAddress);
+        }
+        if((Random() % Rate) == 0U){
+            kind = Random() % 10U;
+            if(kind < 6U){
+                return Host_Fail(FLASH_ERROR, sequence[kind % 3U], FlashAddress);
+            }
+            if(kind < 8U){
+                Flash_Emu_Program(FlashAddress, src, 1);
+                return Host_Fail(FLASH_TIMEOUT, 0U, FlashAddress);
+            }
+            memcpy(word, src, sizeof(word));
+            word[Random() % FW_WORDS] ^= 0x00010000U;
+            Flash_Emu_Program(FlashAddress, word, 1);
+            return Host_Fail(FLASH_ERROR, FLASH_ERR_OPERR, FlashAddress);
+        }
+        Flash_Emu_Program(FlashAddress, src, 1);
+        FlashAddress += FLASH_GEO_FLASHWORD_SIZE;
+        src += FW_WORDS;
+    }
+    return FLASH_OK;
+}
+
+static void Host_LastError(uint32_t FlashAddress, Flash_Error_t *error)
+{
+    (void)FlashAddress;
+    *error = Host_Error;
+}
+
+static const Flash_Recover_Backend_t Host_Backend =
+{
+    Host_Erase, Host_Program, Flash_Emu_Read, Host_LastError
+};
+
+/* The recovery the driver offered so far: any error erases and restarts */
+static uint32_t Baseline_Program(uint32_t FlashAddress, const uint32_t *src, uint32_t NbOfFlashWords)
+{
+    uint32_t attempts = 0;
+
+    while(Host_Program(FlashAddress, src, NbOfFlashWords) != FLASH_OK){
+        if((++attempts > BASELINE_ATTEMPTS) || (Host_Erase(FlashAddress) != FLASH_OK)){
+            return FLASH_ERROR;
+        }
+    }
+    return FLASH_OK;
+}
+
+/* Sectors whose contents differ from the image, the protected one excluded */
+static uint32_t Check(void)
+{
+    uint32_t bad = 0;
+    uint32_t sector;
+
+    for(sector = 0; sector < IMAGE_SECTORS; sector++){
+        if((sector != PROTECTED_SECTOR) &&
+           (memcmp(Flash_Emu_Memory(IMAGE_BASE + (sector << FLASH_GEO_SECTOR_SHIFT)),
+                   &Image[sector * SECTOR_WORDS], FLASH_GEO_SECTOR_SIZE) != 0)){
+            bad++;
+        }
+    }
+    return bad;
+}
+
+int main(int argc, char **argv)
+{
+    static const char *const names[FLASH_ERR_CLASSES] = { "none", "sequence", "timeout", "protected", "operation", "ecc" };
+    Flash_Recover_Report_t report;
+    uint32_t runs = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0) : 20U;
+    uint64_t adaptive_ns = 0;
+    uint64_t baseline_ns = 0;
+    uint32_t adaptive_erases = 0;
+    uint32_t baseline_erases = 0;
+    uint32_t adaptive_bad = 0;
+    uint32_t baseline_bad = 0;
+    uint32_t baseline_failed = 0;
+    uint32_t run;
+    uint32_t sector;
+    uint32_t index;
+
+    Rate = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 2000U;
+    if(Rate == 0U){
+        Rate = 1U;
+    }
+    for(index = 0; index < (IMAGE_SECTORS * SECTOR_WORDS); index++){
+        Image[index] = (index * 2654435761U) ^ (index >> 3);
+    }
+    memset(&report, 0, sizeof(report));
+
+    for(run = 0; run < runs; run++){
+        /* One call per sector, so an escalation may own the whole sector */
+        Seed = run + 1U;
+        Flash_Emu_Init();
+        for(sector = 0; sector < IMAGE_SECTORS; sector++){
+            Flash_Recover_Program(&Host_Backend, IMAGE_BASE + (sector << FLASH_GEO_SECTOR_SHIFT),
+                                  &Image[sector * SECTOR_WORDS], FLASH_GEO_SECTOR_SIZE / FLASH_GEO_FLASHWORD_SIZE,
+                                  FLASH_RECOVER_ERASE, &report);
+        }
+        adaptive_ns += Flash_Emu_Stats.now_ns;
+        adaptive_erases += Flash_Emu_Stats.erases;
+        adaptive_bad += Check();
+
+        Seed = run + 1U;
+        Flash_Emu_Init();
+        for(sector = 0; sector < IMAGE_SECTORS; sector++){
+            if(Baseline_Program(IMAGE_BASE + (sector << FLASH_GEO_SECTOR_SHIFT), &Image[sector * SECTOR_WORDS],
+                                FLASH_GEO_SECTOR_SIZE / FLASH_GEO_FLASHWORD_SIZE) != FLASH_OK){
+                baseline_failed++;
+            }
+        }
+        baseline_ns += Flash_Emu_Stats.now_ns;
+        baseline_erases += Flash_Emu_Stats.erases;
+        baseline_bad += Check();
+    }
+
+    printf("%u runs, %u sectors each, 1 in %u flashword programs fails, sector %u write-protected\n",
+           runs, IMAGE_SECTORS, Rate, PROTECTED_SECTOR);
+    printf("errors       %u:", report.errors);
+    for(index = FLASH_ERR_SEQUENCE; index < FLASH_ERR_CLASSES; index++){
+        printf(" %s %u", names[index], report.classes[index]);
+    }
+    printf("\nadaptive     %u retries, %u verified, %u skipped flashwords, %u escalations\n",
+           report.retries, report.verified, report.skipped, report.escalations);
+    printf("adaptive     %8.3f s flash time, %u erases, %u bad sectors\n",
+           (double)adaptive_ns / 1e9, adaptive_erases, adaptive_bad);
+    printf("erase+retry  %8.3f s flash time, %u erases, %u bad sectors, %u sector writes given up\n",
+           (double)baseline_ns / 1e9, baseline_erases, baseline_bad, baseline_failed);
+    printf("saved        %8.3f s measured, %8.3f s estimated by the policy\n",
+           (double)(int64_t)(baseline_ns - adaptive_ns) / 1e9, (double)report.saved_us / 1e6);
+    return ((adaptive_bad != 0U) || (report.skipped != (runs * (SECTOR_WORDS / FW_WORDS)))) ? 1 : 0;
+}
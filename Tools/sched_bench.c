@@ -0,0 +1,443 @@
+/**
+  ******************************************************************************
+  * @file    sched_bench.c
+  * @brief   Host comparison of the flash write scheduler in
+             Core/Src/flash_sched.c with issuing every erase and program
+             inline, in call order, as the drivers do today. The load is a
+             bulk log flush (erase a sector, program 64 Kbytes) on bank1
+             every FLUSH_PERIOD, an urgent one-flashword config commit on
+             bank2 every CONFIG_PERIOD with a 2 ms budget, and a normal
+             telemetry record on bank1 every 100 ms with a 1.5 s budget.
+             Erases run in the background of the emulated controller
+             (flash_emu.c) while the scheduler serves the other bank; every
+             write is checked against flash at the end. First, an urgent
+             program behind a bulk erase of its sector must land after it,
+             and a program with a deadline behind one must not keep the
+             erase waiting for a gap until that deadline is lost.
+
+             gcc -O2 -DHOST_BUILD -ICore/Inc -ITools Tools/sched_bench.c \
+                 Tools/flash_emu.c Core/Src/flash_sched.c -o sched_bench
+             ./sched_bench [seconds]
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flash_emu.h"
+#include "flash_sched.h"
+
+#define FW_WORDS            (FLASH_GEO_FLASHWORD_SIZE / 4U)
+#define DEFAULT_SECONDS     12U
+#define MAX_EVENTS          4096U
+
+#define FLUSH_PERIOD_US     2000000U
+#define FLUSH_FLASHWORDS    2048U           /* 64 Kbytes */
+#define FLUSH_SECTORS       4U              /* bank1 sectors 1..4 in turn */
+#define MAX_FLUSHES         32U
+#define CONFIG_PERIOD_US    25000U
+#define CONFIG_BUDGET_US    2000U
+#define CONFIG_BASE         FLASH_GEO_SECTOR_BASE(FLASH_BANK_2, 7)
+#define TELEMETRY_PERIOD_US 100000U
+#define TELEMETRY_WORDS     8U
+#define TELEMETRY_BUDGET_US 1500000U
+#define TELEMETRY_BASE      FLASH_GEO_SECTOR_BASE(FLASH_BANK_1, 7)
+#define POLL_US             50U             /* main loop period when the poll had nothing to do */
+
+typedef struct{
+    uint32_t time;          /* us */
+    uint32_t op;
+    uint32_t priority;
+    uint32_t address;
+    const uint32_t *data;
+    uint32_t count;
+    uint32_t budget;
+    Flash_Sched_Request_t req;
+}Event_t;
+
+static Event_t Events[MAX_EVENTS];
+static uint32_t NbOfEvents;
+static uint32_t Flush[MAX_FLUSHES][FLUSH_FLASHWORDS * FW_WORDS];
+static uint32_t Config[MAX_EVENTS][FW_WORDS];
+static uint32_t Telemetry[MAX_EVENTS][TELEMETRY_WORDS * FW_WORDS];
+static uint64_t Busy_Until[FLASH_GEO_NB_BANKS];
+static uint32_t Seed = 1;
+
+static uint32_t Random(void)
+{
+    Seed = (Seed * 1103515245U) + 12345U;
+    return Seed >> 8;
+}
+
+static void Fill(uint32_t *dest, uint32_t Words)
+{
+    uint32_t index;
+
+    for(index = 0; index < Words; index++){
+        dest[index] = Random() ^ (Random() << 16);
+    }
+}
+
+static void Add(uint32_t Time, uint32_t Op, uint32_t Priority, uint32_t Address, const uint32_t *data,
+                uint32_t Count, uint32_t Budget)
+{
+    Event_t *event = &Events[NbOfEvents++];
+
+    event->time = Time;
+    event->op = Op;
+    event->priority = Priority;
+    event->address = Address;
+    event->data = data;
+    event->count = Count;
+    event->budget = Budget;
+}
+
+static int By_Time(const void *a, const void *b)
+{
+    const Event_t *ea = (const Event_t *)a;
+    const Event_t *eb = (const Event_t *)b;
+
+    if(ea->time != eb->time){
+        return (ea->time > eb->time) - (ea->time < eb->time);
+    }
+    /* a flush's erase stays ahead of its program */
+    return (ea < eb) ? -1 : 1;
+}
+
+static void Workload(uint32_t Seconds)
+{
+    uint32_t end = Seconds * 1000000U;
+    uint32_t time;
+    uint32_t flushes = 0;
+    uint32_t configs = 0;
+    uint32_t records = 0;
+    uint32_t sector;
+
+    for(time = 500000U; (time < end) && (flushes < MAX_FLUSHES); time += FLUSH_PERIOD_US){
+        sector = 1U + (flushes % FLUSH_SECTORS);
+        Fill(Flush[flushes], FLUSH_FLASHWORDS * FW_WORDS);
+        Add(time, FLASH_SCHED_ERASE, FLASH_SCHED_BULK, FLASH_GEO_SECTOR_BASE(FLASH_BANK_1, sector), NULL, 1, 0);
+        Add(time, FLASH_SCHED_PROGRAM, FLASH_SCHED_BULK, FLASH_GEO_SECTOR_BASE(FLASH_BANK_1, sector),
+            Flush[flushes], FLUSH_FLASHWORDS, 0);
+        flushes++;
+    }
+    for(time = 0; (time < end) && (NbOfEvents < (MAX_EVENTS - 1U)); time += CONFIG_PERIOD_US){
+        Fill(Config[configs], FW_WORDS);
+        Add(time + (Random() % 5000U), FLASH_SCHED_PROGRAM, FLASH_SCHED_URGENT,
+            CONFIG_BASE + (configs << FLASH_GEO_FLASHWORD_SHIFT), Config[configs], 1, CONFIG_BUDGET_US);
+        configs++;
+    }
+    for(time = 3000U; (time < end) && (NbOfEvents < MAX_EVENTS); time += TELEMETRY_PERIOD_US){
+        Fill(Telemetry[records], TELEMETRY_WORDS * FW_WORDS);
+        Add(time, FLASH_SCHED_PROGRAM, FLASH_SCHED_NORMAL,
+            TELEMETRY_BASE + ((records * TELEMETRY_WORDS) << FLASH_GEO_FLASHWORD_SHIFT),
+            Telemetry[records], TELEMETRY_WORDS, TELEMETRY_BUDGET_US);
+        records++;
+    }
+    qsort(Events, NbOfEvents, sizeof(Event_t), By_Time);
+}
+
+/* The flush sectors hold old data, so a program that overtakes its erase
+   shows up in the final check */
+static void Prepare(void)
+{
+    static uint32_t old[FW_WORDS] = { 0x12345678U, 0x9ABCDEF0U };
+    uint32_t sector;
+
+    Flash_Emu_Init();
+    for(sector = 1; sector <= FLUSH_SECTORS; sector++){
+        Flash_Emu_Program(FLASH_GEO_SECTOR_BASE(FLASH_BANK_1, sector), old, 1);
+    }
+    Flash_Emu_Stats.now_ns = 0;
+    memset(Busy_Until, 0, sizeof(Busy_Until));
+}
+
+static uint32_t Check(void)
+{
+    uint32_t bad = 0;
+    uint32_t index;
+    uint32_t flushes = 0;
+    uint32_t last[FLUSH_SECTORS + 1U];
+
+    memset(last, 0xFF, sizeof(last));
+    for(index = 0; index < NbOfEvents; index++){
+        if((Events[index].op == FLASH_SCHED_PROGRAM) && (Events[index].priority == FLASH_SCHED_BULK)){
+            last[FLASH_GEO_SECTOR(Events[index].address)] = flushes++;
+        }
+    }
+    for(index = 0; index < NbOfEvents; index++){
+        if((Events[index].op != FLASH_SCHED_PROGRAM) ||
+           ((Events[index].priority == FLASH_SCHED_BULK) &&
+            (Events[index].data != Flush[last[FLASH_GEO_SECTOR(Events[index].address)]]))){
+            continue;
+        }
+        if(memcmp(Flash_Emu_Memory(Events[index].address), Events[index].data,
+                  Events[index].count << FLASH_GEO_FLASHWORD_SHIFT) != 0){
+            bad++;
+        }
+    }
+    return bad;
+}
+
+static void Account(Flash_Sched_Class_Stats_t *stats, const Event_t *event, uint32_t Start, uint32_t End)
+{
+    Flash_Sched_Class_Stats_t *cls = &stats[event->priority];
+
+    cls->completed++;
+    cls->wait_us += Start - event->time;
+    if((Start - event->time) > cls->wait_max_us){
+        cls->wait_max_us = Start - event->time;
+    }
+    cls->latency_us += End - event->time;
+    if((End - event->time) > cls->latency_max_us){
+        cls->latency_max_us = End - event->time;
+    }
+    if(event->budget != 0U){
+        cls->deadlines++;
+        if((End - event->time) > event->budget){
+            cls->misses++;
+        }
+    }
+}
+
+/* Today: whoever calls runs the operation to the end, one after the other */
+static void Inline(Flash_Sched_Class_Stats_t *stats)
+{
+    uint32_t index;
+    uint32_t start;
+    const Event_t *event;
+
+    Prepare();
+    for(index = 0; index < NbOfEvents; index++){
+        event = &Events[index];
+        if(Flash_Emu_Stats.now_ns < ((uint64_t)event->time * 1000U)){
+            Flash_Emu_Stats.now_ns = (uint64_t)event->time * 1000U;
+        }
+        start = (uint32_t)(Flash_Emu_Stats.now_ns / 1000U);
+        if(event->op == FLASH_SCHED_ERASE){
+            Flash_Emu_Erase(FLASH_GEO_BANK(event->address), FLASH_GEO_SECTOR(event->address), event->count);
+        }else{
+            Flash_Emu_Session();
+            Flash_Emu_Program(event->address, event->data, event->count);
+        }
+        Account(stats, event, start, (uint32_t)(Flash_Emu_Stats.now_ns / 1000U));
+    }
+}
+
+static uint32_t Host_Now(void)
+{
+    return (uint32_t)(Flash_Emu_Stats.now_ns / 1000U);
+}
+
+/* The erase happens at once in the array, but the bank stays busy and
+   emulated time does not move: the other bank is served meanwhile */
+static uint32_t Host_EraseStart(uint32_t FlashAddress)
+{
+    uint64_t now = Flash_Emu_Stats.now_ns;
+    uint32_t status = Flash_Emu_Erase(FLASH_GEO_BANK(FlashAddress), FLASH_GEO_SECTOR(FlashAddress), 1);
+
+    Flash_Emu_Stats.now_ns = now;
+    Busy_Until[FLASH_GEO_BANK(FlashAddress) - FLASH_BANK_1] = now + Flash_Emu_Timing.erase_ns;
+    return status;
+}
+
+static uint32_t Host_ErasePoll(uint32_t Bank)
+{
+    return (Flash_Emu_Stats.now_ns < Busy_Until[Bank - FLASH_BANK_1]) ? FLASH_BUSY : FLASH_OK;
+}
+
+static uint32_t Host_Program(uint32_t FlashAddress, const uint32_t *src)
+{
+    Flash_Emu_Session();
+    return Flash_Emu_Program(FlashAddress, src, 1);
+}
+
+static const Flash_Sched_Backend_t Host_Backend =
+{
+    Host_EraseStart,
+    Host_ErasePoll,
+    Host_Program,
+    Host_Now
+};
+
+static void Scheduled(Flash_Sched_t *sched)
+{
+    uint32_t next = 0;
+    uint32_t programs;
+    uint32_t status = FLASH_OK;
+    uint64_t when;
+
+    Prepare();
+    Flash_Sched_Init(sched, &Host_Backend);
+    while((next < NbOfEvents) || (status == FLASH_BUSY)){
+        while((next < NbOfEvents) && (Events[next].time <= Host_Now())){
+            if(Flash_Sched_Submit(sched, &Events[next].req, Events[next].op, Events[next].priority, Events[next].address,
+                                  Events[next].data, Events[next].count, Events[next].budget) != FLASH_OK){
+                fprintf(stderr, "request %u refused\n", next);
+                exit(1);
+            }
+            next++;
+        }
+        programs = Flash_Emu_Stats.programs;
+        status = Flash_Sched_Poll(sched);
+        if(Flash_Emu_Stats.programs == programs){
+            /* Nothing to program: sleep until the next request when idle */
+            when = Flash_Emu_Stats.now_ns + (POLL_US * 1000U);
+            if((status == FLASH_OK) && (next < NbOfEvents) && (((uint64_t)Events[next].time * 1000U) > when)){
+                when = (uint64_t)Events[next].time * 1000U;
+            }
+            Flash_Emu_Stats.now_ns = when;
+        }
+    }
+}
+
+/* Polls until the scheduler is idle, in POLL_US steps of emulated time */
+static void Run_Idle(Flash_Sched_t *sched)
+{
+    uint32_t status;
+
+    do{
+        status = Flash_Sched_Poll(sched);
+        Flash_Emu_Stats.now_ns += POLL_US * 1000U;
+    }while(status == FLASH_BUSY);
+}
+
+/* An urgent program submitted after a bulk erase of its sector must wait
+   for the erase instead of going first and being wiped by it */
+static uint32_t Erase_Barrier(void)
+{
+    static Flash_Sched_t sched;
+    static const uint32_t value[FW_WORDS] =
+    {
+        0x5A5A5A5AU, 0x5A5A5A5AU, 0x5A5A5A5AU, 0x5A5A5A5AU, 0x5A5A5A5AU, 0x5A5A5A5AU, 0x5A5A5A5AU, 0x5A5A5A5AU
+    };
+    Flash_Sched_Request_t erase;
+    Flash_Sched_Request_t program;
+    uint32_t address = FLASH_GEO_SECTOR_BASE(FLASH_BANK_2, 1);
+
+    Prepare();
+    Flash_Sched_Init(&sched, &Host_Backend);
+    if((Flash_Sched_Submit(&sched, &erase, FLASH_SCHED_ERASE, FLASH_SCHED_BULK, address, NULL, 1, 0) != FLASH_OK) ||
+       (Flash_Sched_Submit(&sched, &program, FLASH_SCHED_PROGRAM, FLASH_SCHED_URGENT, address, value, 1, 0) != FLASH_OK)){
+        printf("FAIL erase barrier: request refused\n");
+        return 1;
+    }
+    Run_Idle(&sched);
+
+    if((erase.status != FLASH_OK) || (program.status != FLASH_OK) ||
+       (memcmp(Flash_Emu_Memory(address), value, sizeof(value)) != 0)){
+        printf("FAIL erase barrier: urgent program at 0x%08X reads %08X after a bulk erase of its sector\n",
+               address, *(const uint32_t *)Flash_Emu_Memory(address));
+        return 1;
+    }
+    printf("urgent program behind a bulk erase of its sector lands after the erase\n");
+    return 0;
+}
+
+/* A program with a deadline held behind a bulk erase of its sector must
+   not keep that erase waiting for a gap: the erase has to go first for the
+   program to make it. The erase takes less than the starting estimate. */
+static uint32_t Erase_Deadline(void)
+{
+    static Flash_Sched_t sched;
+    static const uint32_t value[FW_WORDS] =
+    {
+        0xC3C3C3C3U, 0xC3C3C3C3U, 0xC3C3C3C3U, 0xC3C3C3C3U, 0xC3C3C3C3U, 0xC3C3C3C3U, 0xC3C3C3C3U, 0xC3C3C3C3U
+    };
+    Flash_Sched_Request_t erase;
+    Flash_Sched_Request_t program;
+    uint32_t address = FLASH_GEO_SECTOR_BASE(FLASH_BANK_2, 2);
+    uint32_t erase_ns = Flash_Emu_Timing.erase_ns;
+    uint32_t budget = (FLASH_SCHED_ERASE_US * 7U) / 10U;
+
+    Prepare();
+    Flash_Emu_Timing.erase_ns = FLASH_SCHED_ERASE_US * 400U;        /* 0.4 of the estimate, in ns */
+    Flash_Sched_Init(&sched, &Host_Backend);
+    if((Flash_Sched_Submit(&sched, &erase, FLASH_SCHED_ERASE, FLASH_SCHED_BULK, address, NULL, 1, 0) != FLASH_OK) ||
+       (Flash_Sched_Submit(&sched, &program, FLASH_SCHED_PROGRAM, FLASH_SCHED_NORMAL, address, value, 1, budget) != FLASH_OK)){
+        Flash_Emu_Timing.erase_ns = erase_ns;
+        printf("FAIL erase deadline: request refused\n");
+        return 1;
+    }
+    Run_Idle(&sched);
+    Flash_Emu_Timing.erase_ns = erase_ns;
+
+    if((erase.status != FLASH_OK) || (program.status != FLASH_OK) || (sched.stats.cls[FLASH_SCHED_NORMAL].misses != 0U) ||
+       (memcmp(Flash_Emu_Memory(address), value, sizeof(value)) != 0)){
+        printf("FAIL erase deadline: program behind the erase done after %u us, budget %u us\n",
+               sched.stats.cls[FLASH_SCHED_NORMAL].latency_max_us, budget);
+        return 1;
+    }
+    printf("program with a deadline behind a bulk erase of its sector done in %u us of %u\n\n",
+           sched.stats.cls[FLASH_SCHED_NORMAL].latency_max_us, budget);
+    return 0;
+}
+
+static void Report(const char *name, const Flash_Sched_Class_Stats_t *stats)
+{
+    static const char *const classes[FLASH_SCHED_CLASSES] = { "urgent", "normal", "bulk" };
+    const Flash_Sched_Class_Stats_t *cls;
+    uint32_t index;
+    uint32_t count;
+
+    printf("%s\n", name);
+    for(index = 0; index < FLASH_SCHED_CLASSES; index++){
+        cls = &stats[index];
+        count = cls->completed + cls->failed;
+        if(count == 0U){
+            continue;
+        }
+        printf("  %-7s %5u requests, %4u/%-4u deadlines missed, wait %9.0f us avg %9u max, done %9.0f us avg %9u max\n",
+               classes[index], count, cls->misses, cls->deadlines, (double)cls->wait_us / count, cls->wait_max_us,
+               (double)cls->latency_us / count, cls->latency_max_us);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    static Flash_Sched_t sched;
+    Flash_Sched_Class_Stats_t inline_stats[FLASH_SCHED_CLASSES];
+    uint32_t seconds = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : DEFAULT_SECONDS;
+    uint32_t bad;
+
+    if((seconds == 0U) || (seconds > 60U)){
+        fprintf(stderr, "seconds: 1..60\n");
+        return 1;
+    }
+    if((Erase_Barrier() != 0U) || (Erase_Deadline() != 0U)){
+        return 3;
+    }
+    Workload(seconds);
+    printf("%u requests over %u s: flush every %u ms, config commit every %u ms, telemetry every %u ms\n\n",
+           NbOfEvents, seconds, FLUSH_PERIOD_US / 1000U, CONFIG_PERIOD_US / 1000U, TELEMETRY_PERIOD_US / 1000U);
+
+    memset(inline_stats, 0, sizeof(inline_stats));
+    Inline(inline_stats);
+    bad = Check();
+    Report("inline, call order", inline_stats);
+    if(bad != 0U){
+        printf("  %u writes wrong in flash\n", bad);
+    }
+
+    Scheduled(&sched);
+    bad = Check();
+    Report("scheduled", sched.stats.cls);
+    printf("  %u preemptions, %u promotions, %u deferred erase polls, longest erase %u us\n",
+           sched.stats.preemptions, sched.stats.promotions, sched.stats.erases_deferred, sched.stats.erase_max_us);
+    if(bad != 0U){
+        printf("  %u writes wrong in flash\n", bad);
+        return 2;
+    }
+    printf("  every write verified in flash\n");
+    return 0;
+}
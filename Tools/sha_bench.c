@@ -0,0 +1,339 @@
+/**
+  ******************************************************************************
+  * @file    sha_bench.c
+  * @brief   Host check of the image authentication in Core/Src/flash_sha.c
+             against the emulated flash (flash_emu.c). Runs the SHA-256 and
+             HMAC known answers, streams an image through flash_stream.c with
+             the digest taken as blocks are programmed (also across a resumed
+             transfer) and checks it against a signed manifest, then times
+             boot checks of the written image without a cache, with a warm
+             cache and after one sector changed; only the first of them
+             authenticates, the cached ones detect change. The controller CRC that
+             tells unchanged sectors apart is modelled as in crc_verify.c:
+             its reads cost no CPU time.
+
+             gcc -O2 -DHOST_BUILD -ICore/Inc -ITools Tools/sha_bench.c Tools/flash_emu.c \
+                 Core/Src/flash_sha.c Core/Src/flash_crc.c Core/Src/flash_stream.c -o sha_bench
+             ./sha_bench [image bytes]
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "flash_emu.h"
+#include "flash_stream.h"
+#include "flash_sha.h"
+
+#define IMAGE_BASE      FLASH_BANK2_BASE
+#define IMAGE_MAX       (FLASH_GEO_BANK_SIZE - FLASH_GEO_SECTOR_SIZE)
+
+static uint8_t Image[FLASH_GEO_BANK_SIZE];
+static const uint8_t Key[32] = "sha_bench manifest key, 32 bytes";
+
+static uint32_t Host_Erase(uint32_t FlashAddress)
+{
+    return Flash_Emu_Erase(FLASH_GEO_BANK(FlashAddress), FLASH_GEO_SECTOR(FlashAddress), 1);
+}
+
+static uint32_t Host_Program(uint32_t FlashAddress, const uint32_t *src, uint32_t NbOfFlashWords)
+{
+    return Flash_Emu_Program(FlashAddress, src, NbOfFlashWords);
+}
+
+static const Flash_Stream_Backend_t Host_Backend =
+{
+    Host_Erase, Host_Program, Flash_Emu_Read
+};
+
+/* Controller CRC: computed at once, its flash reads and time kept off
+   the CPU counts */
+static uint32_t crc_value;
+static double crc_us;
+static double hook_us;
+
+static double HostUs(void);
+
+static uint32_t Host_CrcStart(uint32_t FlashAddress, uint32_t Length)
+{
+    static uint32_t buffer[FLASH_GEO_SECTOR_SIZE / 4U];
+    uint64_t now = Flash_Emu_Stats.now_ns;
+    uint32_t reads = Flash_Emu_Stats.reads;
+    uint32_t fail;
+    uint32_t part;
+    double start = HostUs();
+
+    crc_value = FLASH_CRC_INIT;
+    for(; Length != 0U; Length -= part, FlashAddress += part){
+        part = (Length < sizeof(buffer)) ? Length : sizeof(buffer);
+        if(Flash_Emu_Read(buffer, FlashAddress, part, &fail) != FLASH_OK){
+            return FLASH_ERROR;
+        }
+        crc_value = Flash_Crc_Soft(crc_value, buffer, part);
+    }
+    Flash_Emu_Stats.now_ns = now;
+    Flash_Emu_Stats.reads = reads;
+    crc_us += HostUs() - start;
+    return FLASH_OK;
+}
+
+static uint32_t Host_CrcResult(uint32_t FlashAddress, uint32_t *crc)
+{
+    (void)FlashAddress;
+    *crc = crc_value;
+    return FLASH_OK;
+}
+
+static const Flash_Crc_Backend_t Host_CrcBackend =
+{
+    Host_Program, Flash_Emu_Read, Host_CrcStart, Host_CrcResult
+};
+
+static double HostUs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((double)now.tv_sec * 1e6) + ((double)now.tv_nsec / 1e3);
+}
+
+/* Flash_Sha_StreamHook, timed */
+static void Hook(void *context, uint32_t Offset, const void *data, uint32_t Length)
+{
+    double start = HostUs();
+
+    Flash_Sha_StreamHook(context, Offset, data, Length);
+    hook_us += HostUs() - start;
+}
+
+static uint32_t Hex(const uint8_t *digest, const char *expected)
+{
+    char text[2U * FLASH_SHA_DIGEST_SIZE + 1U];
+    uint32_t index;
+
+    for(index = 0; index < FLASH_SHA_DIGEST_SIZE; index++){
+        sprintf(&text[2U * index], "%02x", digest[index]);
+    }
+    return strcmp(text, expected) == 0;
+}
+
+static uint32_t KnownAnswers(void)
+{
+    static const char *const message[3] =
+    {
+        "", "abc", "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+    };
+    static const char *const expected[3] =
+    {
+        "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+        "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+        "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"
+    };
+    uint8_t digest[FLASH_SHA_DIGEST_SIZE];
+    uint8_t block[1000];
+    Flash_Sha_t sha;
+    uint32_t index;
+    uint32_t fail = 0;
+
+    for(index = 0; index < 3U; index++){
+        Flash_Sha_Init(&sha);
+        Flash_Sha_Update(&sha, message[index], (uint32_t)strlen(message[index]));
+        Flash_Sha_Final(&sha, digest);
+        fail |= !Hex(digest, expected[index]);
+    }
+    /* A million 'a' in uneven pieces, through both the buffered and the
+       direct path */
+    memset(block, 'a', sizeof(block));
+    Flash_Sha_Init(&sha);
+    for(index = 0; index < 1000000U; index += 1000U){
+        Flash_Sha_Update(&sha, block, 7);
+        Flash_Sha_Update(&sha, block, 993);
+    }
+    Flash_Sha_Final(&sha, digest);
+    fail |= !Hex(digest, "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0");
+
+    /* RFC 4231, test case 2 */
+    Flash_Sha_Hmac((const uint8_t *)"Jefe", 4, "what do ya want for nothing?", 28, digest);
+    fail |= !Hex(digest, "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843");
+    printf("known answers: %s\n", fail ? "FAILED" : "ok");
+    return fail;
+}
+
+/* Streams Image[From, Size) as the update transport would */
+static uint32_t Stream(Flash_Stream_t *stream, uint32_t From, uint32_t Size)
+{
+    Flash_Stream_Header_t header;
+    uint8_t *buffer;
+    uint32_t offset;
+
+    for(offset = From; offset < Size; offset += header.length){
+        while((buffer = Flash_Stream_Acquire(stream)) == NULL){
+            if(Flash_Stream_Process(stream) != FLASH_OK){
+                return FLASH_ERROR;
+            }
+        }
+        header.offset = offset;
+        header.length = ((Size - offset) < FLASH_STREAM_BLOCK_SIZE) ? (Size - offset) : FLASH_STREAM_BLOCK_SIZE;
+        memcpy(buffer, &Image[offset], header.length);
+        header.crc = Flash_Stream_Crc(0, buffer, header.length);
+        if(Flash_Stream_Commit(stream, &header) != FLASH_OK){
+            return FLASH_ERROR;
+        }
+    }
+    while(!Flash_Stream_Idle(stream)){
+        if(Flash_Stream_Process(stream) != FLASH_OK){
+            return FLASH_ERROR;
+        }
+    }
+    return stream->status;
+}
+
+int main(int argc, char **argv)
+{
+    static Flash_Stream_t stream;
+    static Flash_Sha_Image_t image;
+    static Flash_Sha_Cache_t cache;
+    static uint8_t block[FLASH_STREAM_BLOCK_SIZE];
+    Flash_Sha_Manifest_t manifest;
+    Flash_Sha_Manifest_t forged;
+    uint8_t digest[FLASH_SHA_DIGEST_SIZE];
+    uint8_t boot[FLASH_SHA_DIGEST_SIZE];
+    uint32_t size = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 900000U;
+    uint32_t sectors;
+    uint32_t changed;
+    uint32_t index;
+    uint32_t reads;
+    uint32_t fail;
+    uint64_t ns;
+    double hash_us;
+    double start;
+
+    if((size <= (2U * FLASH_GEO_SECTOR_SIZE)) || (size > IMAGE_MAX)){
+        fprintf(stderr, "image size must be %u..%u\n", (uint32_t)(2U * FLASH_GEO_SECTOR_SIZE + 1U), (uint32_t)IMAGE_MAX);
+        return 1;
+    }
+    sectors = (size + FLASH_GEO_SECTOR_SIZE - 1U) >> FLASH_GEO_SECTOR_SHIFT;
+    fail = KnownAnswers();
+
+    srand(1);
+    for(index = 0; index < size; index++){
+        Image[index] = (uint8_t)(rand() >> 7);
+    }
+    /* The signer hashes the image the same way, in one piece */
+    Flash_Sha_ImageInit(&image);
+    Flash_Sha_ImageUpdate(&image, Image, size);
+    memset(&manifest, 0, sizeof(manifest));
+    manifest.size = size;
+    manifest.version = 1;
+    Flash_Sha_ImageFinal(&image, manifest.digest);
+    Flash_Sha_ManifestSign(&manifest, Key, sizeof(Key));
+
+    /* Update: digest taken per block as it is programmed */
+    Flash_Emu_Init();
+    Flash_Stream_Init(&stream, &Host_Backend, IMAGE_BASE, FLASH_GEO_BANK_SIZE, 0);
+    Flash_Sha_ImageInit(&image);
+    stream.hook = Hook;
+    stream.hook_context = &image;
+    if(Stream(&stream, 0, size) != FLASH_OK){
+        printf("stream FAILED\n");
+        return 1;
+    }
+    ns = Flash_Emu_Stats.now_ns;
+    Flash_Sha_ImageFinal(&image, digest);
+    if(Flash_Sha_ManifestCheck(&manifest, Key, sizeof(Key), digest) != FLASH_OK){
+        printf("streamed digest: FAILED\n");
+        fail = 1;
+    }
+    printf("update:        %u bytes programmed in %.1f ms emulated; hashing in the hook %.0f us host (%.0f Mbytes/s)\n",
+           size, (double)ns / 1e6, hook_us, (double)size / hook_us);
+
+    /* The alternative: a second pass reading the image back */
+    Flash_Emu_Stats.now_ns = 0;
+    Flash_Emu_Stats.reads = 0;
+    if((Flash_Sha_ImageCompute(&Host_CrcBackend, IMAGE_BASE, size, NULL, boot) != FLASH_OK) ||
+       (memcmp(boot, digest, sizeof(boot)) != 0)){
+        printf("read-back digest: FAILED\n");
+        fail = 1;
+    }
+    printf("read-back:     %u flashword reads, %.3f ms emulated flash time avoided\n",
+           Flash_Emu_Stats.reads, (double)Flash_Emu_Stats.now_ns / 1e6);
+
+    /* Manifest checks */
+    forged = manifest;
+    forged.size ^= 1U;
+    if(Flash_Sha_ManifestCheck(&forged, Key, sizeof(Key), NULL) == FLASH_OK){
+        printf("altered manifest accepted: FAILED\n");
+        fail = 1;
+    }
+    if(Flash_Sha_ManifestCheck(&manifest, (const uint8_t *)"another key", 11, digest) == FLASH_OK){
+        printf("wrong key accepted: FAILED\n");
+        fail = 1;
+    }
+
+    /* Resumed transfer, cut at a block: the prefix on flash is hashed
+       (as Flash_AB_BeginSigned does), the rest streamed */
+    Flash_Emu_Init();
+    Flash_Stream_Init(&stream, &Host_Backend, IMAGE_BASE, FLASH_GEO_BANK_SIZE, 0);
+    Stream(&stream, 0, (size / 2U) & ~(FLASH_STREAM_BLOCK_SIZE - 1U));
+    Flash_Stream_Init(&stream, &Host_Backend, IMAGE_BASE, FLASH_GEO_BANK_SIZE, 1);
+    Flash_Sha_ImageInit(&image);
+    for(index = 0; index < stream.written; index += FLASH_STREAM_BLOCK_SIZE){
+        Flash_Emu_Read(block, IMAGE_BASE + index, FLASH_STREAM_BLOCK_SIZE, &reads);
+        Flash_Sha_ImageUpdate(&image, block, FLASH_STREAM_BLOCK_SIZE);
+    }
+    stream.hook = Flash_Sha_StreamHook;
+    stream.hook_context = &image;
+    if(Stream(&stream, stream.written, size) != FLASH_OK){
+        printf("resumed stream FAILED\n");
+        return 1;
+    }
+    Flash_Sha_ImageFinal(&image, digest);
+    if(Flash_Sha_ManifestCheck(&manifest, Key, sizeof(Key), digest) != FLASH_OK){
+        printf("resumed digest: FAILED\n");
+        fail = 1;
+    }
+
+    /* Boot: cold cache, warm cache, one sector changed */
+    memset(&cache, 0, sizeof(cache));
+    for(index = 0; index < 3U; index++){
+        if(index == 2U){
+            /* A sector rewritten behind the manifest's back */
+            changed = (sectors / 2U) << FLASH_GEO_SECTOR_SHIFT;
+            Image[changed + 1000U] ^= 0x55U;
+            Flash_Emu_Erase(FLASH_GEO_BANK(IMAGE_BASE), sectors / 2U, 1);
+            Flash_Emu_Program(IMAGE_BASE + changed, &Image[changed], FLASH_GEO_WORDS_PER_SECTOR);
+        }
+        Flash_Emu_Stats.reads = 0;
+        crc_us = 0.0;
+        start = HostUs();
+        if(Flash_Sha_ImageCompute(&Host_CrcBackend, IMAGE_BASE, size, &cache, boot) != FLASH_OK){
+            printf("boot: read FAILED\n");
+            return 1;
+        }
+        hash_us = HostUs() - start - crc_us;
+        printf("boot (%s):  %u sectors hashed, %u from cache, %6u CPU flashword reads, host %7.0f us, %s\n",
+               (index == 0U) ? "cold   " : ((index == 1U) ? "cached " : "changed"), cache.hashed, cache.reused,
+               Flash_Emu_Stats.reads, hash_us,
+               (Flash_Sha_ManifestCheck(&manifest, Key, sizeof(Key), boot) == FLASH_OK) ? "matches" : "rejected");
+        if(((index < 2U) && (memcmp(boot, digest, sizeof(boot)) != 0)) ||
+           ((index == 1U) && (cache.hashed != 0U)) || ((index == 2U) && (cache.hashed != 1U)) ||
+           ((index == 2U) && (memcmp(boot, digest, sizeof(boot)) == 0))){
+            printf("boot check FAILED\n");
+            fail = 1;
+        }
+    }
+
+    printf("%s\n", fail ? "FAILED" : "ok");
+    return (int)fail;
+}
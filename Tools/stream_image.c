@@ -0,0 +1,297 @@
+/**
+  ******************************************************************************
+  * @file    stream_image.c
+  * @brief   Host check of the double-buffered image writer in
+             Core/Src/flash_stream.c. A socketpair stands in for the serial
+             link: a sender thread pushes framed blocks at the link rate, a
+             receiver thread plays the UART interrupt, and the main thread
+             programs the emulated flash (flash_emu.c) at real speed, scaled.
+
+             gcc -O2 -pthread -DHOST_BUILD -ICore/Inc -ITools Tools/stream_image.c \
+                 Tools/flash_emu.c Core/Src/flash_stream.c -o stream_image
+             ./stream_image [-s bytes] [-l link bytes/s] [-x flash time divider]
+                            [-c corrupt block] [-k stop offset]
+
+             -c sends one block with a bad CRC, -k cuts the transfer at the
+             given offset and finishes it with a resumed second session.
+             Add -DFLASH_STREAM_BLOCK_SIZE=65536U to see blocks large enough
+             to cover a sector erase (-x 10 makes flash and link comparable).
+             Wire: Flash_Stream_Header_t + payload; reply: next offset (u32).
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include "flash_emu.h"
+#include "flash_stream.h"
+
+#define IMAGE_BASE      FLASH_BANK2_BASE
+
+typedef struct{
+    int fd;
+    const uint8_t *image;
+    uint32_t size;
+    uint32_t link_rate;         /* bytes per second */
+    uint32_t corrupt;           /* block index to corrupt once, or ~0 */
+    uint32_t stop;              /* offset at which the link drops */
+    uint32_t start;             /* first offset to send */
+}Sender_t;
+
+typedef struct{
+    int fd;
+    Flash_Stream_t *stream;
+    volatile int done;
+}Receiver_t;
+
+static uint32_t flash_divider = 100;
+
+static double Now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
+
+static void Sleep_Ns(uint64_t ns)
+{
+    struct timespec ts = { (time_t)(ns / 1000000000U), (long)(ns % 1000000000U) };
+
+    nanosleep(&ts, NULL);
+}
+
+static int Full_Read(int fd, void *dest, size_t length)
+{
+    uint8_t *p = dest;
+    ssize_t got;
+
+    while(length != 0U){
+        got = read(fd, p, length);
+        if(got <= 0){
+            return -1;
+        }
+        p += got;
+        length -= (size_t)got;
+    }
+    return 0;
+}
+
+/* The emulator only accounts time; sleep it off so the overlap is real */
+static uint32_t Host_Erase(uint32_t FlashAddress)
+{
+    uint64_t before = Flash_Emu_Stats.now_ns;
+    uint32_t status = Flash_Emu_Erase(FLASH_GEO_BANK(FlashAddress), FLASH_GEO_SECTOR(FlashAddress), 1);
+
+    Sleep_Ns((Flash_Emu_Stats.now_ns - before) / flash_divider);
+    return status;
+}
+
+static uint32_t Host_Program(uint32_t FlashAddress, const uint32_t *src, uint32_t NbOfFlashWords)
+{
+    uint64_t before = Flash_Emu_Stats.now_ns;
+    uint32_t status;
+
+    Flash_Emu_Session();
+    status = Flash_Emu_Program(FlashAddress, src, NbOfFlashWords);
+    Sleep_Ns((Flash_Emu_Stats.now_ns - before) / flash_divider);
+    return status;
+}
+
+static const Flash_Stream_Backend_t Host_Backend =
+{
+    Host_Erase, Host_Program, Flash_Emu_Read
+};
+
+static void *Sender(void *arg)
+{
+    Sender_t *tx = arg;
+    uint8_t block[FLASH_STREAM_BLOCK_SIZE];
+    Flash_Stream_Header_t header;
+    uint32_t offset = tx->start;
+    uint32_t next;
+
+    while((offset < tx->size) && (offset < tx->stop)){
+        header.offset = offset;
+        header.length = ((tx->size - offset) < FLASH_STREAM_BLOCK_SIZE) ? (tx->size - offset) : FLASH_STREAM_BLOCK_SIZE;
+        header.crc = Flash_Stream_Crc(0, &tx->image[offset], header.length);
+        memcpy(block, &tx->image[offset], header.length);
+        if((offset / FLASH_STREAM_BLOCK_SIZE) == tx->corrupt){
+            block[0] ^= 0x01U;
+            tx->corrupt = ~0U;
+        }
+
+        if((write(tx->fd, &header, sizeof(header)) != sizeof(header)) ||
+           (write(tx->fd, block, header.length) != (ssize_t)header.length)){
+            break;
+        }
+        Sleep_Ns(((uint64_t)(sizeof(header) + header.length) * 1000000000U) / tx->link_rate);
+
+        /* The reply comes at commit, not after programming: only a full
+           pair of buffers holds the link back */
+        if(Full_Read(tx->fd, &next, sizeof(next)) != 0){
+            break;
+        }
+        offset = next;
+    }
+    shutdown(tx->fd, SHUT_WR);
+    return NULL;
+}
+
+static void *Receiver(void *arg)
+{
+    Receiver_t *rx = arg;
+    Flash_Stream_Header_t header;
+    uint32_t next;
+    uint8_t *buffer;
+
+    for(;;){
+        buffer = Flash_Stream_Acquire(rx->stream);
+        if(buffer == NULL){
+            if(rx->stream->status != FLASH_OK){
+                break;
+            }
+            Sleep_Ns(20000);
+            continue;
+        }
+        if((Full_Read(rx->fd, &header, sizeof(header)) != 0) || (header.length > FLASH_STREAM_BLOCK_SIZE) ||
+           (Full_Read(rx->fd, buffer, header.length) != 0)){
+            break;
+        }
+        Flash_Stream_Commit(rx->stream, &header);
+        next = Flash_Stream_NextOffset(rx->stream);
+        if(write(rx->fd, &next, sizeof(next)) != sizeof(next)){
+            break;
+        }
+    }
+    rx->done = 1;
+    return NULL;
+}
+
+static uint32_t Session(Flash_Stream_t *stream, Sender_t *tx, uint32_t Resume, double *elapsed)
+{
+    Receiver_t rx;
+    pthread_t tx_thread;
+    pthread_t rx_thread;
+    int fds[2];
+    double start = Now();
+
+    if(Flash_Stream_Init(stream, &Host_Backend, IMAGE_BASE, FLASH_GEO_BANK_SIZE, Resume) != FLASH_OK){
+        return FLASH_ERROR;
+    }
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0){
+        perror("socketpair");
+        exit(1);
+    }
+
+    tx->fd = fds[0];
+    tx->start = Flash_Stream_NextOffset(stream);
+    rx.fd = fds[1];
+    rx.stream = stream;
+    rx.done = 0;
+    pthread_create(&tx_thread, NULL, Sender, tx);
+    pthread_create(&rx_thread, NULL, Receiver, &rx);
+
+    /* Main loop of the target */
+    while(!rx.done || !Flash_Stream_Idle(stream)){
+        if(Flash_Stream_Process(stream) != FLASH_OK){
+            break;
+        }
+        Sleep_Ns(10000);
+    }
+    /* A failed stream stops acquiring; unblock whichever side still waits */
+    shutdown(fds[1], SHUT_RDWR);
+    pthread_join(tx_thread, NULL);
+    pthread_join(rx_thread, NULL);
+    close(fds[0]);
+    close(fds[1]);
+
+    *elapsed = Now() - start;
+    return stream->status;
+}
+
+int main(int argc, char **argv)
+{
+    static Flash_Stream_t stream;
+    Sender_t tx;
+    uint8_t *image;
+    uint32_t size = 512U * 1024U;
+    uint32_t index;
+    uint32_t status;
+    int opt;
+    double elapsed;
+    double total;
+    double link_s;
+    double flash_s;
+
+    memset(&tx, 0, sizeof(tx));
+    tx.link_rate = 1000000U;
+    tx.corrupt = ~0U;
+    tx.stop = ~0U;
+
+    while((opt = getopt(argc, argv, "s:l:x:c:k:")) != -1){
+        switch(opt){
+        case 's': size = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'l': tx.link_rate = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'x': flash_divider = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'c': tx.corrupt = (uint32_t)strtoul(optarg, NULL, 0); break;
+        case 'k': tx.stop = (uint32_t)strtoul(optarg, NULL, 0); break;
+        default:
+            fprintf(stderr, "usage: %s [-s bytes] [-l link B/s] [-x divider] [-c block] [-k offset]\n", argv[0]);
+            return 1;
+        }
+    }
+    if((size == 0U) || (size > FLASH_GEO_BANK_SIZE) || (tx.link_rate == 0U) || (flash_divider == 0U)){
+        fprintf(stderr, "bad arguments\n");
+        return 1;
+    }
+
+    image = malloc(size);
+    srand(1);
+    for(index = 0; index < size; index++){
+        image[index] = (uint8_t)rand();
+    }
+    tx.image = image;
+    tx.size = size;
+
+    Flash_Emu_Init();
+    status = Session(&stream, &tx, 0, &elapsed);
+    total = elapsed;
+    printf("session 1       %.3f s, %u blocks, written %u, rejected %u, stalls %u\n",
+           elapsed, stream.blocks, stream.written, stream.rejected, stream.stalls);
+
+    if((status == FLASH_OK) && (stream.written < size)){
+        tx.stop = ~0U;
+        status = Session(&stream, &tx, 1, &elapsed);
+        total += elapsed;
+        printf("session 2       %.3f s, resumed, %u blocks, %u flashwords skipped\n", elapsed, stream.blocks, stream.skipped);
+    }
+
+    link_s = (double)size * (1.0 + ((double)sizeof(Flash_Stream_Header_t) / FLASH_STREAM_BLOCK_SIZE)) / tx.link_rate;
+    flash_s = ((double)((size + FLASH_GEO_SECTOR_SIZE - 1U) >> FLASH_GEO_SECTOR_SHIFT) * Flash_Emu_Timing.erase_ns +
+               (double)((size + FLASH_GEO_FLASHWORD_SIZE - 1U) >> FLASH_GEO_FLASHWORD_SHIFT) * Flash_Emu_Timing.program_ns) /
+              1e9 / flash_divider;
+    printf("link alone      %.3f s\nflash alone     %.3f s\nsequential      %.3f s\nmeasured        %.3f s\n",
+           link_s, flash_s, link_s + flash_s, total);
+
+    if((status != FLASH_OK) || (memcmp(Flash_Emu_Memory(IMAGE_BASE), image, size) != 0)){
+        printf("image MISMATCH\n");
+        return 2;
+    }
+    printf("image verified\n");
+    return 0;
+}
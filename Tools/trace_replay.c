@@ -0,0 +1,226 @@
+/**
+  ******************************************************************************
+  * @file    trace_replay.c
+  * @brief   Host replay of a flash operation trace captured on the target
+             (Core/Src/flash_trace.c, built with FLASH_TRACE_ENABLE). Every
+             recorded call is re-issued against flash_emu.c and the recorded
+             time is set against the emulated time per operation type.
+             With a baseline trace, operation types whose mean time grew by
+             more than the threshold are reported and the exit code is 3.
+
+             gcc -O2 -DHOST_BUILD -ICore/Inc -ITools Tools/trace_replay.c \
+                 Tools/flash_emu.c -o trace_replay
+             ./trace_replay trace.bin [baseline.bin [threshold %]]
+
+             trace.bin is the RAM image of Flash_Trace, e.g. from gdb:
+             dump binary memory trace.bin &Flash_Trace (char *)&Flash_Trace + sizeof(Flash_Trace)
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flash_emu.h"
+#include "flash_trace.h"
+
+#define DEFAULT_THRESHOLD   10U     /* percent */
+
+typedef struct{
+    uint32_t calls;
+    uint32_t failed;
+    uint64_t bytes;
+    double recorded_us;
+    double emulated_us;
+}Op_Summary_t;
+
+typedef struct{
+    uint32_t clock_hz;
+    uint32_t count;
+    Flash_Trace_Record_t *records;  /* oldest first */
+}Trace_t;
+
+static const char *const Op_Names[FLASH_TRACE_OP_COUNT] =
+{
+    "Flash_Program", "Flash_Sector_Erase", "FLASH_Program", "FLASH_Erase"
+};
+
+static void Load_Trace(const char *path, Trace_t *trace)
+{
+    Flash_Trace_t header;
+    Flash_Trace_Record_t *ring;
+    uint32_t first;
+    uint32_t index;
+    FILE *f = fopen(path, "rb");
+
+    if(f == NULL){
+        perror(path);
+        exit(1);
+    }
+    if((fread(&header, offsetof(Flash_Trace_t, records), 1, f) != 1) || (header.magic != FLASH_TRACE_MAGIC) ||
+       (header.version != FLASH_TRACE_VERSION) || (header.record_size != sizeof(Flash_Trace_Record_t)) ||
+       (header.depth == 0U) || ((header.depth & (header.depth - 1U)) != 0U) || (header.clock_hz == 0U)){
+        fprintf(stderr, "%s: not a flash trace image\n", path);
+        exit(1);
+    }
+
+    ring = calloc(header.depth, sizeof(*ring));
+    trace->records = calloc(header.depth, sizeof(*ring));
+    if((ring == NULL) || (trace->records == NULL) || (fread(ring, sizeof(*ring), header.depth, f) != header.depth)){
+        fprintf(stderr, "%s: truncated trace image\n", path);
+        exit(1);
+    }
+    fclose(f);
+
+    /* Unroll the ring: once it has wrapped, the oldest record sits at head */
+    trace->clock_hz = header.clock_hz;
+    trace->count = (header.head < header.depth) ? header.head : header.depth;
+    first = (header.head < header.depth) ? 0U : (header.head & (header.depth - 1U));
+    for(index = 0; index < trace->count; index++){
+        trace->records[index] = ring[(first + index) & (header.depth - 1U)];
+    }
+    free(ring);
+}
+
+/* Re-issues one recorded call through the emulator and returns its emulated time */
+static uint64_t Replay(const Flash_Trace_Record_t *rec)
+{
+    static uint32_t data[FLASH_NB_32BITWORD_IN_FLASHWORD];
+    uint32_t op = (rec->info >> FLASH_TRACE_OP_POS) & 0xFU;
+    uint32_t length = rec->info & FLASH_TRACE_LEN_MASK;
+    uint32_t address = rec->address;
+    uint32_t end;
+    uint32_t bank;
+    uint32_t first;
+    uint32_t last;
+    uint64_t before = Flash_Emu_Stats.now_ns;
+
+    if(length == 0U){
+        return 0;
+    }
+    Flash_Emu_Session();
+
+    switch(op){
+    case FLASH_TRACE_OP_PROGRAM:
+    case FLASH_TRACE_OP_PROGRAM_BYTES:
+        /* Contents are not traced; the cost depends only on the flashword count */
+        for(end = address + length; address < end; address += FLASH_GEO_FLASHWORD_SIZE){
+            if(Flash_Emu_Program(address, data, 1) != FLASH_OK){
+                break;
+            }
+        }
+        break;
+
+    case FLASH_TRACE_OP_SECTOR_ERASE:
+    case FLASH_TRACE_OP_ERASE_RANGE:
+        end = address + length - 1U;
+        if(!FLASH_GEO_IS_VALID(address) || !FLASH_GEO_IS_VALID(end)){
+            break;
+        }
+        for(bank = FLASH_GEO_BANK(address); bank <= FLASH_GEO_BANK(end); bank++){
+            first = (bank == FLASH_GEO_BANK(address)) ? FLASH_GEO_SECTOR(address) : 0U;
+            last = (bank == FLASH_GEO_BANK(end)) ? FLASH_GEO_SECTOR(end) : (FLASH_GEO_SECTORS_PER_BANK - 1U);
+            Flash_Emu_Erase(bank, first, last - first + 1U);
+        }
+        break;
+
+    default:
+        break;
+    }
+    return Flash_Emu_Stats.now_ns - before;
+}
+
+static void Summarize(const Trace_t *trace, Op_Summary_t *summary, uint32_t emulate)
+{
+    const Flash_Trace_Record_t *rec;
+    uint32_t op;
+    uint32_t index;
+
+    memset(summary, 0, sizeof(Op_Summary_t) * FLASH_TRACE_OP_COUNT);
+    for(index = 0; index < trace->count; index++){
+        rec = &trace->records[index];
+        op = (rec->info >> FLASH_TRACE_OP_POS) & 0xFU;
+        if(op >= FLASH_TRACE_OP_COUNT){
+            continue;
+        }
+        summary[op].calls++;
+        summary[op].bytes += rec->info & FLASH_TRACE_LEN_MASK;
+        summary[op].recorded_us += (double)rec->cycles * 1e6 / trace->clock_hz;
+        if((rec->info >> FLASH_TRACE_RESULT_POS) != FLASH_OK){
+            summary[op].failed++;
+        }
+        if(emulate != 0U){
+            summary[op].emulated_us += (double)Replay(rec) / 1e3;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    Op_Summary_t current[FLASH_TRACE_OP_COUNT];
+    Op_Summary_t baseline[FLASH_TRACE_OP_COUNT];
+    Trace_t trace;
+    Trace_t base;
+    uint32_t threshold = DEFAULT_THRESHOLD;
+    uint32_t regressions = 0;
+    uint32_t op;
+    double now_mean;
+    double base_mean;
+
+    if(argc < 2){
+        fprintf(stderr, "usage: %s trace.bin [baseline.bin [threshold %%]]\n", argv[0]);
+        return 1;
+    }
+    if(argc > 3){
+        threshold = (uint32_t)strtoul(argv[3], NULL, 0);
+    }
+
+    Load_Trace(argv[1], &trace);
+    Flash_Emu_Init();
+    Summarize(&trace, current, 1);
+
+    printf("%u records at %u Hz\n", trace.count, trace.clock_hz);
+    printf("%-20s %8s %8s %12s %14s %14s %8s\n", "operation", "calls", "failed", "bytes", "recorded us", "emulated us", "ratio");
+    for(op = 0; op < FLASH_TRACE_OP_COUNT; op++){
+        if(current[op].calls == 0U){
+            continue;
+        }
+        printf("%-20s %8u %8u %12llu %14.1f %14.1f %8.2f\n", Op_Names[op], current[op].calls, current[op].failed,
+               (unsigned long long)current[op].bytes, current[op].recorded_us, current[op].emulated_us,
+               (current[op].emulated_us > 0.0) ? (current[op].recorded_us / current[op].emulated_us) : 0.0);
+    }
+
+    if(argc < 3){
+        return 0;
+    }
+
+    Load_Trace(argv[2], &base);
+    Summarize(&base, baseline, 0);
+
+    /* Compare time per byte so traces of different workloads stay comparable */
+    printf("\nagainst %s (threshold %u%%)\n", argv[2], threshold);
+    for(op = 0; op < FLASH_TRACE_OP_COUNT; op++){
+        if((current[op].bytes == 0U) || (baseline[op].bytes == 0U)){
+            continue;
+        }
+        now_mean = current[op].recorded_us / (double)current[op].bytes;
+        base_mean = baseline[op].recorded_us / (double)baseline[op].bytes;
+        if(now_mean > (base_mean * (100.0 + threshold) / 100.0)){
+            printf("REGRESSION %-20s %+.1f%%\n", Op_Names[op], ((now_mean / base_mean) - 1.0) * 100.0);
+            regressions++;
+        }else{
+            printf("ok         %-20s %+.1f%%\n", Op_Names[op], ((now_mean / base_mean) - 1.0) * 100.0);
+        }
+    }
+    return (regressions == 0U) ? 0 : 3;
+}
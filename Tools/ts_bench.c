@@ -0,0 +1,164 @@
+/**
+  ******************************************************************************
+  * @file    ts_bench.c
+  * @brief   Host check of the flash time-series ring in Core/Src/flash_ts.c
+             against the emulated flash (flash_emu.c). Appends enough samples
+             to wrap the ring, remounts it part way through, then checks
+             random range queries against a full scan and reports the data
+             flashwords each approach reads and the mount cost.
+
+             gcc -O2 -DHOST_BUILD -ICore/Inc -ITools Tools/ts_bench.c \
+                 Tools/flash_emu.c Core/Src/flash_ts.c Core/Src/flash_stream.c -o ts_bench
+             ./ts_bench [samples [queries]]
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "flash_emu.h"
+#include "flash_ts.h"
+
+#define RING_BASE       FLASH_BANK2_BASE
+#define RING_SECTORS    4U
+
+static uint32_t Host_Erase(uint32_t FlashAddress)
+{
+    return Flash_Emu_Erase(FLASH_GEO_BANK(FlashAddress), FLASH_GEO_SECTOR(FlashAddress), 1);
+}
+
+static uint32_t Host_Program(uint32_t FlashAddress, const uint32_t *src, uint32_t NbOfFlashWords)
+{
+    return Flash_Emu_Program(FlashAddress, src, NbOfFlashWords);
+}
+
+static const Flash_Stream_Backend_t Host_Backend =
+{
+    Host_Erase, Host_Program, Flash_Emu_Read
+};
+
+/* Reference: every data flashword of every sector holding data */
+static void FullScan(const Flash_TS_t *ts, uint32_t First, uint32_t Last, Flash_TS_Result_t *result)
+{
+    Flash_TS_Sample_t word[FLASH_TS_PER_FLASHWORD];
+    uint32_t k;
+    uint32_t fw;
+    uint32_t slot;
+    uint32_t fail;
+    uint32_t sector;
+
+    memset(result, 0, sizeof(*result));
+    result->min = INT32_MAX;
+    result->max = INT32_MIN;
+    for(k = 0; k < ts->used; k++){
+        sector = RING_BASE + (((ts->oldest + k) % ts->nb_sectors) << FLASH_GEO_SECTOR_SHIFT);
+        for(fw = 0; fw < FLASH_TS_DATA_WORDS; fw++){
+            Flash_Emu_Read(word, sector + ((fw + 1U) << FLASH_GEO_FLASHWORD_SHIFT), sizeof(word), &fail);
+            result->flashwords++;
+            for(slot = 0; slot < FLASH_TS_PER_FLASHWORD; slot++){
+                if((word[slot].time == 0xFFFFFFFFU) || (word[slot].time < First) || (word[slot].time > Last)){
+                    continue;
+                }
+                result->count++;
+                result->min = (word[slot].value < result->min) ? word[slot].value : result->min;
+                result->max = (word[slot].value > result->max) ? word[slot].value : result->max;
+                result->sum += word[slot].value;
+            }
+        }
+    }
+    for(slot = 0; slot < ts->pending; slot++){
+        if((ts->batch[slot].time >= First) && (ts->batch[slot].time <= Last)){
+            result->count++;
+            result->min = (ts->batch[slot].value < result->min) ? ts->batch[slot].value : result->min;
+            result->max = (ts->batch[slot].value > result->max) ? ts->batch[slot].value : result->max;
+            result->sum += ts->batch[slot].value;
+        }
+    }
+}
+
+static uint64_t Mount(Flash_TS_t *ts)
+{
+    Flash_Emu_Stats.now_ns = 0;
+    if(Flash_TS_Init(ts, &Host_Backend, RING_BASE, RING_SECTORS) != FLASH_OK){
+        fprintf(stderr, "mount failed\n");
+        exit(1);
+    }
+    return Flash_Emu_Stats.now_ns;
+}
+
+int main(int argc, char **argv)
+{
+    static Flash_TS_t ts;
+    Flash_TS_Result_t fast;
+    Flash_TS_Result_t slow;
+    uint32_t samples = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : (RING_SECTORS * FLASH_TS_PER_SECTOR * 3U / 2U);
+    uint32_t queries = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0) : 2000U;
+    uint32_t time = 1000;
+    uint32_t index;
+    uint32_t first;
+    uint32_t last;
+    uint32_t oldest;
+    uint64_t fast_fw = 0;
+    uint64_t slow_fw = 0;
+    uint64_t from_summary = 0;
+    uint64_t mount_ns[2] = { 0, 0 };
+    uint32_t failed = 0;
+
+    srand(1);
+    Flash_Emu_Init();
+    Mount(&ts);
+    for(index = 0; index < samples; index++){
+        /* Equal timestamps are allowed, and exercise the edge bisection */
+        time += (uint32_t)(rand() % 3);
+        if(Flash_TS_Append(&ts, time, (int32_t)((rand() % 20001) - 10000)) != FLASH_OK){
+            fprintf(stderr, "append %u failed\n", index);
+            return 1;
+        }
+        if(index == (samples / 2U)){
+            /* Power cycle: the partial batch is flushed first, as a shutdown hook would */
+            Flash_TS_Flush(&ts);
+            mount_ns[0] = Mount(&ts);
+        }
+    }
+    Flash_TS_Flush(&ts);
+    Flash_TS_Append(&ts, time, 7);
+    mount_ns[1] = Mount(&ts);
+    Flash_TS_Append(&ts, time + 1U, -7);
+
+    oldest = ts.summary[ts.oldest].first;
+    for(index = 0; index < queries; index++){
+        first = oldest - 100U + (uint32_t)(rand() % (int)(time - oldest + 200U));
+        last = first + (uint32_t)(rand() % (int)((index % 4U) == 0U ? 100U : (time - oldest)));
+        Flash_TS_Query(&ts, first, last, &fast);
+        FullScan(&ts, first, last, &slow);
+        if((fast.count != slow.count) || (fast.sum != slow.sum) ||
+           ((slow.count != 0U) && ((fast.min != slow.min) || (fast.max != slow.max)))){
+            if(failed++ < 5U){
+                printf("MISMATCH [%u, %u]: count %u/%u sum %lld/%lld\n", first, last, fast.count, slow.count,
+                       (long long)fast.sum, (long long)slow.sum);
+            }
+        }
+        fast_fw += fast.flashwords;
+        slow_fw += slow.flashwords;
+        from_summary += fast.summaries;
+    }
+
+    printf("%u samples, %u sectors in the ring (%u samples each), oldest kept t=%u, newest t=%u\n",
+           samples, RING_SECTORS, (uint32_t)FLASH_TS_PER_SECTOR, oldest, time + 1U);
+    printf("%u queries: %u mismatches\n", queries, failed);
+    printf("data flashwords per query: summaries %.1f (%.2f sectors from summary), full scan %.1f -> %.0fx fewer\n",
+           (double)fast_fw / queries, (double)from_summary / queries, (double)slow_fw / queries,
+           (double)slow_fw / (fast_fw ? fast_fw : 1U));
+    printf("mount: %.1f us mid-sector, %.1f us after wrap (emulated flash time)\n", mount_ns[0] / 1e3, mount_ns[1] / 1e3);
+    return (failed != 0U) ? 2 : 0;
+}
@@ -0,0 +1,252 @@
+/**
+  ******************************************************************************
+  * @file    warm_bench.c
+  * @brief   Host check of the warm restart in Core/Src/flash_warm.c with the
+             file system (flash_fs.c) and the time-series ring (flash_ts.c)
+             on the emulated flash (flash_emu.c). The static indexes stand in
+             for the no-init RAM: a planned reset is Flash_Warm_Save followed
+             by Flash_Warm_Begin. Compares a cold mount of both, in emulated
+             flash time, with the warm check, in host time, makes sure the
+             restored indexes answer like freshly mounted ones, and that an
+             unplanned reset or a corrupted index falls back to a rebuild.
+
+             gcc -O2 -DHOST_BUILD -ICore/Inc -ITools Tools/warm_bench.c Tools/flash_emu.c \
+                 Core/Src/flash_warm.c Core/Src/flash_fs.c Core/Src/flash_ts.c \
+                 Core/Src/flash_stream.c -o warm_bench
+             ./warm_bench [writes]
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "flash_emu.h"
+#include "flash_fs.h"
+#include "flash_ts.h"
+#include "flash_warm.h"
+
+#define FS_BASE         FLASH_BANK2_BASE
+#define FS_SECTORS      4U
+#define TS_BASE         (FLASH_BANK2_BASE + (FS_SECTORS << FLASH_GEO_SECTOR_SHIFT))
+#define TS_SECTORS      4U
+#define NB_FILES        6U
+#define FILE_MAX        4096U
+#define RESTARTS        100U
+
+static FLASH_WARM Flash_FS_t Fs;
+static FLASH_WARM Flash_TS_t Ts;
+static Flash_TS_t TsCheck;
+
+static const char *const Names[NB_FILES] =
+{
+    "net.cfg", "sensor.cfg", "counters", "ui.cfg", "log.idx", "keys"
+};
+
+static uint8_t Shadow[NB_FILES][FILE_MAX];
+static uint32_t ShadowSize[NB_FILES];
+static uint8_t Check[FILE_MAX];
+
+static uint32_t Host_Erase(uint32_t FlashAddress)
+{
+    return Flash_Emu_Erase(FLASH_GEO_BANK(FlashAddress), FLASH_GEO_SECTOR(FlashAddress), 1);
+}
+
+static uint32_t Host_Program(uint32_t FlashAddress, const uint32_t *src, uint32_t NbOfFlashWords)
+{
+    return Flash_Emu_Program(FlashAddress, src, NbOfFlashWords);
+}
+
+static const Flash_Stream_Backend_t Host_Backend =
+{
+    Host_Erase, Host_Program, Flash_Emu_Read
+};
+
+static double HostUs(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((double)now.tv_sec * 1e6) + ((double)now.tv_nsec / 1e3);
+}
+
+/* What main does on every boot: attach in a fixed order, rebuild what
+   did not survive. Returns the regions that came through. */
+static uint32_t Boot(uint64_t *mount_ns, uint32_t *mount_reads, double *us)
+{
+    uint64_t ns = Flash_Emu_Stats.now_ns;
+    uint32_t reads = Flash_Emu_Stats.reads;
+    double start = HostUs();
+    uint32_t warm = 0;
+
+    Flash_Warm_Begin();
+    if(Flash_Warm_Attach(&Fs, sizeof(Fs)) != 0U){
+        warm++;
+    }
+    else if(Flash_FS_Mount(&Fs, &Host_Backend, FS_BASE, FS_SECTORS, 0) != FLASH_OK){
+        printf("fs mount FAILED\n");
+        exit(1);
+    }
+    if(Flash_Warm_Attach(&Ts, sizeof(Ts)) != 0U){
+        warm++;
+    }
+    else if(Flash_TS_Init(&Ts, &Host_Backend, TS_BASE, TS_SECTORS) != FLASH_OK){
+        printf("ts mount FAILED\n");
+        exit(1);
+    }
+    *us = HostUs() - start;
+    *mount_ns = Flash_Emu_Stats.now_ns - ns;
+    *mount_reads = Flash_Emu_Stats.reads - reads;
+    return warm;
+}
+
+static void Workload(uint32_t writes, uint32_t *time)
+{
+    uint32_t index;
+    uint32_t file;
+    uint32_t size;
+    uint32_t k;
+
+    for(index = 0; index < writes; index++){
+        file = (uint32_t)rand() % NB_FILES;
+        size = 64U + ((uint32_t)rand() % (FILE_MAX - 64U));
+        for(k = 0; k < size; k++){
+            Shadow[file][k] = (uint8_t)rand();
+        }
+        ShadowSize[file] = size;
+        if(Flash_FS_Write(&Fs, Names[file], Shadow[file], size) != FLASH_OK){
+            printf("%s: write FAILED\n", Names[file]);
+            exit(1);
+        }
+        for(k = 0; k < 200U; k++){
+            Flash_TS_Append(&Ts, (*time)++, (int32_t)((rand() % 20001) - 10000));
+        }
+    }
+}
+
+/* The restored indexes answer as ones mounted from flash */
+static uint32_t Verify(uint32_t time)
+{
+    Flash_TS_Result_t got;
+    Flash_TS_Result_t want;
+    uint32_t file;
+    uint32_t size;
+    uint32_t first;
+    uint32_t last;
+    uint32_t index;
+
+    for(file = 0; file < NB_FILES; file++){
+        if((ShadowSize[file] != 0U) &&
+           ((Flash_FS_Read(&Fs, Names[file], 0, Check, sizeof(Check), &size) != FLASH_OK) ||
+            (size != ShadowSize[file]) || (memcmp(Check, Shadow[file], size) != 0))){
+            printf("%s: read after restart FAILED\n", Names[file]);
+            return 1;
+        }
+    }
+    /* Pending samples are RAM only: flush so a fresh mount sees them too */
+    if((Flash_TS_Flush(&Ts) != FLASH_OK) ||
+       (Flash_TS_Init(&TsCheck, &Host_Backend, TS_BASE, TS_SECTORS) != FLASH_OK)){
+        printf("ts remount FAILED\n");
+        return 1;
+    }
+    for(index = 0; index < 20U; index++){
+        first = (uint32_t)rand() % time;
+        last = first + ((uint32_t)rand() % 50000U);
+        Flash_TS_Query(&Ts, first, last, &got);
+        Flash_TS_Query(&TsCheck, first, last, &want);
+        if((got.count != want.count) || (got.sum != want.sum) || (got.min != want.min) || (got.max != want.max)){
+            printf("ts query after restart FAILED\n");
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t writes = (argc > 1) ? (uint32_t)strtoul(argv[1], NULL, 0) : 300U;
+    uint64_t cold_ns;
+    uint32_t cold_reads;
+    uint64_t ns;
+    uint32_t reads;
+    double cold_us;
+    double us;
+    double warm_us = 0.0;
+    double worst_us = 0.0;
+    uint32_t time = 1;
+    uint32_t index;
+    uint32_t fail = 0;
+
+    srand(1);
+    Flash_Emu_Init();
+    /* Power-on: the no-init RAM holds whatever it powers up with */
+    memset(&Fs, 0x5A, sizeof(Fs));
+    memset(&Ts, 0xA5, sizeof(Ts));
+    if(Boot(&ns, &reads, &us) != 0U){
+        printf("power-on trusted garbage: FAILED\n");
+        return 1;
+    }
+    Workload(writes, &time);
+
+    /* Reference cold boot over the populated flash */
+    if(Boot(&cold_ns, &cold_reads, &cold_us) != 0U){
+        printf("unplanned reset came back warm: FAILED\n");
+        fail = 1;
+    }
+    printf("cold boot:   %8.3f ms emulated, %6u flashword reads\n", (double)cold_ns / 1e6, cold_reads);
+
+    for(index = 0; index < RESTARTS; index++){
+        Workload(2, &time);
+        Flash_Warm_Save();
+        if(Boot(&ns, &reads, &us) != 2U){
+            printf("restart %u: not warm FAILED\n", index);
+            fail = 1;
+        }
+        if((ns != 0U) || (reads != 0U)){
+            printf("restart %u: read flash FAILED\n", index);
+            fail = 1;
+        }
+        warm_us += us;
+        worst_us = (us > worst_us) ? us : worst_us;
+        fail |= Verify(time);
+    }
+    printf("warm boot:   %8.3f us host mean, %.3f us worst, 0 flashword reads, generation %u\n",
+           warm_us / RESTARTS, worst_us, Flash_Warm_Generation());
+    printf("checked:     %u Kbytes of index (fs %u, ts %u)\n",
+           (uint32_t)((sizeof(Fs) + sizeof(Ts)) / 1024U), (uint32_t)sizeof(Fs), (uint32_t)sizeof(Ts));
+
+    /* A change after the save, as a stray write or a flash update would
+       make, costs that index its warm start and nothing else */
+    Flash_Warm_Save();
+    ((uint8_t *)&Fs)[sizeof(Fs) / 2U] ^= 0x01U;
+    if(Boot(&ns, &reads, &us) != 1U){
+        printf("corrupted fs index trusted: FAILED\n");
+        fail = 1;
+    }
+    fail |= Verify(time);
+
+    /* Reset without a save (fault, watchdog, debugger) */
+    Workload(2, &time);
+    if(Boot(&ns, &reads, &us) != 0U){
+        printf("unsaved restart came back warm: FAILED\n");
+        fail = 1;
+    }
+    fail |= Verify(time);
+    if(Flash_Warm_Generation() != 0U){
+        printf("generation survived a cold boot: FAILED\n");
+        fail = 1;
+    }
+
+    printf("%s\n", (fail != 0U) ? "FAILED" : "ok");
+    return (int)fail;
+}